@@ -0,0 +1,1385 @@
+#include "../include/io_backend.h"
+#include "../include/workload.h"
+#include "../include/packet.h"
+#include "../include/dns_query.h"
+#include "../include/cache.h"
+#include "../include/pipeline.h"
+#include "../include/forward.h"
+#include "../include/resolvers.h"
+#include "../include/scan.h"
+#include "../include/tcp_fallback.h"
+#include "../include/analytics.h"
+#include "../include/zone.h"
+#include "../include/policy.h"
+#include "../include/log.h"
+#include "../include/checksum.h"
+#include "../include/validator.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <getopt.h>
+#include <time.h>
+#include <errno.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <openssl/evp.h>
+#include <openssl/ecdsa.h>
+#include <openssl/core_names.h>
+
+// Benchmark configuration
+struct bench_config {
+    struct workload_config workload;
+    const char *pcap_file;
+    size_t loops;
+    size_t cache_size;
+    size_t policy_rules;            // Rules in the policy stage's list
+    const char *stage;              // Run only this stage (NULL = all)
+    const char *baseline_file;      // Compare against these numbers
+    double tolerance;               // Allowed ns/packet slowdown before failing
+};
+
+// Result of one stage
+struct bench_result {
+    const char *stage;
+    uint64_t packets;
+    uint64_t ns;
+    uint64_t hits;
+    uint64_t lookups;
+};
+
+struct bench_stage {
+    const char *name;
+    const char *description;
+    int (*run)(const struct bench_config *cfg, const struct workload *wl, struct bench_result *res);
+};
+
+static inline uint64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+// Keeps the optimizer from discarding stage work
+static volatile uint64_t sink;
+
+static void bench_cache_init(const struct bench_config *cfg, bool admission) {
+    struct cache_config cache_cfg = {
+        .max_entries = cfg->cache_size,
+        .default_ttl = 3600,
+        .cleanup_interval = 60,
+        .admission = admission
+    };
+    cache_init(&cache_cfg);
+}
+
+// Stage: frame and DNS header parsing
+static int stage_parse(const struct bench_config *cfg, const struct workload *wl, struct bench_result *res) {
+    struct packet_info info;
+    struct dns_query query;
+    uint64_t acc = 0;
+
+    uint64_t start = now_ns();
+    for (size_t loop = 0; loop < cfg->loops; loop++) {
+        for (size_t i = 0; i < wl->count; i++) {
+            size_t len;
+            const uint8_t *frame = workload_frame(wl, i, &len);
+            if (packet_parse(frame, len, &info) == 0 &&
+                parse_response(info.payload, info.payload_len, &query) == 0) {
+                acc += query.header.id;
+            }
+        }
+    }
+    res->ns = now_ns() - start;
+    res->packets = (uint64_t)wl->count * cfg->loops;
+    sink = acc;
+    return 0;
+}
+
+// Stage: DNS headers parsed DNS_BATCH_MAX messages per call
+static int stage_parse_batch(const struct bench_config *cfg, const struct workload *wl, struct bench_result *res) {
+    struct packet_info info;
+    struct dns_batch_result batch;
+    const uint8_t *msgs[DNS_BATCH_MAX];
+    uint16_t lens[DNS_BATCH_MAX];
+    uint64_t acc = 0;
+
+    uint64_t start = now_ns();
+    for (size_t loop = 0; loop < cfg->loops; loop++) {
+        size_t n = 0;
+        for (size_t i = 0; i < wl->count; i++) {
+            size_t len;
+            const uint8_t *frame = workload_frame(wl, i, &len);
+            if (packet_parse(frame, len, &info) == 0) {
+                msgs[n] = info.payload;
+                lens[n++] = info.payload_len;
+            }
+            if (n == DNS_BATCH_MAX || (i + 1 == wl->count && n)) {
+                dns_parse_batch(msgs, lens, n, &batch);
+                for (size_t j = 0; j < n; j++) {
+                    acc += batch.id[j] + batch.answer_offset[j];
+                }
+                n = 0;
+            }
+        }
+    }
+    res->ns = now_ns() - start;
+    res->packets = (uint64_t)wl->count * cfg->loops;
+    sink = acc;
+    return 0;
+}
+
+// Names for the query construction stages
+#define BENCH_BUILD_NAMES   4096
+
+static char (*bench_names(void))[DNS_NAME_MAX] {
+    static char names[BENCH_BUILD_NAMES][DNS_NAME_MAX];
+    for (size_t i = 0; i < BENCH_BUILD_NAMES; i++) {
+        snprintf(names[i], sizeof(names[i]), "host%zu.zone%zu.example", i, i % 97);
+    }
+    return names;
+}
+
+// Stage: one query per init_query/construct_query call
+static int stage_build(const struct bench_config *cfg, const struct workload *wl, struct bench_result *res) {
+    char (*names)[DNS_NAME_MAX] = bench_names();
+    static uint8_t frames[DNS_BATCH_MAX][512];
+    uint64_t acc = 0;
+    size_t total = wl->count * cfg->loops;
+
+    uint64_t start = now_ns();
+    for (size_t i = 0; i < total; i++) {
+        struct dns_query query;
+        size_t len = sizeof(frames[0]);
+        init_query(&query, names[i % BENCH_BUILD_NAMES], A);
+        construct_query(&query, frames[i % DNS_BATCH_MAX], &len);
+        acc += len;
+    }
+    res->ns = now_ns() - start;
+    res->packets = total;
+    sink = acc;
+    return 0;
+}
+
+// Stage: DNS_BATCH_MAX queries per dns_construct_batch call
+static int stage_build_batch(const struct bench_config *cfg, const struct workload *wl, struct bench_result *res) {
+    char (*names)[DNS_NAME_MAX] = bench_names();
+    static uint8_t frames[DNS_BATCH_MAX][512];
+    static uint16_t name_lens[BENCH_BUILD_NAMES];
+    struct dns_batch_query batch[DNS_BATCH_MAX];
+    uint8_t *buffers[DNS_BATCH_MAX];
+    uint16_t lengths[DNS_BATCH_MAX];
+    uint64_t acc = 0;
+    size_t total = wl->count * cfg->loops;
+
+    // Callers hold names as slices, so lengths are not part of the work
+    for (size_t i = 0; i < BENCH_BUILD_NAMES; i++) {
+        name_lens[i] = strlen(names[i]);
+    }
+    for (size_t j = 0; j < DNS_BATCH_MAX; j++) {
+        buffers[j] = frames[j];
+    }
+
+    uint64_t start = now_ns();
+    for (size_t i = 0; i < total; i += DNS_BATCH_MAX) {
+        size_t n = total - i < DNS_BATCH_MAX ? total - i : DNS_BATCH_MAX;
+        for (size_t j = 0; j < n; j++) {
+            size_t name = (i + j) % BENCH_BUILD_NAMES;
+            batch[j].name = names[name];
+            batch[j].name_len = name_lens[name];
+            batch[j].qtype = A;
+            batch[j].id = i + j;
+        }
+        acc += dns_construct_batch(batch, n, DNS_EDNS_BUFFER_SIZE, buffers, sizeof(frames[0]), lengths);
+    }
+    res->ns = now_ns() - start;
+    res->packets = total;
+    sink = acc;
+    return 0;
+}
+
+// Cache lookup, inserting a synthetic answer on every miss
+static int run_cache(const struct bench_config *cfg, const struct workload *wl, struct bench_result *res,
+                     bool admission) {
+    struct packet_info info;
+    uint8_t response[512];
+
+    bench_cache_init(cfg, admission);
+    size_t hits_before = cache_get_hit_count();
+    size_t misses_before = cache_get_miss_count();
+
+    uint64_t start = now_ns();
+    for (size_t loop = 0; loop < cfg->loops; loop++) {
+        for (size_t i = 0; i < wl->count; i++) {
+            size_t len;
+            const uint8_t *frame = workload_frame(wl, i, &len);
+            if (packet_parse(frame, len, &info) != 0) {
+                continue;
+            }
+            const char *qname = (const char *)(info.payload + sizeof(struct dns_header));
+            size_t response_len = sizeof(response);
+            if (!cache_lookup(qname, response, &response_len)) {
+                cache_insert(qname, info.payload, info.payload_len, 3600);
+            }
+        }
+    }
+    res->ns = now_ns() - start;
+    res->packets = (uint64_t)wl->count * cfg->loops;
+    res->hits = cache_get_hit_count() - hits_before;
+    res->lookups = res->hits + cache_get_miss_count() - misses_before;
+    cache_destroy();
+    return 0;
+}
+
+// Stage: direct-mapped cache, every miss displaces the slot's entry
+static int stage_cache(const struct bench_config *cfg, const struct workload *wl, struct bench_result *res) {
+    return run_cache(cfg, wl, res, false);
+}
+
+// Stage: the same cache behind the TinyLFU admission filter
+static int stage_admission(const struct bench_config *cfg, const struct workload *wl, struct bench_result *res) {
+    return run_cache(cfg, wl, res, true);
+}
+
+// Stage: client-subnet cache, answers scoped to the subnet each query disclosed
+static int stage_ecs(const struct bench_config *cfg, const struct workload *wl, struct bench_result *res) {
+    struct packet_info info;
+    struct dns_edns edns;
+    uint8_t response[CACHE_MAX_RESPONSE];
+
+    bench_cache_init(cfg, false);
+    size_t hits_before = cache_get_hit_count();
+    size_t misses_before = cache_get_miss_count();
+
+    uint64_t start = now_ns();
+    for (size_t loop = 0; loop < cfg->loops; loop++) {
+        for (size_t i = 0; i < wl->count; i++) {
+            size_t len;
+            const uint8_t *frame = workload_frame(wl, i, &len);
+            if (packet_parse(frame, len, &info) != 0 ||
+                dns_parse_edns(info.payload, info.payload_len, &edns) != 0) {
+                continue;
+            }
+
+            struct cache_scope scope;
+            const struct cache_scope *client = NULL;
+            if (edns.has_ecs) {
+                cache_scope_init(&scope, edns.ecs.family, edns.ecs.address, edns.ecs.source_prefix);
+                client = &scope;
+            }
+
+            const char *qname = (const char *)(info.payload + sizeof(struct dns_header));
+            size_t response_len = sizeof(response);
+            if (!cache_lookup_scoped(qname, client, response, &response_len, NULL, NULL)) {
+                cache_insert_scoped(qname, client, info.payload, info.payload_len, 3600);
+            }
+        }
+    }
+    res->ns = now_ns() - start;
+    res->packets = (uint64_t)wl->count * cfg->loops;
+    res->hits = cache_get_hit_count() - hits_before;
+    res->lookups = res->hits + cache_get_miss_count() - misses_before;
+    cache_destroy();
+    return 0;
+}
+
+// Stage: passive analytics, every frame into one worker's summary
+static int stage_analytics(const struct bench_config *cfg, const struct workload *wl, struct bench_result *res) {
+    struct analytics_core core;
+    if (analytics_core_init(&core) != 0) {
+        return -ENOMEM;
+    }
+
+    uint64_t start = now_ns();
+    for (size_t loop = 0; loop < cfg->loops; loop++) {
+        for (size_t i = 0; i < wl->count; i++) {
+            size_t len;
+            const uint8_t *frame = workload_frame(wl, i, &len);
+            analytics_observe(analytics_core_summary(&core), frame, len);
+        }
+        analytics_core_poll(&core);
+    }
+    res->ns = now_ns() - start;
+    res->packets = (uint64_t)wl->count * cfg->loops;
+    sink = analytics_core_summary(&core)->queries;
+    analytics_core_free(&core);
+    return 0;
+}
+
+// Stage: one log record per packet, formatted by the writer thread into
+// /dev/null. Hit ratio is the share queued rather than dropped.
+static int stage_log(const struct bench_config *cfg, const struct workload *wl, struct bench_result *res) {
+    struct log_config log_cfg = {
+        .level = LOG_LEVEL_INFO,
+        .file = "/dev/null",
+        .format = LOG_FORMAT_JSON,
+        .timestamps = true
+    };
+    int ret = log_init(&log_cfg);
+    if (ret) {
+        return ret;
+    }
+
+    uint64_t start = now_ns();
+    for (size_t loop = 0; loop < cfg->loops; loop++) {
+        for (size_t i = 0; i < wl->count; i++) {
+            size_t len;
+            workload_frame(wl, i, &len);
+            log_info("frame %zu, %zu bytes", i, len);
+        }
+    }
+    res->ns = now_ns() - start;
+    res->packets = (uint64_t)wl->count * cfg->loops;
+
+    struct log_stats stats;
+    log_destroy();
+    log_get_stats(&stats);
+    res->hits = stats.records;
+    res->lookups = stats.records + stats.dropped;
+    return 0;
+}
+
+// Zone file serving every name the workload asks for, one zone per suffix
+static int bench_zone_load(const struct bench_config *cfg) {
+    char path[] = "/tmp/whack-bench-zone-XXXXXX";
+    int fd = mkstemp(path);
+    FILE *fp = fd >= 0 ? fdopen(fd, "w") : NULL;
+    if (!fp) {
+        if (fd >= 0) {
+            close(fd);
+        }
+        return -errno;
+    }
+
+    size_t domains = cfg->workload.domains ? cfg->workload.domains : 1;
+    for (size_t zone = 0; zone < 97 && zone < domains; zone++) {
+        fprintf(fp, "zone%zu.example. SOA ns.example. hostmaster.example. 1 3600 600 86400 300\n", zone);
+    }
+    for (size_t i = 0; i < domains; i++) {
+        fprintf(fp, "host%zu.zone%zu.example. 300 A 192.0.%zu.%zu\n", i, i % 97, (i >> 8) & 255, i & 255);
+    }
+    fclose(fp);
+
+    const char *paths[] = {path};
+    int ret = zone_load(paths, 1);
+    unlink(path);
+    return ret;
+}
+
+// Stage: authoritative answers from the precomputed zone index
+static int stage_zone(const struct bench_config *cfg, const struct workload *wl, struct bench_result *res) {
+    struct packet_info info;
+    struct dns_edns edns;
+    uint8_t reply[2048];
+    uint64_t acc = 0, answered = 0;
+
+    int ret = bench_zone_load(cfg);
+    if (ret) {
+        return ret;
+    }
+
+    uint64_t start = now_ns();
+    for (size_t loop = 0; loop < cfg->loops; loop++) {
+        for (size_t i = 0; i < wl->count; i++) {
+            size_t len;
+            const uint8_t *frame = workload_frame(wl, i, &len);
+            int end;
+            if (packet_parse(frame, len, &info) != 0 ||
+                dns_parse_edns(info.payload, info.payload_len, &edns) != 0 ||
+                (end = dns_question_end(info.payload, info.payload_len)) < 0) {
+                continue;
+            }
+
+            size_t template_len;
+            const uint8_t *tmpl = zone_lookup(info.payload, end, &template_len);
+            if (!tmpl) {
+                continue;
+            }
+            int out = zone_write(tmpl, template_len, info.payload, end, &edns, reply, sizeof(reply));
+            acc += out > 0 ? reply[out - 1] : 0;
+            answered++;
+        }
+    }
+    res->ns = now_ns() - start;
+    res->packets = (uint64_t)wl->count * cfg->loops;
+    res->hits = answered;
+    res->lookups = res->packets;
+    sink = acc;
+    zone_destroy();
+    return 0;
+}
+
+// Rule list for the policy stage: some of the workload's names by exact,
+// suffix and wildcard rules, the rest of the rules on names it never asks for
+static int bench_policy_load(const struct bench_config *cfg) {
+    char path[] = "/tmp/whack-bench-policy-XXXXXX";
+    int fd = mkstemp(path);
+    FILE *fp = fd >= 0 ? fdopen(fd, "w") : NULL;
+    if (!fp) {
+        if (fd >= 0) {
+            close(fd);
+        }
+        return -errno;
+    }
+
+    size_t domains = cfg->workload.domains ? cfg->workload.domains : 1;
+    size_t written = 0;
+    fprintf(fp, ".zone7.example nxdomain\n*.zone11.example nodata\n");
+    written += 2;
+    for (size_t i = 0; i < domains && written < cfg->policy_rules; i += 8, written++) {
+        fprintf(fp, i % 16 ? "host%zu.zone%zu.example redirect 192.0.2.1\n" : "host%zu.zone%zu.example\n",
+                i, i % 97);
+    }
+    for (size_t i = 0; written < cfg->policy_rules; i++, written++) {
+        static const char *const forms[] = {"b%zu.blk%zu.test\n", ".s%zu.blk%zu.test\n", "*.w%zu.blk%zu.test\n"};
+        fprintf(fp, forms[i % 3], i, i % 1000);
+    }
+    fclose(fp);
+
+    const char *paths[] = {path};
+    int ret = policy_load(paths, 1);
+    unlink(path);
+    return ret;
+}
+
+// Stage: firewall verdicts against a large rule list, replies for the blocked
+static int stage_policy(const struct bench_config *cfg, const struct workload *wl, struct bench_result *res) {
+    struct packet_info info;
+    struct dns_edns edns;
+    uint8_t reply[2048];
+    uint64_t acc = 0, matched = 0;
+
+    int ret = bench_policy_load(cfg);
+    if (ret) {
+        return ret;
+    }
+
+    uint64_t start = now_ns();
+    for (size_t loop = 0; loop < cfg->loops; loop++) {
+        for (size_t i = 0; i < wl->count; i++) {
+            size_t len;
+            const uint8_t *frame = workload_frame(wl, i, &len);
+            int end;
+            if (packet_parse(frame, len, &info) != 0 ||
+                dns_parse_edns(info.payload, info.payload_len, &edns) != 0 ||
+                (end = dns_question_end(info.payload, info.payload_len)) < 0) {
+                continue;
+            }
+
+            size_t template_len;
+            enum policy_action action;
+            const uint8_t *tmpl = policy_lookup(info.payload, end, &template_len, &action);
+            if (!tmpl) {
+                continue;
+            }
+            int out = zone_write(tmpl, template_len, info.payload, end, &edns, reply, sizeof(reply));
+            acc += out > 0 ? reply[out - 1] : 0;
+            matched++;
+        }
+    }
+    res->ns = now_ns() - start;
+    res->packets = (uint64_t)wl->count * cfg->loops;
+    res->hits = matched;
+    res->lookups = res->packets;
+    sink = acc;
+    policy_destroy();
+    return 0;
+}
+
+// Stage: building reply frames around a DNS payload
+static int stage_reply(const struct bench_config *cfg, const struct workload *wl, struct bench_result *res) {
+    struct packet_info info;
+    uint8_t frame[2048];
+    uint64_t acc = 0;
+
+    uint64_t start = now_ns();
+    for (size_t loop = 0; loop < cfg->loops; loop++) {
+        for (size_t i = 0; i < wl->count; i++) {
+            size_t len;
+            const uint8_t *request = workload_frame(wl, i, &len);
+            if (packet_parse(request, len, &info) != 0) {
+                continue;
+            }
+            int out = packet_build_reply(frame, sizeof(frame), &info, info.payload, info.payload_len);
+            acc += out > 0 ? frame[out - 1] : 0;
+        }
+    }
+    res->ns = now_ns() - start;
+    res->packets = (uint64_t)wl->count * cfg->loops;
+    sink = acc;
+    return 0;
+}
+
+// Checksum stages: the UDP checksum of every frame's datagram, as a reply
+// built around it would need, with the dispatched kernel or the scalar
+// reference. Hit ratio is the share that verified.
+static int run_checksum(const struct bench_config *cfg, const struct workload *wl, struct bench_result *res,
+                        uint32_t (*partial)(const void *, size_t, uint32_t)) {
+    struct packet_info info;
+    uint64_t valid = 0;
+
+    uint64_t start = now_ns();
+    for (size_t loop = 0; loop < cfg->loops; loop++) {
+        for (size_t i = 0; i < wl->count; i++) {
+            size_t len;
+            const uint8_t *frame = workload_frame(wl, i, &len);
+            if (packet_parse(frame, len, &info) != 0) {
+                continue;
+            }
+            size_t udp_len = UDP_HDR_LEN + info.payload_len;
+            uint32_t sum = csum_pseudo_udp(info.src.ip, info.dst.ip, udp_len);
+            valid += csum_fold(partial(info.payload - UDP_HDR_LEN, udp_len, sum)) == 0;
+        }
+    }
+    res->ns = now_ns() - start;
+    res->packets = (uint64_t)wl->count * cfg->loops;
+    res->hits = valid;
+    res->lookups = res->packets;
+    return 0;
+}
+
+static int stage_checksum(const struct bench_config *cfg, const struct workload *wl, struct bench_result *res) {
+    return run_checksum(cfg, wl, res, csum_partial);
+}
+
+static int stage_checksum_scalar(const struct bench_config *cfg, const struct workload *wl,
+                                 struct bench_result *res) {
+    return run_checksum(cfg, wl, res, csum_partial_scalar);
+}
+
+// Stand-in resolver for the pipeline stage: answers every query forwarded
+// since *cursor with one A record, straight back into the pipeline
+static void bench_resolve(struct io_backend *io, size_t *cursor) {
+    static const uint8_t record[] = {0xC0, 0x0C, 0, 1, 0, 1, 0, 0, 0x0E, 0x10, 0, 4, 192, 0, 2, 1};
+
+    for (; *cursor < io_backend_mem_tx_count(io); (*cursor)++) {
+        size_t len;
+        const uint8_t *frame = io_backend_mem_tx_frame(io, *cursor, &len);
+        struct packet_info query;
+        if (!frame || packet_parse(frame, len, &query) != 0 || query.dst.port != htons(DNS_PORT)) {
+            continue;   // Replies to clients
+        }
+
+        uint8_t msg[512];
+        int end = dns_question_end(query.payload, query.payload_len);
+        if (end < 0 || end + sizeof(record) > sizeof(msg)) {
+            continue;
+        }
+        memcpy(msg, query.payload, end);
+        memcpy(msg + end, record, sizeof(record));
+        msg[2] = 0x81;
+        msg[3] = 0x80;
+        msg[7] = 1;
+        msg[11] = 0;
+
+        uint8_t reply[PACKET_HDR_LEN + 512];
+        int reply_len = packet_build_reply(reply, sizeof(reply), &query, msg, end + sizeof(record));
+        if (reply_len > 0) {
+            pipeline_process_packet(reply, reply_len);
+        }
+    }
+}
+
+// Stage: the full packet path through the in-memory backend, misses
+// resolved by bench_resolve
+static int stage_pipeline(const struct bench_config *cfg, const struct workload *wl, struct bench_result *res) {
+    struct io_backend io;
+    struct mem_backend_config mem_cfg = {
+        .workload = wl,
+        .loops = cfg->loops,
+    };
+    struct forward_config fwd_cfg = {
+        .src = {
+            .mac = {0x02, 0x00, 0x00, 0x00, 0x00, 0x01},
+            .ip = htonl(0x0A000001),    // 10.0.0.1, the workload's server
+            .port = htons(FORWARD_SRC_PORT)
+        }
+    };
+
+    if (io_backend_mem_init(&io, &mem_cfg) != 0) {
+        return -1;
+    }
+    resolvers_add(htonl(0x0A000035), htons(DNS_PORT), "bench");
+    bench_cache_init(cfg, true);
+    pipeline_init(&io);
+    if (forward_init(&fwd_cfg, &io) != 0) {
+        io_backend_cleanup(&io);
+        return -1;
+    }
+
+    size_t cursor = 0;
+    uint64_t start = now_ns();
+    while (io_backend_wait(&io, 0) > 0) {
+        io_backend_rx(&io, pipeline_process_packet);
+        bench_resolve(&io, &cursor);
+        io_backend_flush(&io);
+    }
+    res->ns = now_ns() - start;
+
+    struct pipeline_stats stats;
+    pipeline_get_stats(&stats);
+    res->packets = stats.packets;
+    res->hits = stats.cache_hits;
+    res->lookups = stats.cache_hits + stats.cache_misses;
+
+    forward_destroy();
+    resolvers_destroy();
+    io_backend_cleanup(&io);
+    cache_destroy();
+    return 0;
+}
+
+// Bulk scan stages: domains resolved per run, and stand-in resolvers from
+// fast to dead. Latencies are real time, so these stages time completion.
+#define BENCH_SCAN_DOMAINS  20000
+#define BENCH_SCAN_INFLIGHT 1024
+#define BENCH_SCAN_TIMEOUT  200     // ms
+#define BENCH_SCAN_QUEUE    4096    // Delayed answers per stand-in
+#define BENCH_SCAN_FRAME    256
+
+static const struct {
+    uint32_t latency_us;
+    uint32_t loss_pct;
+} bench_scan_resolvers[] = {
+    {1000, 0}, {2000, 0}, {5000, 0}, {10000, 0}, {40000, 0}, {100000, 0}, {3000, 20}, {0, 100}
+};
+#define BENCH_SCAN_RESOLVERS (sizeof(bench_scan_resolvers) / sizeof(bench_scan_resolvers[0]))
+
+// Query waiting for its stand-in resolver's latency to pass
+struct bench_scan_reply {
+    uint64_t due_ns;
+    uint16_t len;
+    uint8_t frame[BENCH_SCAN_FRAME];
+};
+
+// A resolver's answers come back in the order it was asked
+struct bench_scan_queue {
+    struct bench_scan_reply *replies;
+    size_t head;
+    size_t count;
+};
+
+static void bench_scan_answer(const struct bench_scan_reply *pending) {
+    struct packet_info query, info;
+    uint8_t msg[512];
+    uint8_t reply[PACKET_HDR_LEN + 512];
+    if (packet_parse(pending->frame, pending->len, &query) != 0 || query.payload_len > sizeof(msg)) {
+        return;
+    }
+    memcpy(msg, query.payload, query.payload_len);
+    msg[2] = 0x81;
+    msg[3] = 0x80;
+    int len = packet_build_reply(reply, sizeof(reply), &query, msg, query.payload_len);
+    if (len > 0 && packet_parse(reply, len, &info) == 0) {
+        scan_handle_response(&info);
+    }
+}
+
+// Time to resolve BENCH_SCAN_DOMAINS names over the stand-in resolvers
+static int bench_scan(enum resolver_select mode, struct bench_result *res) {
+    char path[] = "/tmp/whack-bench-scan-XXXXXX";
+    int fd = mkstemp(path);
+    FILE *fp = fd >= 0 ? fdopen(fd, "w") : NULL;
+    if (!fp) {
+        if (fd >= 0) {
+            close(fd);
+        }
+        return -errno;
+    }
+    for (size_t i = 0; i < BENCH_SCAN_DOMAINS; i++) {
+        fprintf(fp, "host%zu.example.com\n", i);
+    }
+    fclose(fp);
+
+    struct io_backend io;
+    struct mem_backend_config mem_cfg = {0};
+    struct scan_config scan_cfg = {
+        .domains_file = path,
+        .qtype = A,
+        .timeout_ms = BENCH_SCAN_TIMEOUT,
+        .retries = SCAN_RETRIES,
+        .max_inflight = BENCH_SCAN_INFLIGHT,
+        .src = {
+            .mac = {0x02, 0x00, 0x00, 0x00, 0x00, 0x01},
+            .ip = htonl(0x0A000001),
+            .port = htons(SCAN_SRC_PORT)
+        }
+    };
+    struct bench_scan_queue queues[BENCH_SCAN_RESOLVERS] = {0};
+    int ret = io_backend_mem_init(&io, &mem_cfg);
+    for (size_t r = 0; r < BENCH_SCAN_RESOLVERS && ret == 0; r++) {
+        queues[r].replies = malloc(BENCH_SCAN_QUEUE * sizeof(struct bench_scan_reply));
+        ret = queues[r].replies ? resolvers_add(htonl(0x0A000100 + r), htons(DNS_PORT), "bench") : -ENOMEM;
+    }
+    resolvers_set_select(mode);
+    if (ret == 0) {
+        ret = scan_init(&scan_cfg, &io);
+    }
+    unlink(path);
+
+    uint64_t rng = 0x2545F4914F6CDD1DULL;
+    size_t cursor = 0;
+    uint64_t start = now_ns();
+    while (ret == 0 && !scan_done()) {
+        scan_tick();
+        uint64_t now = now_ns();
+
+        // Queue what was sent, minus each stand-in's losses
+        for (; cursor < io_backend_mem_tx_count(&io); cursor++) {
+            size_t len;
+            const uint8_t *frame = io_backend_mem_tx_frame(&io, cursor, &len);
+            struct packet_info query;
+            if (!frame || len > BENCH_SCAN_FRAME || packet_parse(frame, len, &query) != 0) {
+                continue;
+            }
+            size_t r = ntohl(query.dst.ip) - 0x0A000100;
+            rng ^= rng << 13;
+            rng ^= rng >> 7;
+            rng ^= rng << 17;
+            if (r >= BENCH_SCAN_RESOLVERS || rng % 100 < bench_scan_resolvers[r].loss_pct ||
+                queues[r].count == BENCH_SCAN_QUEUE) {
+                continue;
+            }
+            struct bench_scan_reply *pending = &queues[r].replies[(queues[r].head + queues[r].count++) % BENCH_SCAN_QUEUE];
+            pending->due_ns = now + bench_scan_resolvers[r].latency_us * 1000ULL;
+            pending->len = len;
+            memcpy(pending->frame, frame, len);
+        }
+
+        // Answer whatever is due
+        for (size_t r = 0; r < BENCH_SCAN_RESOLVERS; r++) {
+            struct bench_scan_queue *q = &queues[r];
+            while (q->count && q->replies[q->head].due_ns <= now) {
+                bench_scan_answer(&q->replies[q->head]);
+                q->head = (q->head + 1) % BENCH_SCAN_QUEUE;
+                q->count--;
+            }
+        }
+    }
+    res->ns = now_ns() - start;
+
+    struct scan_stats stats;
+    scan_get_stats(&stats);
+    res->packets = stats.domains;
+    res->hits = stats.answers;
+    res->lookups = stats.domains;
+
+    scan_destroy();
+    resolvers_destroy();
+    resolvers_set_select(RESOLVER_SELECT_P2C);
+    io_backend_cleanup(&io);
+    for (size_t r = 0; r < BENCH_SCAN_RESOLVERS; r++) {
+        free(queues[r].replies);
+    }
+    return ret;
+}
+
+// Stage: bulk scan, queries spread by latency and loss
+static int stage_scan(const struct bench_config *cfg, const struct workload *wl, struct bench_result *res) {
+    (void)cfg;
+    (void)wl;
+    return bench_scan(RESOLVER_SELECT_P2C, res);
+}
+
+// Stage: the same scan, queries spread round robin
+static int stage_scan_rr(const struct bench_config *cfg, const struct workload *wl, struct bench_result *res) {
+    (void)cfg;
+    (void)wl;
+    return bench_scan(RESOLVER_SELECT_ROUND_ROBIN, res);
+}
+
+// Queries sent per loop by the TCP stage, loopback round trips are slow
+#define BENCH_TCP_QUERIES   100000
+
+// Loopback DNS-over-TCP responder: echoes each query back with QR set
+static void *tcp_responder_conn(void *arg) {
+    int fd = (int)(intptr_t)arg;
+    uint8_t in[1 << 16];
+    uint8_t out[1 << 16];
+    size_t have = 0;
+
+    for (;;) {
+        ssize_t n = read(fd, in + have, sizeof(in) - have);
+        if (n <= 0) {
+            break;
+        }
+        have += n;
+
+        // Answer every complete message in one write
+        size_t off = 0, olen = 0;
+        while (have - off >= 2) {
+            size_t len = ((size_t)in[off] << 8) | in[off + 1];
+            if (have - off < len + 2 || olen + len + 2 > sizeof(out)) {
+                break;
+            }
+            memcpy(out + olen, in + off, len + 2);
+            if (len > 2) {
+                out[olen + 4] |= 0x80;
+            }
+            olen += len + 2;
+            off += len + 2;
+        }
+        memmove(in, in + off, have - off);
+        have -= off;
+
+        for (size_t sent = 0; sent < olen;) {
+            ssize_t w = write(fd, out + sent, olen - sent);
+            if (w <= 0) {
+                close(fd);
+                return NULL;
+            }
+            sent += w;
+        }
+    }
+
+    close(fd);
+    return NULL;
+}
+
+static void *tcp_responder(void *arg) {
+    int listen_fd = (int)(intptr_t)arg;
+
+    for (;;) {
+        int fd = accept(listen_fd, NULL, NULL);
+        if (fd < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            break;
+        }
+        pthread_t thread;
+        if (pthread_create(&thread, NULL, tcp_responder_conn, (void *)(intptr_t)fd) != 0) {
+            close(fd);
+            continue;
+        }
+        pthread_detach(thread);
+    }
+    return NULL;
+}
+
+static uint64_t tcp_bench_answers;
+
+static void tcp_bench_answer(uint64_t cookie, const uint8_t *msg, size_t len, int status) {
+    (void)cookie;
+    (void)msg;
+    (void)len;
+    if (status == 0) {
+        tcp_bench_answers++;
+    }
+}
+
+// Stage: truncation fallback, pipelined DNS over TCP to a loopback responder
+static int stage_tcp(const struct bench_config *cfg, const struct workload *wl, struct bench_result *res) {
+    struct sockaddr_in addr = {
+        .sin_family = AF_INET,
+        .sin_addr.s_addr = htonl(INADDR_LOOPBACK)
+    };
+    socklen_t addr_len = sizeof(addr);
+
+    int listen_fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (listen_fd < 0 || bind(listen_fd, (struct sockaddr *)&addr, sizeof(addr)) != 0 ||
+        listen(listen_fd, 16) != 0 || getsockname(listen_fd, (struct sockaddr *)&addr, &addr_len) != 0) {
+        if (listen_fd >= 0) {
+            close(listen_fd);
+        }
+        return -1;
+    }
+
+    pthread_t thread;
+    if (pthread_create(&thread, NULL, tcp_responder, (void *)(intptr_t)listen_fd) != 0 ||
+        tcp_fallback_init(NULL, tcp_bench_answer) != 0) {
+        close(listen_fd);
+        return -1;
+    }
+
+    size_t per_loop = wl->count < BENCH_TCP_QUERIES ? wl->count : BENCH_TCP_QUERIES;
+    uint64_t submitted = 0;
+    tcp_bench_answers = 0;
+
+    uint64_t start = now_ns();
+    for (size_t loop = 0; loop < cfg->loops; loop++) {
+        for (size_t i = 0; i < per_loop; i++) {
+            size_t len;
+            struct packet_info info;
+            const uint8_t *frame = workload_frame(wl, i, &len);
+            if (packet_parse(frame, len, &info) != 0) {
+                continue;
+            }
+            // Back off while the per-resolver queue is full
+            while (tcp_fallback_submit(addr.sin_addr.s_addr, addr.sin_port, info.payload,
+                                       info.payload_len, i) == -ENOBUFS) {
+                tcp_fallback_poll(1);
+            }
+            submitted++;
+            if (tcp_fallback_pending() >= 1024) {
+                tcp_fallback_poll(0);
+            }
+        }
+    }
+    while (tcp_fallback_pending()) {
+        tcp_fallback_poll(10);
+    }
+    res->ns = now_ns() - start;
+    res->packets = tcp_bench_answers;
+
+    tcp_fallback_destroy();
+    shutdown(listen_fd, SHUT_RDWR);
+    close(listen_fd);
+    pthread_join(thread, NULL);
+    return tcp_bench_answers == submitted ? 0 : -1;
+}
+
+// Signed answers validated per loop by the DNSSEC stage, each with its
+// own signature so none is answered from a worker's memo
+#define BENCH_DNSSEC_ANSWERS 4000
+
+// Signed A answers for h<i>.bench. under a zone with one ECDSA P-256 key
+struct bench_dnssec {
+    EVP_PKEY *pkey;
+    uint8_t dnskey[4 + 64];
+    uint16_t tag;
+    uint8_t (*answers)[256];
+    uint16_t *lens;
+};
+
+static void bench_put16(uint8_t *p, uint16_t v) {
+    p[0] = v >> 8;
+    p[1] = v;
+}
+
+static void bench_put32(uint8_t *p, uint32_t v) {
+    bench_put16(p, v >> 16);
+    bench_put16(p + 2, v);
+}
+
+// RRSIG rdata by the bench. key over one record of owner; 0 on failure
+static size_t bench_dnssec_sign(const struct bench_dnssec *d, const uint8_t *owner, size_t owner_len,
+                                uint16_t type, const uint8_t *rdata, size_t rdlen, uint8_t labels,
+                                uint8_t *out) {
+    static const uint8_t signer[] = "\x05" "bench";
+    uint8_t data[512], der[128];
+    size_t der_len = sizeof(der);
+    uint32_t now = (uint32_t)time(NULL);
+
+    bench_put16(out, type);
+    out[2] = 13;
+    out[3] = labels;
+    bench_put32(out + 4, 3600);
+    bench_put32(out + 8, now + 86400);
+    bench_put32(out + 12, now - 3600);
+    bench_put16(out + 16, d->tag);
+    memcpy(out + 18, signer, sizeof(signer));
+    size_t prefix = 18 + sizeof(signer);
+
+    memcpy(data, out, prefix);
+    size_t n = prefix;
+    memcpy(data + n, owner, owner_len);
+    n += owner_len;
+    bench_put16(data + n, type);
+    bench_put16(data + n + 2, 1);
+    bench_put32(data + n + 4, 3600);
+    bench_put16(data + n + 8, rdlen);
+    memcpy(data + n + 10, rdata, rdlen);
+    n += 10 + rdlen;
+
+    EVP_MD_CTX *ctx = EVP_MD_CTX_new();
+    int ok = ctx && EVP_DigestSignInit(ctx, NULL, EVP_sha256(), NULL, d->pkey) == 1 &&
+             EVP_DigestSign(ctx, der, &der_len, data, n) == 1;
+    EVP_MD_CTX_free(ctx);
+    const uint8_t *p = der;
+    ECDSA_SIG *sig = ok ? d2i_ECDSA_SIG(NULL, &p, der_len) : NULL;
+    if (!sig) {
+        return 0;
+    }
+    BN_bn2binpad(ECDSA_SIG_get0_r(sig), out + prefix, 32);
+    BN_bn2binpad(ECDSA_SIG_get0_s(sig), out + prefix + 32, 32);
+    ECDSA_SIG_free(sig);
+    return prefix + 64;
+}
+
+// One signed answer: the question, a record and its RRSIG, both owned by
+// a pointer to the question name
+static size_t bench_dnssec_answer(const struct bench_dnssec *d, const uint8_t *qname, size_t qname_len,
+                                  uint16_t type, const uint8_t *rdata, size_t rdlen, uint8_t labels,
+                                  uint8_t *out) {
+    uint8_t sig[128];
+    size_t sig_len = bench_dnssec_sign(d, qname, qname_len, type, rdata, rdlen, labels, sig);
+    if (!sig_len) {
+        return 0;
+    }
+    memset(out, 0, 12);
+    out[2] = 0x81;
+    out[3] = 0x80;
+    bench_put16(out + 4, 1);
+    bench_put16(out + 6, 2);
+    memcpy(out + 12, qname, qname_len);
+    size_t len = 12 + qname_len;
+    bench_put16(out + len, type);
+    bench_put16(out + len + 2, 1);
+    len += 4;
+
+    const uint8_t *rr[2] = {rdata, sig};
+    const size_t rr_len[2] = {rdlen, sig_len};
+    const uint16_t rr_type[2] = {type, 46};
+    for (int i = 0; i < 2; i++) {
+        bench_put16(out + len, 0xC00C);
+        bench_put16(out + len + 2, rr_type[i]);
+        bench_put16(out + len + 4, 1);
+        bench_put32(out + len + 6, 3600);
+        bench_put16(out + len + 10, rr_len[i]);
+        memcpy(out + len + 12, rr[i], rr_len[i]);
+        len += 12 + rr_len[i];
+    }
+    return len;
+}
+
+static void bench_dnssec_free(struct bench_dnssec *d) {
+    EVP_PKEY_free(d->pkey);
+    free(d->answers);
+    free(d->lens);
+}
+
+// Key, trust anchor file and count signed answers
+static int bench_dnssec_setup(struct bench_dnssec *d, size_t count, char *anchors) {
+    uint8_t point[65];
+    size_t point_len = 0;
+    memset(d, 0, sizeof(*d));
+    d->pkey = EVP_PKEY_Q_keygen(NULL, NULL, "EC", "P-256");
+    d->answers = malloc(count * sizeof(*d->answers));
+    d->lens = malloc(count * sizeof(*d->lens));
+    if (!d->pkey || !d->answers || !d->lens ||
+        !EVP_PKEY_get_octet_string_param(d->pkey, OSSL_PKEY_PARAM_PUB_KEY, point, sizeof(point), &point_len) ||
+        point_len != sizeof(point)) {
+        return -ENOMEM;
+    }
+
+    // Flags 257, protocol 3, algorithm 13, then X | Y
+    const uint8_t head[4] = {1, 1, 3, 13};
+    memcpy(d->dnskey, head, 4);
+    memcpy(d->dnskey + 4, point + 1, 64);
+    uint32_t ac = 0;
+    for (size_t i = 0; i < sizeof(d->dnskey); i++) {
+        ac += i & 1 ? d->dnskey[i] : (uint32_t)d->dnskey[i] << 8;
+    }
+    d->tag = (ac + (ac >> 16)) & 0xFFFF;
+
+    int fd = mkstemp(anchors);
+    FILE *fp = fd >= 0 ? fdopen(fd, "w") : NULL;
+    if (!fp) {
+        if (fd >= 0) {
+            close(fd);
+        }
+        return -errno;
+    }
+    uint8_t text[128];
+    int text_len = EVP_EncodeBlock(text, d->dnskey + 4, 64);
+    fprintf(fp, "bench. IN DNSKEY 257 3 13 %.*s\n", text_len, text);
+    fclose(fp);
+
+    for (size_t i = 0; i < count; i++) {
+        uint8_t qname[32];
+        int label = snprintf((char *)qname + 1, sizeof(qname) - 1, "h%zu", i);
+        qname[0] = label;
+        memcpy(qname + 1 + label, "\x05" "bench", 7);
+        const uint8_t addr[4] = {192, 0, (uint8_t)(i >> 8), (uint8_t)i};
+        d->lens[i] = bench_dnssec_answer(d, qname, label + 8, 1, addr, sizeof(addr), 2, d->answers[i]);
+        if (!d->lens[i]) {
+            return -EINVAL;
+        }
+    }
+    return 0;
+}
+
+// Stage: ECDSA P-256 signed answers queued by this thread and verified by
+// one crypto worker per CPU; ns/pkt is wall time per validation, the hit
+// ratio the share found secure
+static int stage_dnssec(const struct bench_config *cfg, const struct workload *wl, struct bench_result *res) {
+    (void)wl;
+    size_t count = BENCH_DNSSEC_ANSWERS * cfg->loops;
+    char anchors[] = "/tmp/whack-bench-anchors-XXXXXX";
+    struct bench_dnssec d;
+    int ret = bench_dnssec_setup(&d, count, anchors);
+    if (ret) {
+        bench_dnssec_free(&d);
+        return ret;
+    }
+
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    struct validator_config validator_cfg = {
+        .workers = cpus < 1 ? 1 : cpus > VALIDATOR_MAX_WORKERS ? VALIDATOR_MAX_WORKERS : (unsigned int)cpus,
+        .anchors_file = anchors
+    };
+    bench_cache_init(cfg, false);
+    ret = validator_init(&validator_cfg);
+    unlink(anchors);
+    if (ret) {
+        cache_destroy();
+        bench_dnssec_free(&d);
+        return ret;
+    }
+
+    // The zone's self-signed DNSKEY set first, every answer chains to it
+    static const uint8_t apex[] = "\x05" "bench";
+    uint8_t keys[256];
+    size_t keys_len = bench_dnssec_answer(&d, apex, sizeof(apex), 48, d.dnskey, sizeof(d.dnskey), 1, keys);
+    validator_submit((const char *)keys + 12, NULL, keys, keys_len);
+    validator_flush();
+    validator_poll();
+
+    struct validator_stats before, after;
+    validator_get_stats(&before);
+    uint64_t start = now_ns();
+    for (size_t i = 0; i < count; i++) {
+        // Full rings: sleep like the packet loop would, not spin against the workers
+        while (validator_submit((const char *)d.answers[i] + 12, NULL, d.answers[i], d.lens[i]) == -EAGAIN) {
+            validator_flush();
+            validator_poll();
+        }
+    }
+    validator_flush();
+    validator_poll();
+    res->ns = now_ns() - start;
+    validator_get_stats(&after);
+    res->packets = count;
+    res->hits = after.results[VALIDATOR_SECURE] - before.results[VALIDATOR_SECURE];
+    res->lookups = after.queued - before.queued;
+
+    validator_destroy();
+    cache_destroy();
+    bench_dnssec_free(&d);
+    return 0;
+}
+
+static const struct bench_stage stages[] = {
+    {"parse", "Ethernet/IPv4/UDP and DNS header parsing", stage_parse},
+    {"parse_batch", "frame parsing, DNS headers 64 per call", stage_parse_batch},
+    {"build", "query construction, one per call", stage_build},
+    {"build_batch", "query construction, 64 per call", stage_build_batch},
+    {"cache", "cache lookup, insert on miss", stage_cache},
+    {"admission", "cache lookup, insert on miss past the TinyLFU filter", stage_admission},
+    {"ecs", "EDNS parse and subnet-scoped cache lookup", stage_ecs},
+    {"reply", "reply frame construction", stage_reply},
+    {"checksum", "UDP checksum of each datagram, fastest kernel", stage_checksum},
+    {"checksum_scalar", "the same with the 16-bit scalar reference", stage_checksum_scalar},
+    {"zone", "authoritative lookup and reply from the zone index", stage_zone},
+    {"policy", "firewall verdict against --rules suffix, wildcard and exact rules", stage_policy},
+    {"analytics", "passive top-K, HyperLogLog and histogram updates", stage_analytics},
+    {"log", "one log record queued per packet, JSON lines written by a thread", stage_log},
+    {"pipeline", "full path through the in-memory backend, misses forwarded", stage_pipeline},
+    {"scan", "bulk scan of 20k names over 8 uneven resolvers, p2c selection", stage_scan},
+    {"scan_rr", "the same scan with round-robin selection", stage_scan_rr},
+    {"tcp", "pipelined DNS over TCP to a loopback responder", stage_tcp},
+    {"dnssec", "ECDSA P-256 signed answers verified by one crypto thread per CPU", stage_dnssec},
+};
+
+static void print_result(const struct bench_result *res) {
+    double ns_per_pkt = res->packets ? (double)res->ns / res->packets : 0.0;
+    double mpps = res->ns ? res->packets * 1e3 / res->ns : 0.0;
+
+    printf("%-16s %10.2f %10.1f", res->stage, mpps, ns_per_pkt);
+    if (res->lookups) {
+        printf(" %10.4f", (double)res->hits / res->lookups);
+    } else {
+        printf(" %10s", "-");
+    }
+    printf("\n");
+}
+
+// Baseline lines are "<stage> <mpps> <ns/packet> <hit ratio|->"
+static int compare_baseline(const char *path, const struct bench_result *results, size_t count,
+                            double tolerance) {
+    FILE *fp = fopen(path, "r");
+    if (!fp) {
+        fprintf(stderr, "Cannot open baseline %s\n", path);
+        return -1;
+    }
+
+    int regressions = 0;
+    char line[256];
+    while (fgets(line, sizeof(line), fp)) {
+        char stage[64];
+        double mpps, ns_per_pkt;
+        if (line[0] == '#' || sscanf(line, "%63s %lf %lf", stage, &mpps, &ns_per_pkt) != 3) {
+            continue;
+        }
+
+        for (size_t i = 0; i < count; i++) {
+            if (strcmp(results[i].stage, stage) != 0 || !results[i].packets) {
+                continue;
+            }
+            double current = (double)results[i].ns / results[i].packets;
+            double change = (current - ns_per_pkt) / ns_per_pkt * 100.0;
+            bool regressed = change > tolerance;
+            printf("%-16s %10.1f -> %7.1f ns/pkt (%+.1f%%)%s\n", stage, ns_per_pkt, current, change,
+                   regressed ? "  REGRESSION" : "");
+            regressions += regressed;
+        }
+    }
+
+    fclose(fp);
+    return regressions;
+}
+
+static void usage(const char *prog) {
+    printf("Usage: %s [options]\n", prog);
+    printf("Options:\n");
+    printf("  -n, --packets      Synthesized frames (default: 1000000)\n");
+    printf("  -d, --domains      Distinct query names (default: 100000)\n");
+    printf("  -z, --zipf         Zipf exponent of name popularity (default: 1.0)\n");
+    printf("  -C, --clients      Distinct client addresses (default: 65536)\n");
+    printf("  -e, --ecs-prefix   Add a client subnet option of this length (default: none)\n");
+    printf("  -r, --random-subdomains  Fraction of queries for unique random names (default: 0)\n");
+    printf("  -P, --pcap         Replay this pcap instead of a synthesized workload\n");
+    printf("  -L, --loops        Passes over the workload per stage (default: 3)\n");
+    printf("  -c, --cache-size   Cache size (default: 10000)\n");
+    printf("  -u, --rules        Rules in the policy stage's list (default: 10000000)\n");
+    printf("  -s, --stage        Run a single stage\n");
+    printf("  -b, --baseline     Compare ns/packet against a baseline file\n");
+    printf("  -t, --tolerance    Allowed slowdown in percent (default: 20)\n");
+    printf("  -h, --help         Show this help message\n");
+    printf("Stages:\n");
+    for (size_t i = 0; i < sizeof(stages) / sizeof(stages[0]); i++) {
+        printf("  %-16s %s\n", stages[i].name, stages[i].description);
+    }
+}
+
+int main(int argc, char **argv) {
+    struct bench_config cfg = {
+        .workload = {
+            .packets = 1000000,
+            .domains = 100000,
+            .zipf_s = 1.0,
+            .clients = 65536,
+            .seed = 1
+        },
+        .loops = 3,
+        .cache_size = 10000,
+        .policy_rules = 10000000,
+        .tolerance = 20.0
+    };
+
+    static struct option long_options[] = {
+        {"packets", required_argument, 0, 'n'},
+        {"domains", required_argument, 0, 'd'},
+        {"zipf", required_argument, 0, 'z'},
+        {"clients", required_argument, 0, 'C'},
+        {"ecs-prefix", required_argument, 0, 'e'},
+        {"random-subdomains", required_argument, 0, 'r'},
+        {"pcap", required_argument, 0, 'P'},
+        {"loops", required_argument, 0, 'L'},
+        {"cache-size", required_argument, 0, 'c'},
+        {"rules", required_argument, 0, 'u'},
+        {"stage", required_argument, 0, 's'},
+        {"baseline", required_argument, 0, 'b'},
+        {"tolerance", required_argument, 0, 't'},
+        {"help", no_argument, 0, 'h'},
+        {0, 0, 0, 0}
+    };
+
+    int opt;
+    while ((opt = getopt_long(argc, argv, "n:d:z:C:e:r:P:L:c:u:s:b:t:h", long_options, NULL)) != -1) {
+        switch (opt) {
+            case 'n':
+                cfg.workload.packets = strtoull(optarg, NULL, 10);
+                break;
+            case 'd':
+                cfg.workload.domains = strtoull(optarg, NULL, 10);
+                break;
+            case 'z':
+                cfg.workload.zipf_s = atof(optarg);
+                break;
+            case 'C':
+                cfg.workload.clients = strtoull(optarg, NULL, 10);
+                break;
+            case 'e':
+                cfg.workload.ecs_prefix = atoi(optarg);
+                break;
+            case 'r':
+                cfg.workload.random_subdomains = atof(optarg);
+                break;
+            case 'P':
+                cfg.pcap_file = optarg;
+                break;
+            case 'L':
+                cfg.loops = strtoull(optarg, NULL, 10);
+                break;
+            case 'c':
+                cfg.cache_size = strtoull(optarg, NULL, 10);
+                break;
+            case 'u':
+                cfg.policy_rules = strtoull(optarg, NULL, 10);
+                break;
+            case 's':
+                cfg.stage = optarg;
+                break;
+            case 'b':
+                cfg.baseline_file = optarg;
+                break;
+            case 't':
+                cfg.tolerance = atof(optarg);
+                break;
+            case 'h':
+                usage(argv[0]);
+                return 0;
+            default:
+                usage(argv[0]);
+                return 1;
+        }
+    }
+
+    if (!cfg.loops || !cfg.cache_size) {
+        fprintf(stderr, "Loops and cache size must be non-zero\n");
+        return 1;
+    }
+
+    // Build the workload once, every stage replays the same frames
+    struct workload wl = {0};
+    int ret = cfg.pcap_file ? workload_load_pcap(&wl, cfg.pcap_file)
+                            : workload_synthesize(&wl, &cfg.workload);
+    if (ret != 0 || wl.count == 0) {
+        fprintf(stderr, "Failed to build workload (%d)\n", ret);
+        workload_free(&wl);
+        return 1;
+    }
+
+    if (cfg.pcap_file) {
+        printf("whack-bench: %zu frames from %s, %zu loops, cache %zu\n",
+               wl.count, cfg.pcap_file, cfg.loops, cfg.cache_size);
+    } else {
+        printf("whack-bench: %zu frames, %zu domains, zipf %.2f, %.0f%% random subdomains, %zu loops, cache %zu\n",
+               wl.count, cfg.workload.domains, cfg.workload.zipf_s, cfg.workload.random_subdomains * 100.0,
+               cfg.loops, cfg.cache_size);
+    }
+    printf("%-16s %10s %10s %10s\n", "stage", "Mpps", "ns/pkt", "hit ratio");
+
+    size_t stage_count = sizeof(stages) / sizeof(stages[0]);
+    struct bench_result results[sizeof(stages) / sizeof(stages[0])];
+    size_t ran = 0;
+
+    for (size_t i = 0; i < stage_count; i++) {
+        if (cfg.stage && strcmp(cfg.stage, stages[i].name) != 0) {
+            continue;
+        }
+        struct bench_result *res = &results[ran];
+        memset(res, 0, sizeof(*res));
+        res->stage = stages[i].name;
+        if (stages[i].run(&cfg, &wl, res) != 0) {
+            fprintf(stderr, "Stage %s failed\n", stages[i].name);
+            continue;
+        }
+        print_result(res);
+        ran++;
+    }
+
+    int regressions = 0;
+    if (cfg.baseline_file) {
+        printf("\nBaseline comparison (%s, tolerance %.0f%%):\n", cfg.baseline_file, cfg.tolerance);
+        regressions = compare_baseline(cfg.baseline_file, results, ran, cfg.tolerance);
+    }
+
+    workload_free(&wl);
+    return regressions != 0;
+}
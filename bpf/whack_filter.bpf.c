@@ -0,0 +1,211 @@
+// XDP front end for whack: CIDR allow/deny lists and per-source response
+// rate limiting, enforced before packets reach the AF_XDP socket.
+//
+// Build: clang -O2 -g -target bpf -I include -c bpf/whack_filter.bpf.c -o whack_filter.bpf.o
+
+#include <linux/bpf.h>
+#include <linux/if_ether.h>
+#include <linux/ip.h>
+#include <linux/in.h>
+#include <linux/udp.h>
+#include <bpf/bpf_helpers.h>
+#include <bpf/bpf_endian.h>
+#include "../include/xdp_filter_maps.h"
+
+#define DNS_PORT    53
+
+struct dns_hdr {
+    __be16 id;
+    __be16 flags;
+    __be16 qdcount;
+    __be16 ancount;
+    __be16 nscount;
+    __be16 arcount;
+};
+
+// AF_XDP sockets by RX queue
+struct {
+    __uint(type, BPF_MAP_TYPE_XSKMAP);
+    __uint(max_entries, XDP_FILTER_MAX_QUEUES);
+    __type(key, __u32);
+    __type(value, __u32);
+} xsks_map SEC(".maps");
+
+struct {
+    __uint(type, BPF_MAP_TYPE_LPM_TRIE);
+    __uint(max_entries, XDP_FILTER_MAX_CIDRS);
+    __uint(map_flags, BPF_F_NO_PREALLOC);
+    __type(key, struct xdp_filter_lpm_key);
+    __type(value, __u8);
+} deny_v4 SEC(".maps");
+
+struct {
+    __uint(type, BPF_MAP_TYPE_LPM_TRIE);
+    __uint(max_entries, XDP_FILTER_MAX_CIDRS);
+    __uint(map_flags, BPF_F_NO_PREALLOC);
+    __type(key, struct xdp_filter_lpm_key);
+    __type(value, __u8);
+} allow_v4 SEC(".maps");
+
+struct {
+    __uint(type, BPF_MAP_TYPE_ARRAY);
+    __uint(max_entries, 1);
+    __type(key, __u32);
+    __type(value, struct xdp_filter_limits);
+} limits SEC(".maps");
+
+// Shared across CPUs so the limit holds per source, not per queue; racing
+// updates only make the bucket slightly generous
+struct {
+    __uint(type, BPF_MAP_TYPE_LRU_HASH);
+    __uint(max_entries, XDP_FILTER_MAX_SOURCES);
+    __type(key, __u32);
+    __type(value, struct xdp_filter_bucket);
+} buckets SEC(".maps");
+
+struct {
+    __uint(type, BPF_MAP_TYPE_PERCPU_ARRAY);
+    __uint(max_entries, XDP_FILTER_COUNTERS);
+    __type(key, __u32);
+    __type(value, __u64);
+} counters SEC(".maps");
+
+static __always_inline void count(__u32 counter) {
+    __u64 *value = bpf_map_lookup_elem(&counters, &counter);
+    if (value) {
+        (*value)++;
+    }
+}
+
+// Take a token from the source's bucket, 0 when the query may pass
+static __always_inline int rate_limit(const struct xdp_filter_limits *lim, __u32 saddr,
+                                      __u32 *limited) {
+    __u32 mask = lim->prefix >= 32 ? 0xFFFFFFFF : lim->prefix ? ~0U << (32 - lim->prefix) : 0;
+    __u32 source = saddr & bpf_htonl(mask);
+    __u64 capacity = (__u64)lim->burst * XDP_FILTER_TOKEN;
+    __u64 now = bpf_ktime_get_ns();
+
+    struct xdp_filter_bucket *bucket = bpf_map_lookup_elem(&buckets, &source);
+    if (!bucket) {
+        // New sources start with a full bucket, less this query
+        struct xdp_filter_bucket fresh = {
+            .tokens = capacity - XDP_FILTER_TOKEN,
+            .last_ns = now,
+        };
+        bpf_map_update_elem(&buckets, &source, &fresh, BPF_NOEXIST);
+        return 0;
+    }
+
+    // Cap the idle time so the multiply cannot overflow
+    __u64 elapsed = now - bucket->last_ns;
+    if (elapsed > 10 * XDP_FILTER_TOKEN) {
+        elapsed = 10 * XDP_FILTER_TOKEN;
+    }
+    __u64 tokens = bucket->tokens + elapsed * lim->rate;
+    if (tokens > capacity) {
+        tokens = capacity;
+    }
+    bucket->last_ns = now;
+
+    if (tokens >= XDP_FILTER_TOKEN) {
+        bucket->tokens = tokens - XDP_FILTER_TOKEN;
+        return 0;
+    }
+
+    bucket->tokens = tokens;
+    *limited = ++bucket->limited;
+    return -1;
+}
+
+// Turn the query into an empty truncated answer and bounce it back, so a
+// real client retries over TCP while a spoofed victim gets a tiny packet
+static __always_inline int slip(struct ethhdr *eth, struct iphdr *ip, struct udphdr *udp,
+                                struct dns_hdr *dns) {
+    unsigned char mac[ETH_ALEN];
+    __builtin_memcpy(mac, eth->h_source, ETH_ALEN);
+    __builtin_memcpy(eth->h_source, eth->h_dest, ETH_ALEN);
+    __builtin_memcpy(eth->h_dest, mac, ETH_ALEN);
+
+    // Swapping addresses and ports leaves both checksums valid
+    __be32 addr = ip->saddr;
+    ip->saddr = ip->daddr;
+    ip->daddr = addr;
+    __be16 port = udp->source;
+    udp->source = udp->dest;
+    udp->dest = port;
+    udp->check = 0;
+
+    // QR and TC; the question and OPT stay, nothing else was there
+    dns->flags |= bpf_htons(0x8200);
+    return XDP_TX;
+}
+
+SEC("xdp")
+int whack_filter(struct xdp_md *ctx) {
+    void *data = (void *)(long)ctx->data;
+    void *data_end = (void *)(long)ctx->data_end;
+
+    // Only IPv4/UDP DNS is ours, everything else goes to the kernel
+    struct ethhdr *eth = data;
+    if ((void *)(eth + 1) > data_end || eth->h_proto != bpf_htons(ETH_P_IP)) {
+        goto pass;
+    }
+
+    struct iphdr *ip = (void *)(eth + 1);
+    if ((void *)(ip + 1) > data_end || ip->protocol != IPPROTO_UDP || ip->ihl < 5 ||
+        (ip->frag_off & bpf_htons(0x3FFF))) {
+        goto pass;
+    }
+
+    struct udphdr *udp = (void *)ip + ip->ihl * 4;
+    if ((void *)(udp + 1) > data_end) {
+        goto pass;
+    }
+
+    int query = udp->dest == bpf_htons(DNS_PORT);
+    if (!query && udp->source != bpf_htons(DNS_PORT)) {
+        goto pass;
+    }
+
+    struct xdp_filter_lpm_key key = {
+        .prefixlen = 32,
+        .addr = ip->saddr,
+    };
+    if (bpf_map_lookup_elem(&deny_v4, &key)) {
+        count(XDP_FILTER_DENIED);
+        return XDP_DROP;
+    }
+
+    // Answers from resolvers are not subject to the client policy
+    __u32 zero = 0;
+    struct xdp_filter_limits *lim = bpf_map_lookup_elem(&limits, &zero);
+    if (query && lim) {
+        if (lim->allow_only && !bpf_map_lookup_elem(&allow_v4, &key)) {
+            count(XDP_FILTER_NOT_ALLOWED);
+            return XDP_DROP;
+        }
+
+        __u32 limited = 0;
+        if (lim->rate && rate_limit(lim, ip->saddr, &limited) != 0) {
+            struct dns_hdr *dns = (void *)(udp + 1);
+            if (lim->slip && limited % lim->slip == 0 && (void *)(dns + 1) <= data_end) {
+                count(XDP_FILTER_SLIPPED);
+                return slip(eth, ip, udp, dns);
+            }
+            count(XDP_FILTER_RATE_LIMITED);
+            return XDP_DROP;
+        }
+    }
+
+    int action = bpf_redirect_map(&xsks_map, ctx->rx_queue_index, XDP_PASS);
+    if (action == XDP_REDIRECT) {
+        count(XDP_FILTER_REDIRECTED);
+        return action;
+    }
+
+pass:
+    count(XDP_FILTER_PASSED);
+    return XDP_PASS;
+}
+
+char _license[] SEC("license") = "GPL";
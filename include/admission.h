@@ -0,0 +1,27 @@
+#ifndef ADMISSION_H
+#define ADMISSION_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+// Default configuration values
+#define ADMISSION_MIN_COUNTERS  256     // Smallest sketch row
+#define ADMISSION_SAMPLE_FACTOR 10      // Recorded accesses per cache entry between agings
+
+// TinyLFU admission filter configuration
+struct admission_config {
+    size_t entries;                 // Cache entries the filter guards
+    size_t counters;                // 4-bit counters per sketch row (0 = entries), rounded up to a power of two
+    size_t sample_size;             // Accesses between halving every count (0 = 10 x entries)
+};
+
+// Function declarations
+int admission_init(const struct admission_config *config);
+void admission_record(uint32_t hash);
+uint32_t admission_estimate(uint32_t hash);
+bool admission_admit(uint32_t candidate, uint32_t victim);
+uint64_t admission_agings(void);
+void admission_destroy(void);
+
+#endif // ADMISSION_H
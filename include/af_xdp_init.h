@@ -15,6 +15,14 @@
 #define XSK_UMEM_FRAME_SIZE 2048
 #define XSK_NUM_FRAMES      4096
 
+// RX strategy defaults
+#define XSK_BUSY_POLL_USEC      20      // SO_BUSY_POLL timeout
+#define XSK_BUSY_POLL_BUDGET    XSK_BATCH_SIZE
+#define XSK_ADAPTIVE_IDLE_SPINS 1024    // Empty peeks before falling back to poll()
+
+// Returned by af_xdp_frame_alloc when no frame is free
+#define XSK_INVALID_FRAME   UINT64_MAX
+
 // XDP flags if not defined
 #ifndef XDP_FLAGS_UPDATE_IF_NOEXIST
 #define XDP_FLAGS_UPDATE_IF_NOEXIST (1U << 0)
@@ -24,10 +32,56 @@
 #define XDP_FLAGS_DRV_MODE (0U << 1)
 #endif
 
+#ifndef XDP_FLAGS_SKB_MODE
+#define XDP_FLAGS_SKB_MODE (1U << 1)
+#endif
+
 #ifndef XDP_USE_NEED_WAKEUP
 #define XDP_USE_NEED_WAKEUP (1U << 3)
 #endif
 
+#ifndef XSK_LIBXDP_FLAGS__INHIBIT_PROG_LOAD
+#define XSK_LIBXDP_FLAGS__INHIBIT_PROG_LOAD (1 << 0)
+#endif
+
+#ifndef SO_BUSY_POLL
+#define SO_BUSY_POLL 46
+#endif
+
+#ifndef SO_PREFER_BUSY_POLL
+#define SO_PREFER_BUSY_POLL 69
+#endif
+
+#ifndef SO_BUSY_POLL_BUDGET
+#define SO_BUSY_POLL_BUDGET 70
+#endif
+
+// TX checksum offload through AF_XDP TX metadata: kernel 6.8 headers and a
+// libxdp whose UMEM config carries tx_metadata_len (checked by CMake)
+#if defined(WHACK_XSK_TX_METADATA) && defined(XDP_TX_METADATA) && defined(XDP_UMEM_TX_METADATA_LEN)
+#define XSK_TX_METADATA 1
+#endif
+
+// RX wait strategies
+enum xsk_rx_mode {
+    XSK_RX_MODE_BUSY_POLL,          // Never sleep, drive NAPI from the syscall path
+    XSK_RX_MODE_WAKEUP,             // Sleep in poll() whenever the RX ring is empty
+    XSK_RX_MODE_ADAPTIVE            // Spin while traffic flows, poll() once idle
+};
+
+// RX path counters
+struct xsk_rx_stats {
+    uint64_t rx_packets;            // Packets handed to process_packet
+    uint64_t rx_batches;            // Non-empty RX ring peeks
+    uint64_t empty_polls;           // Waits that found the RX ring empty
+    uint64_t syscalls;              // poll/recvfrom/sendto issued by the RX and TX paths
+    uint64_t sleeps;                // poll() calls that were allowed to block
+    uint64_t batch_ns;              // Time spent from peek to release, summed over batches
+    uint64_t batch_ns_max;          // Worst single batch
+    uint64_t wall_ns;               // Time since socket init
+    uint64_t cpu_ns;                // Thread CPU time since socket init
+};
+
 // Structure to hold XDP socket information
 struct xdp_socket {
     int ifindex;                    // Interface index
@@ -40,6 +94,17 @@ struct xdp_socket {
     void *buffer;                   // Packet buffer
     __u32 prog_id;                  // XDP program ID
     unsigned int outstanding_tx;     // Number of outstanding TX packets
+    enum xsk_rx_mode rx_mode;       // RX wait strategy
+    bool busy_poll;                 // SO_PREFER_BUSY_POLL accepted by the kernel
+    unsigned int idle_spins;        // Consecutive empty peeks (adaptive mode)
+    unsigned int idle_spin_limit;   // Empty peeks before sleeping (adaptive mode)
+    bool tx_csum_offload;           // TX descriptors ask the NIC for the UDP checksum
+    uint32_t tx_headroom;           // Bytes kept free before each TX packet for its metadata
+    uint64_t *free_frames;          // Stack of unused UMEM frame addresses, XSK_NUM_FRAMES long
+    uint32_t free_count;            // Number of entries in free_frames
+    uint64_t start_ns;              // CLOCK_MONOTONIC at init
+    uint64_t start_cpu_ns;          // CLOCK_THREAD_CPUTIME_ID at init
+    struct xsk_rx_stats stats;      // RX path counters
 };
 
 // XDP socket configuration
@@ -49,17 +114,37 @@ struct xdp_socket_config {
     __u32 batch_size;               // Batch size for processing
     int bind_flags;                 // Socket bind flags
     bool xdp_flags;                 // XDP program flags
+    bool xdp_generic;               // Attach in generic (SKB) mode, e.g. on veth
     char *ifname;                   // Interface name
+    int queue_id;                   // NIC queue the socket binds to
+    enum xsk_rx_mode rx_mode;       // RX wait strategy
+    int busy_poll_usec;             // SO_BUSY_POLL value (busy-poll mode, 0 = default)
+    int busy_poll_budget;           // SO_BUSY_POLL_BUDGET value (busy-poll mode, 0 = default)
+    unsigned int idle_spins;        // Adaptive mode spin limit (0 = default)
+    int xsks_map_fd;                // XSKMAP of an already attached program (0 = libxdp default)
+    bool tx_csum_offload;           // Use TX checksum offload if the kernel and driver have it
 };
 
 // Function declarations
 int af_xdp_socket_init(struct xdp_socket *xsk_socket, struct xdp_socket_config *config);
 void af_xdp_socket_rx(struct xdp_socket *xsk_socket, void (*process_packet)(const uint8_t *, size_t));
 int af_xdp_socket_tx(struct xdp_socket *xsk_socket, const uint8_t *pkt, size_t len);
+int af_xdp_socket_tx_batch(struct xdp_socket *xsk_socket, uint8_t *const *pkts, const uint32_t *lens,
+                           size_t count);
 void af_xdp_socket_cleanup(struct xdp_socket *xsk_socket);
 
 // Helper functions
 int af_xdp_socket_poll(struct xdp_socket *xsk_socket, int timeout_ms);
+int af_xdp_socket_wait(struct xdp_socket *xsk_socket, int timeout_ms);
 void af_xdp_socket_complete_tx(struct xdp_socket *xsk_socket);
+void af_xdp_socket_get_stats(struct xdp_socket *xsk_socket, struct xsk_rx_stats *stats);
+
+// RX mode helpers
+int af_xdp_rx_mode_parse(const char *name, enum xsk_rx_mode *mode);
+const char *af_xdp_rx_mode_name(enum xsk_rx_mode mode);
+
+// UMEM frame allocator
+uint64_t af_xdp_frame_alloc(struct xdp_socket *xsk_socket);
+void af_xdp_frame_free(struct xdp_socket *xsk_socket, uint64_t addr);
 
 #endif // AF_XDP_INIT_H
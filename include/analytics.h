@@ -0,0 +1,98 @@
+#ifndef ANALYTICS_H
+#define ANALYTICS_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdatomic.h>
+#include <time.h>
+
+// Default configuration values
+#define ANALYTICS_TOPK              128     // Space-Saving counters per list
+#define ANALYTICS_REPORT_TOP        10      // Entries emitted per list
+#define ANALYTICS_KEY_MAX           255     // Longest key, a wire-format name
+#define ANALYTICS_SKETCH_BLOCKS     1024    // 64-byte count-min blocks in front of each list
+#define ANALYTICS_HLL_BITS          12      // 4096 registers, about 1.6% standard error
+#define ANALYTICS_QTYPES            256     // Types counted individually, the rest share one slot
+#define ANALYTICS_RCODES            16
+#define ANALYTICS_SIZE_BUCKETS      8       // Responses up to 64, 128, ... 4096 bytes, then larger
+#define ANALYTICS_METRICS_INTERVAL  10      // Seconds between reports
+
+// Space-Saving heavy-hitter counter
+struct analytics_topk_entry {
+    uint64_t count;                 // Upper bound on the key's occurrences
+    uint64_t error;                 // How much of count may belong to evicted keys
+    uint32_t hash;
+    uint16_t len;
+    uint16_t heap;                  // Position in the min-heap
+};
+
+// Top-K list: a min-heap on count finds the entry to evict, an open
+// addressing index finds a key's entry. Once the list is full, a key that
+// is not in it must first out-count the smallest entry in a count-min
+// sketch, so the long tail never churns the heap.
+struct analytics_topk {
+    uint32_t sketch[ANALYTICS_SKETCH_BLOCKS][16];
+    struct analytics_topk_entry entries[ANALYTICS_TOPK];
+    uint8_t keys[ANALYTICS_TOPK][ANALYTICS_KEY_MAX];
+    uint16_t heap[ANALYTICS_TOPK];
+    uint16_t index[ANALYTICS_TOPK * 2];     // Entry + 1, 0 = empty
+    uint16_t used;
+};
+
+// Streaming summary of the DNS traffic seen by one worker, fixed size
+struct analytics_summary {
+    uint64_t queries;
+    uint64_t responses;
+    uint64_t malformed;
+    uint64_t response_bytes;
+    uint64_t qtypes[ANALYTICS_QTYPES + 1];
+    uint64_t rcodes[ANALYTICS_RCODES];
+    uint64_t sizes[ANALYTICS_SIZE_BUCKETS + 1];
+    uint8_t names_hll[1 << ANALYTICS_HLL_BITS];
+    uint8_t clients_hll[1 << ANALYTICS_HLL_BITS];
+    struct analytics_topk names;    // Wire-format query names, lower case
+    struct analytics_topk clients;  // Querying IPv4 addresses
+};
+
+// One worker's summaries: the worker writes the active one and retires it
+// when the reporter asks, so the two never touch the same summary
+struct analytics_core {
+    struct analytics_summary *slots[2];
+    atomic_uint active;             // Slot the worker writes
+    atomic_bool flip;               // Reporter asked for the active slot
+    atomic_bool ready;              // Retired slot waiting to be merged
+};
+
+// Summaries
+struct analytics_summary *analytics_summary_alloc(void);
+void analytics_reset(struct analytics_summary *summary);
+void analytics_observe(struct analytics_summary *summary, const uint8_t *packet, size_t length);
+void analytics_merge(struct analytics_summary *dst, const struct analytics_summary *src);
+uint64_t analytics_distinct_names(const struct analytics_summary *summary);
+uint64_t analytics_distinct_clients(const struct analytics_summary *summary);
+size_t analytics_top(const struct analytics_topk *topk, const struct analytics_topk_entry **out, size_t max);
+int analytics_report(FILE *fp, const struct analytics_summary *summary, time_t now, uint32_t interval);
+
+// Worker side
+int analytics_core_init(struct analytics_core *core);
+void analytics_core_poll(struct analytics_core *core);
+void analytics_core_free(struct analytics_core *core);
+
+// Reporter side
+void analytics_core_request(struct analytics_core *core);
+bool analytics_core_collect(struct analytics_core *core, struct analytics_summary *dst);
+
+// Summary the worker is writing
+static inline struct analytics_summary *analytics_core_summary(struct analytics_core *core) {
+    return core->slots[atomic_load_explicit(&core->active, memory_order_relaxed)];
+}
+
+// Key bytes of a top-K entry
+static inline const uint8_t *analytics_topk_key(const struct analytics_topk *topk,
+                                                const struct analytics_topk_entry *entry) {
+    return topk->keys[entry - topk->entries];
+}
+
+#endif // ANALYTICS_H
@@ -3,16 +3,37 @@
 
 #include <stdint.h>
 #include <stdbool.h>
+#include <stddef.h>
 #include <time.h>
 
+#define CACHE_MAX_RESPONSE  4096    // Largest response kept (EDNS answers included)
+#define CACHE_SLAB_SLOT     576     // Response bytes preallocated per entry, an odd number of cache lines
+                                    // so slots spread over cache sets; larger ones go to the heap
+
+// The key past the name: the clients an entry answers, by subnet (RFC 7871,
+// family 0 being the global scope) and by DO, since DO answers carry
+// RRSIGs, and the type and class they asked for
+struct cache_scope {
+    uint16_t family;            // 0, DNS_ECS_FAMILY_IPV4 or DNS_ECS_FAMILY_IPV6
+    uint8_t prefix;             // Significant bits of address
+    uint8_t address[16];        // Network byte order, zero past prefix
+    bool dnssec_ok;             // Set by the caller after cache_scope_init
+    uint16_t qtype;             // Likewise, 0 for callers caching by name alone
+    uint16_t qclass;
+};
+
 // Cache entry structure
 struct cache_entry {
     char domain[256];           // Domain name
-    uint8_t response[512];      // DNS response data
+    uint32_t name_hash;         // Hash of domain, the admission filter's key
+    struct cache_scope scope;   // Subnet the response is valid for
+    uint8_t *response;          // DNS response data
     size_t response_len;        // Length of response
+    size_t response_cap;        // Bytes allocated for response
     time_t timestamp;           // Time when entry was added
     uint32_t ttl;              // Time-to-live in seconds
     bool valid;                // Entry validity flag
+    bool secure;               // DNSSEC validated, see validator.h
 };
 
 // Cache configuration structure
@@ -20,18 +41,29 @@ struct cache_config {
     size_t max_entries;         // Maximum number of entries in cache
     uint32_t default_ttl;       // Default TTL for entries without explicit TTL
     uint32_t cleanup_interval;  // Interval for cleanup of expired entries
+    bool admission;             // TinyLFU: only displace a live entry for a more frequent name
+    size_t admission_counters;  // Sketch counters per row (0 = max_entries)
+    size_t admission_sample;    // Lookups between agings of the counts (0 = 10 x max_entries)
 };
 
 // Function declarations
 void cache_init(struct cache_config *config);
 bool cache_lookup(const char *domain, uint8_t *response, size_t *response_len);
 void cache_insert(const char *domain, const uint8_t *response, size_t response_len, uint32_t ttl);
+bool cache_lookup_scoped(const char *domain, const struct cache_scope *client,
+                         uint8_t *response, size_t *response_len, bool *secure, uint32_t *age);
+void cache_insert_scoped(const char *domain, const struct cache_scope *scope,
+                         const uint8_t *response, size_t response_len, uint32_t ttl);
+bool cache_set_secure(const char *domain, const struct cache_scope *scope,
+                      const uint8_t *response, size_t response_len);
+void cache_scope_init(struct cache_scope *scope, uint16_t family, const uint8_t *address, uint8_t prefix);
 void cache_cleanup(void);
 void cache_destroy(void);
 
 // Statistics functions
 size_t cache_get_hit_count(void);
 size_t cache_get_miss_count(void);
+size_t cache_get_rejected_count(void);
 double cache_get_hit_ratio(void);
 
 #endif // CACHE_H
@@ -0,0 +1,46 @@
+#ifndef CHECKSUM_H
+#define CHECKSUM_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+// Shorter buffers skip the vector kernel, its setup costs more than it saves
+#define CSUM_SIMD_MIN_LEN   128
+
+// Internet checksum (RFC 1071) helpers. Partial sums are 32-bit ones'
+// complement accumulators over 16-bit words in memory order, so the folded
+// result is stored into a header as is, without byte swapping. A buffer
+// summed in pieces must have every piece but the last of even length.
+
+// Add a buffer to a partial sum, with the fastest kernel this CPU has
+uint32_t csum_partial(const void *buf, size_t len, uint32_t sum);
+
+// Reference: one 16-bit word at a time
+uint32_t csum_partial_scalar(const void *buf, size_t len, uint32_t sum);
+
+// Add two partial sums, end-around carry included
+static inline uint32_t csum_add(uint32_t sum, uint32_t addend) {
+    sum += addend;
+    return sum + (sum < addend);
+}
+
+// Fold a partial sum and complement it, ready to store in a header
+uint16_t csum_fold(uint32_t sum);
+
+// Partial sum of the IPv4 pseudo-header of a UDP datagram (addresses in
+// network byte order, len in host order)
+uint32_t csum_pseudo_udp(uint32_t saddr, uint32_t daddr, uint16_t len);
+
+// RFC 1624 incremental update of a stored checksum when one field of the
+// covered data changes from old to new, both as stored in the packet
+uint16_t csum_replace16(uint16_t check, uint16_t old, uint16_t new);
+uint16_t csum_replace32(uint16_t check, uint32_t old, uint32_t new);
+
+// Kernel csum_partial dispatches to: "avx2" or "scalar"
+const char *csum_impl_name(void);
+
+// Turn the vector kernel off, for comparisons (no effect without AVX2)
+void csum_set_simd(bool enabled);
+
+#endif // CHECKSUM_H
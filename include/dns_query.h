@@ -3,6 +3,16 @@
 
 #include <stdint.h>
 #include <stdlib.h>
+#include <stdbool.h>
+
+#define DNS_MAX_UDP_SIZE        512     // Largest UDP message without EDNS (RFC 1035)
+#define DNS_EDNS_BUFFER_SIZE    1232    // Default advertised UDP payload size
+#define DNS_OPT_RR_LEN          11      // OPT record without options
+#define DNS_EDNS_OPT_ECS        8       // Client subnet option code (RFC 7871)
+#define DNS_ECS_FAMILY_IPV4     1
+#define DNS_ECS_FAMILY_IPV6     2
+#define DNS_BATCH_MAX           64      // Messages per batch call, one bit each in a mask
+#define DNS_NAME_MAX            256     // Dotted name buffer, names are at most 253 characters
 
 // DNS Query Types
 enum DnsQType {
@@ -27,12 +37,52 @@ struct dns_header {
     uint16_t arcount;       // Number of additional records
 };
 
+// EDNS client subnet option
+struct dns_ecs {
+    uint16_t family;        // DNS_ECS_FAMILY_IPV4 or DNS_ECS_FAMILY_IPV6
+    uint8_t source_prefix;  // Bits of the address supplied by the client
+    uint8_t scope_prefix;   // Bits the answer is valid for (responses)
+    uint8_t address[16];    // Network byte order, zero past source_prefix
+};
+
+// EDNS(0) pseudo-header carried in the OPT record
+struct dns_edns {
+    bool present;           // OPT record in the message
+    uint16_t udp_size;      // Advertised UDP payload size
+    uint8_t ext_rcode;      // Upper 8 bits of the extended RCODE
+    uint8_t version;        // EDNS version
+    bool dnssec_ok;         // DO bit
+    bool has_ecs;           // Client subnet option present
+    struct dns_ecs ecs;
+};
+
 // DNS Query structure
 struct dns_query {
     struct dns_header header;
     enum DnsQType qtype;
     char name[256];         // Domain name
     uint16_t qclass;        // Query class (usually IN=1)
+    struct dns_edns edns;   // OPT record to send, or parsed from a response
+};
+
+// One query of a batch; the name is a slice and need not be NUL-terminated
+struct dns_batch_query {
+    const char *name;       // Dotted name, an optional trailing dot is ignored
+    uint16_t name_len;
+    uint16_t qtype;
+    uint16_t id;            // Host byte order
+};
+
+// Batch parse result, one array per header field (host byte order)
+struct dns_batch_result {
+    size_t count;                           // Messages in the batch
+    uint64_t valid;                         // Bit i set when message i parsed
+    uint16_t id[DNS_BATCH_MAX];
+    uint16_t flags[DNS_BATCH_MAX];
+    uint8_t rcode[DNS_BATCH_MAX];
+    uint16_t qdcount[DNS_BATCH_MAX];
+    uint16_t ancount[DNS_BATCH_MAX];
+    uint16_t answer_offset[DNS_BATCH_MAX];  // Start of the answer section
 };
 
 // Function declarations
@@ -40,4 +90,24 @@ int construct_query(struct dns_query *query, uint8_t *buffer, size_t *buffer_len
 int parse_response(const uint8_t *response, size_t response_len, struct dns_query *query);
 void init_query(struct dns_query *query, const char *domain_name, enum DnsQType type);
 
+// Batch variants
+int dns_construct_batch(const struct dns_batch_query *queries, size_t count, uint16_t edns_size,
+                        uint8_t *const *buffers, size_t buffer_len, uint16_t *lengths);
+int dns_parse_batch(const uint8_t *const *msgs, const uint16_t *lens, size_t count,
+                    struct dns_batch_result *result);
+
+// Message walking and EDNS
+int dns_skip_name(const uint8_t *msg, size_t len, size_t offset);
+int dns_question_end(const uint8_t *msg, size_t len);
+int dns_parse_edns(const uint8_t *msg, size_t len, struct dns_edns *edns);
+void dns_ecs_init(struct dns_ecs *ecs, uint16_t family, const void *address, uint8_t source_prefix);
+int dns_truncate(uint8_t *msg, size_t *len);
+int dns_answer_ttl(const uint8_t *msg, size_t len, uint32_t *ttl);
+int dns_age_ttls(uint8_t *msg, size_t len, uint32_t age);
+void dns_name_to_text(const uint8_t *name, size_t max, char *out, size_t out_len);
+
+// Record type names
+const char *dns_qtype_name(uint16_t qtype);
+int dns_qtype_parse(const char *name, enum DnsQType *qtype);
+
 #endif // DNS_QUERY_H
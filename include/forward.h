@@ -0,0 +1,59 @@
+#ifndef FORWARD_H
+#define FORWARD_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "packet.h"
+#include "dns_query.h"
+
+struct io_backend;
+
+// Default configuration values
+#define FORWARD_MAX_PENDING 65536   // One slot per upstream message ID
+#define FORWARD_TIMEOUT_MS  1000
+#define FORWARD_RETRIES     2
+#define FORWARD_SRC_PORT    45354
+#define FORWARD_MAX_TTL     86400   // Longest an upstream answer is cached
+#define FORWARD_MAX_CLIENTS 64      // Clients sharing one upstream query, answered in one TX batch
+
+// Forwarding configuration
+struct forward_config {
+    uint32_t timeout_ms;            // Retransmit after this long (0 = default)
+    uint32_t retries;               // Retransmits before answering SERVFAIL
+    uint32_t max_pending;           // Outstanding upstream queries (0 = default)
+    struct packet_endpoint src;     // Our MAC, IP and source port towards resolvers
+    uint8_t gateway_mac[ETH_ADDR_LEN]; // Next hop towards the resolvers
+};
+
+// Client waiting on an upstream answer
+struct forward_client {
+    struct packet_endpoint addr;    // Where the query came from
+    struct packet_endpoint local;   // Address the client sent it to
+    uint16_t id;                    // Client's message ID, network byte order
+    uint16_t udp_limit;             // Largest UDP reply the client accepts
+    bool dnssec_ok;                 // Asked with DO, like everyone waiting on the same query
+};
+
+// Forwarding counters
+struct forward_stats {
+    uint64_t forwarded;             // Client queries sent upstream
+    uint64_t coalesced;             // Misses attached to a query already upstream
+    uint64_t fanout_max;            // Most clients answered from one upstream answer
+    uint64_t retransmits;           // Upstream queries resent after a timeout
+    uint64_t answers;               // Upstream answers matched to a client
+    uint64_t timeouts;              // Queries answered with SERVFAIL
+    uint64_t unmatched;             // Answers matching no outstanding query
+    uint64_t overflows;             // Queries dropped with every slot in use
+    uint64_t tx_failures;           // Frames the backend did not accept
+};
+
+// Function declarations
+int forward_init(const struct forward_config *config, struct io_backend *io);
+int forward_query(const struct packet_info *request, const struct dns_edns *edns, uint16_t udp_limit);
+int forward_match(const struct packet_info *answer, struct forward_client *clients);
+void forward_tick(void);
+size_t forward_pending(void);
+void forward_get_stats(struct forward_stats *stats);
+void forward_destroy(void);
+
+#endif // FORWARD_H
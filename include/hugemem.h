@@ -0,0 +1,47 @@
+#ifndef HUGEMEM_H
+#define HUGEMEM_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+// Default configuration values
+#define HUGEMEM_MAX_REGIONS 16      // Live allocations tracked for reporting and freeing
+
+// Page size policy for long-lived buffers
+enum hugemem_pages {
+    HUGEMEM_PAGES_AUTO,             // 2M pages when the kernel has them, else 4K
+    HUGEMEM_PAGES_4K,
+    HUGEMEM_PAGES_2M,               // Fail rather than fall back
+    HUGEMEM_PAGES_1G                // Fail rather than fall back
+};
+
+// Placement of everything allocated through hugemem_alloc
+struct hugemem_config {
+    int numa_node;                  // Node to bind to (-1 = leave to the kernel)
+    enum hugemem_pages pages;
+    bool lock;                      // Prefault and mlock every region
+};
+
+// One allocation and what the kernel actually gave us
+struct hugemem_region {
+    const char *name;               // A string literal, also used in log lines
+    void *addr;
+    size_t size;                    // Mapped bytes, a multiple of page_size
+    size_t page_size;               // Page size obtained
+    int node;                       // Node of the first page (-1 = unknown)
+    bool locked;                    // mlock succeeded
+};
+
+// Function declarations
+int hugemem_init(const struct hugemem_config *config);
+void *hugemem_alloc(const char *name, size_t size);
+void hugemem_free(void *addr);
+size_t hugemem_regions(const struct hugemem_region **regions);
+
+// Helper functions
+int hugemem_nic_node(const char *ifname);
+int hugemem_pages_parse(const char *name, enum hugemem_pages *pages);
+const char *hugemem_page_name(size_t page_size);
+
+#endif // HUGEMEM_H
@@ -0,0 +1,108 @@
+#ifndef IO_BACKEND_H
+#define IO_BACKEND_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include <errno.h>
+
+struct io_backend;
+struct xdp_socket;
+struct xdp_socket_config;
+struct workload;
+
+// Called once per received frame
+typedef void (*io_packet_handler)(const uint8_t *packet, size_t length);
+
+// Operations every packet I/O backend implements
+struct io_backend_ops {
+    int (*wait)(struct io_backend *io, int timeout_ms);            // >0 when RX has frames
+    void (*rx)(struct io_backend *io, io_packet_handler handler);  // Drain one RX batch
+    uint8_t *(*tx_buffer)(struct io_backend *io, size_t *capacity); // Frame to build a TX packet in
+    int (*tx)(struct io_backend *io, uint8_t *frame, size_t len);  // Queue a frame from tx_buffer
+    int (*tx_batch)(struct io_backend *io, uint8_t *const *frames, const uint32_t *lens,
+                    size_t count);                                 // Queue several, optional
+    void (*flush)(struct io_backend *io);                          // Kick TX and reap completions
+    void (*cleanup)(struct io_backend *io);
+};
+
+// Backend counters
+struct io_backend_stats {
+    uint64_t rx_packets;
+    uint64_t rx_bytes;
+    uint64_t tx_packets;
+    uint64_t tx_bytes;
+    uint64_t tx_dropped;            // No frame or ring space
+};
+
+// Backend handle
+struct io_backend {
+    const struct io_backend_ops *ops;
+    const char *name;
+    void *priv;
+    struct io_backend_stats stats;
+};
+
+// In-memory backend configuration
+struct mem_backend_config {
+    const struct workload *workload; // Frames replayed on RX (not owned)
+    size_t loops;                   // Replay passes over the workload (0 = 1)
+    bool loopback;                  // Feed transmitted frames back into RX
+    uint32_t tx_ring_size;          // TX ring slots (0 = default)
+};
+
+// Backend constructors
+int io_backend_afxdp_init(struct io_backend *io, struct xdp_socket *xsk_socket,
+                          struct xdp_socket_config *config);
+int io_backend_mem_init(struct io_backend *io, const struct mem_backend_config *config);
+
+// In-memory backend inspection
+size_t io_backend_mem_tx_count(struct io_backend *io);
+const uint8_t *io_backend_mem_tx_frame(struct io_backend *io, size_t index, size_t *len);
+bool io_backend_mem_done(struct io_backend *io);
+
+// Dispatch helpers
+static inline int io_backend_wait(struct io_backend *io, int timeout_ms) {
+    return io->ops->wait(io, timeout_ms);
+}
+
+static inline void io_backend_rx(struct io_backend *io, io_packet_handler handler) {
+    io->ops->rx(io, handler);
+}
+
+static inline uint8_t *io_backend_tx_buffer(struct io_backend *io, size_t *capacity) {
+    return io->ops->tx_buffer(io, capacity);
+}
+
+static inline int io_backend_tx(struct io_backend *io, uint8_t *frame, size_t len) {
+    return io->ops->tx(io, frame, len);
+}
+
+// Queue frames taken from tx_buffer, in one ring update where the backend
+// supports it; 0 when all were queued
+static inline int io_backend_tx_batch(struct io_backend *io, uint8_t *const *frames, const uint32_t *lens,
+                                      size_t count) {
+    if (io->ops->tx_batch) {
+        return io->ops->tx_batch(io, frames, lens, count);
+    }
+
+    int ret = 0;
+    for (size_t i = 0; i < count; i++) {
+        if (io->ops->tx(io, frames[i], lens[i]) != 0) {
+            ret = -ENOBUFS;
+        }
+    }
+    return ret;
+}
+
+static inline void io_backend_flush(struct io_backend *io) {
+    io->ops->flush(io);
+}
+
+static inline void io_backend_cleanup(struct io_backend *io) {
+    if (io->ops && io->ops->cleanup) {
+        io->ops->cleanup(io);
+    }
+}
+
+#endif // IO_BACKEND_H
@@ -0,0 +1,77 @@
+#ifndef LOG_H
+#define LOG_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+// Default configuration values
+#define LOG_RING_RECORDS    8192    // Records buffered per logging thread, a power of two
+#define LOG_MAX_THREADS     64      // Threads that may log
+#define LOG_MAX_ARGS        5       // Arguments carried by one record
+#define LOG_BATCH_SIZE      65536   // Bytes formatted before each write
+#define LOG_FLUSH_MS        10      // Writer sleep between passes over the rings
+#define LOG_RATE_BURST      20      // Lines per second from one call site before suppressing
+
+enum log_level {
+    LOG_LEVEL_DEBUG,
+    LOG_LEVEL_INFO,
+    LOG_LEVEL_WARN,
+    LOG_LEVEL_ERROR,
+    LOG_LEVELS
+};
+
+enum log_format {
+    LOG_FORMAT_TEXT,
+    LOG_FORMAT_JSON                 // One object per line
+};
+
+struct log_config {
+    enum log_level level;           // Records below it are not queued
+    const char *file;               // Appended to, NULL = stderr
+    enum log_format format;
+    bool timestamps;
+    unsigned int rate_burst;        // 0 = never suppress
+};
+
+// One queued message: the call site's format string and its raw
+// arguments. Formatting happens on the writer thread.
+struct log_record {
+    uint64_t time_ns;               // CLOCK_REALTIME
+    const char *fmt;                // Must outlive the logger, a string literal
+    uint8_t level;
+    uint8_t argc;
+    uint64_t args[LOG_MAX_ARGS];    // Integers, double bits or static string pointers
+};
+
+struct log_stats {
+    uint64_t records;               // Queued by the logging threads
+    uint64_t dropped;               // Lost to a full ring
+    uint64_t suppressed;            // Rate limited by the writer
+    uint64_t lines;                 // Written
+    uint64_t writes;                // write(2) calls
+    uint64_t bytes;
+};
+
+// Function declarations
+int log_init(const struct log_config *config);
+void log_destroy(void);
+void log_flush(void);
+void log_get_stats(struct log_stats *stats);
+
+// Hot path: queue a record, never blocks and makes no system call. The
+// format takes printf conversions; %s arguments must be static strings,
+// since they are read when the line is written.
+void log_write(enum log_level level, const char *fmt, ...) __attribute__((format(printf, 2, 3)));
+
+#define log_debug(...) log_write(LOG_LEVEL_DEBUG, __VA_ARGS__)
+#define log_info(...) log_write(LOG_LEVEL_INFO, __VA_ARGS__)
+#define log_warn(...) log_write(LOG_LEVEL_WARN, __VA_ARGS__)
+#define log_error(...) log_write(LOG_LEVEL_ERROR, __VA_ARGS__)
+
+// Helper functions
+int log_level_parse(const char *name, enum log_level *level);
+int log_format_parse(const char *name, enum log_format *format);
+const char *log_level_name(enum log_level level);
+
+#endif // LOG_H
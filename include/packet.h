@@ -0,0 +1,62 @@
+#ifndef PACKET_H
+#define PACKET_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+// Frame layout constants
+#define ETH_ADDR_LEN        6
+#define ETH_HDR_LEN         14
+#define IPV4_HDR_LEN        20
+#define UDP_HDR_LEN         8
+#define PACKET_HDR_LEN      (ETH_HDR_LEN + IPV4_HDR_LEN + UDP_HDR_LEN)
+#define DNS_PORT            53
+
+// How packet_build_udp fills in the UDP checksum
+enum packet_csum_mode {
+    PACKET_CSUM_SOFTWARE,           // Summed over the whole datagram here
+    PACKET_CSUM_OFFLOAD,            // Pseudo-header sum only, the NIC finishes it
+    PACKET_CSUM_NONE                // Left zero, allowed over IPv4
+};
+
+// One side of a UDP flow (ip and port in network byte order)
+struct packet_endpoint {
+    uint8_t mac[ETH_ADDR_LEN];
+    uint32_t ip;
+    uint16_t port;
+};
+
+// Result of parsing an Ethernet/IPv4/UDP frame
+struct packet_info {
+    struct packet_endpoint src;     // Sender
+    struct packet_endpoint dst;     // Receiver
+    const uint8_t *payload;         // UDP payload (the DNS message)
+    size_t payload_len;             // Length of the UDP payload
+    uint8_t ttl;                    // IPv4 TTL
+};
+
+// Function declarations
+int packet_parse(const uint8_t *frame, size_t len, struct packet_info *info);
+int packet_build_udp(uint8_t *frame, size_t frame_len,
+                     const struct packet_endpoint *src, const struct packet_endpoint *dst,
+                     const uint8_t *payload, size_t payload_len);
+int packet_build_reply(uint8_t *frame, size_t frame_len, const struct packet_info *request,
+                       const uint8_t *payload, size_t payload_len);
+uint16_t packet_ipv4_checksum(const void *header, size_t len);
+
+// Readdress a frame built by packet_build_udp, or change one 16-bit word of
+// its payload (even offset), updating both checksums incrementally
+void packet_rewrite_udp(uint8_t *frame, const struct packet_endpoint *src, const struct packet_endpoint *dst);
+void packet_rewrite_payload16(uint8_t *frame, size_t offset, uint16_t value);
+
+// True when the UDP checksum is absent or verifies
+bool packet_udp_checksum_ok(const uint8_t *frame, size_t len);
+
+// Checksum mode, process wide; set before any frame is built
+void packet_set_csum_mode(enum packet_csum_mode mode);
+enum packet_csum_mode packet_get_csum_mode(void);
+int packet_csum_mode_parse(const char *name, enum packet_csum_mode *mode);
+const char *packet_csum_mode_name(enum packet_csum_mode mode);
+
+#endif // PACKET_H
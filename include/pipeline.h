@@ -0,0 +1,40 @@
+#ifndef PIPELINE_H
+#define PIPELINE_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+struct io_backend;
+struct packet_info;
+
+// Receives DNS responses (QR=1) seen by the pipeline
+typedef void (*pipeline_response_handler)(const struct packet_info *info);
+
+// Per-stage packet counters
+struct pipeline_stats {
+    uint64_t packets;               // Frames handed to the pipeline
+    uint64_t malformed;             // Not IPv4/UDP/DNS or truncated
+    uint64_t queries;               // DNS queries (QR=0)
+    uint64_t responses;             // DNS responses (QR=1)
+    uint64_t policy_answers;        // Queries blocked or redirected by a policy rule
+    uint64_t zone_answers;          // Queries answered from a loaded zone
+    uint64_t cache_hits;            // Queries answered from the cache
+    uint64_t cache_misses;          // Queries not in the cache
+    uint64_t ecs_queries;           // Queries carrying a client subnet
+    uint64_t truncated;             // Replies cut to the client's UDP limit
+    uint64_t relayed;               // Upstream answers sent on to clients
+    uint64_t unforwarded;           // Misses that could not be sent upstream
+    uint64_t validations;           // Signed answers queued for DNSSEC validation
+    uint64_t secure_hits;           // Cache hits answered with AD set
+    uint64_t replies;               // Frames queued for TX
+    uint64_t tx_failures;           // Frames that could not be queued
+};
+
+// Function declarations
+void pipeline_init(struct io_backend *io);
+void pipeline_set_response_handler(pipeline_response_handler handler);
+void pipeline_process_packet(const uint8_t *packet, size_t length);
+void pipeline_get_stats(struct pipeline_stats *stats);
+void pipeline_reset_stats(void);
+
+#endif // PIPELINE_H
@@ -0,0 +1,43 @@
+#ifndef POLICY_H
+#define POLICY_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+// Default configuration values
+#define POLICY_MAX_FILES        16      // Rule files loaded together
+#define POLICY_MAX_REDIRECTS    4096    // Distinct redirect targets
+#define POLICY_TTL              60      // TTL of synthesized redirect records
+
+// What a matching rule does with the query
+enum policy_action {
+    POLICY_NONE = 0,                // No rule matched
+    POLICY_PASSTHRU,                // Exempt from broader rules, resolved normally
+    POLICY_NXDOMAIN,
+    POLICY_NODATA,
+    POLICY_REDIRECT,                // Answer with the rule's address
+    POLICY_ACTIONS
+};
+
+// Loaded rules and what they caught
+struct policy_stats {
+    size_t rules;
+    size_t names;                   // Distinct rule names in the table
+    size_t table_bytes;
+    uint64_t build_ns;
+    uint64_t matches[POLICY_ACTIONS];
+};
+
+// Function declarations; errors are logged by path, so the paths must
+// outlive the logger
+int policy_load(const char *const *paths, size_t count);
+void policy_destroy(void);
+void policy_get_stats(struct policy_stats *stats);
+const char *policy_action_name(enum policy_action action);
+
+// Hot path: the response template for a blocked query, written with
+// zone_write, or NULL when the query goes on to the zones and the cache
+const uint8_t *policy_lookup(const uint8_t *msg, size_t question_end, size_t *template_len,
+                             enum policy_action *action);
+
+#endif // POLICY_H
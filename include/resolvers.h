@@ -0,0 +1,70 @@
+#ifndef RESOLVERS_H
+#define RESOLVERS_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+#define RESOLVER_DESC_LEN   64
+
+// Default configuration values
+#define RESOLVER_INITIAL_RTT_US         50000   // Assumed until the first answer
+#define RESOLVER_QUARANTINE_FAILURES    5       // Consecutive timeouts before quarantine
+#define RESOLVER_QUARANTINE_MS          1000    // First quarantine, doubled by each failed probe
+#define RESOLVER_QUARANTINE_MAX_MS      60000
+
+// How queries are spread over the resolvers
+enum resolver_select {
+    RESOLVER_SELECT_P2C,            // Cheaper of two random healthy resolvers
+    RESOLVER_SELECT_ROUND_ROBIN
+};
+
+// Health of one resolver, fed by the answers and timeouts of its queries
+struct resolver_health {
+    uint64_t queries;               // Sent, including retransmits and probes
+    uint64_t answers;
+    uint64_t timeouts;
+    uint32_t srtt_us;               // Smoothed RTT (RFC 6298), 0 = no sample yet
+    uint32_t rttvar_us;
+    double loss;                    // Moving average of queries timed out, 0-1
+    uint32_t inflight;
+    uint32_t failures;              // Consecutive timeouts
+    uint64_t quarantined_until_ns;  // Next probe while quarantined, 0 = healthy
+    uint32_t backoff_ms;            // Current quarantine length
+    bool probing;                   // A probe is outstanding
+    uint64_t quarantines;
+    uint64_t probes;
+};
+
+// Upstream resolver
+struct resolver {
+    uint32_t ip;                    // IPv4 address, network byte order
+    uint16_t port;                  // UDP/TCP port, network byte order
+    char desc[RESOLVER_DESC_LEN];   // Comment from the resolvers file
+    struct resolver_health health;
+};
+
+// Function declarations
+int resolvers_load(const char *path);
+int resolvers_add(uint32_t ip, uint16_t port, const char *desc);
+size_t resolvers_count(void);
+const struct resolver *resolvers_get(size_t index);
+int resolvers_find(uint32_t ip, uint16_t port);
+int resolvers_next(void);
+void resolvers_destroy(void);
+
+// Health-aware selection: avoid is the resolver a retransmit should not go
+// back to (-1 = none). Every query sent is reported as answered or timed
+// out; rtt_ns is 0 when the answer may belong to an earlier transmission.
+void resolvers_set_select(enum resolver_select mode);
+int resolvers_select(uint64_t now_ns, int avoid);
+void resolvers_sent(int index);
+void resolvers_answered(int index, uint64_t rtt_ns);
+void resolvers_timed_out(int index, uint64_t now_ns);
+bool resolvers_quarantined(int index);
+
+// Helper functions
+int resolvers_select_parse(const char *name, enum resolver_select *mode);
+const char *resolvers_select_name(enum resolver_select mode);
+
+#endif // RESOLVERS_H
@@ -0,0 +1,68 @@
+#ifndef SCAN_H
+#define SCAN_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "dns_query.h"
+#include "packet.h"
+
+struct io_backend;
+
+// Default configuration values
+#define SCAN_MAX_INFLIGHT   65536   // One slot per DNS message ID
+#define SCAN_TIMEOUT_MS     1000
+#define SCAN_RETRIES        3
+#define SCAN_SRC_PORT       45353   // Shard i sends from SCAN_SRC_PORT + i % SCAN_SHARD_PORTS
+#define SCAN_SHARD_PORTS    1024
+#define SCAN_CHECKPOINT_INTERVAL 10 // Seconds between checkpoints
+
+// Bulk-resolver configuration
+struct scan_config {
+    const char *domains_file;       // One domain per line, '#' comments
+    const char *output_file;        // JSON lines per domain (NULL = none)
+    enum DnsQType qtype;            // Record type queried for every domain
+    uint32_t rate_limit;            // Queries per second (0 = unlimited)
+    uint32_t timeout_ms;            // Retransmit after this long (0 = default)
+    uint32_t retries;               // Retransmits before giving up
+    uint32_t max_inflight;          // Outstanding queries (0 = default)
+    struct packet_endpoint src;     // Our MAC, IP and source port
+    uint8_t gateway_mac[ETH_ADDR_LEN]; // Next hop towards the resolvers
+    bool tcp_fallback;              // Retry truncated answers over TCP
+    uint16_t edns_buffer_size;      // Advertised UDP size (0 = no OPT record)
+    uint32_t shard_index;           // This instance's part of the input
+    uint32_t shard_count;           // Instances splitting the input (0 or 1 = all of it)
+    const char *checkpoint_file;    // Progress saved here (NULL = none)
+    uint32_t checkpoint_interval;   // Seconds between checkpoints (0 = default)
+    bool resume;                    // Continue from checkpoint_file if it exists
+};
+
+// Scan counters
+struct scan_stats {
+    uint64_t domains;               // Domains of this shard read from the input
+    uint64_t other_shards;          // Domains left to the other shards
+    uint64_t queries;               // UDP queries sent, including retransmits
+    uint64_t retransmits;           // Queries resent after a timeout
+    uint64_t answers;               // Domains completed with an answer
+    uint64_t timeouts;              // Domains that exhausted their retries
+    uint64_t truncated;             // Answers with TC set
+    uint64_t tcp_answers;           // Truncated answers completed over TCP
+    uint64_t tcp_failures;          // Truncated answers TCP could not complete
+    uint64_t tx_failures;           // Queries the backend did not accept
+    uint64_t unmatched;             // Responses matching no outstanding query
+    uint64_t rcodes[16];            // Answers by RCODE
+    uint64_t checkpoints;           // Checkpoint files written
+    uint64_t resumed;               // Outstanding domains taken over from a checkpoint
+};
+
+// Function declarations
+int scan_init(const struct scan_config *config, struct io_backend *io);
+void scan_tick(void);
+void scan_handle_response(const struct packet_info *info);
+bool scan_done(void);
+size_t scan_inflight(void);
+int scan_checkpoint(void);
+uint32_t scan_shard_of(const char *domain, uint32_t shard_count);
+void scan_get_stats(struct scan_stats *stats);
+void scan_destroy(void);
+
+#endif // SCAN_H
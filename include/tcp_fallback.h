@@ -0,0 +1,45 @@
+#ifndef TCP_FALLBACK_H
+#define TCP_FALLBACK_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+// Default configuration values
+#define TCP_CONNS_PER_RESOLVER  2
+#define TCP_MAX_PIPELINE        32
+#define TCP_QUERY_TIMEOUT_MS    5000
+#define TCP_IDLE_TIMEOUT_MS     10000
+#define TCP_MAX_QUERY           512     // Largest query accepted by tcp_fallback_submit
+#define TCP_MAX_MESSAGE         65535   // Largest DNS message over TCP
+
+// TCP fallback configuration
+struct tcp_fallback_config {
+    size_t conns_per_resolver;      // Connections opened per resolver (0 = default)
+    size_t max_pipeline;            // Queries in flight per connection (0 = default)
+    uint32_t query_timeout_ms;      // Per-query deadline (0 = default)
+    uint32_t idle_timeout_ms;       // Idle connections are closed after this (0 = default)
+};
+
+// TCP fallback counters
+struct tcp_fallback_stats {
+    uint64_t queries;               // Queries submitted
+    uint64_t answers;               // Answers delivered
+    uint64_t failures;              // Queries failed (timeout, reset, refused)
+    uint64_t retries;               // Queries resent after a connection closed
+    uint64_t connects;              // Connections opened
+    uint64_t reused;                // Queries sent on an already established connection
+    uint64_t max_pipelined;         // Deepest pipeline seen on one connection
+};
+
+// Called with the answer (status 0) or a negative errno and no message
+typedef void (*tcp_answer_handler)(uint64_t cookie, const uint8_t *msg, size_t len, int status);
+
+// Function declarations
+int tcp_fallback_init(const struct tcp_fallback_config *config, tcp_answer_handler handler);
+int tcp_fallback_submit(uint32_t ip, uint16_t port, const uint8_t *query, size_t len, uint64_t cookie);
+int tcp_fallback_poll(int timeout_ms);
+size_t tcp_fallback_pending(void);
+void tcp_fallback_get_stats(struct tcp_fallback_stats *stats);
+void tcp_fallback_destroy(void);
+
+#endif // TCP_FALLBACK_H
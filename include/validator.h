@@ -0,0 +1,76 @@
+#ifndef VALIDATOR_H
+#define VALIDATOR_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include "cache.h"
+
+// Default configuration values
+#define VALIDATOR_MAX_WORKERS   16      // Crypto threads
+#define VALIDATOR_RING_JOBS     512     // Answers queued per worker, a power of two
+#define VALIDATOR_BATCH         32      // Jobs a worker verifies before publishing their results
+#define VALIDATOR_IDLE_US       100     // Worker sleep while its ring is empty
+#define VALIDATOR_ZONES         1024    // Zones whose DNSKEY and DS sets the workers keep
+#define VALIDATOR_MAX_ANCHORS   16      // Trust anchor records
+#define VALIDATOR_MAX_DEPTH     32      // Delegations followed up from a signer to an anchor
+
+// Outcome of validating one answer (RFC 4035 section 4.3)
+enum validator_status {
+    VALIDATOR_SECURE,               // The question's RRset (or CNAME chain to it) verified up to a trust anchor
+    VALIDATOR_INSECURE,             // Unsigned, negative, a wildcard expansion, off the question,
+                                    // or signed only with unsupported algorithms
+    VALIDATOR_BOGUS,                // A signature or the chain of trust failed
+    VALIDATOR_INDETERMINATE,        // Keys or DS records needed for the chain not seen yet
+    VALIDATOR_STATUSES
+};
+
+struct validator_config {
+    unsigned int workers;           // Crypto threads (0 = 1)
+    const char *anchors_file;       // DS or DNSKEY records in master file format, NULL = root KSKs
+};
+
+// Counters of one crypto thread
+struct validator_worker_stats {
+    uint64_t validated;             // Answers finished
+    uint64_t batches;               // Passes over the ring that found work
+    uint64_t signatures;            // Public key operations
+    uint64_t memo_hits;             // Signatures already verified over the same data
+    uint64_t busy_ns;               // Time spent on batches
+};
+
+struct validator_stats {
+    uint64_t queued;                // Answers handed to the workers
+    uint64_t dropped;               // Not queued, every ring full
+    uint64_t results[VALIDATOR_STATUSES];
+    uint64_t marked;                // Cache entries marked secure
+    uint64_t key_sets;              // DNSKEY sets that reached a trust anchor
+    uint64_t wall_ns;               // Since validator_init
+    struct validator_worker_stats total;
+};
+
+// Function declarations
+int validator_init(const struct validator_config *config);
+bool validator_running(void);
+unsigned int validator_workers(void);
+void validator_destroy(void);
+
+// Packet core, single producer: copy an answer cached under domain and
+// scope to a worker. Never blocks; -EAGAIN when every ring is full.
+int validator_submit(const char *domain, const struct cache_scope *scope,
+                     const uint8_t *response, size_t response_len);
+
+// Packet core: apply finished validations to the cache, returns how many
+size_t validator_poll(void);
+
+// Jobs queued and not yet polled
+size_t validator_pending(void);
+
+// Wait until the workers have finished everything queued (tests, benchmarks)
+void validator_flush(void);
+
+void validator_get_stats(struct validator_stats *stats);
+void validator_get_worker_stats(unsigned int worker, struct validator_worker_stats *stats);
+const char *validator_status_name(enum validator_status status);
+
+#endif // VALIDATOR_H
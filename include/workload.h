@@ -0,0 +1,41 @@
+#ifndef WORKLOAD_H
+#define WORKLOAD_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+// A replayable list of Ethernet frames kept in one arena
+struct workload {
+    uint8_t *data;                  // Frame bytes, back to back
+    size_t data_len;                // Bytes used in data
+    size_t data_cap;                // Bytes allocated for data
+    size_t *offsets;                // Start of each frame in data
+    uint32_t *lengths;              // Length of each frame
+    size_t count;                   // Number of frames
+    size_t capacity;                // Slots allocated in offsets/lengths
+};
+
+// Synthetic DNS query workload
+struct workload_config {
+    size_t packets;                 // Frames to generate
+    size_t domains;                 // Distinct query names
+    double zipf_s;                  // Zipf exponent over names (0 = uniform)
+    size_t clients;                 // Distinct client addresses
+    uint32_t seed;                  // PRNG seed, equal seeds give equal workloads
+    uint8_t ecs_prefix;             // Attach the client's subnet of this length (0 = no ECS)
+    double random_subdomains;       // Fraction of queries for a fresh random label (one-hit wonders)
+};
+
+// Function declarations
+int workload_add(struct workload *wl, const uint8_t *frame, size_t len);
+int workload_load_pcap(struct workload *wl, const char *path);
+int workload_synthesize(struct workload *wl, const struct workload_config *config);
+void workload_free(struct workload *wl);
+
+// Frame accessor
+static inline const uint8_t *workload_frame(const struct workload *wl, size_t index, size_t *len) {
+    *len = wl->lengths[index];
+    return wl->data + wl->offsets[index];
+}
+
+#endif // WORKLOAD_H
@@ -0,0 +1,55 @@
+#ifndef XDP_FILTER_H
+#define XDP_FILTER_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// Default configuration values
+#define XDP_FILTER_BURST        0       // 0 = one second worth of queries
+#define XDP_FILTER_SLIP         2       // Every other limited query gets a TC answer
+#define XDP_FILTER_PREFIX       24      // Sources in one /24 share a bucket
+
+#ifndef WHACK_BPF_OBJ
+#define WHACK_BPF_OBJ           "whack_filter.bpf.o"
+#endif
+
+// Lists enforced by the XDP program
+enum xdp_filter_list {
+    XDP_FILTER_ALLOW,
+    XDP_FILTER_DENY
+};
+
+// XDP filter configuration
+struct xdp_filter_config {
+    const char *ifname;             // Interface to attach to
+    const char *object_path;        // Compiled bpf/whack_filter.bpf.c (NULL = WHACK_BPF_OBJ)
+    bool generic;                   // Attach in generic (SKB) mode
+    uint32_t rate_limit;            // Queries per second per source prefix (0 = off)
+    uint32_t burst;                 // Bucket depth (0 = rate_limit)
+    uint32_t slip;                  // TC answer every Nth limited query (0 = drop all)
+    uint8_t prefix;                 // Source prefix length sharing a bucket (0 = default)
+    const char *allow_file;         // CIDRs allowed to query, one per line (NULL = all)
+    const char *deny_file;          // CIDRs dropped outright, one per line
+};
+
+// Verdicts taken by the XDP program, summed over CPUs
+struct xdp_filter_stats {
+    uint64_t passed;                // Left to the kernel stack
+    uint64_t redirected;            // Delivered to the AF_XDP socket
+    uint64_t denied;                // Deny list drops
+    uint64_t not_allowed;           // Allow list drops
+    uint64_t rate_limited;          // Token bucket drops
+    uint64_t slipped;               // Truncated answers sent from XDP
+};
+
+// Function declarations
+int xdp_filter_init(const struct xdp_filter_config *config);
+int xdp_filter_xsks_map_fd(void);
+int xdp_filter_set_limits(uint32_t rate, uint32_t burst, uint32_t slip, uint8_t prefix);
+int xdp_filter_add(enum xdp_filter_list list, const char *cidr);
+int xdp_filter_remove(enum xdp_filter_list list, const char *cidr);
+int xdp_filter_reload(void);
+int xdp_filter_get_stats(struct xdp_filter_stats *stats);
+void xdp_filter_destroy(void);
+
+#endif // XDP_FILTER_H
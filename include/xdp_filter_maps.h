@@ -0,0 +1,47 @@
+#ifndef XDP_FILTER_MAPS_H
+#define XDP_FILTER_MAPS_H
+
+// Map layouts shared by bpf/whack_filter.bpf.c and src/xdp_filter.c
+
+#include <linux/types.h>
+
+#define XDP_FILTER_MAX_CIDRS    65536   // Entries per allow/deny list
+#define XDP_FILTER_MAX_SOURCES  1048576 // Rate-limit buckets, least recently used evicted
+#define XDP_FILTER_MAX_QUEUES   64      // XSKMAP slots, indexed by RX queue
+#define XDP_FILTER_TOKEN        1000000000ULL // One token in bucket units (ns * queries/s)
+
+// LPM trie key for IPv4 CIDRs
+struct xdp_filter_lpm_key {
+    __u32 prefixlen;                // Significant bits of addr
+    __u32 addr;                     // Network byte order
+};
+
+// Rate limiting parameters, the single entry of the "limits" array map
+struct xdp_filter_limits {
+    __u32 rate;                     // Queries per second per bucket (0 = no limit)
+    __u32 burst;                    // Bucket depth in queries
+    __u32 slip;                     // Answer every Nth limited query with TC (0 = drop all)
+    __u32 prefix;                   // Source bits sharing one bucket
+    __u32 allow_only;               // Drop queries from sources not in the allow list
+};
+
+// Token bucket per source prefix
+struct xdp_filter_bucket {
+    __u64 tokens;                   // In XDP_FILTER_TOKEN units
+    __u64 last_ns;                  // Last refill
+    __u32 limited;                  // Queries over the limit, drives slip
+    __u32 pad;
+};
+
+// Per-CPU verdict counters
+enum xdp_filter_counter {
+    XDP_FILTER_PASSED,              // Not DNS or no AF_XDP socket, left to the kernel
+    XDP_FILTER_REDIRECTED,          // Handed to the AF_XDP socket
+    XDP_FILTER_DENIED,              // Source in the deny list
+    XDP_FILTER_NOT_ALLOWED,         // Query from a source outside the allow list
+    XDP_FILTER_RATE_LIMITED,        // Dropped by the token bucket
+    XDP_FILTER_SLIPPED,             // Limited, answered with TC from XDP
+    XDP_FILTER_COUNTERS
+};
+
+#endif // XDP_FILTER_MAPS_H
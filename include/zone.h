@@ -0,0 +1,37 @@
+#ifndef ZONE_H
+#define ZONE_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "dns_query.h"
+
+// Default configuration values
+#define ZONE_MAX_FILES      16      // Master files loaded together
+#define ZONE_DEFAULT_TTL    3600    // Records before any $TTL or explicit TTL
+#define ZONE_MAX_CNAME      8       // CNAME hops followed inside the zone data
+#define ZONE_BUCKET_KEYS    4       // Average names per perfect hash bucket
+#define ZONE_MAX_TEMPLATE   16384   // Largest precomputed answer
+
+// What the loaded index holds
+struct zone_stats {
+    size_t zones;                   // SOA records, one per zone apex
+    size_t names;                   // Owner names plus empty non-terminals
+    size_t records;
+    size_t answers;                 // Precomputed response templates
+    size_t index_bytes;             // Read-only arena the hot path reads
+    uint64_t build_ns;              // Parse and compile time of the last load
+};
+
+// Function declarations; errors are logged by path, so the paths must
+// outlive the logger
+int zone_load(const char *const *paths, size_t count);
+void zone_destroy(void);
+void zone_get_stats(struct zone_stats *stats);
+
+// Hot path: find the template answering a query, then write the reply.
+// zone_write takes any template of this layout, policy answers included.
+const uint8_t *zone_lookup(const uint8_t *msg, size_t question_end, size_t *template_len);
+int zone_write(const uint8_t *tmpl, size_t template_len, const uint8_t *msg, size_t question_end,
+               const struct dns_edns *edns, uint8_t *out, size_t out_len);
+
+#endif // ZONE_H
@@ -0,0 +1,50 @@
+#!/bin/bash
+
+# Run a bulk scan as SHARDS whack processes on one host, shard i bound to NIC
+# queue i, and restart any shard that dies until its checkpoint says the
+# shard is complete. Results land in OUT/shard-<i>.json. Answers are steered
+# to each shard's queue by its source port (45353 + i).
+#
+# Usage: sudo ./scripts/shard_scan.sh <interface> <shards> <out_dir> [whack options]
+#   e.g. sudo ./scripts/shard_scan.sh eth0 4 /data/scan -d domains.txt -r resolvers.txt
+
+set -e
+
+IF=$1
+SHARDS=$2
+OUT=$3
+shift 3 || { echo "Usage: $0 <interface> <shards> <out_dir> [whack options]"; exit 1; }
+WHACK=${WHACK:-./build/whack}
+
+if [ "$EUID" -ne 0 ]; then
+    echo "Error: Please run as root (sudo)"
+    exit 1
+fi
+
+mkdir -p "$OUT"
+rm -f "$OUT/.stop"
+
+# One ntuple rule per shard; drivers without ntuple support need RSS to do
+for ((i = 0; i < SHARDS; i++)); do
+    ethtool -N "$IF" flow-type udp4 dst-port $((45353 + i)) action "$i" >/dev/null 2>&1 || true
+done
+
+run_shard() {
+    local i=$1
+    shift
+    local ckpt="$OUT/shard-$i.ckpt"
+    until grep -q '^status complete' "$ckpt" 2>/dev/null || [ -e "$OUT/.stop" ]; do
+        "$WHACK" -i "$IF" --queue "$i" --shard "$i/$SHARDS" --checkpoint "$ckpt" --resume \
+            -o "$OUT/shard-$i.json" "$@" > "$OUT/shard-$i.log" 2>&1 || true
+        grep -q '^status complete' "$ckpt" 2>/dev/null || sleep 1
+    done
+}
+
+for ((i = 0; i < SHARDS; i++)); do
+    run_shard "$i" "$@" &
+done
+# Interrupted shards write a checkpoint, rerun this script to carry on
+trap 'touch "$OUT/.stop"; pkill -INT -f "$WHACK -i $IF" || true' INT TERM
+wait
+
+cat "$OUT"/shard-*.json | wc -l | xargs echo "Results:"
@@ -0,0 +1,82 @@
+#!/bin/bash
+
+# Flood whack over the veth pair from scripts/veth_setup.sh and report what
+# the XDP filter did with it. Queries come from SOURCES spoofed addresses in
+# 10.201.0.0/16 (one per /24, so each gets its own bucket) plus one deny-listed
+# network, at full speed for DURATION seconds.
+#
+# Usage: sudo ./scripts/veth_flood.sh [build_dir] [duration] [sources]
+
+set -e
+
+BUILD=${1:-build}
+DURATION=${2:-10}
+SOURCES=${3:-64}
+RATE=${RATE:-100}
+
+NS=whack-peer
+HOST_IF=whack0
+HOST_IP=10.200.0.1
+DIR=$(cd "$(dirname "$0")" && pwd)
+TMP=$(mktemp -d)
+
+if [ "$EUID" -ne 0 ]; then
+    echo "Error: Please run as root (sudo)"
+    exit 1
+fi
+
+cleanup() {
+    [ -n "$WHACK_PID" ] && kill "$WHACK_PID" 2>/dev/null || true
+    rm -rf "$TMP"
+    "$DIR/veth_setup.sh" down >/dev/null
+}
+trap cleanup EXIT
+
+"$DIR/veth_setup.sh" up >/dev/null
+HOST_MAC=$(cat /sys/class/net/$HOST_IF/address)
+
+echo "10.202.0.0/16" > "$TMP/deny.txt"
+echo "10.200.0.2" > "$TMP/resolvers.txt"
+
+# Stats are printed on SIGINT, after the filter counters are read
+"$BUILD/whack" -i "$HOST_IF" --generic -r "$TMP/resolvers.txt" \
+    --rate-limit-ip "$RATE" --deny "$TMP/deny.txt" > "$TMP/whack.log" 2>&1 &
+WHACK_PID=$!
+sleep 2
+
+echo "Flooding $HOST_IP for ${DURATION}s from $SOURCES sources (limit ${RATE}/s each)..."
+ip netns exec "$NS" python3 - "$HOST_IP" "$HOST_MAC" "$DURATION" "$SOURCES" <<'EOF'
+import socket, struct, sys, time
+
+dst, dst_mac, duration, sources = sys.argv[1], sys.argv[2], float(sys.argv[3]), int(sys.argv[4])
+question = b"\x07example\x03com\x00\x00\x01\x00\x01"
+
+def frame(src, qid):
+    dns = struct.pack("!6H", qid, 0x0100, 1, 0, 0, 0) + question
+    udp = struct.pack("!4H", 40000 + qid % 20000, 53, 8 + len(dns), 0) + dns
+    ip = struct.pack("!BBHHHBBH4s4s", 0x45, 0, 20 + len(udp), 0, 0, 64, 17, 0,
+                     socket.inet_aton(src), socket.inet_aton(dst))
+    csum = sum(struct.unpack("!10H", ip))
+    csum = (csum & 0xFFFF) + (csum >> 16)
+    csum = ~((csum & 0xFFFF) + (csum >> 16)) & 0xFFFF
+    ip = ip[:10] + struct.pack("!H", csum) + ip[12:]
+    return bytes.fromhex(dst_mac.replace(":", "")) + b"\x02\x00\x00\x00\x00\x01\x08\x00" + ip + udp
+
+s = socket.socket(socket.AF_PACKET, socket.SOCK_RAW)
+s.bind(("whack1", 0))
+srcs = ["10.201.%d.1" % (i % 256) for i in range(sources)] + ["10.202.0.1"]
+frames = [frame(src, i) for i, src in enumerate(srcs)]
+
+sent, end = 0, time.time() + duration
+while time.time() < end:
+    for f in frames:
+        s.send(f)
+    sent += len(frames)
+print("sent %d queries (%.0f/s)" % (sent, sent / duration))
+EOF
+
+kill -INT "$WHACK_PID"
+wait "$WHACK_PID" || true
+WHACK_PID=
+echo ""
+sed -n '/XDP filter/,$p' "$TMP/whack.log"
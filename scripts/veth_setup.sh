@@ -0,0 +1,66 @@
+#!/bin/bash
+
+# Create a veth pair with one end in a network namespace so whack can be run
+# in generic XDP mode without a physical NIC.
+#
+#   host:  whack0 10.200.0.1/24  <-->  whack1 10.200.0.2/24  :netns whack-peer
+#
+# Usage: sudo ./scripts/veth_setup.sh [up|down]
+
+set -e
+
+NS=whack-peer
+HOST_IF=whack0
+PEER_IF=whack1
+HOST_IP=10.200.0.1
+PEER_IP=10.200.0.2
+
+if [ "$EUID" -ne 0 ]; then
+    echo "Error: Please run as root (sudo)"
+    exit 1
+fi
+
+down() {
+    ip link del "$HOST_IF" 2>/dev/null || true
+    ip netns del "$NS" 2>/dev/null || true
+}
+
+up() {
+    down
+    ip netns add "$NS"
+    ip link add "$HOST_IF" type veth peer name "$PEER_IF"
+    ip link set "$PEER_IF" netns "$NS"
+
+    ip addr add "$HOST_IP/24" dev "$HOST_IF"
+    ip link set "$HOST_IF" up
+    ip netns exec "$NS" ip addr add "$PEER_IP/24" dev "$PEER_IF"
+    ip netns exec "$NS" ip link set "$PEER_IF" up
+    ip netns exec "$NS" ip link set lo up
+
+    # Generic XDP sees frames after GRO, and whack does not fill in UDP
+    # checksums the peer would otherwise insist on
+    ethtool -K "$HOST_IF" gro off tx off rx off >/dev/null 2>&1 || true
+    ip netns exec "$NS" ethtool -K "$PEER_IF" gro off tx off rx off >/dev/null 2>&1 || true
+
+    echo "veth ready: $HOST_IF ($HOST_IP) <-> $PEER_IF ($PEER_IP, netns $NS)"
+    echo ""
+    echo "Run whack on the host side in generic mode:"
+    echo "  sudo ./build/whack -i $HOST_IF --generic -d examples/domains.txt -r examples/resolvers.txt"
+    echo ""
+    echo "Send queries from the peer:"
+    echo "  sudo ip netns exec $NS dig @$HOST_IP example.com"
+}
+
+case "${1:-up}" in
+    up)
+        up
+        ;;
+    down)
+        down
+        echo "veth removed"
+        ;;
+    *)
+        echo "Usage: $0 [up|down]"
+        exit 1
+        ;;
+esac
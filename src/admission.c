@@ -0,0 +1,155 @@
+#include "../include/admission.h"
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#define SKETCH_ROWS     4
+#define BLOCK_WORDS     8           // One cache line, two words per row
+#define DOORKEEPER_BITS 8           // Doorkeeper bits per sketch counter
+
+// Static filter state: a count-min sketch of 4-bit counters, 16 to a word,
+// and a Bloom filter doorkeeper in front of it. A key's four counters share
+// one 64-byte block and its two doorkeeper bits one word, so recording an
+// access touches two cache lines.
+static uint64_t *sketch = NULL;
+static uint64_t *doorkeeper = NULL;
+static size_t block_mask = 0;
+static size_t door_mask = 0;        // Doorkeeper words - 1
+static size_t sample_size = 0;
+static size_t additions = 0;
+static uint64_t agings = 0;
+
+// The cache's 32-bit name hash, spread over 64 bits
+static uint64_t mix(uint32_t hash) {
+    uint64_t x = hash;
+    x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    x = (x ^ (x >> 27)) * 0x94D049BB133111EBULL;
+    return x ^ (x >> 31);
+}
+
+// Counter of row for x, as a nibble index into the sketch: the block comes
+// from the high half, the word and nibble within it from the low bits
+static size_t counter_index(uint64_t x, unsigned row) {
+    size_t block = (size_t)(x >> 32) & block_mask;
+    size_t word = row * 2 + ((x >> row) & 1);
+    size_t nibble = (x >> (SKETCH_ROWS + row * 4)) & 0xF;
+    return (block * BLOCK_WORDS + word) * 16 + nibble;
+}
+
+static unsigned counter_get(size_t index) {
+    return (sketch[index / 16] >> (index % 16 * 4)) & 0xF;
+}
+
+static bool door_test(uint64_t x, bool set) {
+    uint64_t y = x * 0x9E3779B97F4A7C15ULL;
+    uint64_t *word = &doorkeeper[(y >> 32) & door_mask];
+    uint64_t bits = (1ULL << (y & 63)) | (1ULL << ((y >> 6) & 63));
+    bool present = (*word & bits) == bits;
+
+    if (set) {
+        *word |= bits;
+    }
+    return present;
+}
+
+// Halve every counter and forget the doorkeeper, so old popularity fades
+static void age(void) {
+    size_t words = (block_mask + 1) * BLOCK_WORDS;
+    for (size_t i = 0; i < words; i++) {
+        sketch[i] = (sketch[i] >> 1) & 0x7777777777777777ULL;
+    }
+    memset(doorkeeper, 0, (door_mask + 1) * sizeof(*doorkeeper));
+    additions /= 2;
+    agings++;
+}
+
+static size_t round_pow2(size_t n) {
+    size_t p = 1;
+    while (p < n) {
+        p <<= 1;
+    }
+    return p;
+}
+
+int admission_init(const struct admission_config *config) {
+    admission_destroy();
+
+    size_t counters = config->counters ? config->counters : config->entries;
+    counters = round_pow2(counters < ADMISSION_MIN_COUNTERS ? ADMISSION_MIN_COUNTERS : counters);
+
+    sketch = calloc(SKETCH_ROWS * counters / 16, sizeof(*sketch));
+    doorkeeper = calloc(counters * DOORKEEPER_BITS / 64, sizeof(*doorkeeper));
+    if (!sketch || !doorkeeper) {
+        admission_destroy();
+        return -ENOMEM;
+    }
+
+    block_mask = SKETCH_ROWS * counters / 16 / BLOCK_WORDS - 1;
+    door_mask = counters * DOORKEEPER_BITS / 64 - 1;
+    sample_size = config->sample_size ? config->sample_size
+                                      : (config->entries ? config->entries : 1) * ADMISSION_SAMPLE_FACTOR;
+    additions = 0;
+    agings = 0;
+    return 0;
+}
+
+// The first access only sets doorkeeper bits, repeats go to the sketch
+void admission_record(uint32_t hash) {
+    if (!sketch) {
+        return;
+    }
+
+    uint64_t x = mix(hash);
+    if (door_test(x, true)) {
+        // Conservative update: only the smallest counters grow
+        size_t index[SKETCH_ROWS];
+        unsigned min = 15;
+        for (unsigned row = 0; row < SKETCH_ROWS; row++) {
+            index[row] = counter_index(x, row);
+            unsigned count = counter_get(index[row]);
+            min = count < min ? count : min;
+        }
+        if (min < 15) {
+            for (unsigned row = 0; row < SKETCH_ROWS; row++) {
+                if (counter_get(index[row]) == min) {
+                    sketch[index[row] / 16] += 1ULL << (index[row] % 16 * 4);
+                }
+            }
+        }
+    }
+
+    if (++additions >= sample_size) {
+        age();
+    }
+}
+
+uint32_t admission_estimate(uint32_t hash) {
+    if (!sketch) {
+        return 0;
+    }
+
+    uint64_t x = mix(hash);
+    unsigned min = 15;
+    for (unsigned row = 0; row < SKETCH_ROWS; row++) {
+        unsigned count = counter_get(counter_index(x, row));
+        min = count < min ? count : min;
+    }
+    return min + door_test(x, false);
+}
+
+// Admit only a name seen more often than the one it would displace
+bool admission_admit(uint32_t candidate, uint32_t victim) {
+    return !sketch || admission_estimate(candidate) > admission_estimate(victim);
+}
+
+uint64_t admission_agings(void) {
+    return agings;
+}
+
+void admission_destroy(void) {
+    free(sketch);
+    free(doorkeeper);
+    sketch = NULL;
+    doorkeeper = NULL;
+    block_mask = door_mask = 0;
+}
@@ -1,18 +1,128 @@
 #include "../include/af_xdp_init.h"
+#include "../include/hugemem.h"
+#include "../include/packet.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <errno.h>
-#include <sys/mman.h>
 #include <sys/resource.h>
 #include <poll.h>
+#include <time.h>
 #include <unistd.h>
+#include <sys/socket.h>
+
+#ifdef XSK_TX_METADATA
+#include <linux/genetlink.h>
+#include <linux/netlink.h>
+#include <linux/netdev.h>
+#endif
 
 #ifndef SOL_XDP
 #define SOL_XDP 283
 #endif
 
-static int xsk_configure_umem(struct xdp_socket *xsk_socket) {
+static inline uint64_t clock_ns(clockid_t clock) {
+    struct timespec ts;
+    clock_gettime(clock, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+#ifdef XSK_TX_METADATA
+// Send one generic netlink request, the reply lands in buf
+static int genl_request(int fd, struct nlmsghdr *req, void *buf, size_t len) {
+    if (send(fd, req, req->nlmsg_len, 0) < 0) {
+        return -errno;
+    }
+    ssize_t n = recv(fd, buf, len, 0);
+    if (n < 0) {
+        return -errno;
+    }
+    const struct nlmsghdr *nlh = buf;
+    if (!NLMSG_OK(nlh, (size_t)n) || nlh->nlmsg_type == NLMSG_ERROR) {
+        return -EOPNOTSUPP;
+    }
+    return 0;
+}
+
+// Payload of a top-level attribute of a generic netlink reply
+static const void *genl_attr(const struct nlmsghdr *nlh, uint16_t type, size_t len) {
+    const uint8_t *p = (const uint8_t *)NLMSG_DATA(nlh) + GENL_HDRLEN;
+    const uint8_t *end = (const uint8_t *)nlh + nlh->nlmsg_len;
+
+    while (p + NLA_HDRLEN <= end) {
+        const struct nlattr *attr = (const struct nlattr *)p;
+        if (attr->nla_len < NLA_HDRLEN || p + attr->nla_len > end) {
+            break;
+        }
+        if ((attr->nla_type & NLA_TYPE_MASK) == type) {
+            return attr->nla_len >= NLA_HDRLEN + len ? p + NLA_HDRLEN : NULL;
+        }
+        p += NLA_ALIGN(attr->nla_len);
+    }
+    return NULL;
+}
+
+// Build a request with one attribute
+static void genl_build(struct nlmsghdr *req, uint16_t family, uint8_t cmd, uint8_t version, uint16_t type,
+                       const void *data, size_t len) {
+    struct genlmsghdr *genl = NLMSG_DATA(req);
+    struct nlattr *attr = (struct nlattr *)((uint8_t *)genl + GENL_HDRLEN);
+
+    req->nlmsg_type = family;
+    req->nlmsg_flags = NLM_F_REQUEST;
+    req->nlmsg_len = NLMSG_LENGTH(GENL_HDRLEN) + NLA_ALIGN(NLA_HDRLEN + len);
+    genl->cmd = cmd;
+    genl->version = version;
+    attr->nla_type = type;
+    attr->nla_len = NLA_HDRLEN + len;
+    memcpy((uint8_t *)attr + NLA_HDRLEN, data, len);
+}
+
+// Ask the netdev family whether the driver fills in checksums on request
+// of AF_XDP TX metadata
+static bool xsk_driver_tx_checksum(int ifindex) {
+    union {
+        struct nlmsghdr nlh;
+        uint8_t buf[4096];
+    } req, reply;
+    bool supported = false;
+
+    int fd = socket(AF_NETLINK, SOCK_RAW | SOCK_CLOEXEC, NETLINK_GENERIC);
+    if (fd < 0) {
+        return false;
+    }
+
+    memset(&req, 0, sizeof(req));
+    genl_build(&req.nlh, GENL_ID_CTRL, CTRL_CMD_GETFAMILY, 1, CTRL_ATTR_FAMILY_NAME,
+               NETDEV_FAMILY_NAME, sizeof(NETDEV_FAMILY_NAME));
+    const uint16_t *family;
+    if (genl_request(fd, &req.nlh, &reply, sizeof(reply)) == 0 &&
+        (family = genl_attr(&reply.nlh, CTRL_ATTR_FAMILY_ID, sizeof(*family)))) {
+        uint32_t index = ifindex;
+        uint64_t features = 0;
+        const void *attr;
+
+        memset(&req, 0, sizeof(req));
+        genl_build(&req.nlh, *family, NETDEV_CMD_DEV_GET, NETDEV_FAMILY_VERSION, NETDEV_A_DEV_IFINDEX,
+                   &index, sizeof(index));
+        if (genl_request(fd, &req.nlh, &reply, sizeof(reply)) == 0 &&
+            (attr = genl_attr(&reply.nlh, NETDEV_A_DEV_XSK_FEATURES, sizeof(features)))) {
+            memcpy(&features, attr, sizeof(features));
+            supported = features & NETDEV_XSK_FLAGS_TX_CHECKSUM;
+        }
+    }
+
+    close(fd);
+    return supported;
+}
+#else
+static bool xsk_driver_tx_checksum(int ifindex) {
+    (void)ifindex;
+    return false;
+}
+#endif
+
+static int xsk_configure_umem(struct xdp_socket *xsk_socket, bool tx_metadata) {
     struct xsk_umem_config umem_cfg = {
         .fill_size = XSK_RING_SIZE,
         .comp_size = XSK_RING_SIZE,
@@ -21,24 +131,24 @@ static int xsk_configure_umem(struct xdp_socket *xsk_socket) {
         .flags = 0
     };
 
-    // Try to allocate huge pages first
-    void *bufs = mmap(NULL, 
-                     XSK_UMEM_FRAME_SIZE * XSK_NUM_FRAMES,
-                     PROT_READ | PROT_WRITE,
-                     MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB,
-                     -1, 0);
-    
-    if (bufs == MAP_FAILED) {
-        // Fallback to regular pages
-        bufs = mmap(NULL, 
-                   XSK_UMEM_FRAME_SIZE * XSK_NUM_FRAMES,
-                   PROT_READ | PROT_WRITE,
-                   MAP_PRIVATE | MAP_ANONYMOUS,
-                   -1, 0);
-        
-        if (bufs == MAP_FAILED) {
-            return -errno;
-        }
+#ifdef XSK_TX_METADATA
+    // Room for a struct xsk_tx_metadata in front of every TX packet
+    if (tx_metadata) {
+        umem_cfg.flags |= XDP_UMEM_TX_METADATA_LEN;
+        umem_cfg.tx_metadata_len = sizeof(struct xsk_tx_metadata);
+    }
+#else
+    (void)tx_metadata;
+#endif
+
+    // Page size and node come from the hugemem placement policy
+    void *bufs = hugemem_alloc("UMEM", XSK_UMEM_FRAME_SIZE * XSK_NUM_FRAMES);
+    uint64_t *frames = hugemem_alloc("frame allocator", XSK_NUM_FRAMES * sizeof(*frames));
+    if (!bufs || !frames) {
+        int ret = -errno;
+        hugemem_free(bufs);
+        hugemem_free(frames);
+        return ret;
     }
 
     // Create and configure UMEM
@@ -50,14 +160,56 @@ static int xsk_configure_umem(struct xdp_socket *xsk_socket) {
                               &umem_cfg);
     
     if (ret) {
-        munmap(bufs, XSK_UMEM_FRAME_SIZE * XSK_NUM_FRAMES);
+        hugemem_free(bufs);
+        hugemem_free(frames);
         return ret;
     }
 
     xsk_socket->buffer = bufs;
+    xsk_socket->free_frames = frames;
+
+    // Every frame starts out free
+    for (uint32_t i = 0; i < XSK_NUM_FRAMES; i++) {
+        xsk_socket->free_frames[i] = (uint64_t)i * XSK_UMEM_FRAME_SIZE;
+    }
+    xsk_socket->free_count = XSK_NUM_FRAMES;
     return 0;
 }
 
+// Hand half of the UMEM to the kernel for RX, keep the rest for TX
+static int xsk_populate_fill_queue(struct xdp_socket *xsk_socket) {
+    uint32_t idx_fq;
+    uint32_t count = XSK_NUM_FRAMES / 2;
+
+    if (xsk_ring_prod__reserve(&xsk_socket->fq, count, &idx_fq) != count) {
+        return -ENOMEM;
+    }
+
+    for (uint32_t i = 0; i < count; i++) {
+        *xsk_ring_prod__fill_addr(&xsk_socket->fq, idx_fq++) = af_xdp_frame_alloc(xsk_socket);
+    }
+    xsk_ring_prod__submit(&xsk_socket->fq, count);
+    return 0;
+}
+
+// Ask the kernel to run the driver's NAPI loop from our context
+static void xsk_configure_busy_poll(struct xdp_socket *xsk_socket, struct xdp_socket_config *config) {
+    int fd = xsk_socket__fd(xsk_socket->xsk);
+    int prefer = 1;
+    int usec = config->busy_poll_usec > 0 ? config->busy_poll_usec : XSK_BUSY_POLL_USEC;
+    int budget = config->busy_poll_budget > 0 ? config->busy_poll_budget : XSK_BUSY_POLL_BUDGET;
+
+    // Older kernels reject these options; we then spin in userspace only
+    if (setsockopt(fd, SOL_SOCKET, SO_PREFER_BUSY_POLL, &prefer, sizeof(prefer)) ||
+        setsockopt(fd, SOL_SOCKET, SO_BUSY_POLL, &usec, sizeof(usec)) ||
+        setsockopt(fd, SOL_SOCKET, SO_BUSY_POLL_BUDGET, &budget, sizeof(budget))) {
+        xsk_socket->busy_poll = false;
+        return;
+    }
+
+    xsk_socket->busy_poll = true;
+}
+
 int af_xdp_socket_init(struct xdp_socket *xsk_socket, struct xdp_socket_config *config) {
     // Zero out the socket structure
     memset(xsk_socket, 0, sizeof(*xsk_socket));
@@ -68,25 +220,38 @@ int af_xdp_socket_init(struct xdp_socket *xsk_socket, struct xdp_socket_config *
         return -errno;
     }
 
+    // Checksum offload needs TX metadata in the UMEM and a driver that
+    // reads it; without both the checksums stay in software
+    bool tx_metadata = config->tx_csum_offload && xsk_driver_tx_checksum(xsk_socket->ifindex);
+
     // Configure UMEM
-    int ret = xsk_configure_umem(xsk_socket);
+    int ret = xsk_configure_umem(xsk_socket, tx_metadata);
+    if (ret && tx_metadata) {
+        tx_metadata = false;
+        ret = xsk_configure_umem(xsk_socket, false);
+    }
     if (ret) {
         return ret;
     }
+#ifdef XSK_TX_METADATA
+    xsk_socket->tx_csum_offload = tx_metadata;
+    xsk_socket->tx_headroom = tx_metadata ? sizeof(struct xsk_tx_metadata) : 0;
+#endif
 
     // Configure socket
     struct xsk_socket_config xsk_cfg = {
         .rx_size = config->rx_size,
         .tx_size = config->tx_size,
-        .libbpf_flags = 0,
-        .xdp_flags = config->xdp_flags ? XDP_FLAGS_UPDATE_IF_NOEXIST | XDP_FLAGS_DRV_MODE : 0,
+        .libbpf_flags = config->xsks_map_fd > 0 ? XSK_LIBXDP_FLAGS__INHIBIT_PROG_LOAD : 0,
+        .xdp_flags = config->xdp_generic ? XDP_FLAGS_UPDATE_IF_NOEXIST | XDP_FLAGS_SKB_MODE :
+                     config->xdp_flags ? XDP_FLAGS_UPDATE_IF_NOEXIST | XDP_FLAGS_DRV_MODE : 0,
         .bind_flags = config->bind_flags | XDP_USE_NEED_WAKEUP
     };
 
     // Create XDP socket
     ret = xsk_socket__create(&xsk_socket->xsk,
                             config->ifname,
-                            0, // Queue ID
+                            config->queue_id,
                             xsk_socket->umem,
                             &xsk_socket->rx,
                             &xsk_socket->tx,
@@ -97,6 +262,30 @@ int af_xdp_socket_init(struct xdp_socket *xsk_socket, struct xdp_socket_config *
         return ret;
     }
 
+    // A custom XDP program redirects through its own XSKMAP
+    if (config->xsks_map_fd > 0) {
+        ret = xsk_socket__update_xskmap(xsk_socket->xsk, config->xsks_map_fd);
+        if (ret) {
+            af_xdp_socket_cleanup(xsk_socket);
+            return ret;
+        }
+    }
+
+    ret = xsk_populate_fill_queue(xsk_socket);
+    if (ret) {
+        af_xdp_socket_cleanup(xsk_socket);
+        return ret;
+    }
+
+    // Set up the RX wait strategy
+    xsk_socket->rx_mode = config->rx_mode;
+    xsk_socket->idle_spin_limit = config->idle_spins ? config->idle_spins : XSK_ADAPTIVE_IDLE_SPINS;
+    if (config->rx_mode == XSK_RX_MODE_BUSY_POLL) {
+        xsk_configure_busy_poll(xsk_socket, config);
+    }
+    xsk_socket->start_ns = clock_ns(CLOCK_MONOTONIC);
+    xsk_socket->start_cpu_ns = clock_ns(CLOCK_THREAD_CPUTIME_ID);
+
     // Increase resource limits for performance
     struct rlimit rlim = {RLIM_INFINITY, RLIM_INFINITY};
     setrlimit(RLIMIT_MEMLOCK, &rlim);
@@ -106,12 +295,16 @@ int af_xdp_socket_init(struct xdp_socket *xsk_socket, struct xdp_socket_config *
 
 void af_xdp_socket_rx(struct xdp_socket *xsk_socket, void (*process_packet)(const uint8_t *, size_t)) {
     unsigned int rcvd, i;
-    uint32_t idx_rx = 0;
+    uint32_t idx_rx = 0, idx_fq = 0;
+    uint64_t frames[XSK_BATCH_SIZE];
 
     // Receive packets in batches
     rcvd = xsk_ring_cons__peek(&xsk_socket->rx, XSK_BATCH_SIZE, &idx_rx);
-    if (!rcvd)
+    if (!rcvd) {
         return;
+    }
+
+    uint64_t start = clock_ns(CLOCK_MONOTONIC);
 
     // Process received packets
     for (i = 0; i < rcvd; i++) {
@@ -120,6 +313,8 @@ void af_xdp_socket_rx(struct xdp_socket *xsk_socket, void (*process_packet)(cons
         uint32_t len = desc->len;
         uint8_t *pkt = xsk_umem__get_data(xsk_socket->buffer, addr);
 
+        frames[i] = addr - addr % XSK_UMEM_FRAME_SIZE;
+
         // Process the packet
         if (process_packet) {
             process_packet(pkt, len);
@@ -129,10 +324,49 @@ void af_xdp_socket_rx(struct xdp_socket *xsk_socket, void (*process_packet)(cons
     // Release processed packets
     xsk_ring_cons__release(&xsk_socket->rx, rcvd);
 
+    // Recycle the frames straight back to the fill queue
+    if (xsk_ring_prod__reserve(&xsk_socket->fq, rcvd, &idx_fq) == rcvd) {
+        for (i = 0; i < rcvd; i++) {
+            *xsk_ring_prod__fill_addr(&xsk_socket->fq, idx_fq++) = frames[i];
+        }
+        xsk_ring_prod__submit(&xsk_socket->fq, rcvd);
+    } else {
+        for (i = 0; i < rcvd; i++) {
+            af_xdp_frame_free(xsk_socket, frames[i]);
+        }
+    }
+
+    uint64_t elapsed = clock_ns(CLOCK_MONOTONIC) - start;
+    xsk_socket->stats.rx_packets += rcvd;
+    xsk_socket->stats.rx_batches++;
+    xsk_socket->stats.batch_ns += elapsed;
+    if (elapsed > xsk_socket->stats.batch_ns_max) {
+        xsk_socket->stats.batch_ns_max = elapsed;
+    }
+
     // Complete any pending transmissions
     af_xdp_socket_complete_tx(xsk_socket);
 }
 
+// Point a TX descriptor at a packet, asking for its UDP checksum when offloaded
+static inline void xsk_fill_tx_desc(struct xdp_socket *xsk_socket, struct xdp_desc *desc, const uint8_t *pkt,
+                                    uint32_t len) {
+    desc->addr = (uint64_t)pkt - (uint64_t)xsk_socket->buffer;
+    desc->len = len;
+    desc->options = 0;
+
+#ifdef XSK_TX_METADATA
+    if (xsk_socket->tx_csum_offload) {
+        // tx_buffer left the metadata's room in front of the packet
+        struct xsk_tx_metadata *meta = (struct xsk_tx_metadata *)(pkt - sizeof(*meta));
+        meta->flags = XDP_TXMD_FLAGS_CHECKSUM;
+        meta->request.csum_start = ETH_HDR_LEN + IPV4_HDR_LEN;
+        meta->request.csum_offset = 6;  // UDP checksum field
+        desc->options = XDP_TX_METADATA;
+    }
+#endif
+}
+
 int af_xdp_socket_tx(struct xdp_socket *xsk_socket, const uint8_t *pkt, size_t len) {
     uint32_t idx_tx;
     struct xdp_desc *desc;
@@ -143,8 +377,7 @@ int af_xdp_socket_tx(struct xdp_socket *xsk_socket, const uint8_t *pkt, size_t l
 
     // Get the descriptor and copy the packet
     desc = xsk_ring_prod__tx_desc(&xsk_socket->tx, idx_tx);
-    desc->addr = (uint64_t)pkt - (uint64_t)xsk_socket->buffer;
-    desc->len = len;
+    xsk_fill_tx_desc(xsk_socket, desc, pkt, len);
 
     // Submit the packet for transmission
     xsk_ring_prod__submit(&xsk_socket->tx, 1);
@@ -153,6 +386,30 @@ int af_xdp_socket_tx(struct xdp_socket *xsk_socket, const uint8_t *pkt, size_t l
     // Kick the kernel if needed
     if (xsk_ring_prod__needs_wakeup(&xsk_socket->tx)) {
         sendto(xsk_socket__fd(xsk_socket->xsk), NULL, 0, MSG_DONTWAIT, NULL, 0);
+        xsk_socket->stats.syscalls++;
+    }
+
+    return 0;
+}
+
+int af_xdp_socket_tx_batch(struct xdp_socket *xsk_socket, uint8_t *const *pkts, const uint32_t *lens,
+                           size_t count) {
+    uint32_t idx_tx;
+
+    // All or nothing, so the caller knows which frames to take back
+    if (xsk_ring_prod__reserve(&xsk_socket->tx, count, &idx_tx) != count)
+        return -ENOSPC;
+
+    for (size_t i = 0; i < count; i++) {
+        xsk_fill_tx_desc(xsk_socket, xsk_ring_prod__tx_desc(&xsk_socket->tx, idx_tx + i), pkts[i], lens[i]);
+    }
+
+    // One submit and at most one kick for the whole batch
+    xsk_ring_prod__submit(&xsk_socket->tx, count);
+    xsk_socket->outstanding_tx += count;
+    if (xsk_ring_prod__needs_wakeup(&xsk_socket->tx)) {
+        sendto(xsk_socket__fd(xsk_socket->xsk), NULL, 0, MSG_DONTWAIT, NULL, 0);
+        xsk_socket->stats.syscalls++;
     }
 
     return 0;
@@ -168,6 +425,9 @@ void af_xdp_socket_complete_tx(struct xdp_socket *xsk_socket) {
     // Process completed transmissions
     completed = xsk_ring_cons__peek(&xsk_socket->cq, XSK_BATCH_SIZE, &idx_cq);
     if (completed > 0) {
+        for (unsigned int i = 0; i < completed; i++) {
+            af_xdp_frame_free(xsk_socket, *xsk_ring_cons__comp_addr(&xsk_socket->cq, idx_cq++));
+        }
         xsk_ring_cons__release(&xsk_socket->cq, completed);
         xsk_socket->outstanding_tx -= completed;
     }
@@ -179,9 +439,107 @@ int af_xdp_socket_poll(struct xdp_socket *xsk_socket, int timeout_ms) {
         .events = POLLIN,
     };
 
+    xsk_socket->stats.syscalls++;
+    if (timeout_ms != 0) {
+        xsk_socket->stats.sleeps++;
+    }
     return poll(&fds, 1, timeout_ms);
 }
 
+// Non-destructive check for pending RX descriptors
+static bool xsk_rx_ready(struct xdp_socket *xsk_socket) {
+    uint32_t idx_rx;
+
+    if (xsk_ring_cons__peek(&xsk_socket->rx, 1, &idx_rx)) {
+        xsk_ring_cons__cancel(&xsk_socket->rx, 1);
+        return true;
+    }
+    return false;
+}
+
+// Non-blocking kick: runs NAPI in busy-poll mode, refills the driver otherwise
+static void xsk_kick_rx(struct xdp_socket *xsk_socket) {
+    recvfrom(xsk_socket__fd(xsk_socket->xsk), NULL, 0, MSG_DONTWAIT, NULL, NULL);
+    xsk_socket->stats.syscalls++;
+}
+
+int af_xdp_socket_wait(struct xdp_socket *xsk_socket, int timeout_ms) {
+    // Packets already queued never cost a syscall
+    if (xsk_rx_ready(xsk_socket)) {
+        xsk_socket->idle_spins = 0;
+        return 1;
+    }
+    xsk_socket->stats.empty_polls++;
+
+    switch (xsk_socket->rx_mode) {
+        case XSK_RX_MODE_BUSY_POLL:
+            if (xsk_socket->busy_poll || xsk_ring_prod__needs_wakeup(&xsk_socket->fq)) {
+                xsk_kick_rx(xsk_socket);
+            }
+            return xsk_rx_ready(xsk_socket);
+
+        case XSK_RX_MODE_WAKEUP:
+            return af_xdp_socket_poll(xsk_socket, timeout_ms);
+
+        case XSK_RX_MODE_ADAPTIVE:
+            if (++xsk_socket->idle_spins < xsk_socket->idle_spin_limit) {
+                if (xsk_ring_prod__needs_wakeup(&xsk_socket->fq)) {
+                    xsk_kick_rx(xsk_socket);
+                }
+                return xsk_rx_ready(xsk_socket);
+            }
+            // Traffic has stopped, go back to interrupts
+            xsk_socket->idle_spins = 0;
+            return af_xdp_socket_poll(xsk_socket, timeout_ms);
+    }
+
+    return -EINVAL;
+}
+
+void af_xdp_socket_get_stats(struct xdp_socket *xsk_socket, struct xsk_rx_stats *stats) {
+    *stats = xsk_socket->stats;
+    stats->wall_ns = clock_ns(CLOCK_MONOTONIC) - xsk_socket->start_ns;
+    stats->cpu_ns = clock_ns(CLOCK_THREAD_CPUTIME_ID) - xsk_socket->start_cpu_ns;
+}
+
+int af_xdp_rx_mode_parse(const char *name, enum xsk_rx_mode *mode) {
+    if (strcmp(name, "busy") == 0 || strcmp(name, "busy-poll") == 0) {
+        *mode = XSK_RX_MODE_BUSY_POLL;
+    } else if (strcmp(name, "wakeup") == 0) {
+        *mode = XSK_RX_MODE_WAKEUP;
+    } else if (strcmp(name, "adaptive") == 0) {
+        *mode = XSK_RX_MODE_ADAPTIVE;
+    } else {
+        return -1;
+    }
+    return 0;
+}
+
+const char *af_xdp_rx_mode_name(enum xsk_rx_mode mode) {
+    switch (mode) {
+        case XSK_RX_MODE_BUSY_POLL:
+            return "busy-poll";
+        case XSK_RX_MODE_WAKEUP:
+            return "wakeup";
+        case XSK_RX_MODE_ADAPTIVE:
+            return "adaptive";
+    }
+    return "unknown";
+}
+
+uint64_t af_xdp_frame_alloc(struct xdp_socket *xsk_socket) {
+    if (!xsk_socket->free_count) {
+        return XSK_INVALID_FRAME;
+    }
+    return xsk_socket->free_frames[--xsk_socket->free_count];
+}
+
+void af_xdp_frame_free(struct xdp_socket *xsk_socket, uint64_t addr) {
+    if (xsk_socket->free_count < XSK_NUM_FRAMES) {
+        xsk_socket->free_frames[xsk_socket->free_count++] = addr - addr % XSK_UMEM_FRAME_SIZE;
+    }
+}
+
 void af_xdp_socket_cleanup(struct xdp_socket *xsk_socket) {
     if (!xsk_socket)
         return;
@@ -202,9 +560,8 @@ void af_xdp_socket_cleanup(struct xdp_socket *xsk_socket) {
     }
 
     // Free packet buffer memory
-    if (xsk_socket->buffer) {
-        munmap(xsk_socket->buffer, XSK_UMEM_FRAME_SIZE * XSK_NUM_FRAMES);
-    }
+    hugemem_free(xsk_socket->buffer);
+    hugemem_free(xsk_socket->free_frames);
 
     memset(xsk_socket, 0, sizeof(*xsk_socket));
 }
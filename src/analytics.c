@@ -0,0 +1,494 @@
+#include "../include/analytics.h"
+#include "../include/packet.h"
+#include "../include/dns_query.h"
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <errno.h>
+#include <arpa/inet.h>
+
+#define INDEX_MASK      (ANALYTICS_TOPK * 2 - 1)
+#define HLL_REGISTERS   (1 << ANALYTICS_HLL_BITS)
+
+// Eight bytes per multiply, finished with a 64-bit mixer so every bit is
+// usable by the HLL
+static uint64_t hash_key(const uint8_t *key, size_t len) {
+    uint64_t h = 0xCBF29CE484222325ULL ^ len;
+    uint64_t word;
+
+    for (; len >= 8; key += 8, len -= 8) {
+        memcpy(&word, key, 8);
+        h = (h ^ word) * 0x9E3779B97F4A7C15ULL;
+        h ^= h >> 32;
+    }
+    word = 0;
+    for (size_t i = 0; i < len; i++) {
+        word |= (uint64_t)key[i] << (i * 8);
+    }
+    h = (h ^ word) * 0x9E3779B97F4A7C15ULL;
+
+    h = (h ^ (h >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    h = (h ^ (h >> 27)) * 0x94D049BB133111EBULL;
+    return h ^ (h >> 31);
+}
+
+// HyperLogLog: the top bits pick a register, which keeps the longest run of
+// leading zeros seen in the rest
+static void hll_add(uint8_t *registers, uint64_t hash) {
+    uint32_t index = hash >> (64 - ANALYTICS_HLL_BITS);
+    uint64_t rest = hash << ANALYTICS_HLL_BITS;
+    uint8_t rank = rest ? (uint8_t)(__builtin_clzll(rest) + 1) : 64 - ANALYTICS_HLL_BITS + 1;
+    if (rank > registers[index]) {
+        registers[index] = rank;
+    }
+}
+
+static uint64_t hll_estimate(const uint8_t *registers) {
+    double m = HLL_REGISTERS;
+    double sum = 0.0;
+    size_t zeros = 0;
+
+    for (size_t i = 0; i < HLL_REGISTERS; i++) {
+        sum += ldexp(1.0, -registers[i]);
+        zeros += registers[i] == 0;
+    }
+
+    double estimate = 0.7213 / (1.0 + 1.079 / m) * m * m / sum;
+    // Small cardinalities are better counted by the empty registers
+    if (estimate <= 2.5 * m && zeros) {
+        estimate = m * log(m / zeros);
+    }
+    return (uint64_t)(estimate + 0.5);
+}
+
+// Space-Saving list: heap helpers keep the smallest count at heap[0]
+static void heap_swap(struct analytics_topk *t, uint16_t a, uint16_t b) {
+    uint16_t ea = t->heap[a], eb = t->heap[b];
+    t->heap[a] = eb;
+    t->heap[b] = ea;
+    t->entries[eb].heap = a;
+    t->entries[ea].heap = b;
+}
+
+static void heap_up(struct analytics_topk *t, uint16_t pos) {
+    while (pos > 0) {
+        uint16_t parent = (pos - 1) / 2;
+        if (t->entries[t->heap[parent]].count <= t->entries[t->heap[pos]].count) {
+            break;
+        }
+        heap_swap(t, parent, pos);
+        pos = parent;
+    }
+}
+
+static void heap_down(struct analytics_topk *t, uint16_t pos) {
+    for (;;) {
+        uint16_t smallest = pos;
+        uint16_t left = pos * 2 + 1, right = left + 1;
+        if (left < t->used && t->entries[t->heap[left]].count < t->entries[t->heap[smallest]].count) {
+            smallest = left;
+        }
+        if (right < t->used && t->entries[t->heap[right]].count < t->entries[t->heap[smallest]].count) {
+            smallest = right;
+        }
+        if (smallest == pos) {
+            return;
+        }
+        heap_swap(t, pos, smallest);
+        pos = smallest;
+    }
+}
+
+// Index slot holding the key, or the empty slot where it would go
+static size_t index_find(const struct analytics_topk *t, const uint8_t *key, uint16_t len, uint32_t hash) {
+    size_t slot = hash & INDEX_MASK;
+    while (t->index[slot]) {
+        const struct analytics_topk_entry *e = &t->entries[t->index[slot] - 1];
+        if (e->hash == hash && e->len == len && memcmp(t->keys[t->index[slot] - 1], key, len) == 0) {
+            break;
+        }
+        slot = (slot + 1) & INDEX_MASK;
+    }
+    return slot;
+}
+
+// Linear probing delete: pull later entries back over the hole unless
+// their home slot lies between the hole and where they sit
+static void index_remove(struct analytics_topk *t, size_t slot) {
+    for (size_t next = (slot + 1) & INDEX_MASK; t->index[next]; next = (next + 1) & INDEX_MASK) {
+        size_t home = t->entries[t->index[next] - 1].hash & INDEX_MASK;
+        if (((next - home) & INDEX_MASK) >= ((next - slot) & INDEX_MASK)) {
+            t->index[slot] = t->index[next];
+            slot = next;
+        }
+    }
+    t->index[slot] = 0;
+}
+
+// Count weight occurrences of key; a new key takes over the smallest counter
+static void topk_offer(struct analytics_topk *t, const uint8_t *key, uint16_t len, uint32_t hash,
+                       uint64_t weight, uint64_t error) {
+    size_t slot = index_find(t, key, len, hash);
+    if (t->index[slot]) {
+        struct analytics_topk_entry *e = &t->entries[t->index[slot] - 1];
+        e->count += weight;
+        e->error += error;
+        heap_down(t, e->heap);
+        return;
+    }
+
+    uint16_t victim;
+    uint64_t floor = 0;
+    if (t->used < ANALYTICS_TOPK) {
+        victim = t->used;
+        t->heap[t->used] = victim;
+        t->entries[victim].heap = t->used;
+        t->used++;
+    } else {
+        victim = t->heap[0];
+        floor = t->entries[victim].count;
+        index_remove(t, index_find(t, t->keys[victim], t->entries[victim].len, t->entries[victim].hash));
+        slot = index_find(t, key, len, hash);
+    }
+
+    struct analytics_topk_entry *e = &t->entries[victim];
+    memcpy(t->keys[victim], key, len);
+    e->len = len;
+    e->hash = hash;
+    e->count = floor + weight;
+    e->error = floor + error;
+    t->index[slot] = victim + 1;
+    heap_up(t, e->heap);
+    heap_down(t, e->heap);
+}
+
+// Conservative count-min update within one block: four rows, each choosing
+// one of four counters, only the smallest grow. Returns the new estimate.
+static uint32_t sketch_add(struct analytics_topk *t, uint64_t hash, uint32_t weight) {
+    uint32_t *block = t->sketch[(hash >> 20) & (ANALYTICS_SKETCH_BLOCKS - 1)];
+    uint32_t *counters[4];
+    uint32_t min = UINT32_MAX;
+
+    for (unsigned row = 0; row < 4; row++) {
+        counters[row] = &block[row * 4 + ((hash >> (8 + row * 2)) & 3)];
+        min = *counters[row] < min ? *counters[row] : min;
+    }
+    uint32_t estimate = min + weight;
+    for (unsigned row = 0; row < 4; row++) {
+        if (*counters[row] < estimate) {
+            *counters[row] = estimate;
+        }
+    }
+    return estimate;
+}
+
+// One occurrence from the data path
+static void topk_observe(struct analytics_topk *t, const uint8_t *key, uint16_t len, uint64_t hash) {
+    if (t->used < ANALYTICS_TOPK) {
+        sketch_add(t, hash, 1);
+        topk_offer(t, key, len, (uint32_t)hash, 1, 0);
+        return;
+    }
+
+    size_t slot = index_find(t, key, len, (uint32_t)hash);
+    if (t->index[slot]) {
+        struct analytics_topk_entry *e = &t->entries[t->index[slot] - 1];
+        e->count++;
+        heap_down(t, e->heap);
+        return;
+    }
+
+    // The estimate bounds the key's true count, so while it does not exceed
+    // the smallest entry the list stays as Space-Saving would leave it
+    uint32_t estimate = sketch_add(t, hash, 1);
+    uint64_t floor = t->entries[t->heap[0]].count;
+    if (estimate > floor) {
+        topk_offer(t, key, len, (uint32_t)hash, estimate - floor, estimate - floor - 1);
+    }
+}
+
+static void topk_merge(struct analytics_topk *dst, const struct analytics_topk *src) {
+    for (size_t b = 0; b < ANALYTICS_SKETCH_BLOCKS; b++) {
+        for (size_t i = 0; i < 16; i++) {
+            dst->sketch[b][i] += src->sketch[b][i];
+        }
+    }
+    for (uint16_t i = 0; i < src->used; i++) {
+        const struct analytics_topk_entry *e = &src->entries[i];
+        topk_offer(dst, src->keys[i], e->len, e->hash, e->count, e->error);
+    }
+}
+
+static int cmp_count(const void *a, const void *b) {
+    const struct analytics_topk_entry *ea = *(const struct analytics_topk_entry *const *)a;
+    const struct analytics_topk_entry *eb = *(const struct analytics_topk_entry *const *)b;
+    return ea->count < eb->count ? 1 : ea->count > eb->count ? -1 : 0;
+}
+
+// Up to max entries, most frequent first
+size_t analytics_top(const struct analytics_topk *topk, const struct analytics_topk_entry **out, size_t max) {
+    const struct analytics_topk_entry *all[ANALYTICS_TOPK];
+    for (uint16_t i = 0; i < topk->used; i++) {
+        all[i] = &topk->entries[i];
+    }
+    qsort(all, topk->used, sizeof(all[0]), cmp_count);
+
+    size_t count = topk->used < max ? topk->used : max;
+    memcpy(out, all, count * sizeof(all[0]));
+    return count;
+}
+
+struct analytics_summary *analytics_summary_alloc(void) {
+    return calloc(1, sizeof(struct analytics_summary));
+}
+
+void analytics_reset(struct analytics_summary *summary) {
+    memset(summary, 0, sizeof(*summary));
+}
+
+// ASCII lower case, eight bytes at a time: a byte is upper case when adding
+// 0x3F carries into its top bit but adding 0x25 does not
+static void lower_copy(uint8_t *dst, const uint8_t *src, size_t len) {
+    size_t i = 0;
+    for (; i + 8 <= len; i += 8) {
+        uint64_t word;
+        memcpy(&word, src + i, 8);
+        uint64_t low = word & 0x7F7F7F7F7F7F7F7FULL;
+        uint64_t upper = ((low + 0x3F3F3F3F3F3F3F3FULL) ^ (low + 0x2525252525252525ULL)) &
+                         ~word & 0x8080808080808080ULL;
+        word |= upper >> 2;
+        memcpy(dst + i, &word, 8);
+    }
+    for (; i < len; i++) {
+        dst[i] = src[i] >= 'A' && src[i] <= 'Z' ? src[i] + 32 : src[i];
+    }
+}
+
+static size_t size_bucket(size_t len) {
+    size_t bucket = 0;
+    for (size_t limit = 64; bucket < ANALYTICS_SIZE_BUCKETS && len > limit; limit <<= 1) {
+        bucket++;
+    }
+    return bucket;
+}
+
+void analytics_observe(struct analytics_summary *s, const uint8_t *packet, size_t length) {
+    struct packet_info info;
+    struct dns_header header;
+
+    if (packet_parse(packet, length, &info) != 0 || info.payload_len < sizeof(header)) {
+        s->malformed++;
+        return;
+    }
+    memcpy(&header, info.payload, sizeof(header));
+    uint16_t flags = ntohs(header.flags);
+
+    if (flags & 0x8000) {
+        s->responses++;
+        s->rcodes[flags & 0xF]++;
+        s->sizes[size_bucket(info.payload_len)]++;
+        s->response_bytes += info.payload_len;
+        return;
+    }
+
+    int end = dns_skip_name(info.payload, info.payload_len, sizeof(header));
+    if (ntohs(header.qdcount) == 0 || end < 0 || (size_t)end + 4 > info.payload_len ||
+        info.payload[end - 1] != 0) {
+        s->malformed++;
+        return;
+    }
+    s->queries++;
+
+    uint16_t qtype = (uint16_t)(info.payload[end] << 8 | info.payload[end + 1]);
+    s->qtypes[qtype < ANALYTICS_QTYPES ? qtype : ANALYTICS_QTYPES]++;
+
+    // Names are counted case-insensitively, 0x20 randomization must not split them
+    uint8_t name[ANALYTICS_KEY_MAX];
+    size_t name_len = end - sizeof(header);
+    if (name_len > sizeof(name)) {
+        s->malformed++;
+        return;
+    }
+    lower_copy(name, info.payload + sizeof(header), name_len);
+
+    uint64_t h = hash_key(name, name_len);
+    hll_add(s->names_hll, h);
+    topk_observe(&s->names, name, name_len, h);
+
+    h = hash_key((const uint8_t *)&info.src.ip, sizeof(info.src.ip));
+    hll_add(s->clients_hll, h);
+    topk_observe(&s->clients, (const uint8_t *)&info.src.ip, sizeof(info.src.ip), h);
+}
+
+void analytics_merge(struct analytics_summary *dst, const struct analytics_summary *src) {
+    dst->queries += src->queries;
+    dst->responses += src->responses;
+    dst->malformed += src->malformed;
+    dst->response_bytes += src->response_bytes;
+    for (size_t i = 0; i <= ANALYTICS_QTYPES; i++) {
+        dst->qtypes[i] += src->qtypes[i];
+    }
+    for (size_t i = 0; i < ANALYTICS_RCODES; i++) {
+        dst->rcodes[i] += src->rcodes[i];
+    }
+    for (size_t i = 0; i <= ANALYTICS_SIZE_BUCKETS; i++) {
+        dst->sizes[i] += src->sizes[i];
+    }
+    for (size_t i = 0; i < HLL_REGISTERS; i++) {
+        dst->names_hll[i] = dst->names_hll[i] > src->names_hll[i] ? dst->names_hll[i] : src->names_hll[i];
+        dst->clients_hll[i] = dst->clients_hll[i] > src->clients_hll[i] ? dst->clients_hll[i] : src->clients_hll[i];
+    }
+    topk_merge(&dst->names, &src->names);
+    topk_merge(&dst->clients, &src->clients);
+}
+
+uint64_t analytics_distinct_names(const struct analytics_summary *summary) {
+    return hll_estimate(summary->names_hll);
+}
+
+uint64_t analytics_distinct_clients(const struct analytics_summary *summary) {
+    return hll_estimate(summary->clients_hll);
+}
+
+// Observed names are arbitrary bytes, keep the JSON valid
+static void write_json_string(FILE *fp, const char *text) {
+    fputc('"', fp);
+    for (const unsigned char *p = (const unsigned char *)text; *p; p++) {
+        if (*p == '"' || *p == '\\') {
+            fprintf(fp, "\\%c", *p);
+        } else if (*p < 0x20 || *p >= 0x7F) {
+            fprintf(fp, "\\u%04x", *p);
+        } else {
+            fputc(*p, fp);
+        }
+    }
+    fputc('"', fp);
+}
+
+static const char *rcode_names[ANALYTICS_RCODES] = {
+    "NOERROR", "FORMERR", "SERVFAIL", "NXDOMAIN", "NOTIMP", "REFUSED",
+    "YXDOMAIN", "YXRRSET", "NXRRSET", "NOTAUTH", "NOTZONE"
+};
+
+// One JSON line per interval
+int analytics_report(FILE *fp, const struct analytics_summary *s, time_t now, uint32_t interval) {
+    const struct analytics_topk_entry *top[ANALYTICS_REPORT_TOP];
+
+    fprintf(fp, "{\"time\":%ld,\"interval\":%u,\"queries\":%lu,\"responses\":%lu,\"malformed\":%lu,"
+            "\"distinct_names\":%lu,\"distinct_clients\":%lu,",
+            (long)now, interval, (unsigned long)s->queries, (unsigned long)s->responses,
+            (unsigned long)s->malformed, (unsigned long)analytics_distinct_names(s),
+            (unsigned long)analytics_distinct_clients(s));
+
+    fprintf(fp, "\"top_names\":[");
+    size_t count = analytics_top(&s->names, top, ANALYTICS_REPORT_TOP);
+    for (size_t i = 0; i < count; i++) {
+        char name[DNS_NAME_MAX];
+        dns_name_to_text(analytics_topk_key(&s->names, top[i]), top[i]->len, name, sizeof(name));
+        fprintf(fp, "%s{\"name\":", i ? "," : "");
+        write_json_string(fp, name[0] ? name : ".");
+        fprintf(fp, ",\"count\":%lu,\"error\":%lu}", (unsigned long)top[i]->count, (unsigned long)top[i]->error);
+    }
+
+    fprintf(fp, "],\"top_clients\":[");
+    count = analytics_top(&s->clients, top, ANALYTICS_REPORT_TOP);
+    for (size_t i = 0; i < count; i++) {
+        char ip[INET_ADDRSTRLEN];
+        inet_ntop(AF_INET, analytics_topk_key(&s->clients, top[i]), ip, sizeof(ip));
+        fprintf(fp, "%s{\"ip\":\"%s\",\"count\":%lu,\"error\":%lu}", i ? "," : "", ip,
+                (unsigned long)top[i]->count, (unsigned long)top[i]->error);
+    }
+
+    fprintf(fp, "],\"qtypes\":{");
+    const char *sep = "";
+    for (size_t i = 0; i <= ANALYTICS_QTYPES; i++) {
+        if (!s->qtypes[i]) {
+            continue;
+        }
+        const char *name = dns_qtype_name(i);
+        if (i == ANALYTICS_QTYPES) {
+            fprintf(fp, "%s\"OTHER\":%lu", sep, (unsigned long)s->qtypes[i]);
+        } else if (strcmp(name, "UNKNOWN") != 0) {
+            fprintf(fp, "%s\"%s\":%lu", sep, name, (unsigned long)s->qtypes[i]);
+        } else {
+            fprintf(fp, "%s\"TYPE%zu\":%lu", sep, i, (unsigned long)s->qtypes[i]);
+        }
+        sep = ",";
+    }
+
+    fprintf(fp, "},\"rcodes\":{");
+    sep = "";
+    for (size_t i = 0; i < ANALYTICS_RCODES; i++) {
+        if (!s->rcodes[i]) {
+            continue;
+        }
+        if (rcode_names[i]) {
+            fprintf(fp, "%s\"%s\":%lu", sep, rcode_names[i], (unsigned long)s->rcodes[i]);
+        } else {
+            fprintf(fp, "%s\"RCODE%zu\":%lu", sep, i, (unsigned long)s->rcodes[i]);
+        }
+        sep = ",";
+    }
+
+    // Keys are the upper bound of each size bucket
+    fprintf(fp, "},\"response_sizes\":{");
+    for (size_t i = 0; i <= ANALYTICS_SIZE_BUCKETS; i++) {
+        if (i < ANALYTICS_SIZE_BUCKETS) {
+            fprintf(fp, "%s\"%u\":%lu", i ? "," : "", 64u << i, (unsigned long)s->sizes[i]);
+        } else {
+            fprintf(fp, ",\"larger\":%lu", (unsigned long)s->sizes[i]);
+        }
+    }
+    fprintf(fp, "},\"avg_response_size\":%.1f}\n",
+            s->responses ? (double)s->response_bytes / s->responses : 0.0);
+
+    return ferror(fp) ? -EIO : 0;
+}
+
+int analytics_core_init(struct analytics_core *core) {
+    core->slots[0] = analytics_summary_alloc();
+    core->slots[1] = analytics_summary_alloc();
+    if (!core->slots[0] || !core->slots[1]) {
+        analytics_core_free(core);
+        return -ENOMEM;
+    }
+    atomic_init(&core->active, 0);
+    atomic_init(&core->flip, false);
+    atomic_init(&core->ready, false);
+    return 0;
+}
+
+// Called by the worker between batches: retire the active summary if the
+// reporter asked for it and has merged the previous one
+void analytics_core_poll(struct analytics_core *core) {
+    if (!atomic_load_explicit(&core->flip, memory_order_relaxed) ||
+        atomic_load_explicit(&core->ready, memory_order_acquire)) {
+        return;
+    }
+    unsigned active = atomic_load_explicit(&core->active, memory_order_relaxed);
+    atomic_store_explicit(&core->active, active ^ 1, memory_order_relaxed);
+    atomic_store_explicit(&core->flip, false, memory_order_relaxed);
+    atomic_store_explicit(&core->ready, true, memory_order_release);
+}
+
+void analytics_core_request(struct analytics_core *core) {
+    atomic_store_explicit(&core->flip, true, memory_order_relaxed);
+}
+
+// Merge a retired summary into dst and hand it back to the worker empty
+bool analytics_core_collect(struct analytics_core *core, struct analytics_summary *dst) {
+    if (!atomic_load_explicit(&core->ready, memory_order_acquire)) {
+        return false;
+    }
+    struct analytics_summary *retired = core->slots[atomic_load_explicit(&core->active, memory_order_relaxed) ^ 1];
+    analytics_merge(dst, retired);
+    analytics_reset(retired);
+    atomic_store_explicit(&core->ready, false, memory_order_release);
+    return true;
+}
+
+void analytics_core_free(struct analytics_core *core) {
+    free(core->slots[0]);
+    free(core->slots[1]);
+    core->slots[0] = core->slots[1] = NULL;
+}
@@ -1,13 +1,21 @@
 #include "../include/cache.h"
+#include "../include/admission.h"
+#include "../include/hugemem.h"
+#include "../include/log.h"
 #include <string.h>
 #include <stdlib.h>
 #include <stdio.h>
 
 // Static cache variables
 static struct cache_entry *cache = NULL;
+static uint8_t *slab = NULL;        // A CACHE_SLAB_SLOT response buffer per entry
 static struct cache_config config;
 static size_t hit_count = 0;
 static size_t miss_count = 0;
+static size_t rejected_count = 0;
+
+// Scope prefix lengths that have been inserted, per ECS family (bits 0-128)
+static uint64_t scope_lengths[3][3];
 
 // Hash function for domain names
 static uint32_t hash_domain(const char *domain) {
@@ -21,67 +29,271 @@ static uint32_t hash_domain(const char *domain) {
     return hash;
 }
 
+// Scoped entries hash the question, the subnet and DO after the name;
+// entries keyed by name alone hash like before
+static uint32_t hash_key(uint32_t hash, const struct cache_scope *scope) {
+    if (scope->qtype || scope->qclass) {
+        hash = ((hash << 5) + hash) + scope->qtype;
+        hash = ((hash << 5) + hash) + scope->qclass;
+    }
+    // An odd step moves DO answers off their plain twin's slot for any
+    // power-of-two table size
+    if (scope->dnssec_ok) {
+        hash = ((hash << 5) + hash) + 1;
+    }
+    if (scope->family) {
+        hash = ((hash << 5) + hash) + scope->family;
+        hash = ((hash << 5) + hash) + scope->prefix;
+        for (size_t i = 0; i < (size_t)(scope->prefix + 7) / 8; i++) {
+            hash = ((hash << 5) + hash) + scope->address[i];
+        }
+    }
+
+    return hash;
+}
+
+static bool scope_equal(const struct cache_scope *a, const struct cache_scope *b) {
+    return a->family == b->family && a->prefix == b->prefix && a->dnssec_ok == b->dnssec_ok &&
+           a->qtype == b->qtype && a->qclass == b->qclass &&
+           memcmp(a->address, b->address, sizeof(a->address)) == 0;
+}
+
+// The parts of the key that subnet normalization leaves alone
+static void copy_question(struct cache_scope *key, const struct cache_scope *from) {
+    key->dnssec_ok = from && from->dnssec_ok;
+    key->qtype = from ? from->qtype : 0;
+    key->qclass = from ? from->qclass : 0;
+}
+
+static bool scope_in_use(uint16_t family, uint8_t prefix) {
+    return family < 3 && prefix <= 128 && (scope_lengths[family][prefix / 64] >> (prefix % 64)) & 1;
+}
+
+void cache_scope_init(struct cache_scope *scope, uint16_t family, const uint8_t *address, uint8_t prefix) {
+    memset(scope, 0, sizeof(*scope));
+    if (family != 1 && family != 2) {
+        return;     // Anything else is global
+    }
+
+    uint8_t max = family == 1 ? 32 : 128;
+    scope->family = family;
+    scope->prefix = prefix < max ? prefix : max;
+
+    // Keep only the significant bits so equal subnets compare equal
+    size_t bytes = (scope->prefix + 7) / 8;
+    memcpy(scope->address, address, bytes);
+    if (scope->prefix % 8) {
+        scope->address[bytes - 1] &= 0xFF << (8 - scope->prefix % 8);
+    }
+    if (scope->prefix == 0) {
+        scope->family = 0;
+    }
+}
+
+static const struct cache_scope global_scope;
+
 void cache_init(struct cache_config *cfg) {
     // Store configuration
     memcpy(&config, cfg, sizeof(struct cache_config));
+    hit_count = 0;
+    miss_count = 0;
+    rejected_count = 0;
+    memset(scope_lengths, 0, sizeof(scope_lengths));
     
-    // Allocate cache entries
-    cache = calloc(config.max_entries, sizeof(struct cache_entry));
-    if (!cache) {
+    // Entries and their response slots come from the NIC's node
+    cache = hugemem_alloc("cache table", config.max_entries * sizeof(struct cache_entry));
+    slab = hugemem_alloc("cache responses", config.max_entries * CACHE_SLAB_SLOT);
+    if (!cache || !slab) {
         fprintf(stderr, "Failed to allocate cache memory\n");
+        hugemem_free(cache);
+        hugemem_free(slab);
+        cache = NULL;
+        slab = NULL;
         return;
     }
     
     // Initialize all entries as invalid
     for (size_t i = 0; i < config.max_entries; i++) {
         cache[i].valid = false;
+        cache[i].response = slab + i * CACHE_SLAB_SLOT;
+        cache[i].response_cap = CACHE_SLAB_SLOT;
+    }
+
+    if (config.admission) {
+        struct admission_config admission_cfg = {
+            .entries = config.max_entries,
+            .counters = config.admission_counters,
+            .sample_size = config.admission_sample
+        };
+        if (admission_init(&admission_cfg) != 0) {
+            fprintf(stderr, "Failed to allocate admission filter, caching without it\n");
+            config.admission = false;
+        }
     }
 }
 
-bool cache_lookup(const char *domain, uint8_t *response, size_t *response_len) {
+static bool in_slab(const uint8_t *buffer) {
+    return buffer >= slab && buffer < slab + config.max_entries * CACHE_SLAB_SLOT;
+}
+
+static bool entry_expired(const struct cache_entry *entry, time_t now) {
+    return now - entry->timestamp > entry->ttl;
+}
+
+// Entry for this exact key if present and fresh
+static struct cache_entry *find_entry(const char *domain, uint32_t name_hash,
+                                      const struct cache_scope *scope, time_t now) {
+    uint32_t index = hash_key(name_hash, scope) % config.max_entries;
+    struct cache_entry *entry = &cache[index];
+
+    if (!entry->valid || strcmp(entry->domain, domain) != 0 || !scope_equal(&entry->scope, scope)) {
+        return NULL;
+    }
+
+    // Check if entry has expired
+    if (entry_expired(entry, now)) {
+        entry->valid = false;
+        return NULL;
+    }
+
+    return entry;
+}
+
+// age is set to the seconds since the response was inserted, for the
+// caller to count its TTLs down
+bool cache_lookup_scoped(const char *domain, const struct cache_scope *client,
+                         uint8_t *response, size_t *response_len, bool *secure, uint32_t *age) {
     if (!cache || !domain || !response || !response_len) {
         return false;
     }
-    
-    uint32_t index = hash_domain(domain) % config.max_entries;
-    struct cache_entry *entry = &cache[index];
-    
-    if (entry->valid && strcmp(entry->domain, domain) == 0) {
-        // Check if entry has expired
-        time_t now = time(NULL);
-        if (now - entry->timestamp > entry->ttl) {
-            entry->valid = false;
-            miss_count++;
-            return false;
+
+    time_t now = time(NULL);
+    struct cache_entry *entry = NULL;
+    uint32_t name_hash = hash_domain(domain);
+
+    // Every lookup counts towards the name's popularity, hit or miss
+    if (config.admission) {
+        admission_record(name_hash);
+    }
+
+    // Most specific subnet first, never narrower than what the client disclosed
+    if (client && client->family) {
+        for (int prefix = client->prefix; prefix > 0 && !entry; prefix--) {
+            if (!scope_in_use(client->family, prefix)) {
+                continue;
+            }
+            struct cache_scope scope;
+            cache_scope_init(&scope, client->family, client->address, prefix);
+            copy_question(&scope, client);
+            entry = find_entry(domain, name_hash, &scope, now);
         }
-        
-        // Return cached response
-        memcpy(response, entry->response, entry->response_len);
-        *response_len = entry->response_len;
-        hit_count++;
-        return true;
     }
-    
-    miss_count++;
-    return false;
+    if (!entry) {
+        struct cache_scope global = global_scope;
+        copy_question(&global, client);
+        entry = find_entry(domain, name_hash, &global, now);
+    }
+
+    // The caller's buffer size comes in through response_len
+    if (!entry || entry->response_len > *response_len) {
+        miss_count++;
+        return false;
+    }
+
+    // Return cached response
+    memcpy(response, entry->response, entry->response_len);
+    *response_len = entry->response_len;
+    if (secure) {
+        *secure = entry->secure;
+    }
+    if (age) {
+        *age = (uint32_t)(now - entry->timestamp);
+    }
+    hit_count++;
+    return true;
 }
 
-void cache_insert(const char *domain, const uint8_t *response, size_t response_len, uint32_t ttl) {
-    if (!cache || !domain || !response || response_len > sizeof(cache->response)) {
+bool cache_lookup(const char *domain, uint8_t *response, size_t *response_len) {
+    return cache_lookup_scoped(domain, NULL, response, response_len, NULL, NULL);
+}
+
+void cache_insert_scoped(const char *domain, const struct cache_scope *scope,
+                         const uint8_t *response, size_t response_len, uint32_t ttl) {
+    if (!cache || !domain || !response || response_len > CACHE_MAX_RESPONSE) {
         return;
     }
-    
-    uint32_t index = hash_domain(domain) % config.max_entries;
+
+    // Scope 0 answers are valid for every client asking the same question
+    // with the same DO
+    struct cache_scope key = global_scope;
+    if (scope && scope->family && scope->prefix) {
+        cache_scope_init(&key, scope->family, scope->address, scope->prefix);
+    }
+    copy_question(&key, scope);
+
+    uint32_t name_hash = hash_domain(domain);
+    uint32_t index = hash_key(name_hash, &key) % config.max_entries;
     struct cache_entry *entry = &cache[index];
-    
+    time_t now = time(NULL);
+
+    // A live entry for another key stays unless the new name is more popular
+    if (config.admission && entry->valid && !entry_expired(entry, now) &&
+        (strcmp(entry->domain, domain) != 0 || !scope_equal(&entry->scope, &key)) &&
+        !admission_admit(name_hash, entry->name_hash)) {
+        rejected_count++;
+        return;
+    }
+
+    // Buffers only grow, most answers fit the slab slot
+    if (entry->response_cap < response_len) {
+        size_t cap = response_len;
+        uint8_t *buffer = in_slab(entry->response) ? malloc(cap) : realloc(entry->response, cap);
+        if (!buffer) {
+            return;
+        }
+        entry->response = buffer;
+        entry->response_cap = cap;
+    }
+
     // Update entry
     strncpy(entry->domain, domain, sizeof(entry->domain) - 1);
     entry->domain[sizeof(entry->domain) - 1] = '\0';
+    entry->name_hash = name_hash;
+    entry->scope = key;
     memcpy(entry->response, response, response_len);
     entry->response_len = response_len;
-    entry->timestamp = time(NULL);
+    entry->timestamp = now;
     entry->ttl = ttl > 0 ? ttl : config.default_ttl;
     entry->valid = true;
+    entry->secure = false;
+
+    scope_lengths[key.family][key.prefix / 64] |= 1ULL << (key.prefix % 64);
+}
+
+void cache_insert(const char *domain, const uint8_t *response, size_t response_len, uint32_t ttl) {
+    cache_insert_scoped(domain, NULL, response, response_len, ttl);
+}
+
+// Mark an entry validated, only while it still holds the response that was
+// checked: the slot may have been replaced while a worker verified it
+bool cache_set_secure(const char *domain, const struct cache_scope *scope,
+                      const uint8_t *response, size_t response_len) {
+    if (!cache || !domain || !response) {
+        return false;
+    }
+
+    struct cache_scope key = global_scope;
+    if (scope && scope->family && scope->prefix) {
+        cache_scope_init(&key, scope->family, scope->address, scope->prefix);
+    }
+    copy_question(&key, scope);
+    struct cache_entry *entry = find_entry(domain, hash_domain(domain), &key, time(NULL));
+    if (!entry || entry->response_len != response_len || memcmp(entry->response, response, response_len) != 0) {
+        return false;
+    }
+
+    entry->secure = true;
+    return true;
 }
 
 void cache_cleanup(void) {
@@ -93,22 +305,30 @@ void cache_cleanup(void) {
     size_t cleaned = 0;
     
     for (size_t i = 0; i < config.max_entries; i++) {
-        if (cache[i].valid && (now - cache[i].timestamp > cache[i].ttl)) {
+        if (cache[i].valid && entry_expired(&cache[i], now)) {
             cache[i].valid = false;
             cleaned++;
         }
     }
     
     if (cleaned > 0) {
-        printf("Cleaned %zu expired cache entries\n", cleaned);
+        log_info("Cleaned %zu expired cache entries", cleaned);
     }
 }
 
 void cache_destroy(void) {
     if (cache) {
-        free(cache);
+        for (size_t i = 0; i < config.max_entries; i++) {
+            if (!in_slab(cache[i].response)) {
+                free(cache[i].response);
+            }
+        }
+        hugemem_free(cache);
+        hugemem_free(slab);
         cache = NULL;
+        slab = NULL;
     }
+    admission_destroy();
 }
 
 // Statistics functions
@@ -120,6 +340,11 @@ size_t cache_get_miss_count(void) {
     return miss_count;
 }
 
+// Inserts the admission filter turned away
+size_t cache_get_rejected_count(void) {
+    return rejected_count;
+}
+
 double cache_get_hit_ratio(void) {
     size_t total = hit_count + miss_count;
     if (total == 0) {
@@ -0,0 +1,192 @@
+#include "../include/checksum.h"
+#include <string.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+
+#if defined(__x86_64__) && defined(__GNUC__)
+#include <immintrin.h>
+#define CSUM_HAVE_AVX2 1
+#endif
+
+// -1 until the CPU has been asked
+static int simd_state = -1;
+
+// Fold a 64-bit accumulator back to a 32-bit partial sum. 2^16 is 1 modulo
+// 0xFFFF, so wider words sum to the same checksum as their 16-bit halves.
+static inline uint32_t fold64(uint64_t sum) {
+    sum = (sum & 0xFFFFFFFF) + (sum >> 32);
+    sum = (sum & 0xFFFFFFFF) + (sum >> 32);
+    return (uint32_t)sum;
+}
+
+// An odd last byte is summed as a word padded with a zero byte after it
+static inline uint32_t tail_byte(const uint8_t *p) {
+    uint16_t word = 0;
+    memcpy(&word, p, 1);
+    return word;
+}
+
+// The last len % 8 bytes, zero padded in memory order. When the buffer
+// holds 8 bytes before end they are loaded whole and shifted past the
+// bytes already summed, so packet lengths that vary from one call to the
+// next don't cost a branch misprediction per tail case.
+static inline uint64_t tail_sum(const uint8_t *end, size_t rem, bool whole_word) {
+    uint64_t w = 0;
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+    if (whole_word) {
+        memcpy(&w, end - 8, sizeof(w));
+        w = rem ? w >> (64 - 8 * rem) : 0;
+        return (w & 0xFFFFFFFF) + (w >> 32);
+    }
+#else
+    (void)whole_word;
+#endif
+    memcpy(&w, end - rem, rem);
+    return (w & 0xFFFFFFFF) + (w >> 32);
+}
+
+// Portable kernel: 64-bit loads split into 32-bit halves, so a 64-bit
+// accumulator takes them without carries. whole_word: at least 8 bytes
+// of the buffer lie before p + len.
+static uint32_t csum_partial_words(const uint8_t *p, size_t len, uint32_t sum, bool whole_word) {
+    uint64_t acc = sum;
+
+    while (len >= 32) {
+        uint64_t w[4];
+        memcpy(w, p, sizeof(w));
+        acc += (w[0] & 0xFFFFFFFF) + (w[0] >> 32) + (w[1] & 0xFFFFFFFF) + (w[1] >> 32);
+        acc += (w[2] & 0xFFFFFFFF) + (w[2] >> 32) + (w[3] & 0xFFFFFFFF) + (w[3] >> 32);
+        p += 32;
+        len -= 32;
+    }
+    while (len >= 8) {
+        uint64_t w;
+        memcpy(&w, p, sizeof(w));
+        acc += (w & 0xFFFFFFFF) + (w >> 32);
+        p += 8;
+        len -= 8;
+    }
+    acc += tail_sum(p + len, len, whole_word);
+
+    return fold64(acc);
+}
+
+#ifdef CSUM_HAVE_AVX2
+// Iterations before the 32-bit lanes are spilled: each adds at most
+// 2 * 0xFFFF per lane and accumulator, well clear of overflow
+#define CSUM_AVX2_BLOCK 8192
+
+__attribute__((target("avx2")))
+static inline uint64_t lanes_sum(__m256i v) {
+    uint32_t lanes[8];
+    _mm256_storeu_si256((__m256i *)lanes, v);
+    uint64_t sum = 0;
+    for (int i = 0; i < 8; i++) {
+        sum += lanes[i];
+    }
+    return sum;
+}
+
+// Vector kernel: 64 bytes per iteration, each 32-bit lane split into its
+// 16-bit halves so two accumulators of eight lanes never carry out
+__attribute__((target("avx2")))
+static uint32_t csum_partial_avx2(const uint8_t *p, size_t len, uint32_t sum) {
+    const __m256i mask = _mm256_set1_epi32(0xFFFF);
+    uint64_t acc = sum;
+
+    while (len >= 64) {
+        __m256i acc0 = _mm256_setzero_si256();
+        __m256i acc1 = _mm256_setzero_si256();
+        size_t blocks = len / 64 < CSUM_AVX2_BLOCK ? len / 64 : CSUM_AVX2_BLOCK;
+
+        for (size_t i = 0; i < blocks; i++) {
+            __m256i a = _mm256_loadu_si256((const __m256i *)p);
+            __m256i b = _mm256_loadu_si256((const __m256i *)(p + 32));
+            acc0 = _mm256_add_epi32(acc0, _mm256_and_si256(a, mask));
+            acc1 = _mm256_add_epi32(acc1, _mm256_srli_epi32(a, 16));
+            acc0 = _mm256_add_epi32(acc0, _mm256_and_si256(b, mask));
+            acc1 = _mm256_add_epi32(acc1, _mm256_srli_epi32(b, 16));
+            p += 64;
+        }
+        len -= blocks * 64;
+        acc += lanes_sum(acc0) + lanes_sum(acc1);
+    }
+
+    // Whole 64-byte blocks keep the tail on an even offset
+    return csum_partial_words(p, len, fold64(acc), true);
+}
+
+static bool cpu_has_avx2(void) {
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("avx2");
+}
+#else
+static bool cpu_has_avx2(void) {
+    return false;
+}
+#endif
+
+static inline bool use_simd(void) {
+    if (simd_state < 0) {
+        simd_state = cpu_has_avx2();
+    }
+    return simd_state;
+}
+
+uint32_t csum_partial(const void *buf, size_t len, uint32_t sum) {
+#ifdef CSUM_HAVE_AVX2
+    if (len >= CSUM_SIMD_MIN_LEN && use_simd()) {
+        return csum_partial_avx2(buf, len, sum);
+    }
+#endif
+    return csum_partial_words(buf, len, sum, len >= 8);
+}
+
+uint32_t csum_partial_scalar(const void *buf, size_t len, uint32_t sum) {
+    const uint8_t *p = buf;
+    uint64_t acc = sum;
+
+    while (len > 1) {
+        uint16_t w;
+        memcpy(&w, p, sizeof(w));
+        acc += w;
+        p += 2;
+        len -= 2;
+    }
+    if (len) {
+        acc += tail_byte(p);
+    }
+
+    return fold64(acc);
+}
+
+uint16_t csum_fold(uint32_t sum) {
+    while (sum >> 16) {
+        sum = (sum & 0xFFFF) + (sum >> 16);
+    }
+    return (uint16_t)~sum;
+}
+
+uint32_t csum_pseudo_udp(uint32_t saddr, uint32_t daddr, uint16_t len) {
+    uint64_t sum = (uint64_t)saddr + daddr + htons(IPPROTO_UDP) + htons(len);
+    return fold64(sum);
+}
+
+// RFC 1624 eqn. 3: HC' = ~(~HC + ~m + m')
+uint16_t csum_replace16(uint16_t check, uint16_t old, uint16_t new) {
+    uint32_t sum = (uint32_t)(uint16_t)~check + (uint16_t)~old + new;
+    return csum_fold(sum);
+}
+
+uint16_t csum_replace32(uint16_t check, uint32_t old, uint32_t new) {
+    uint64_t sum = (uint64_t)(uint16_t)~check + (uint32_t)~old + new;
+    return csum_fold(fold64(sum));
+}
+
+const char *csum_impl_name(void) {
+    return use_simd() ? "avx2" : "scalar";
+}
+
+void csum_set_simd(bool enabled) {
+    simd_state = enabled && cpu_has_avx2();
+}
@@ -1,16 +1,18 @@
 #include "../include/dns_query.h"
 #include <string.h>
+#include <strings.h>
 #include <arpa/inet.h>
 
 // Convert domain name to DNS format (e.g., "www.example.com" -> "\03www\07example\03com\0")
-static int encode_domain_name(const char *domain, uint8_t *buffer, size_t buffer_len) {
+static int encode_domain_name(const char *domain, size_t domain_len, uint8_t *buffer, size_t buffer_len) {
     size_t label_len = 0;
     size_t pos = 0;
     const char *label_start = domain;
     
     // Process each character in the domain name
-    for (const char *p = domain; ; p++) {
-        if (*p == '.' || *p == '\0') {
+    for (size_t i = 0; ; i++) {
+        bool end = i == domain_len || domain[i] == '\0';
+        if (end || domain[i] == '.') {
             if (label_len == 0 || label_len > 63) {
                 return -1;  // Invalid label length
             }
@@ -25,13 +27,13 @@ static int encode_domain_name(const char *domain, uint8_t *buffer, size_t buffer
             memcpy(buffer + pos, label_start, label_len);
             pos += label_len;
             
-            if (*p == '\0') {
+            if (end) {
                 break;
             }
             
             // Reset for next label
             label_len = 0;
-            label_start = p + 1;
+            label_start = domain + i + 1;
         } else {
             label_len++;
         }
@@ -60,6 +62,62 @@ void init_query(struct dns_query *query, const char *domain_name, enum DnsQType
     query->name[sizeof(query->name) - 1] = '\0';
     query->qtype = type;
     query->qclass = htons(1);  // IN class
+
+    // Advertise a large UDP buffer so fewer answers come back truncated
+    memset(&query->edns, 0, sizeof(query->edns));
+    query->edns.present = true;
+    query->edns.udp_size = DNS_EDNS_BUFFER_SIZE;
+}
+
+// Bytes of address carried for a prefix length
+static size_t ecs_address_len(uint8_t prefix) {
+    return (prefix + 7) / 8;
+}
+
+static size_t ecs_max_prefix(uint16_t family) {
+    return family == DNS_ECS_FAMILY_IPV4 ? 32 : 128;
+}
+
+static void put16(uint8_t *p, uint16_t v) {
+    p[0] = v >> 8;
+    p[1] = v & 0xFF;
+}
+
+static uint16_t get16(const uint8_t *p) {
+    return ((uint16_t)p[0] << 8) | p[1];
+}
+
+static uint32_t get32(const uint8_t *p) {
+    return ((uint32_t)get16(p) << 16) | get16(p + 2);
+}
+
+// Append the OPT pseudo-record (RFC 6891), returns its length or -1
+static int encode_opt(const struct dns_edns *edns, uint8_t *buffer, size_t buffer_len) {
+    size_t ecs_len = edns->has_ecs ? 8 + ecs_address_len(edns->ecs.source_prefix) : 0;
+    size_t len = DNS_OPT_RR_LEN + ecs_len;
+    if (len > buffer_len) {
+        return -1;
+    }
+
+    buffer[0] = 0;                                  // Root name
+    put16(buffer + 1, OPT);
+    put16(buffer + 3, edns->udp_size);              // Class carries the UDP size
+    buffer[5] = edns->ext_rcode;                    // TTL: extended RCODE, version, flags
+    buffer[6] = edns->version;
+    put16(buffer + 7, edns->dnssec_ok ? 0x8000 : 0);
+    put16(buffer + 9, ecs_len);
+
+    if (edns->has_ecs) {
+        uint8_t *opt = buffer + DNS_OPT_RR_LEN;
+        put16(opt, DNS_EDNS_OPT_ECS);
+        put16(opt + 2, ecs_len - 4);
+        put16(opt + 4, edns->ecs.family);
+        opt[6] = edns->ecs.source_prefix;
+        opt[7] = 0;                                 // Scope is always zero in queries
+        memcpy(opt + 8, edns->ecs.address, ecs_address_len(edns->ecs.source_prefix));
+    }
+
+    return len;
 }
 
 int construct_query(struct dns_query *query, uint8_t *buffer, size_t *buffer_len) {
@@ -72,7 +130,7 @@ int construct_query(struct dns_query *query, uint8_t *buffer, size_t *buffer_len
     size_t pos = sizeof(struct dns_header);
     
     // Encode domain name
-    int name_len = encode_domain_name(query->name, buffer + pos, *buffer_len - pos);
+    int name_len = encode_domain_name(query->name, strlen(query->name), buffer + pos, *buffer_len - pos);
     if (name_len < 0) {
         return -1;
     }
@@ -86,6 +144,16 @@ int construct_query(struct dns_query *query, uint8_t *buffer, size_t *buffer_len
     pos += 2;
     *(uint16_t *)(buffer + pos) = query->qclass;
     pos += 2;
+
+    // OPT goes in the additional section
+    if (query->edns.present) {
+        int opt_len = encode_opt(&query->edns, buffer + pos, *buffer_len - pos);
+        if (opt_len < 0) {
+            return -1;
+        }
+        pos += opt_len;
+        put16(buffer + 10, ntohs(query->header.arcount) + 1);
+    }
     
     *buffer_len = pos;
     return 0;
@@ -96,20 +164,410 @@ int parse_response(const uint8_t *response, size_t response_len, struct dns_quer
         return -1;
     }
     
-    // Copy and validate header
+    // Copy and validate header, fields stay in network byte order like init_query
     memcpy(&query->header, response, sizeof(struct dns_header));
     
-    // Convert header fields from network byte order
-    query->header.flags = ntohs(query->header.flags);
-    query->header.qdcount = ntohs(query->header.qdcount);
-    query->header.ancount = ntohs(query->header.ancount);
-    query->header.nscount = ntohs(query->header.nscount);
-    query->header.arcount = ntohs(query->header.arcount);
-    
     // Check for errors in response
-    if (query->header.flags & 0x000F) {  // RCODE field
+    if (ntohs(query->header.flags) & 0x000F) {  // RCODE field
         return -1;
     }
-    
+
+    // Pick up the responder's EDNS parameters
+    return dns_parse_edns(response, response_len, &query->edns);
+}
+
+int dns_construct_batch(const struct dns_batch_query *queries, size_t count, uint16_t edns_size,
+                        uint8_t *const *buffers, size_t buffer_len, uint16_t *lengths) {
+    // Header and OPT are the same for every query, only the ID differs
+    uint8_t header[sizeof(struct dns_header)] = {0, 0, 0x01, 0x00, 0, 1, 0, 0, 0, 0, 0, edns_size ? 1 : 0};
+    uint8_t opt[DNS_OPT_RR_LEN] = {0, 0, OPT, 0, 0, 0, 0, 0, 0, 0, 0};
+    size_t opt_len = edns_size ? DNS_OPT_RR_LEN : 0;
+    put16(opt + 3, edns_size);
+
+    int built = 0;
+    for (size_t i = 0; i < count; i++) {
+        const struct dns_batch_query *q = &queries[i];
+        uint8_t *buffer = buffers[i];
+        size_t name_len = q->name_len;
+        if (name_len > 1 && q->name[name_len - 1] == '.') {
+            name_len--;
+        }
+
+        lengths[i] = 0;
+        if (buffer_len < sizeof(header) + 4 + opt_len) {
+            continue;
+        }
+
+        memcpy(buffer, header, sizeof(header));
+        put16(buffer, q->id);
+        size_t pos = sizeof(header);
+
+        int encoded = encode_domain_name(q->name, name_len, buffer + pos, buffer_len - pos - 4 - opt_len);
+        if (encoded < 0) {
+            continue;
+        }
+        pos += encoded;
+
+        put16(buffer + pos, q->qtype);
+        put16(buffer + pos + 2, 1);     // IN class
+        pos += 4;
+        memcpy(buffer + pos, opt, opt_len);
+        pos += opt_len;
+
+        lengths[i] = pos;
+        built++;
+    }
+
+    return built;
+}
+
+// Unaligned big-endian load that compiles to a load and a byte swap
+static inline uint16_t load16(const uint8_t *p) {
+    uint16_t v;
+    memcpy(&v, p, sizeof(v));
+    return ntohs(v);
+}
+
+int dns_parse_batch(const uint8_t *const *msgs, const uint16_t *lens, size_t count,
+                    struct dns_batch_result *result) {
+    static const uint8_t empty_header[sizeof(struct dns_header)];
+
+    if (count > DNS_BATCH_MAX) {
+        return -1;
+    }
+
+    // Fixed header fields first, without data-dependent branches; short
+    // messages read a zero header and are masked out
+    uint64_t valid = 0;
+    for (size_t i = 0; i < count; i++) {
+        bool ok = lens[i] >= sizeof(struct dns_header);
+        const uint8_t *h = ok ? msgs[i] : empty_header;
+        result->id[i] = load16(h);
+        result->flags[i] = load16(h + 2);
+        result->rcode[i] = h[3] & 0x0F;
+        result->qdcount[i] = load16(h + 4);
+        result->ancount[i] = load16(h + 6);
+        valid |= (uint64_t)ok << i;
+    }
+
+    // Then the variable-length question walk, inlined for the usual single
+    // uncompressed question
+    for (size_t i = 0; i < count; i++) {
+        const uint8_t *msg = msgs[i];
+        size_t len = lens[i];
+        int end = -1;
+
+        if (!((valid >> i) & 1)) {
+            // Masked out above
+        } else if (result->qdcount[i] == 1) {
+            size_t pos = sizeof(struct dns_header);
+            while (pos < len && msg[pos] && msg[pos] < 0x40) {
+                pos += msg[pos] + 1;
+            }
+            if (pos < len && msg[pos] == 0 && pos + 5 <= len) {
+                end = pos + 5;
+            } else {
+                end = dns_question_end(msg, len);  // Pointers, reserved labels or truncation
+            }
+        } else {
+            end = dns_question_end(msg, len);
+        }
+
+        if (end < 0) {
+            valid &= ~(1ULL << i);
+            end = 0;
+        }
+        result->answer_offset[i] = end;
+    }
+
+    result->count = count;
+    result->valid = valid;
+    return 0;
+}
+
+int dns_skip_name(const uint8_t *msg, size_t len, size_t offset) {
+    // A name has at most 127 labels
+    for (int labels = 0; labels < 128; labels++) {
+        if (offset >= len) {
+            return -1;
+        }
+        uint8_t c = msg[offset];
+        if (c == 0) {
+            return offset + 1;
+        }
+        if ((c & 0xC0) == 0xC0) {
+            // Compression pointer ends the name
+            return offset + 2 <= len ? (int)(offset + 2) : -1;
+        }
+        if (c & 0xC0) {
+            return -1;  // Reserved label types
+        }
+        offset += c + 1;
+    }
+    return -1;
+}
+
+int dns_question_end(const uint8_t *msg, size_t len) {
+    if (len < sizeof(struct dns_header)) {
+        return -1;
+    }
+
+    size_t offset = sizeof(struct dns_header);
+    for (uint16_t i = get16(msg + 4); i > 0; i--) {
+        int end = dns_skip_name(msg, len, offset);
+        if (end < 0 || (size_t)end + 4 > len) {
+            return -1;
+        }
+        offset = end + 4;
+    }
+    return offset;
+}
+
+// Client subnet option, RFC 7871 section 6
+static int parse_ecs(const uint8_t *opt, size_t len, struct dns_ecs *ecs) {
+    if (len < 4) {
+        return -1;
+    }
+
+    memset(ecs, 0, sizeof(*ecs));
+    ecs->family = get16(opt);
+    ecs->source_prefix = opt[2];
+    ecs->scope_prefix = opt[3];
+    if ((ecs->family != DNS_ECS_FAMILY_IPV4 && ecs->family != DNS_ECS_FAMILY_IPV6) ||
+        ecs->source_prefix > ecs_max_prefix(ecs->family) ||
+        ecs->scope_prefix > ecs_max_prefix(ecs->family) ||
+        len - 4 != ecs_address_len(ecs->source_prefix)) {
+        return -1;
+    }
+    memcpy(ecs->address, opt + 4, len - 4);
     return 0;
 }
+
+static int parse_opt(const uint8_t *rr, size_t rr_len, struct dns_edns *edns) {
+    edns->present = true;
+    edns->udp_size = get16(rr + 2);
+    edns->ext_rcode = rr[4];
+    edns->version = rr[5];
+    edns->dnssec_ok = (get16(rr + 6) & 0x8000) != 0;
+
+    // Options are code, length, data
+    const uint8_t *opt = rr + 10;
+    size_t remaining = rr_len - 10;
+    while (remaining >= 4) {
+        uint16_t code = get16(opt);
+        uint16_t opt_len = get16(opt + 2);
+        if ((size_t)opt_len + 4 > remaining) {
+            return -1;
+        }
+        if (code == DNS_EDNS_OPT_ECS) {
+            if (parse_ecs(opt + 4, opt_len, &edns->ecs) != 0) {
+                return -1;
+            }
+            edns->has_ecs = true;
+        }
+        opt += opt_len + 4;
+        remaining -= opt_len + 4;
+    }
+    return remaining ? -1 : 0;
+}
+
+int dns_parse_edns(const uint8_t *msg, size_t len, struct dns_edns *edns) {
+    memset(edns, 0, sizeof(*edns));
+
+    int offset = dns_question_end(msg, len);
+    if (offset < 0) {
+        return -1;
+    }
+
+    unsigned int records = get16(msg + 6) + get16(msg + 8);
+    unsigned int additional = get16(msg + 10);
+    for (unsigned int i = 0; i < records + additional; i++) {
+        int name_start = offset;
+        offset = dns_skip_name(msg, len, offset);
+        if (offset < 0 || (size_t)offset + 10 > len) {
+            return -1;
+        }
+
+        // Type, class, TTL, RDLENGTH
+        const uint8_t *rr = msg + offset;
+        size_t rdlen = get16(rr + 8);
+        if ((size_t)offset + 10 + rdlen > len) {
+            return -1;
+        }
+
+        if (i >= records && get16(rr) == OPT) {
+            // Exactly one OPT, owned by the root
+            if (edns->present || msg[name_start] != 0 || parse_opt(rr, 10 + rdlen, edns) != 0) {
+                return -1;
+            }
+        }
+        offset += 10 + rdlen;
+    }
+    return 0;
+}
+
+void dns_ecs_init(struct dns_ecs *ecs, uint16_t family, const void *address, uint8_t source_prefix) {
+    memset(ecs, 0, sizeof(*ecs));
+    ecs->family = family;
+    ecs->source_prefix = source_prefix < ecs_max_prefix(family) ? source_prefix : ecs_max_prefix(family);
+
+    // Bits past the prefix must be zero on the wire
+    size_t bytes = ecs_address_len(ecs->source_prefix);
+    memcpy(ecs->address, address, bytes);
+    if (ecs->source_prefix % 8) {
+        ecs->address[bytes - 1] &= 0xFF << (8 - ecs->source_prefix % 8);
+    }
+}
+
+int dns_truncate(uint8_t *msg, size_t *len) {
+    int end = dns_question_end(msg, *len);
+    if (end < 0) {
+        return -1;
+    }
+
+    // Keep the header and question, flag TC so the client retries over TCP
+    msg[2] |= 0x02;
+    memset(msg + 6, 0, 6);
+    *len = end;
+    return 0;
+}
+
+// How long a response may be cached: its smallest answer TTL, or for a
+// negative answer the TTL of the SOA in the authority section
+int dns_answer_ttl(const uint8_t *msg, size_t len, uint32_t *ttl) {
+    int offset = dns_question_end(msg, len);
+    if (offset < 0) {
+        return -1;
+    }
+
+    unsigned int answers = get16(msg + 6);
+    unsigned int records = answers + get16(msg + 8);
+    uint32_t min = UINT32_MAX;
+    bool found = false;
+    for (unsigned int i = 0; i < records; i++) {
+        offset = dns_skip_name(msg, len, offset);
+        if (offset < 0 || (size_t)offset + 10 > len) {
+            return -1;
+        }
+
+        const uint8_t *rr = msg + offset;
+        size_t rdlen = get16(rr + 8);
+        if ((size_t)offset + 10 + rdlen > len) {
+            return -1;
+        }
+
+        // TTLs with the top bit set count as zero (RFC 2181 section 8)
+        uint32_t rr_ttl = get32(rr + 4);
+        if (rr_ttl > 0x7FFFFFFF) {
+            rr_ttl = 0;
+        }
+
+        if (i < answers) {
+            found = true;
+        } else if (!answers && get16(rr) == SOA && rdlen >= 20) {
+            // Negative answers live for the SOA MINIMUM at most (RFC 2308 section 5)
+            uint32_t minimum = get32(rr + 10 + rdlen - 4);
+            if (minimum < rr_ttl) {
+                rr_ttl = minimum;
+            }
+            found = true;
+        } else {
+            rr_ttl = UINT32_MAX;
+        }
+
+        if (rr_ttl < min) {
+            min = rr_ttl;
+        }
+        offset += 10 + rdlen;
+    }
+
+    // Without records or an SOA there is nothing to say how long it stays valid
+    if (!found) {
+        return -1;
+    }
+    *ttl = min;
+    return 0;
+}
+
+// Count the TTLs of a cached response down by the seconds it has been held,
+// stopping at zero. The OPT record is left alone: its TTL field holds the
+// extended RCODE and flags.
+int dns_age_ttls(uint8_t *msg, size_t len, uint32_t age) {
+    int offset = dns_question_end(msg, len);
+    if (offset < 0) {
+        return -1;
+    }
+
+    unsigned int records = get16(msg + 6) + get16(msg + 8) + get16(msg + 10);
+    for (unsigned int i = 0; i < records; i++) {
+        offset = dns_skip_name(msg, len, offset);
+        if (offset < 0 || (size_t)offset + 10 > len) {
+            return -1;
+        }
+
+        uint8_t *rr = msg + offset;
+        size_t rdlen = get16(rr + 8);
+        if ((size_t)offset + 10 + rdlen > len) {
+            return -1;
+        }
+        if (get16(rr) != OPT) {
+            uint32_t ttl = get32(rr + 4);
+            ttl = ttl > 0x7FFFFFFF || ttl < age ? 0 : ttl - age;
+            put16(rr + 4, ttl >> 16);
+            put16(rr + 6, ttl & 0xFFFF);
+        }
+        offset += 10 + rdlen;
+    }
+    return 0;
+}
+
+// Wire-format name to dotted text
+void dns_name_to_text(const uint8_t *name, size_t max, char *out, size_t out_len) {
+    size_t pos = 0, o = 0;
+
+    while (pos < max && name[pos] && o + 1 < out_len) {
+        size_t label = name[pos++];
+        if (o && o + 1 < out_len) {
+            out[o++] = '.';
+        }
+        for (size_t i = 0; i < label && pos < max && o + 1 < out_len; i++) {
+            out[o++] = name[pos++];
+        }
+    }
+    out[o] = '\0';
+}
+
+// Record type name table
+static const struct {
+    enum DnsQType qtype;
+    const char *name;
+} qtype_names[] = {
+    {A, "A"},
+    {NS, "NS"},
+    {CNAME, "CNAME"},
+    {SOA, "SOA"},
+    {PTR, "PTR"},
+    {MX, "MX"},
+    {TXT, "TXT"},
+    {AAAA, "AAAA"},
+    {OPT, "OPT"},
+};
+
+const char *dns_qtype_name(uint16_t qtype) {
+    for (size_t i = 0; i < sizeof(qtype_names) / sizeof(qtype_names[0]); i++) {
+        if (qtype_names[i].qtype == qtype) {
+            return qtype_names[i].name;
+        }
+    }
+    return "UNKNOWN";
+}
+
+int dns_qtype_parse(const char *name, enum DnsQType *qtype) {
+    for (size_t i = 0; i < sizeof(qtype_names) / sizeof(qtype_names[0]); i++) {
+        if (strcasecmp(qtype_names[i].name, name) == 0) {
+            *qtype = qtype_names[i].qtype;
+            return 0;
+        }
+    }
+    return -1;
+}
@@ -0,0 +1,474 @@
+#include "../include/forward.h"
+#include "../include/io_backend.h"
+#include "../include/resolvers.h"
+#include "../include/dns_query.h"
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <errno.h>
+#include <time.h>
+#include <arpa/inet.h>
+
+#define FORWARD_QUERY_MAX   512     // Largest client query forwarded
+#define FORWARD_NONE        UINT32_MAX
+
+// One outstanding upstream query; the slot index is its message ID. Later
+// misses for the same key wait on it instead of going upstream themselves
+struct forward_slot {
+    uint64_t sent_ns;               // Last transmission
+    uint32_t generation;            // Bumped on reuse, stale timers are ignored
+    int resolver;                   // Resolver of the last transmission
+    uint8_t attempts;
+    bool busy;
+    bool indexed;                   // Reachable through the key index
+    bool dnssec_ok;                 // Part of the key, DO changes the answer
+    uint16_t query_len;
+    uint16_t question_end;          // Offset past the question
+    uint32_t hash;                  // Key hash
+    uint32_t hash_next;             // Next slot in the same bucket
+    uint32_t waiter_head;           // First waiter, FORWARD_NONE when alone
+    uint32_t waiter_tail;
+    uint32_t waiters;
+    struct dns_ecs ecs;             // Client subnet part of the key (family 0 = none)
+    struct forward_client client;   // Client whose miss created the query
+    uint8_t query[FORWARD_QUERY_MAX]; // Client's query carrying the upstream ID
+};
+
+// Client attached to an outstanding query
+struct forward_waiter {
+    struct forward_client client;
+    uint32_t next;
+};
+
+// Retransmit timer, queued in send order
+struct forward_timer {
+    uint64_t deadline_ns;
+    uint32_t slot;
+    uint32_t generation;
+};
+
+// Static forwarding state
+static struct forward_config config;
+static struct io_backend *io = NULL;
+static struct forward_slot *slots = NULL;
+static uint32_t *free_slots = NULL;
+static uint32_t free_count = 0;
+static uint32_t *buckets = NULL;        // Key index, max_pending chains
+static struct forward_waiter *waiters = NULL;
+static uint32_t waiter_free = FORWARD_NONE;
+static struct forward_timer *timers = NULL;
+static size_t timer_head = 0;
+static size_t timer_count = 0;
+static size_t timer_capacity = 0;
+static uint16_t id_key = 0;
+static struct forward_stats stats;
+
+static inline uint64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+// A query has one live timer at most, so the ring, twice the slot count, is
+// never short of room once the stale timers of finished queries are dropped
+static void timer_push(uint32_t slot, uint64_t deadline_ns) {
+    if (timer_count == timer_capacity) {
+        size_t kept = 0;
+        for (size_t i = 0; i < timer_count; i++) {
+            const struct forward_timer *t = &timers[(timer_head + i) % timer_capacity];
+            const struct forward_slot *owner = &slots[t->slot];
+            if (owner->busy && owner->generation == t->generation) {
+                timers[(timer_head + kept++) % timer_capacity] = *t;
+            }
+        }
+        timer_count = kept;
+    }
+
+    struct forward_timer *t = &timers[(timer_head + timer_count++) % timer_capacity];
+    t->deadline_ns = deadline_ns;
+    t->slot = slot;
+    t->generation = slots[slot].generation;
+}
+
+// FNV-1a over the question and the rest of the key
+static uint32_t key_hash(const uint8_t *question, size_t len, const struct dns_ecs *ecs, bool dnssec_ok) {
+    uint32_t hash = 2166136261u;
+    for (size_t i = 0; i < len; i++) {
+        hash = (hash ^ question[i]) * 16777619u;
+    }
+    if (ecs->family) {
+        hash = (hash ^ ecs->family) * 16777619u;
+        hash = (hash ^ ecs->source_prefix) * 16777619u;
+        for (size_t i = 0; i < (size_t)(ecs->source_prefix + 7) / 8; i++) {
+            hash = (hash ^ ecs->address[i]) * 16777619u;
+        }
+    }
+    return (hash ^ dnssec_ok) * 16777619u;
+}
+
+// Outstanding query with this key, if any
+static struct forward_slot *key_find(uint32_t hash, const uint8_t *msg, size_t question_end,
+                                     const struct dns_ecs *ecs, bool dnssec_ok) {
+    for (uint32_t i = buckets[hash % config.max_pending]; i != FORWARD_NONE; i = slots[i].hash_next) {
+        struct forward_slot *slot = &slots[i];
+        if (slot->hash == hash && slot->question_end == question_end && slot->dnssec_ok == dnssec_ok &&
+            memcmp(&slot->ecs, ecs, sizeof(*ecs)) == 0 &&
+            memcmp(slot->query + sizeof(struct dns_header), msg + sizeof(struct dns_header),
+                   question_end - sizeof(struct dns_header)) == 0) {
+            return slot;
+        }
+    }
+    return NULL;
+}
+
+static void key_unlink(uint32_t index) {
+    struct forward_slot *slot = &slots[index];
+    uint32_t *link = &buckets[slot->hash % config.max_pending];
+    while (*link != FORWARD_NONE && *link != index) {
+        link = &slots[*link].hash_next;
+    }
+    if (*link == index) {
+        *link = slot->hash_next;
+    }
+    slot->indexed = false;
+}
+
+static void release_slot(uint32_t index) {
+    struct forward_slot *slot = &slots[index];
+    if (slot->indexed) {
+        key_unlink(index);
+    }
+
+    // Waiters go back on the free list in one splice
+    if (slot->waiter_head != FORWARD_NONE) {
+        waiters[slot->waiter_tail].next = waiter_free;
+        waiter_free = slot->waiter_head;
+        slot->waiter_head = FORWARD_NONE;
+    }
+    slot->waiters = 0;
+
+    slot->busy = false;
+    slot->generation++;
+    free_slots[free_count++] = index;
+}
+
+// Everyone waiting on a slot, the creator first; returns the count
+static size_t slot_clients(const struct forward_slot *slot, struct forward_client *clients) {
+    size_t n = 0;
+    clients[n++] = slot->client;
+    for (uint32_t w = slot->waiter_head; w != FORWARD_NONE; w = waiters[w].next) {
+        clients[n++] = waiters[w].client;
+    }
+    return n;
+}
+
+static int send_upstream(uint32_t index) {
+    struct forward_slot *slot = &slots[index];
+    slot->attempts++;
+
+    // A retransmit goes to another resolver when there is one
+    uint64_t now = now_ns();
+    int resolver = resolvers_select(now, slot->attempts > 1 ? slot->resolver : -1);
+    const struct resolver *r = resolvers_get(resolver);
+    slot->resolver = -1;
+    if (!r) {
+        return -ENOENT;
+    }
+
+    size_t capacity;
+    uint8_t *frame = io_backend_tx_buffer(io, &capacity);
+    if (!frame) {
+        stats.tx_failures++;
+        return -ENOBUFS;
+    }
+
+    struct packet_endpoint dst = {
+        .ip = r->ip,
+        .port = r->port
+    };
+    memcpy(dst.mac, config.gateway_mac, ETH_ADDR_LEN);
+
+    int len = packet_build_udp(frame, capacity, &config.src, &dst, slot->query, slot->query_len);
+    if (len < 0 || io_backend_tx(io, frame, len) != 0) {
+        stats.tx_failures++;
+        return -ENOBUFS;
+    }
+
+    slot->resolver = resolver;
+    slot->sent_ns = now;
+    resolvers_sent(resolver);
+    timer_push(index, slot->sent_ns + (uint64_t)config.timeout_ms * 1000000ULL);
+    return 0;
+}
+
+// Tell every client we gave up: its question back with SERVFAIL
+static void send_servfail(const struct forward_slot *slot) {
+    struct forward_client clients[FORWARD_MAX_CLIENTS];
+    uint8_t *frames[FORWARD_MAX_CLIENTS];
+    uint32_t lens[FORWARD_MAX_CLIENTS];
+    size_t count = slot_clients(slot, clients);
+    size_t n = 0;
+
+    for (size_t i = 0; i < count; i++) {
+        size_t capacity;
+        uint8_t *frame = io_backend_tx_buffer(io, &capacity);
+        if (!frame || capacity < (size_t)PACKET_HDR_LEN + slot->question_end) {
+            stats.tx_failures++;
+            continue;
+        }
+
+        // Built in place, packet_build_udp leaves the payload where it is
+        uint8_t *msg = frame + PACKET_HDR_LEN;
+        memcpy(msg, slot->query, slot->question_end);
+        memcpy(msg, &clients[i].id, sizeof(clients[i].id));
+        msg[2] = 0x80 | (slot->query[2] & 0x79);   // QR, keep opcode and RD
+        msg[3] = 0x80 | 2;                          // RA, SERVFAIL
+        memset(msg + 6, 0, 6);
+
+        int len = packet_build_udp(frame, capacity, &clients[i].local, &clients[i].addr,
+                                   msg, slot->question_end);
+        if (len < 0) {
+            stats.tx_failures++;
+            continue;
+        }
+        frames[n] = frame;
+        lens[n++] = len;
+    }
+
+    if (n && io_backend_tx_batch(io, frames, lens, n) != 0) {
+        stats.tx_failures += n;
+    }
+}
+
+int forward_init(const struct forward_config *cfg, struct io_backend *backend) {
+    memset(&stats, 0, sizeof(stats));
+    config = *cfg;
+    io = backend;
+
+    if (!config.timeout_ms) {
+        config.timeout_ms = FORWARD_TIMEOUT_MS;
+    }
+    if (!config.max_pending || config.max_pending > FORWARD_MAX_PENDING) {
+        config.max_pending = FORWARD_MAX_PENDING;
+    }
+    if (!resolvers_count()) {
+        return -ENOENT;
+    }
+
+    slots = calloc(config.max_pending, sizeof(*slots));
+    free_slots = malloc(config.max_pending * sizeof(*free_slots));
+    buckets = malloc(config.max_pending * sizeof(*buckets));
+    waiters = malloc(config.max_pending * sizeof(*waiters));
+    timer_capacity = 2 * (size_t)config.max_pending;
+    timers = malloc(timer_capacity * sizeof(*timers));
+    if (!slots || !free_slots || !buckets || !waiters || !timers) {
+        forward_destroy();
+        return -ENOMEM;
+    }
+
+    free_count = 0;
+    for (uint32_t i = config.max_pending; i > 0; i--) {
+        free_slots[free_count++] = i - 1;
+        slots[i - 1].waiter_head = FORWARD_NONE;
+        buckets[i - 1] = FORWARD_NONE;
+    }
+
+    // As many waiters as slots; past that, misses go upstream on their own
+    for (uint32_t i = 0; i < config.max_pending; i++) {
+        waiters[i].next = i + 1 < config.max_pending ? i + 1 : FORWARD_NONE;
+    }
+    waiter_free = 0;
+
+    // Upstream IDs are not guessable from the slot number
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    id_key = (uint16_t)(ts.tv_nsec ^ (ts.tv_nsec >> 16));
+    return 0;
+}
+
+int forward_query(const struct packet_info *request, const struct dns_edns *edns, uint16_t udp_limit) {
+    if (!slots) {
+        return -ENODEV;
+    }
+    if (request->payload_len > FORWARD_QUERY_MAX) {
+        return -EMSGSIZE;
+    }
+
+    int question_end = dns_question_end(request->payload, request->payload_len);
+    if (question_end < 0) {
+        return -EINVAL;
+    }
+
+    struct forward_client client = {
+        .addr = request->src,
+        .local = request->dst,
+        .udp_limit = udp_limit,
+        .dnssec_ok = edns->dnssec_ok
+    };
+    memcpy(&client.id, request->payload, sizeof(client.id));
+
+    // Keyed like the cache: question plus client subnet, and the DO bit
+    struct dns_ecs ecs;
+    memset(&ecs, 0, sizeof(ecs));
+    if (edns->has_ecs) {
+        dns_ecs_init(&ecs, edns->ecs.family, edns->ecs.address, edns->ecs.source_prefix);
+    }
+    uint32_t hash = key_hash(request->payload + sizeof(struct dns_header),
+                             question_end - sizeof(struct dns_header), &ecs, edns->dnssec_ok);
+
+    // Same key already upstream: wait for its answer
+    struct forward_slot *pending = key_find(hash, request->payload, question_end, &ecs, edns->dnssec_ok);
+    if (pending && pending->waiters + 1 < FORWARD_MAX_CLIENTS && waiter_free != FORWARD_NONE) {
+        uint32_t w = waiter_free;
+        waiter_free = waiters[w].next;
+        waiters[w].client = client;
+        waiters[w].next = FORWARD_NONE;
+        if (pending->waiter_head == FORWARD_NONE) {
+            pending->waiter_head = w;
+        } else {
+            waiters[pending->waiter_tail].next = w;
+        }
+        pending->waiter_tail = w;
+        pending->waiters++;
+        stats.coalesced++;
+        return 0;
+    }
+
+    if (!free_count) {
+        stats.overflows++;
+        return -EBUSY;
+    }
+
+    uint32_t index = free_slots[--free_count];
+    struct forward_slot *slot = &slots[index];
+    slot->busy = true;
+    slot->attempts = 0;
+    slot->query_len = request->payload_len;
+    slot->question_end = question_end;
+    slot->client = client;
+    slot->ecs = ecs;
+    slot->dnssec_ok = edns->dnssec_ok;
+    slot->hash = hash;
+
+    // A full query leaves the index, later misses wait on this one instead
+    if (pending) {
+        key_unlink(pending - slots);
+    }
+    slot->indexed = true;
+    slot->hash_next = buckets[hash % config.max_pending];
+    buckets[hash % config.max_pending] = index;
+
+    // Forwarded verbatim apart from the ID, so EDNS and ECS reach the resolver
+    uint16_t id = htons((uint16_t)index ^ id_key);
+    memcpy(slot->query, request->payload, request->payload_len);
+    memcpy(slot->query, &id, sizeof(id));
+
+    stats.forwarded++;
+    if (send_upstream(index) != 0) {
+        timer_push(index, now_ns() + (uint64_t)config.timeout_ms * 1000000ULL);
+    }
+    return 0;
+}
+
+// Fills clients (FORWARD_MAX_CLIENTS entries) with everyone waiting on the
+// answer, returns how many or a negative errno
+int forward_match(const struct packet_info *answer, struct forward_client *clients) {
+    if (!slots || answer->dst.port != config.src.port) {
+        return -ENOENT;
+    }
+    if (answer->payload_len < sizeof(struct dns_header)) {
+        stats.unmatched++;
+        return -EINVAL;
+    }
+
+    uint16_t id;
+    memcpy(&id, answer->payload, sizeof(id));
+    uint32_t index = (uint16_t)(ntohs(id) ^ id_key);
+    if (index >= config.max_pending) {
+        stats.unmatched++;
+        return -EINVAL;
+    }
+
+    // Must come from the resolver we asked, for the question we asked
+    struct forward_slot *slot = &slots[index];
+    const struct resolver *r = resolvers_get(slot->resolver);
+    size_t question_len = slot->question_end - sizeof(struct dns_header);
+    if (!slot->busy || !r || r->ip != answer->src.ip || r->port != answer->src.port ||
+        answer->payload_len < slot->question_end ||
+        memcmp(answer->payload + sizeof(struct dns_header), slot->query + sizeof(struct dns_header),
+               question_len) != 0) {
+        stats.unmatched++;
+        return -EINVAL;
+    }
+
+    // Karn: only answers to a single transmission time the resolver
+    resolvers_answered(slot->resolver, slot->attempts == 1 ? now_ns() - slot->sent_ns : 0);
+
+    size_t count = slot_clients(slot, clients);
+    stats.answers++;
+    if (count > stats.fanout_max) {
+        stats.fanout_max = count;
+    }
+    release_slot(index);
+    return (int)count;
+}
+
+void forward_tick(void) {
+    if (!slots) {
+        return;
+    }
+
+    uint64_t now = now_ns();
+    while (timer_count) {
+        struct forward_timer *t = &timers[timer_head];
+        if (t->deadline_ns > now) {
+            break;
+        }
+
+        uint32_t index = t->slot;
+        struct forward_slot *slot = &slots[index];
+        bool live = slot->busy && slot->generation == t->generation;
+        timer_head = (timer_head + 1) % timer_capacity;
+        timer_count--;
+        if (!live) {
+            continue;
+        }
+
+        resolvers_timed_out(slot->resolver, now);
+        if (slot->attempts > config.retries) {
+            stats.timeouts++;
+            send_servfail(slot);
+            release_slot(index);
+            continue;
+        }
+
+        // Another resolver gets the retransmit
+        stats.retransmits++;
+        if (send_upstream(index) != 0) {
+            timer_push(index, now + (uint64_t)config.timeout_ms * 1000000ULL);
+        }
+    }
+}
+
+size_t forward_pending(void) {
+    return slots ? config.max_pending - free_count : 0;
+}
+
+void forward_get_stats(struct forward_stats *out) {
+    *out = stats;
+}
+
+void forward_destroy(void) {
+    free(slots);
+    free(free_slots);
+    free(buckets);
+    free(waiters);
+    free(timers);
+    slots = NULL;
+    free_slots = NULL;
+    buckets = NULL;
+    waiters = NULL;
+    timers = NULL;
+    timer_head = timer_count = timer_capacity = 0;
+    free_count = 0;
+}
@@ -0,0 +1,191 @@
+#include "../include/hugemem.h"
+#include "../include/log.h"
+#include <stdio.h>
+#include <string.h>
+#include <strings.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+
+#ifndef MAP_HUGE_SHIFT
+#define MAP_HUGE_SHIFT 26
+#endif
+
+#ifndef MAP_HUGE_2MB
+#define MAP_HUGE_2MB (21 << MAP_HUGE_SHIFT)
+#endif
+
+#ifndef MAP_HUGE_1GB
+#define MAP_HUGE_1GB (30 << MAP_HUGE_SHIFT)
+#endif
+
+// Memory policy constants from <numaif.h>, which only libnuma ships
+#define MPOL_BIND           2
+#define MPOL_MF_MOVE        (1 << 1)
+#define MPOL_F_NODE         (1 << 0)
+#define MPOL_F_ADDR         (1 << 1)
+#define NODEMASK_LONGS      16      // Nodes 0-1023
+
+#define PAGE_2M             (2UL << 20)
+#define PAGE_1G             (1UL << 30)
+
+// Static placement state, the default maps lazily like calloc
+static struct hugemem_config config = {.numa_node = -1, .pages = HUGEMEM_PAGES_4K};
+static struct hugemem_region regions[HUGEMEM_MAX_REGIONS];
+static size_t region_count = 0;
+
+int hugemem_init(const struct hugemem_config *cfg) {
+    if (cfg->numa_node >= NODEMASK_LONGS * 64) {
+        return -EINVAL;
+    }
+    config = *cfg;
+    return 0;
+}
+
+static size_t base_page(void) {
+    long size = sysconf(_SC_PAGESIZE);
+    return size > 0 ? (size_t)size : 4096;
+}
+
+static void *map_pages(size_t size, size_t page_size) {
+    int flags = MAP_PRIVATE | MAP_ANONYMOUS;
+    if (page_size == PAGE_2M) {
+        flags |= MAP_HUGETLB | MAP_HUGE_2MB;
+    } else if (page_size == PAGE_1G) {
+        flags |= MAP_HUGETLB | MAP_HUGE_1GB;
+    }
+    return mmap(NULL, size, PROT_READ | PROT_WRITE, flags, -1, 0);
+}
+
+// Bind before the first touch so every page is allocated on the node
+static int bind_node(void *addr, size_t size, int node) {
+    unsigned long mask[NODEMASK_LONGS] = {0};
+    mask[node / 64] = 1UL << (node % 64);
+    if (syscall(SYS_mbind, addr, size, MPOL_BIND, mask, NODEMASK_LONGS * 64 + 1, MPOL_MF_MOVE) != 0) {
+        // A kernel without NUMA support has a single node anyway
+        return errno == ENOSYS ? 0 : -errno;
+    }
+    return 0;
+}
+
+static int page_node(void *addr) {
+    int node = -1;
+    if (syscall(SYS_get_mempolicy, &node, NULL, 0, addr, MPOL_F_NODE | MPOL_F_ADDR) != 0) {
+        return -1;
+    }
+    return node;
+}
+
+// Regions under 2M keep base pages, a huge page would be mostly waste.
+// Explicit 2M and 1G fail when the pool is empty, auto falls back to base
+// pages and the region's page_size shows it.
+void *hugemem_alloc(const char *name, size_t size) {
+    if (region_count == HUGEMEM_MAX_REGIONS || size == 0) {
+        errno = region_count == HUGEMEM_MAX_REGIONS ? ENOMEM : EINVAL;
+        return NULL;
+    }
+
+    size_t page_size = base_page();
+    if (size >= PAGE_2M) {
+        if (config.pages == HUGEMEM_PAGES_AUTO || config.pages == HUGEMEM_PAGES_2M) {
+            page_size = PAGE_2M;
+        } else if (config.pages == HUGEMEM_PAGES_1G) {
+            page_size = PAGE_1G;
+        }
+    }
+
+    struct hugemem_region region = {.name = name, .page_size = page_size, .node = -1};
+    region.size = (size + page_size - 1) / page_size * page_size;
+    region.addr = map_pages(region.size, page_size);
+    if (region.addr == MAP_FAILED && config.pages == HUGEMEM_PAGES_AUTO && page_size != base_page()) {
+        region.page_size = base_page();
+        region.size = (size + region.page_size - 1) / region.page_size * region.page_size;
+        region.addr = map_pages(region.size, region.page_size);
+    }
+    if (region.addr == MAP_FAILED) {
+        int err = errno;
+        log_error("Failed to map %s with %s pages: errno %d", name, hugemem_page_name(region.page_size), err);
+        errno = err;
+        return NULL;
+    }
+
+    if (config.numa_node >= 0) {
+        int ret = bind_node(region.addr, region.size, config.numa_node);
+        if (ret) {
+            munmap(region.addr, region.size);
+            errno = -ret;
+            return NULL;
+        }
+    }
+
+    // Fault every page in now rather than on the packet path
+    if (config.lock) {
+        for (size_t off = 0; off < region.size; off += region.page_size) {
+            ((volatile uint8_t *)region.addr)[off] = 0;
+        }
+        region.locked = mlock(region.addr, region.size) == 0;
+        region.node = page_node(region.addr);
+    }
+
+    regions[region_count++] = region;
+    return region.addr;
+}
+
+void hugemem_free(void *addr) {
+    for (size_t i = 0; i < region_count; i++) {
+        if (regions[i].addr == addr) {
+            munmap(addr, regions[i].size);
+            regions[i] = regions[--region_count];
+            return;
+        }
+    }
+}
+
+// Live regions, in no particular order
+size_t hugemem_regions(const struct hugemem_region **out) {
+    *out = regions;
+    return region_count;
+}
+
+// Node the NIC hangs off, -1 for virtual devices and single-node machines
+int hugemem_nic_node(const char *ifname) {
+    char path[128];
+    snprintf(path, sizeof(path), "/sys/class/net/%s/device/numa_node", ifname);
+
+    FILE *fp = fopen(path, "r");
+    if (!fp) {
+        return -1;
+    }
+    int node = -1;
+    if (fscanf(fp, "%d", &node) != 1) {
+        node = -1;
+    }
+    fclose(fp);
+    return node;
+}
+
+int hugemem_pages_parse(const char *name, enum hugemem_pages *pages) {
+    if (strcasecmp(name, "auto") == 0) {
+        *pages = HUGEMEM_PAGES_AUTO;
+    } else if (strcasecmp(name, "4k") == 0 || strcasecmp(name, "off") == 0) {
+        *pages = HUGEMEM_PAGES_4K;
+    } else if (strcasecmp(name, "2m") == 0) {
+        *pages = HUGEMEM_PAGES_2M;
+    } else if (strcasecmp(name, "1g") == 0) {
+        *pages = HUGEMEM_PAGES_1G;
+    } else {
+        return -1;
+    }
+    return 0;
+}
+
+const char *hugemem_page_name(size_t page_size) {
+    if (page_size == PAGE_1G) {
+        return "1G";
+    }
+    if (page_size == PAGE_2M) {
+        return "2M";
+    }
+    return page_size == 4096 ? "4K" : "base";
+}
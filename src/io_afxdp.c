@@ -0,0 +1,101 @@
+#include "../include/io_backend.h"
+#include "../include/af_xdp_init.h"
+#include <errno.h>
+
+// AF_XDP backend: thin adapter over af_xdp_init.c
+
+static int afxdp_wait(struct io_backend *io, int timeout_ms) {
+    return af_xdp_socket_wait(io->priv, timeout_ms);
+}
+
+static void afxdp_rx(struct io_backend *io, io_packet_handler handler) {
+    struct xdp_socket *xsk_socket = io->priv;
+    uint64_t before = xsk_socket->stats.rx_packets;
+
+    af_xdp_socket_rx(xsk_socket, handler);
+    io->stats.rx_packets += xsk_socket->stats.rx_packets - before;
+}
+
+static uint8_t *afxdp_tx_buffer(struct io_backend *io, size_t *capacity) {
+    struct xdp_socket *xsk_socket = io->priv;
+    uint64_t addr = af_xdp_frame_alloc(xsk_socket);
+
+    // Out of frames: reap completions once before giving up
+    if (addr == XSK_INVALID_FRAME) {
+        af_xdp_socket_complete_tx(xsk_socket);
+        addr = af_xdp_frame_alloc(xsk_socket);
+        if (addr == XSK_INVALID_FRAME) {
+            io->stats.tx_dropped++;
+            return NULL;
+        }
+    }
+
+    // TX metadata, when used, sits just in front of the packet
+    *capacity = XSK_UMEM_FRAME_SIZE - xsk_socket->tx_headroom;
+    return xsk_umem__get_data(xsk_socket->buffer, addr + xsk_socket->tx_headroom);
+}
+
+static int afxdp_tx(struct io_backend *io, uint8_t *frame, size_t len) {
+    struct xdp_socket *xsk_socket = io->priv;
+
+    int ret = af_xdp_socket_tx(xsk_socket, frame, len);
+    if (ret) {
+        af_xdp_frame_free(xsk_socket, (uint64_t)(frame - (uint8_t *)xsk_socket->buffer));
+        io->stats.tx_dropped++;
+        return ret;
+    }
+
+    io->stats.tx_packets++;
+    io->stats.tx_bytes += len;
+    return 0;
+}
+
+static int afxdp_tx_batch(struct io_backend *io, uint8_t *const *frames, const uint32_t *lens, size_t count) {
+    struct xdp_socket *xsk_socket = io->priv;
+
+    int ret = af_xdp_socket_tx_batch(xsk_socket, frames, lens, count);
+    if (ret) {
+        for (size_t i = 0; i < count; i++) {
+            af_xdp_frame_free(xsk_socket, (uint64_t)(frames[i] - (uint8_t *)xsk_socket->buffer));
+        }
+        io->stats.tx_dropped += count;
+        return ret;
+    }
+
+    io->stats.tx_packets += count;
+    for (size_t i = 0; i < count; i++) {
+        io->stats.tx_bytes += lens[i];
+    }
+    return 0;
+}
+
+static void afxdp_flush(struct io_backend *io) {
+    af_xdp_socket_complete_tx(io->priv);
+}
+
+static void afxdp_cleanup(struct io_backend *io) {
+    af_xdp_socket_cleanup(io->priv);
+}
+
+static const struct io_backend_ops afxdp_ops = {
+    .wait = afxdp_wait,
+    .rx = afxdp_rx,
+    .tx_buffer = afxdp_tx_buffer,
+    .tx = afxdp_tx,
+    .tx_batch = afxdp_tx_batch,
+    .flush = afxdp_flush,
+    .cleanup = afxdp_cleanup,
+};
+
+int io_backend_afxdp_init(struct io_backend *io, struct xdp_socket *xsk_socket,
+                          struct xdp_socket_config *config) {
+    int ret = af_xdp_socket_init(xsk_socket, config);
+    if (ret) {
+        return ret;
+    }
+
+    io->ops = &afxdp_ops;
+    io->name = "afxdp";
+    io->priv = xsk_socket;
+    return 0;
+}
@@ -0,0 +1,192 @@
+#include "../include/io_backend.h"
+#include "../include/workload.h"
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+// In-memory backend: replays a workload on RX and records TX into a ring
+
+#define MEM_FRAME_SIZE      2048
+#define MEM_TX_RING_SIZE    4096
+#define MEM_BATCH_SIZE      64
+
+struct mem_backend {
+    const struct workload *workload; // Frames replayed on RX
+    size_t loops;                   // Passes to replay
+    size_t pass;                    // Current pass
+    size_t cursor;                  // Next workload frame
+    bool loopback;                  // Transmitted frames are received again
+    uint8_t *tx_frames;             // tx_ring_size frames of MEM_FRAME_SIZE
+    uint32_t *tx_lengths;           // Length of each TX slot
+    uint32_t tx_ring_size;          // Number of TX slots
+    size_t tx_head;                 // Total frames transmitted
+    size_t tx_handed;               // Buffers handed out and not yet queued
+    size_t loop_cursor;             // Next transmitted frame to loop back
+};
+
+static bool mem_workload_pending(const struct mem_backend *mem) {
+    return mem->workload && mem->workload->count && mem->pass < mem->loops;
+}
+
+static bool mem_loopback_pending(const struct mem_backend *mem) {
+    return mem->loopback && mem->loop_cursor < mem->tx_head;
+}
+
+static int mem_wait(struct io_backend *io, int timeout_ms) {
+    (void)timeout_ms;
+    struct mem_backend *mem = io->priv;
+    return mem_loopback_pending(mem) || mem_workload_pending(mem);
+}
+
+static void mem_rx(struct io_backend *io, io_packet_handler handler) {
+    struct mem_backend *mem = io->priv;
+    unsigned int budget = MEM_BATCH_SIZE;
+
+    // Looped-back frames first so replies are seen before new load
+    while (budget && mem_loopback_pending(mem)) {
+        // Frames overwritten by a wrapped ring are lost, like a real NIC overrun
+        if (mem->tx_head - mem->loop_cursor > mem->tx_ring_size) {
+            mem->loop_cursor = mem->tx_head - mem->tx_ring_size;
+        }
+        uint32_t slot = mem->loop_cursor++ % mem->tx_ring_size;
+        const uint8_t *frame = mem->tx_frames + (size_t)slot * MEM_FRAME_SIZE;
+        size_t len = mem->tx_lengths[slot];
+
+        io->stats.rx_packets++;
+        io->stats.rx_bytes += len;
+        if (handler) {
+            handler(frame, len);
+        }
+        budget--;
+    }
+
+    while (budget && mem_workload_pending(mem)) {
+        size_t len;
+        const uint8_t *frame = workload_frame(mem->workload, mem->cursor, &len);
+
+        if (++mem->cursor == mem->workload->count) {
+            mem->cursor = 0;
+            mem->pass++;
+        }
+
+        io->stats.rx_packets++;
+        io->stats.rx_bytes += len;
+        if (handler) {
+            handler(frame, len);
+        }
+        budget--;
+    }
+}
+
+static uint8_t *mem_tx_buffer(struct io_backend *io, size_t *capacity) {
+    struct mem_backend *mem = io->priv;
+
+    // Successive slots, so several frames can be built before a batch TX
+    uint32_t slot = (mem->tx_head + mem->tx_handed++) % mem->tx_ring_size;
+
+    *capacity = MEM_FRAME_SIZE;
+    return mem->tx_frames + (size_t)slot * MEM_FRAME_SIZE;
+}
+
+static int mem_tx(struct io_backend *io, uint8_t *frame, size_t len) {
+    struct mem_backend *mem = io->priv;
+    uint32_t slot = mem->tx_head % mem->tx_ring_size;
+    uint8_t *dst = mem->tx_frames + (size_t)slot * MEM_FRAME_SIZE;
+
+    if (len > MEM_FRAME_SIZE) {
+        io->stats.tx_dropped++;
+        return -EMSGSIZE;
+    }
+
+    // Frames not built in place are copied into the ring
+    if (frame != dst) {
+        memcpy(dst, frame, len);
+    }
+
+    mem->tx_lengths[slot] = len;
+    mem->tx_head++;
+    if (mem->tx_handed) {
+        mem->tx_handed--;
+    }
+    io->stats.tx_packets++;
+    io->stats.tx_bytes += len;
+    return 0;
+}
+
+static void mem_flush(struct io_backend *io) {
+    struct mem_backend *mem = io->priv;
+
+    // Buffers taken but never queued are reclaimed
+    mem->tx_handed = 0;
+}
+
+static void mem_cleanup(struct io_backend *io) {
+    struct mem_backend *mem = io->priv;
+    if (!mem) {
+        return;
+    }
+
+    free(mem->tx_frames);
+    free(mem->tx_lengths);
+    free(mem);
+    io->priv = NULL;
+}
+
+static const struct io_backend_ops mem_ops = {
+    .wait = mem_wait,
+    .rx = mem_rx,
+    .tx_buffer = mem_tx_buffer,
+    .tx = mem_tx,
+    .flush = mem_flush,
+    .cleanup = mem_cleanup,
+};
+
+int io_backend_mem_init(struct io_backend *io, const struct mem_backend_config *config) {
+    memset(io, 0, sizeof(*io));
+
+    struct mem_backend *mem = calloc(1, sizeof(*mem));
+    if (!mem) {
+        return -ENOMEM;
+    }
+
+    mem->workload = config->workload;
+    mem->loops = config->loops ? config->loops : 1;
+    mem->loopback = config->loopback;
+    mem->tx_ring_size = config->tx_ring_size ? config->tx_ring_size : MEM_TX_RING_SIZE;
+    mem->tx_frames = malloc((size_t)mem->tx_ring_size * MEM_FRAME_SIZE);
+    mem->tx_lengths = calloc(mem->tx_ring_size, sizeof(*mem->tx_lengths));
+    if (!mem->tx_frames || !mem->tx_lengths) {
+        free(mem->tx_frames);
+        free(mem->tx_lengths);
+        free(mem);
+        return -ENOMEM;
+    }
+
+    io->ops = &mem_ops;
+    io->name = "mem";
+    io->priv = mem;
+    return 0;
+}
+
+size_t io_backend_mem_tx_count(struct io_backend *io) {
+    struct mem_backend *mem = io->priv;
+    return mem->tx_head;
+}
+
+const uint8_t *io_backend_mem_tx_frame(struct io_backend *io, size_t index, size_t *len) {
+    struct mem_backend *mem = io->priv;
+
+    // Only the last tx_ring_size frames are retained
+    if (index >= mem->tx_head || mem->tx_head - index > mem->tx_ring_size) {
+        return NULL;
+    }
+
+    uint32_t slot = index % mem->tx_ring_size;
+    *len = mem->tx_lengths[slot];
+    return mem->tx_frames + (size_t)slot * MEM_FRAME_SIZE;
+}
+
+bool io_backend_mem_done(struct io_backend *io) {
+    struct mem_backend *mem = io->priv;
+    return !mem_loopback_pending(mem) && !mem_workload_pending(mem);
+}
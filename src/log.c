@@ -0,0 +1,634 @@
+#include "../include/log.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <stdatomic.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <pthread.h>
+#include <time.h>
+#include <unistd.h>
+
+#define LINE_MAX_BYTES  1024        // Longest formatted line, longer messages are cut
+#define RATE_SLOTS      256         // Call sites tracked by the rate limiter
+
+// Single-producer ring, one per logging thread. The producer and the writer
+// keep their indices on separate cache lines.
+struct log_ring {
+    _Alignas(64) _Atomic uint64_t head;
+    uint64_t cached_tail;           // Producer's last view of tail
+    _Atomic uint64_t dropped;
+    _Alignas(64) _Atomic uint64_t tail;
+    _Alignas(64) struct log_record records[LOG_RING_RECORDS];
+};
+
+// How a conversion's argument is passed
+enum arg_kind {
+    ARG_NONE,                       // %%, no argument
+    ARG_INT,
+    ARG_LONG,
+    ARG_LLONG,
+    ARG_SIZE,
+    ARG_INTMAX,
+    ARG_PTRDIFF,
+    ARG_DOUBLE,
+    ARG_STRING,
+    ARG_POINTER,
+    ARG_BAD                         // Unsupported, the rest of the format is copied as is
+};
+
+// Per call site suppression state, owned by the writer
+struct rate_slot {
+    const char *fmt;
+    uint64_t second;
+    uint32_t count;
+    uint32_t suppressed;
+    uint8_t level;
+};
+
+// Static logger state
+static struct log_config config = {.level = LOG_LEVEL_INFO, .rate_burst = LOG_RATE_BURST};
+static _Atomic bool active = false;
+static _Atomic bool writer_running = false;
+static _Atomic uint64_t passes = 0;
+static _Atomic unsigned int generation = 0;
+static struct log_ring *_Atomic rings[LOG_MAX_THREADS];
+static _Atomic size_t ring_count = 0;
+static pthread_t writer;
+static int fd = -1;
+
+// Writer state
+static char batch[LOG_BATCH_SIZE];
+static size_t batch_len = 0;
+static struct rate_slot rate_slots[RATE_SLOTS];
+static uint64_t reported_dropped = 0;
+static uint64_t stamp_second = UINT64_MAX;
+static char stamp[32];
+
+static _Atomic uint64_t stat_suppressed, stat_lines, stat_writes, stat_bytes;
+static uint64_t retired_records, retired_dropped;   // From rings freed by log_destroy
+
+// The calling thread's ring, registered on its first record
+static _Thread_local struct log_ring *thread_ring_ptr = NULL;
+static _Thread_local unsigned int thread_generation = 0;
+
+static const char *level_names[LOG_LEVELS] = {"debug", "info", "warn", "error"};
+static const char *level_tags[LOG_LEVELS] = {"DEBUG", "INFO ", "WARN ", "ERROR"};
+
+// Thread setup, once per thread and logger generation, off the packet loop
+// when the thread logs before entering it
+static struct log_ring *thread_ring(void) {
+    unsigned int gen = atomic_load_explicit(&generation, memory_order_acquire);
+    if (thread_generation == gen) {
+        return thread_ring_ptr;
+    }
+
+    thread_generation = gen;
+    thread_ring_ptr = NULL;
+    size_t index = atomic_fetch_add(&ring_count, 1);
+    if (index >= LOG_MAX_THREADS) {
+        return NULL;
+    }
+    struct log_ring *ring = aligned_alloc(64, sizeof(*ring));
+    if (!ring) {
+        return NULL;
+    }
+    memset(ring, 0, sizeof(*ring));
+    atomic_store_explicit(&rings[index], ring, memory_order_release);
+    thread_ring_ptr = ring;
+    return ring;
+}
+
+// Next conversion in fmt: literal text before it is left in [fmt, *start),
+// the conversion itself copied to spec. Returns the text after it, NULL at
+// the end of the format.
+static const char *next_conversion(const char *fmt, const char **start, char *spec, size_t spec_size,
+                                   enum arg_kind *kind) {
+    const char *p = strchr(fmt, '%');
+    if (!p) {
+        *start = fmt + strlen(fmt);
+        *kind = ARG_NONE;
+        return NULL;
+    }
+    *start = p;
+
+    const char *q = p + 1;
+    q += strspn(q, "-+ #0123456789.");
+    int longs = 0;
+    char size = 0;
+    while (*q == 'l' || *q == 'h' || *q == 'z' || *q == 'j' || *q == 't') {
+        if (*q == 'l') {
+            longs++;
+        } else {
+            size = *q;
+        }
+        q++;
+    }
+
+    switch (*q) {
+        case '%':
+            *kind = ARG_NONE;
+            break;
+        case 'd': case 'i': case 'u': case 'x': case 'X': case 'o': case 'c':
+            *kind = longs >= 2 ? ARG_LLONG : longs ? ARG_LONG : size == 'z' ? ARG_SIZE :
+                    size == 'j' ? ARG_INTMAX : size == 't' ? ARG_PTRDIFF : ARG_INT;
+            break;
+        case 'f': case 'F': case 'e': case 'E': case 'g': case 'G':
+            *kind = ARG_DOUBLE;
+            break;
+        case 's':
+            *kind = longs ? ARG_BAD : ARG_STRING;
+            break;
+        case 'p':
+            *kind = ARG_POINTER;
+            break;
+        default:
+            *kind = ARG_BAD;    // *, %n, wide characters
+            return NULL;
+    }
+
+    size_t len = q + 1 - p;
+    if (len >= spec_size) {
+        *kind = ARG_BAD;
+        return NULL;
+    }
+    memcpy(spec, p, len);
+    spec[len] = '\0';
+    return q + 1;
+}
+
+// Copy the arguments as the format says they were passed
+static uint8_t capture_args(const char *fmt, va_list ap, uint64_t *args) {
+    uint8_t argc = 0;
+    const char *start;
+    char spec[32];
+    enum arg_kind kind;
+
+    while (argc < LOG_MAX_ARGS && (fmt = next_conversion(fmt, &start, spec, sizeof(spec), &kind))) {
+        union { uint64_t u; double d; } value = {0};
+        switch (kind) {
+            case ARG_NONE:
+                continue;
+            case ARG_INT:
+                value.u = (uint64_t)va_arg(ap, int);
+                break;
+            case ARG_LONG:
+                value.u = (uint64_t)va_arg(ap, long);
+                break;
+            case ARG_LLONG:
+                value.u = (uint64_t)va_arg(ap, long long);
+                break;
+            case ARG_SIZE:
+                value.u = va_arg(ap, size_t);
+                break;
+            case ARG_INTMAX:
+                value.u = (uint64_t)va_arg(ap, intmax_t);
+                break;
+            case ARG_PTRDIFF:
+                value.u = (uint64_t)va_arg(ap, ptrdiff_t);
+                break;
+            case ARG_DOUBLE:
+                value.d = va_arg(ap, double);
+                break;
+            case ARG_STRING:
+                value.u = (uintptr_t)va_arg(ap, const char *);
+                break;
+            case ARG_POINTER:
+                value.u = (uintptr_t)va_arg(ap, void *);
+                break;
+            case ARG_BAD:
+                return argc;
+        }
+        args[argc++] = value.u;
+    }
+    return argc;
+}
+
+void log_write(enum log_level level, const char *fmt, ...) {
+    if (!atomic_load_explicit(&active, memory_order_acquire) || level < config.level) {
+        return;
+    }
+    struct log_ring *ring = thread_ring();
+    if (!ring) {
+        return;
+    }
+
+    uint64_t head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+    if (head - ring->cached_tail >= LOG_RING_RECORDS) {
+        ring->cached_tail = atomic_load_explicit(&ring->tail, memory_order_acquire);
+        if (head - ring->cached_tail >= LOG_RING_RECORDS) {
+            atomic_store_explicit(&ring->dropped, atomic_load_explicit(&ring->dropped, memory_order_relaxed) + 1,
+                                  memory_order_relaxed);
+            return;
+        }
+    }
+
+    // clock_gettime goes through the vDSO, no system call
+    struct log_record *rec = &ring->records[head & (LOG_RING_RECORDS - 1)];
+    struct timespec now;
+    clock_gettime(CLOCK_REALTIME, &now);
+    rec->time_ns = (uint64_t)now.tv_sec * 1000000000ULL + now.tv_nsec;
+    rec->fmt = fmt;
+    rec->level = level;
+    va_list ap;
+    va_start(ap, fmt);
+    rec->argc = capture_args(fmt, ap, rec->args);
+    va_end(ap);
+    atomic_store_explicit(&ring->head, head + 1, memory_order_release);
+}
+
+// Expand a record's format with its arguments
+static size_t format_message(const struct log_record *rec, char *out, size_t size) {
+    const char *fmt = rec->fmt, *start, *next;
+    char spec[32];
+    enum arg_kind kind;
+    size_t len = 0;
+    uint8_t arg = 0;
+
+    while (len < size - 1) {
+        next = next_conversion(fmt, &start, spec, sizeof(spec), &kind);
+        if (!next && kind == ARG_BAD && start != fmt + strlen(fmt)) {
+            start += strlen(start);     // Copy the unsupported rest verbatim
+        }
+        size_t text = start - fmt;
+        if (text > size - 1 - len) {
+            text = size - 1 - len;
+        }
+        memcpy(out + len, fmt, text);
+        len += text;
+        if (!next) {
+            break;
+        }
+        fmt = next;
+
+        if (kind != ARG_NONE && arg >= rec->argc) {
+            break;      // More conversions than a record holds
+        }
+        union { uint64_t u; double d; } value = {.u = kind == ARG_NONE ? 0 : rec->args[arg++]};
+        int n;
+        switch (kind) {
+            case ARG_NONE:
+                n = snprintf(out + len, size - len, "%%");
+                break;
+            case ARG_INT:
+                n = snprintf(out + len, size - len, spec, (int)value.u);
+                break;
+            case ARG_LONG:
+                n = snprintf(out + len, size - len, spec, (long)value.u);
+                break;
+            case ARG_LLONG:
+                n = snprintf(out + len, size - len, spec, (long long)value.u);
+                break;
+            case ARG_SIZE:
+                n = snprintf(out + len, size - len, spec, (size_t)value.u);
+                break;
+            case ARG_INTMAX:
+                n = snprintf(out + len, size - len, spec, (intmax_t)value.u);
+                break;
+            case ARG_PTRDIFF:
+                n = snprintf(out + len, size - len, spec, (ptrdiff_t)value.u);
+                break;
+            case ARG_DOUBLE:
+                n = snprintf(out + len, size - len, spec, value.d);
+                break;
+            case ARG_STRING: {
+                const char *s = (const char *)(uintptr_t)value.u;
+                n = snprintf(out + len, size - len, spec, s ? s : "(null)");
+                break;
+            }
+            case ARG_POINTER:
+                n = snprintf(out + len, size - len, spec, (void *)(uintptr_t)value.u);
+                break;
+            default:
+                n = 0;
+                break;
+        }
+        if (n < 0) {
+            break;
+        }
+        len += (size_t)n < size - len ? (size_t)n : size - 1 - len;
+    }
+    out[len] = '\0';
+    return len;
+}
+
+static void write_all(const char *buf, size_t len) {
+    while (len > 0) {
+        ssize_t n = write(fd, buf, len);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return;     // Nowhere left to report it
+        }
+        buf += n;
+        len -= n;
+    }
+}
+
+static void flush_batch(void) {
+    if (batch_len == 0) {
+        return;
+    }
+    write_all(batch, batch_len);
+    atomic_fetch_add_explicit(&stat_writes, 1, memory_order_relaxed);
+    atomic_fetch_add_explicit(&stat_bytes, batch_len, memory_order_relaxed);
+    batch_len = 0;
+}
+
+// ISO 8601 UTC with microseconds, the seconds part reused within a second
+static const char *format_time(uint64_t time_ns, char *buf, size_t size) {
+    uint64_t second = time_ns / 1000000000ULL;
+    if (second != stamp_second) {
+        time_t t = (time_t)second;
+        struct tm tm;
+        gmtime_r(&t, &tm);
+        strftime(stamp, sizeof(stamp), "%Y-%m-%dT%H:%M:%S", &tm);
+        stamp_second = second;
+    }
+    snprintf(buf, size, "%s.%06luZ", stamp, (unsigned long)(time_ns % 1000000000ULL / 1000));
+    return buf;
+}
+
+// Messages carry arbitrary %s text, keep the JSON valid
+static size_t escape_json(const char *text, char *out, size_t size) {
+    size_t len = 0;
+    for (const unsigned char *p = (const unsigned char *)text; *p && len + 7 < size; p++) {
+        if (*p == '"' || *p == '\\') {
+            out[len++] = '\\';
+            out[len++] = *p;
+        } else if (*p < 0x20 || *p >= 0x7F) {
+            len += snprintf(out + len, size - len, "\\u%04x", *p);
+        } else {
+            out[len++] = *p;
+        }
+    }
+    out[len] = '\0';
+    return len;
+}
+
+// Append one line in the configured format to the batch
+static void emit_line(uint64_t time_ns, uint8_t level, const char *msg) {
+    char line[LINE_MAX_BYTES + 128], when[48];
+    int len;
+    if (config.format == LOG_FORMAT_JSON) {
+        char escaped[LINE_MAX_BYTES];
+        escape_json(msg, escaped, sizeof(escaped));
+        if (config.timestamps) {
+            len = snprintf(line, sizeof(line), "{\"time\":\"%s\",\"level\":\"%s\",\"msg\":\"%s\"}\n",
+                           format_time(time_ns, when, sizeof(when)), level_names[level], escaped);
+        } else {
+            len = snprintf(line, sizeof(line), "{\"level\":\"%s\",\"msg\":\"%s\"}\n", level_names[level], escaped);
+        }
+    } else if (config.timestamps) {
+        len = snprintf(line, sizeof(line), "%s %s %s\n", format_time(time_ns, when, sizeof(when)),
+                       level_tags[level], msg);
+    } else {
+        len = snprintf(line, sizeof(line), "%s %s\n", level_tags[level], msg);
+    }
+    if (len < 0) {
+        return;
+    }
+    if ((size_t)len >= sizeof(line)) {
+        len = sizeof(line) - 1;
+        line[len - 1] = '\n';
+    }
+
+    if (batch_len + len > sizeof(batch)) {
+        flush_batch();
+    }
+    memcpy(batch + batch_len, line, len);
+    batch_len += len;
+    atomic_fetch_add_explicit(&stat_lines, 1, memory_order_relaxed);
+}
+
+// Report call sites that went quiet after being suppressed
+static void report_suppressed(uint64_t second, uint64_t time_ns) {
+    for (size_t i = 0; i < RATE_SLOTS; i++) {
+        struct rate_slot *slot = &rate_slots[i];
+        if (slot->suppressed && slot->second < second) {
+            char msg[LINE_MAX_BYTES];
+            snprintf(msg, sizeof(msg), "%u similar messages suppressed: %s", slot->suppressed, slot->fmt);
+            emit_line(time_ns, slot->level, msg);
+            slot->suppressed = 0;
+        }
+    }
+}
+
+// Whether a call site is over its per-second budget
+static bool rate_limited(const struct log_record *rec) {
+    if (!config.rate_burst) {
+        return false;
+    }
+    uint64_t second = rec->time_ns / 1000000000ULL;
+    size_t i = ((uintptr_t)rec->fmt >> 3) * 0x9E3779B97F4A7C15ULL >> 56;
+    for (size_t probe = 0; probe < RATE_SLOTS; probe++, i = (i + 1) % RATE_SLOTS) {
+        struct rate_slot *slot = &rate_slots[i];
+        if (slot->fmt && slot->fmt != rec->fmt) {
+            continue;
+        }
+        if (slot->fmt != rec->fmt || slot->second != second) {
+            if (slot->suppressed) {
+                char msg[LINE_MAX_BYTES];
+                snprintf(msg, sizeof(msg), "%u similar messages suppressed: %s", slot->suppressed, slot->fmt);
+                emit_line(rec->time_ns, slot->level, msg);
+            }
+            *slot = (struct rate_slot){.fmt = rec->fmt, .second = second, .level = rec->level};
+        }
+        if (++slot->count <= config.rate_burst) {
+            return false;
+        }
+        slot->suppressed++;
+        atomic_fetch_add_explicit(&stat_suppressed, 1, memory_order_relaxed);
+        return true;
+    }
+    return false;   // Table full, let it through
+}
+
+// One pass over every ring, then one write for whatever was formatted
+static void drain(bool final) {
+    size_t count = atomic_load_explicit(&ring_count, memory_order_acquire);
+    uint64_t dropped = 0;
+    char msg[LINE_MAX_BYTES];
+
+    for (size_t i = 0; i < count && i < LOG_MAX_THREADS; i++) {
+        struct log_ring *ring = atomic_load_explicit(&rings[i], memory_order_acquire);
+        if (!ring) {
+            continue;
+        }
+        uint64_t tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+        uint64_t head = atomic_load_explicit(&ring->head, memory_order_acquire);
+        for (; tail != head; tail++) {
+            const struct log_record *rec = &ring->records[tail & (LOG_RING_RECORDS - 1)];
+            if (!rate_limited(rec)) {
+                format_message(rec, msg, sizeof(msg));
+                emit_line(rec->time_ns, rec->level, msg);
+            }
+        }
+        atomic_store_explicit(&ring->tail, tail, memory_order_release);
+        dropped += atomic_load_explicit(&ring->dropped, memory_order_relaxed);
+    }
+
+    struct timespec now;
+    clock_gettime(CLOCK_REALTIME, &now);
+    uint64_t now_ns = (uint64_t)now.tv_sec * 1000000000ULL + now.tv_nsec;
+    if (dropped > reported_dropped) {
+        snprintf(msg, sizeof(msg), "%lu log records dropped, ring full",
+                 (unsigned long)(dropped - reported_dropped));
+        emit_line(now_ns, LOG_LEVEL_WARN, msg);
+        reported_dropped = dropped;
+    }
+    report_suppressed(final ? UINT64_MAX : (uint64_t)now.tv_sec, now_ns);
+    flush_batch();
+}
+
+static void *writer_main(void *arg) {
+    (void)arg;
+    struct timespec pause = {.tv_sec = 0, .tv_nsec = LOG_FLUSH_MS * 1000000L};
+    while (atomic_load(&writer_running)) {
+        drain(false);
+        atomic_fetch_add(&passes, 1);
+        nanosleep(&pause, NULL);
+    }
+    drain(true);
+    atomic_fetch_add(&passes, 1);
+    return NULL;
+}
+
+static void free_rings(void) {
+    size_t count = atomic_load(&ring_count);
+    for (size_t i = 0; i < count && i < LOG_MAX_THREADS; i++) {
+        struct log_ring *ring = atomic_load(&rings[i]);
+        if (ring) {
+            retired_records += atomic_load(&ring->head);
+            retired_dropped += atomic_load(&ring->dropped);
+            free(ring);
+            atomic_store(&rings[i], NULL);
+        }
+    }
+    atomic_store(&ring_count, 0);
+}
+
+// Start the writer thread. Call before pinning the calling thread to a
+// worker core: the writer inherits the affinity it is created with.
+int log_init(const struct log_config *cfg) {
+    if (atomic_load(&active)) {
+        return -EBUSY;
+    }
+
+    int out = STDERR_FILENO;
+    if (cfg->file && (out = open(cfg->file, O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644)) < 0) {
+        return -errno;
+    }
+    config = *cfg;
+    fd = out;
+    batch_len = 0;
+    reported_dropped = 0;
+    stamp_second = UINT64_MAX;
+    memset(rate_slots, 0, sizeof(rate_slots));
+    retired_records = retired_dropped = 0;
+    atomic_store(&stat_suppressed, 0);
+    atomic_store(&stat_lines, 0);
+    atomic_store(&stat_writes, 0);
+    atomic_store(&stat_bytes, 0);
+
+    // Stale thread rings belong to an earlier generation
+    atomic_fetch_add(&generation, 1);
+    atomic_store(&writer_running, true);
+
+    // Signals stay with the packet threads
+    sigset_t all, old;
+    sigfillset(&all);
+    pthread_sigmask(SIG_SETMASK, &all, &old);
+    int ret = pthread_create(&writer, NULL, writer_main, NULL);
+    pthread_sigmask(SIG_SETMASK, &old, NULL);
+    if (ret != 0) {
+        if (fd != STDERR_FILENO) {
+            close(fd);
+        }
+        fd = -1;
+        return -ret;
+    }
+    pthread_setname_np(writer, "whack-log");
+
+    atomic_store_explicit(&active, true, memory_order_release);
+    thread_ring();  // The caller's ring, before it reaches a hot path
+    return 0;
+}
+
+// Stop accepting records and write out everything queued. No thread may
+// log concurrently.
+void log_destroy(void) {
+    if (!atomic_load(&active)) {
+        return;
+    }
+    atomic_store(&active, false);
+    atomic_store(&writer_running, false);
+    pthread_join(writer, NULL);
+    if (fd != STDERR_FILENO) {
+        close(fd);
+    }
+    fd = -1;
+    free_rings();
+}
+
+// Wait until everything queued before the call is written
+void log_flush(void) {
+    if (!atomic_load(&active)) {
+        return;
+    }
+    uint64_t target = atomic_load(&passes) + 2;
+    struct timespec pause = {.tv_sec = 0, .tv_nsec = 1000000L};
+    while (atomic_load(&passes) < target) {
+        nanosleep(&pause, NULL);
+    }
+}
+
+void log_get_stats(struct log_stats *stats) {
+    memset(stats, 0, sizeof(*stats));
+    stats->records = retired_records;
+    stats->dropped = retired_dropped;
+    size_t count = atomic_load(&ring_count);
+    for (size_t i = 0; i < count && i < LOG_MAX_THREADS; i++) {
+        struct log_ring *ring = atomic_load(&rings[i]);
+        if (ring) {
+            stats->records += atomic_load_explicit(&ring->head, memory_order_relaxed);
+            stats->dropped += atomic_load_explicit(&ring->dropped, memory_order_relaxed);
+        }
+    }
+    stats->suppressed = atomic_load_explicit(&stat_suppressed, memory_order_relaxed);
+    stats->lines = atomic_load_explicit(&stat_lines, memory_order_relaxed);
+    stats->writes = atomic_load_explicit(&stat_writes, memory_order_relaxed);
+    stats->bytes = atomic_load_explicit(&stat_bytes, memory_order_relaxed);
+}
+
+int log_level_parse(const char *name, enum log_level *level) {
+    for (int i = 0; i < LOG_LEVELS; i++) {
+        if (strcmp(name, level_names[i]) == 0) {
+            *level = i;
+            return 0;
+        }
+    }
+    if (strcmp(name, "warning") == 0) {
+        *level = LOG_LEVEL_WARN;
+        return 0;
+    }
+    return -1;
+}
+
+int log_format_parse(const char *name, enum log_format *format) {
+    if (strcmp(name, "text") == 0) {
+        *format = LOG_FORMAT_TEXT;
+    } else if (strcmp(name, "json") == 0) {
+        *format = LOG_FORMAT_JSON;
+    } else {
+        return -1;
+    }
+    return 0;
+}
+
+const char *log_level_name(enum log_level level) {
+    return level < LOG_LEVELS ? level_names[level] : "unknown";
+}
@@ -1,16 +1,37 @@
 #include "../include/af_xdp_init.h"
 #include "../include/dns_query.h"
 #include "../include/cache.h"
+#include "../include/io_backend.h"
+#include "../include/pipeline.h"
+#include "../include/workload.h"
+#include "../include/resolvers.h"
+#include "../include/scan.h"
+#include "../include/forward.h"
+#include "../include/tcp_fallback.h"
+#include "../include/xdp_filter.h"
+#include "../include/analytics.h"
+#include "../include/hugemem.h"
+#include "../include/zone.h"
+#include "../include/policy.h"
+#include "../include/log.h"
+#include "../include/packet.h"
+#include "../include/checksum.h"
+#include "../include/validator.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <signal.h>
+#include <errno.h>
 #include <unistd.h>
 #include <getopt.h>
 #include <numa.h>
 #include <sched.h>
 #include <pthread.h>
 #include <sys/types.h>
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+#include <arpa/inet.h>
+#include <net/if.h>
 #include <linux/if_link.h>
 #include <linux/if_xdp.h>
 #include <xdp/xsk.h>
@@ -18,7 +39,11 @@
 
 // Global variables for program control
 static volatile int running = 1;
+static volatile int reload_lists = 0;
 static struct xdp_socket xsk = {0};
+static struct io_backend io = {0};
+static struct workload replay = {0};
+static struct analytics_core passive_core = {0};
 
 // Configuration structure
 struct config {
@@ -29,8 +54,79 @@ struct config {
     char *output_file;
     size_t cache_size;
     unsigned int cache_ttl;
+    bool cache_admission;
     int numa_node;
+    enum hugemem_pages hugepages;
     int cpu_core;
+    enum xsk_rx_mode rx_mode;
+    int busy_poll_budget;
+    char *backend;
+    char *replay_file;
+    bool xdp_generic;
+    enum DnsQType qtype;
+    unsigned int timeout_ms;
+    unsigned int retries;
+    char *src_ip;
+    char *src_mac;
+    char *gateway_mac;
+    bool tcp_fallback;
+    unsigned int edns_size;
+    char *xdp_prog;
+    char *allow_file;
+    char *deny_file;
+    unsigned int rrl_rate;
+    unsigned int rrl_burst;
+    unsigned int rrl_slip;
+    unsigned int rrl_prefix;
+    bool passive;
+    unsigned int metrics_interval;
+    const char *zone_files[ZONE_MAX_FILES];
+    size_t zone_count;
+    const char *policy_files[POLICY_MAX_FILES];
+    size_t policy_count;
+    int queue_id;
+    unsigned int shard_index;
+    unsigned int shard_count;
+    char *checkpoint_file;
+    unsigned int checkpoint_interval;
+    bool resume;
+    struct log_config log;
+    enum resolver_select resolver_select;
+    enum packet_csum_mode tx_csum;
+    bool dnssec;
+    unsigned int dnssec_threads;
+    char *trust_anchors;
+};
+
+// Long-only options
+enum {
+    OPT_XDP_PROG = 256,
+    OPT_ALLOW,
+    OPT_DENY,
+    OPT_RRL_RATE,
+    OPT_RRL_BURST,
+    OPT_RRL_SLIP,
+    OPT_RRL_PREFIX,
+    OPT_NO_ADMISSION,
+    OPT_PASSIVE,
+    OPT_METRICS_INTERVAL,
+    OPT_HUGEPAGES,
+    OPT_ZONE,
+    OPT_POLICY,
+    OPT_QUEUE,
+    OPT_SHARD,
+    OPT_CHECKPOINT,
+    OPT_CHECKPOINT_INTERVAL,
+    OPT_RESUME,
+    OPT_LOG_LEVEL,
+    OPT_LOG_FILE,
+    OPT_LOG_FORMAT,
+    OPT_NO_LOG_TIMESTAMPS,
+    OPT_RESOLVER_SELECT,
+    OPT_TX_CSUM,
+    OPT_DNSSEC,
+    OPT_DNSSEC_THREADS,
+    OPT_TRUST_ANCHORS
 };
 
 // Signal handler for graceful shutdown
@@ -39,47 +135,173 @@ static void signal_handler(int signum) {
     running = 0;
 }
 
-// Process received DNS packet
-static void process_packet(const uint8_t *packet, size_t length) {
-    struct dns_query query;
-    uint8_t response[512];
-    size_t response_len = sizeof(response);
+// SIGHUP re-reads the allow and deny lists, zone and policy files
+static void reload_handler(int signum) {
+    (void)signum;
+    reload_lists = 1;
+}
+
+// Initialize program configuration
+static void init_config(struct config *cfg) {
+    memset(cfg, 0, sizeof(struct config));
+    cfg->cache_size = 10000;    // Default cache size
+    cfg->cache_ttl = 3600;      // Default TTL: 1 hour
+    cfg->cache_admission = true;
+    cfg->rate_limit = 5000;     // Default rate limit: 5000 queries/sec
+    cfg->numa_node = -1;        // Auto-detect NUMA node
+    cfg->hugepages = HUGEMEM_PAGES_AUTO;
+    cfg->cpu_core = -1;         // Auto-detect CPU core
+    cfg->rx_mode = XSK_RX_MODE_ADAPTIVE;
+    cfg->busy_poll_budget = XSK_BUSY_POLL_BUDGET;
+    cfg->backend = "afxdp";
+    cfg->qtype = A;
+    cfg->timeout_ms = SCAN_TIMEOUT_MS;
+    cfg->retries = SCAN_RETRIES;
+    cfg->log.level = LOG_LEVEL_INFO;
+    cfg->log.format = LOG_FORMAT_TEXT;
+    cfg->log.timestamps = true;
+    cfg->log.rate_burst = LOG_RATE_BURST;
+    cfg->tcp_fallback = true;
+    cfg->edns_size = DNS_EDNS_BUFFER_SIZE;
+    cfg->rrl_slip = XDP_FILTER_SLIP;
+    cfg->rrl_prefix = XDP_FILTER_PREFIX;
+    cfg->metrics_interval = ANALYTICS_METRICS_INTERVAL;
+    cfg->shard_count = 1;
+    cfg->checkpoint_interval = SCAN_CHECKPOINT_INTERVAL;
+    cfg->dnssec_threads = 1;
+}
+
+// The XDP filter replaces libxdp's default program when any policy is set
+static bool filter_enabled(const struct config *cfg) {
+    return cfg->xdp_prog || cfg->allow_file || cfg->deny_file || cfg->rrl_rate;
+}
+
+// libxdp's default program redirects the whole queue, TCP answers included,
+// so scanning with TCP fallback takes the filter, which passes them on
+static bool fallback_needs_filter(const struct config *cfg) {
+    return cfg->domains_file && cfg->tcp_fallback && !filter_enabled(cfg);
+}
 
-    // First check if this is a DNS query
-    if (length < sizeof(struct dns_header)) {
+// Passive mode: observe, never answer
+static void passive_process_packet(const uint8_t *packet, size_t length) {
+    analytics_observe(analytics_core_summary(&passive_core), packet, length);
+}
+
+// Collect the worker's summary and emit one report line
+static void emit_metrics(struct analytics_summary *report, FILE *fp, time_t now, uint32_t interval) {
+    analytics_core_request(&passive_core);
+    analytics_core_poll(&passive_core);     // The worker is this thread
+    if (analytics_core_collect(&passive_core, report)) {
+        analytics_report(fp, report, now, interval);
+        fflush(fp);
+        analytics_reset(report);
+    }
+}
+
+// Report XDP verdicts
+static void print_filter_stats(void) {
+    struct xdp_filter_stats stats;
+    if (xdp_filter_get_stats(&stats) != 0) {
         return;
     }
 
-    // Parse the DNS header
-    memcpy(&query.header, packet, sizeof(struct dns_header));
+    printf("XDP filter statistics:\n");
+    printf("  Redirected: %lu  Passed to kernel: %lu\n",
+           (unsigned long)stats.redirected, (unsigned long)stats.passed);
+    printf("  Dropped: %lu denied, %lu not allowed, %lu rate limited; %lu slipped as TC\n",
+           (unsigned long)stats.denied, (unsigned long)stats.not_allowed,
+           (unsigned long)stats.rate_limited, (unsigned long)stats.slipped);
+}
+
+// Parse "aa:bb:cc:dd:ee:ff"
+static int parse_mac(const char *text, uint8_t *mac) {
+    unsigned int b[ETH_ADDR_LEN];
+    if (sscanf(text, "%x:%x:%x:%x:%x:%x", &b[0], &b[1], &b[2], &b[3], &b[4], &b[5]) != ETH_ADDR_LEN) {
+        return -1;
+    }
+    for (int i = 0; i < ETH_ADDR_LEN; i++) {
+        if (b[i] > 0xFF) {
+            return -1;
+        }
+        mac[i] = b[i];
+    }
+    return 0;
+}
 
-    // Check cache first
-    if (cache_lookup((char*)(packet + sizeof(struct dns_header)), response, &response_len)) {
-        // Send cached response
-        af_xdp_socket_tx(&xsk, response, response_len);
+// Fill in our MAC and IPv4 address from the interface
+static void detect_interface_addr(const char *ifname, struct packet_endpoint *ep) {
+    struct ifreq ifr;
+    int fd = socket(AF_INET, SOCK_DGRAM, 0);
+    if (fd < 0 || !ifname) {
+        if (fd >= 0) {
+            close(fd);
+        }
         return;
     }
 
-    // Process the query and prepare response
-    if (parse_response(packet, length, &query) == 0) {
-        // Cache the response for future use
-        cache_insert((char*)(packet + sizeof(struct dns_header)), 
-                    response, response_len, 
-                    3600); // Default TTL of 1 hour
-        
-        // Send the response
-        af_xdp_socket_tx(&xsk, response, response_len);
+    memset(&ifr, 0, sizeof(ifr));
+    strncpy(ifr.ifr_name, ifname, IFNAMSIZ - 1);
+    if (ioctl(fd, SIOCGIFHWADDR, &ifr) == 0) {
+        memcpy(ep->mac, ifr.ifr_hwaddr.sa_data, ETH_ADDR_LEN);
+    }
+    if (ioctl(fd, SIOCGIFADDR, &ifr) == 0) {
+        ep->ip = ((struct sockaddr_in *)&ifr.ifr_addr)->sin_addr.s_addr;
     }
+    close(fd);
 }
 
-// Initialize program configuration
-static void init_config(struct config *cfg) {
-    memset(cfg, 0, sizeof(struct config));
-    cfg->cache_size = 10000;    // Default cache size
-    cfg->cache_ttl = 3600;      // Default TTL: 1 hour
-    cfg->rate_limit = 5000;     // Default rate limit: 5000 queries/sec
-    cfg->numa_node = -1;        // Auto-detect NUMA node
-    cfg->cpu_core = -1;         // Auto-detect CPU core
+// Our address and the next hop for queries sent to the resolvers
+static int init_upstream(struct config *cfg, struct packet_endpoint *src, uint8_t *gateway_mac) {
+    detect_interface_addr(cfg->interface, src);
+    if (cfg->src_mac && parse_mac(cfg->src_mac, src->mac) != 0) {
+        fprintf(stderr, "Invalid source MAC: %s\n", cfg->src_mac);
+        return -1;
+    }
+    if (cfg->src_ip && inet_pton(AF_INET, cfg->src_ip, &src->ip) != 1) {
+        fprintf(stderr, "Invalid source IP: %s\n", cfg->src_ip);
+        return -1;
+    }
+
+    // Without a gateway the queries are broadcast, which only works on a shared segment
+    memset(gateway_mac, 0xFF, ETH_ADDR_LEN);
+    if (cfg->gateway_mac && parse_mac(cfg->gateway_mac, gateway_mac) != 0) {
+        fprintf(stderr, "Invalid gateway MAC: %s\n", cfg->gateway_mac);
+        return -1;
+    }
+    if (!cfg->gateway_mac) {
+        fprintf(stderr, "Warning: no --gateway-mac given, sending queries to broadcast\n");
+    }
+    return 0;
+}
+
+// Build the bulk-resolver configuration from the command line
+static int init_scan_config(struct config *cfg, struct scan_config *scan_cfg) {
+    memset(scan_cfg, 0, sizeof(*scan_cfg));
+    scan_cfg->domains_file = cfg->domains_file;
+    scan_cfg->output_file = cfg->output_file;
+    scan_cfg->qtype = cfg->qtype;
+    scan_cfg->rate_limit = cfg->rate_limit;
+    scan_cfg->timeout_ms = cfg->timeout_ms;
+    scan_cfg->retries = cfg->retries;
+    scan_cfg->tcp_fallback = cfg->tcp_fallback;
+    scan_cfg->edns_buffer_size = cfg->edns_size;
+    scan_cfg->shard_index = cfg->shard_index;
+    scan_cfg->shard_count = cfg->shard_count;
+    scan_cfg->checkpoint_file = cfg->checkpoint_file;
+    scan_cfg->checkpoint_interval = cfg->checkpoint_interval;
+    scan_cfg->resume = cfg->resume;
+    // Shards on one host get their own port, so answers can be steered to their queue
+    scan_cfg->src.port = htons(SCAN_SRC_PORT + cfg->shard_index % SCAN_SHARD_PORTS);
+    return init_upstream(cfg, &scan_cfg->src, scan_cfg->gateway_mac);
+}
+
+// Build the cache-miss forwarding configuration from the command line
+static int init_forward_config(struct config *cfg, struct forward_config *fwd_cfg) {
+    memset(fwd_cfg, 0, sizeof(*fwd_cfg));
+    fwd_cfg->timeout_ms = cfg->timeout_ms;
+    fwd_cfg->retries = cfg->retries;
+    fwd_cfg->src.port = htons(FORWARD_SRC_PORT);
+    return init_upstream(cfg, &fwd_cfg->src, fwd_cfg->gateway_mac);
 }
 
 // Set CPU affinity for optimal performance
@@ -90,6 +312,245 @@ static int set_cpu_affinity(int cpu_core) {
     return pthread_setaffinity_np(pthread_self(), sizeof(cpu_set), &cpu_set);
 }
 
+// Run on the NIC's node and place UMEM, rings and cache there. Must come
+// before anything long-lived is allocated: rings are allocated by the kernel
+// on the node of the thread creating the socket.
+static int init_placement(struct config *cfg) {
+    if (cfg->numa_node < 0 && cfg->interface) {
+        cfg->numa_node = hugemem_nic_node(cfg->interface);
+    }
+    if (numa_available() < 0) {
+        cfg->numa_node = -1;    // Single node, nothing to bind
+    } else if (cfg->numa_node > numa_max_node()) {
+        fprintf(stderr, "NUMA node %d does not exist (highest is %d)\n", cfg->numa_node, numa_max_node());
+        return -1;
+    }
+
+    if (cfg->cpu_core >= 0) {
+        if (set_cpu_affinity(cfg->cpu_core) != 0) {
+            fprintf(stderr, "Warning: Failed to set CPU affinity\n");
+        } else if (cfg->numa_node >= 0 && numa_node_of_cpu(cfg->cpu_core) != cfg->numa_node) {
+            fprintf(stderr, "Warning: CPU %d is not on NUMA node %d\n", cfg->cpu_core, cfg->numa_node);
+        }
+    } else if (cfg->numa_node >= 0 && numa_run_on_node(cfg->numa_node) != 0) {
+        fprintf(stderr, "Warning: Failed to run on NUMA node %d\n", cfg->numa_node);
+    }
+    if (cfg->numa_node >= 0) {
+        numa_set_preferred(cfg->numa_node);
+    }
+
+    struct hugemem_config mem_cfg = {
+        .numa_node = cfg->numa_node,
+        .pages = cfg->hugepages,
+        .lock = true
+    };
+    return hugemem_init(&mem_cfg);
+}
+
+// Page size, node and locking the kernel actually gave each region
+static void print_placement(const struct config *cfg) {
+    const struct hugemem_region *regions;
+    size_t count = hugemem_regions(&regions);
+
+    for (size_t i = 0; i < count; i++) {
+        const struct hugemem_region *r = &regions[i];
+        printf("Memory: %-16s %8.1f MB, %s pages", r->name, r->size / 1048576.0, hugemem_page_name(r->page_size));
+        if (cfg->hugepages == HUGEMEM_PAGES_AUTO && r->size >= (2UL << 20) && r->page_size < (2UL << 20)) {
+            printf(" (no 2M pages free)");
+        }
+        if (r->node >= 0) {
+            printf(", node %d", r->node);
+        }
+        printf(", %s\n", r->locked ? "locked" : "not locked (raise RLIMIT_MEMLOCK)");
+    }
+}
+
+// Report syscall cost, CPU usage and batch latency of the RX strategy
+static void print_rx_stats(struct xdp_socket *xsk_socket) {
+    struct xsk_rx_stats stats;
+    af_xdp_socket_get_stats(xsk_socket, &stats);
+
+    printf("RX statistics (%s):\n", af_xdp_rx_mode_name(xsk_socket->rx_mode));
+    printf("  Packets: %lu in %lu batches\n",
+           (unsigned long)stats.rx_packets, (unsigned long)stats.rx_batches);
+    printf("  Syscalls: %lu (%.4f per packet, %lu sleeping)\n",
+           (unsigned long)stats.syscalls,
+           stats.rx_packets ? (double)stats.syscalls / stats.rx_packets : 0.0,
+           (unsigned long)stats.sleeps);
+    printf("  Empty polls: %lu\n", (unsigned long)stats.empty_polls);
+    printf("  CPU usage: %.1f%%\n",
+           stats.wall_ns ? 100.0 * stats.cpu_ns / stats.wall_ns : 0.0);
+    printf("  Batch latency: avg %.0f ns, max %lu ns\n",
+           stats.rx_batches ? (double)stats.batch_ns / stats.rx_batches : 0.0,
+           (unsigned long)stats.batch_ns_max);
+}
+
+// Report what the loaded zone files compiled to
+static void print_zone_stats(void) {
+    struct zone_stats stats;
+    zone_get_stats(&stats);
+    printf("Zones: %zu zones, %zu names, %zu records, %zu answers, index %.1f MB, built in %.1f ms\n",
+           stats.zones, stats.names, stats.records, stats.answers, stats.index_bytes / (1024.0 * 1024.0),
+           stats.build_ns / 1e6);
+}
+
+// Report the loaded firewall rules
+static void print_policy_rules(void) {
+    struct policy_stats stats;
+    policy_get_stats(&stats);
+    printf("Policy: %zu rules on %zu names, table %.1f MB, built in %.1f ms\n",
+           stats.rules, stats.names, stats.table_bytes / (1024.0 * 1024.0), stats.build_ns / 1e6);
+}
+
+// Report what the firewall rules caught
+static void print_policy_matches(void) {
+    struct policy_stats stats;
+    policy_get_stats(&stats);
+    printf("Policy statistics:\n");
+    for (int action = POLICY_PASSTHRU; action < POLICY_ACTIONS; action++) {
+        printf("  %s: %lu\n", policy_action_name(action), (unsigned long)stats.matches[action]);
+    }
+}
+
+// Report per-stage packet counters
+static void print_pipeline_stats(void) {
+    struct pipeline_stats stats;
+    pipeline_get_stats(&stats);
+
+    printf("Pipeline statistics:\n");
+    printf("  Packets: %lu (%lu malformed)\n",
+           (unsigned long)stats.packets, (unsigned long)stats.malformed);
+    printf("  Queries: %lu (%lu with client subnet)  Responses: %lu\n",
+           (unsigned long)stats.queries, (unsigned long)stats.ecs_queries, (unsigned long)stats.responses);
+    printf("  Policy: %lu answered  Zones: %lu answered\n", (unsigned long)stats.policy_answers,
+           (unsigned long)stats.zone_answers);
+    printf("  Cache: %lu hits, %lu misses (%lu not forwarded)\n",
+           (unsigned long)stats.cache_hits, (unsigned long)stats.cache_misses,
+           (unsigned long)stats.unforwarded);
+    if (validator_running()) {
+        printf("  DNSSEC: %lu answers queued for validation, %lu hits answered with AD\n",
+               (unsigned long)stats.validations, (unsigned long)stats.secure_hits);
+    }
+    printf("  Replies: %lu (%lu relayed from upstream, %lu truncated, %lu TX failures)\n",
+           (unsigned long)stats.replies, (unsigned long)stats.relayed, (unsigned long)stats.truncated,
+           (unsigned long)stats.tx_failures);
+    printf("  I/O: %lu RX, %lu TX, %lu TX dropped\n",
+           (unsigned long)io.stats.rx_packets, (unsigned long)io.stats.tx_packets,
+           (unsigned long)io.stats.tx_dropped);
+}
+
+// Report upstream resolution of cache misses
+static void print_forward_stats(void) {
+    struct forward_stats stats;
+    forward_get_stats(&stats);
+
+    struct pipeline_stats pipe;
+    pipeline_get_stats(&pipe);
+
+    printf("Forwarding statistics:\n");
+    printf("  Forwarded: %lu  Answered: %lu  SERVFAIL after timeout: %lu\n",
+           (unsigned long)stats.forwarded, (unsigned long)stats.answers, (unsigned long)stats.timeouts);
+    printf("  Coalesced misses: %lu (upstream queries saved)  Fan-out: avg %.2f, max %lu\n",
+           (unsigned long)stats.coalesced,
+           stats.answers ? (double)pipe.relayed / stats.answers : 0.0, (unsigned long)stats.fanout_max);
+    printf("  Retransmits: %lu  Unmatched answers: %lu  Dropped (table full): %lu  TX failures: %lu\n",
+           (unsigned long)stats.retransmits, (unsigned long)stats.unmatched,
+           (unsigned long)stats.overflows, (unsigned long)stats.tx_failures);
+}
+
+// Report how each upstream resolver performed
+static void print_resolver_stats(void) {
+    size_t count = resolvers_count();
+    printf("Resolver statistics:\n");
+    for (size_t i = 0; i < count; i++) {
+        const struct resolver *r = resolvers_get(i);
+        const struct resolver_health *h = &r->health;
+        char ip[INET_ADDRSTRLEN];
+        inet_ntop(AF_INET, &r->ip, ip, sizeof(ip));
+        printf("  %-15s %8lu queries %8lu answers %6lu timeouts  srtt %7.1f ms  loss %5.1f%%",
+               ip, (unsigned long)h->queries, (unsigned long)h->answers, (unsigned long)h->timeouts,
+               h->srtt_us / 1000.0, h->loss * 100);
+        if (h->quarantines) {
+            printf("  %lu quarantines%s", (unsigned long)h->quarantines,
+                   h->quarantined_until_ns ? ", quarantined" : "");
+        }
+        if (r->desc[0]) {
+            printf("  # %s", r->desc);
+        }
+        printf("\n");
+    }
+}
+
+// Report bulk-resolver progress and the TCP fallback
+static void print_scan_stats(void) {
+    struct scan_stats stats;
+    struct tcp_fallback_stats tcp;
+    scan_get_stats(&stats);
+    tcp_fallback_get_stats(&tcp);
+
+    printf("Scan statistics:\n");
+    printf("  Domains: %lu  Answered: %lu  Timed out: %lu\n",
+           (unsigned long)stats.domains, (unsigned long)stats.answers, (unsigned long)stats.timeouts);
+    if (stats.other_shards || stats.checkpoints || stats.resumed) {
+        printf("  Left to other shards: %lu  Resumed outstanding: %lu  Checkpoints: %lu\n",
+               (unsigned long)stats.other_shards, (unsigned long)stats.resumed,
+               (unsigned long)stats.checkpoints);
+    }
+    printf("  Queries: %lu (%lu retransmits, %lu TX failures, %lu unmatched responses)\n",
+           (unsigned long)stats.queries, (unsigned long)stats.retransmits,
+           (unsigned long)stats.tx_failures, (unsigned long)stats.unmatched);
+    printf("  NOERROR: %lu  NXDOMAIN: %lu  SERVFAIL: %lu\n",
+           (unsigned long)stats.rcodes[0], (unsigned long)stats.rcodes[3], (unsigned long)stats.rcodes[2]);
+    printf("  Truncated: %lu (%lu completed over TCP, %lu failed)\n",
+           (unsigned long)stats.truncated, (unsigned long)stats.tcp_answers,
+           (unsigned long)stats.tcp_failures);
+    if (tcp.queries) {
+        printf("  TCP: %lu connections, %lu queries on reused connections, pipeline depth %lu, %lu retries\n",
+               (unsigned long)tcp.connects, (unsigned long)tcp.reused,
+               (unsigned long)tcp.max_pipelined, (unsigned long)tcp.retries);
+    }
+}
+
+// Report what the logger queued, wrote and lost
+static void print_log_stats(void) {
+    struct log_stats stats;
+    log_flush();
+    log_get_stats(&stats);
+    printf("Log statistics:\n");
+    printf("  Records: %lu (%lu dropped, ring full; %lu rate limited)\n", (unsigned long)stats.records,
+           (unsigned long)stats.dropped, (unsigned long)stats.suppressed);
+    printf("  Lines: %lu in %lu writes, %lu bytes\n", (unsigned long)stats.lines,
+           (unsigned long)stats.writes, (unsigned long)stats.bytes);
+}
+
+// Report what the crypto workers validated and how fast each went
+static void print_validator_stats(void) {
+    struct validator_stats stats;
+    validator_get_stats(&stats);
+    printf("DNSSEC statistics:\n");
+    printf("  Answers: %lu queued, %lu dropped (rings full)\n", (unsigned long)stats.queued,
+           (unsigned long)stats.dropped);
+    printf(" ");
+    for (int s = 0; s < VALIDATOR_STATUSES; s++) {
+        printf(" %s: %lu", validator_status_name(s), (unsigned long)stats.results[s]);
+    }
+    printf("\n");
+    printf("  Cache entries marked secure: %lu  Key sets trusted: %lu\n", (unsigned long)stats.marked,
+           (unsigned long)stats.key_sets);
+    printf("  Signatures: %lu verified, %lu memo hits\n", (unsigned long)stats.total.signatures,
+           (unsigned long)stats.total.memo_hits);
+    for (unsigned int i = 0; i < validator_workers(); i++) {
+        struct validator_worker_stats w;
+        validator_get_worker_stats(i, &w);
+        printf("  Worker %u: %lu validated in %lu batches, %.1f ms busy, %.0f/s per busy core\n", i,
+               (unsigned long)w.validated, (unsigned long)w.batches, w.busy_ns / 1e6,
+               w.busy_ns ? w.validated * 1e9 / w.busy_ns : 0.0);
+    }
+    if (stats.wall_ns) {
+        printf("  Throughput: %.0f validations/s\n", stats.total.validated * 1e9 / stats.wall_ns);
+    }
+}
+
 // Parse command line arguments
 static int parse_args(int argc, char **argv, struct config *cfg) {
     static struct option long_options[] = {
@@ -101,12 +562,52 @@ static int parse_args(int argc, char **argv, struct config *cfg) {
         {"cache-size", required_argument, 0, 'c'},
         {"numa-node", required_argument, 0, 'n'},
         {"cpu-core", required_argument, 0, 'p'},
+        {"rx-mode", required_argument, 0, 'm'},
+        {"busy-budget", required_argument, 0, 'b'},
+        {"backend", required_argument, 0, 'k'},
+        {"replay", required_argument, 0, 'R'},
+        {"generic", no_argument, 0, 'g'},
+        {"qtype", required_argument, 0, 'T'},
+        {"timeout", required_argument, 0, 't'},
+        {"retries", required_argument, 0, 'x'},
+        {"src-ip", required_argument, 0, 'S'},
+        {"src-mac", required_argument, 0, 'M'},
+        {"gateway-mac", required_argument, 0, 'G'},
+        {"no-tcp-fallback", no_argument, 0, 'N'},
+        {"edns-size", required_argument, 0, 'E'},
+        {"xdp-prog", required_argument, 0, OPT_XDP_PROG},
+        {"allow", required_argument, 0, OPT_ALLOW},
+        {"deny", required_argument, 0, OPT_DENY},
+        {"rate-limit-ip", required_argument, 0, OPT_RRL_RATE},
+        {"rrl-burst", required_argument, 0, OPT_RRL_BURST},
+        {"rrl-slip", required_argument, 0, OPT_RRL_SLIP},
+        {"rrl-prefix", required_argument, 0, OPT_RRL_PREFIX},
+        {"no-admission", no_argument, 0, OPT_NO_ADMISSION},
+        {"passive", no_argument, 0, OPT_PASSIVE},
+        {"metrics-interval", required_argument, 0, OPT_METRICS_INTERVAL},
+        {"hugepages", required_argument, 0, OPT_HUGEPAGES},
+        {"zone", required_argument, 0, OPT_ZONE},
+        {"policy", required_argument, 0, OPT_POLICY},
+        {"queue", required_argument, 0, OPT_QUEUE},
+        {"shard", required_argument, 0, OPT_SHARD},
+        {"checkpoint", required_argument, 0, OPT_CHECKPOINT},
+        {"checkpoint-interval", required_argument, 0, OPT_CHECKPOINT_INTERVAL},
+        {"resume", no_argument, 0, OPT_RESUME},
+        {"log-level", required_argument, 0, OPT_LOG_LEVEL},
+        {"log-file", required_argument, 0, OPT_LOG_FILE},
+        {"log-format", required_argument, 0, OPT_LOG_FORMAT},
+        {"no-log-timestamps", no_argument, 0, OPT_NO_LOG_TIMESTAMPS},
+        {"resolver-select", required_argument, 0, OPT_RESOLVER_SELECT},
+        {"tx-csum", required_argument, 0, OPT_TX_CSUM},
+        {"dnssec", no_argument, 0, OPT_DNSSEC},
+        {"dnssec-threads", required_argument, 0, OPT_DNSSEC_THREADS},
+        {"trust-anchors", required_argument, 0, OPT_TRUST_ANCHORS},
         {"help", no_argument, 0, 'h'},
         {0, 0, 0, 0}
     };
 
     int opt;
-    while ((opt = getopt_long(argc, argv, "i:d:r:l:o:c:n:p:h", long_options, NULL)) != -1) {
+    while ((opt = getopt_long(argc, argv, "i:d:r:l:o:c:n:p:m:b:k:R:gT:t:x:S:M:G:NE:h", long_options, NULL)) != -1) {
         switch (opt) {
             case 'i':
                 cfg->interface = optarg;
@@ -127,22 +628,240 @@ static int parse_args(int argc, char **argv, struct config *cfg) {
                 cfg->cache_size = atoi(optarg);
                 break;
             case 'n':
-                cfg->numa_node = atoi(optarg);
+                cfg->numa_node = strcmp(optarg, "auto") == 0 ? -1 : atoi(optarg);
                 break;
             case 'p':
                 cfg->cpu_core = atoi(optarg);
                 break;
+            case 'm':
+                if (af_xdp_rx_mode_parse(optarg, &cfg->rx_mode) != 0) {
+                    fprintf(stderr, "Unknown RX mode: %s\n", optarg);
+                    return -1;
+                }
+                break;
+            case 'b':
+                cfg->busy_poll_budget = atoi(optarg);
+                break;
+            case 'k':
+                cfg->backend = optarg;
+                break;
+            case 'R':
+                cfg->replay_file = optarg;
+                break;
+            case 'g':
+                cfg->xdp_generic = true;
+                break;
+            case 'T':
+                if (dns_qtype_parse(optarg, &cfg->qtype) != 0) {
+                    fprintf(stderr, "Unknown record type: %s\n", optarg);
+                    return -1;
+                }
+                break;
+            case 't':
+                cfg->timeout_ms = atoi(optarg);
+                break;
+            case 'x':
+                cfg->retries = atoi(optarg);
+                break;
+            case 'S':
+                cfg->src_ip = optarg;
+                break;
+            case 'M':
+                cfg->src_mac = optarg;
+                break;
+            case 'G':
+                cfg->gateway_mac = optarg;
+                break;
+            case 'N':
+                cfg->tcp_fallback = false;
+                break;
+            case OPT_XDP_PROG:
+                cfg->xdp_prog = optarg;
+                break;
+            case OPT_ALLOW:
+                cfg->allow_file = optarg;
+                break;
+            case OPT_DENY:
+                cfg->deny_file = optarg;
+                break;
+            case OPT_RRL_RATE:
+                cfg->rrl_rate = atoi(optarg);
+                break;
+            case OPT_RRL_BURST:
+                cfg->rrl_burst = atoi(optarg);
+                break;
+            case OPT_RRL_SLIP:
+                cfg->rrl_slip = atoi(optarg);
+                break;
+            case OPT_RRL_PREFIX:
+                cfg->rrl_prefix = atoi(optarg);
+                if (cfg->rrl_prefix < 1 || cfg->rrl_prefix > 32) {
+                    fprintf(stderr, "Rate limit prefix must be 1-32\n");
+                    return -1;
+                }
+                break;
+            case OPT_NO_ADMISSION:
+                cfg->cache_admission = false;
+                break;
+            case OPT_PASSIVE:
+                cfg->passive = true;
+                break;
+            case OPT_METRICS_INTERVAL:
+                cfg->metrics_interval = atoi(optarg);
+                if (cfg->metrics_interval == 0) {
+                    fprintf(stderr, "Metrics interval must be at least 1 second\n");
+                    return -1;
+                }
+                break;
+            case OPT_HUGEPAGES:
+                if (hugemem_pages_parse(optarg, &cfg->hugepages) != 0) {
+                    fprintf(stderr, "Unknown page size: %s\n", optarg);
+                    return -1;
+                }
+                break;
+            case OPT_ZONE:
+                if (cfg->zone_count == ZONE_MAX_FILES) {
+                    fprintf(stderr, "At most %d zone files\n", ZONE_MAX_FILES);
+                    return -1;
+                }
+                cfg->zone_files[cfg->zone_count++] = optarg;
+                break;
+            case OPT_POLICY:
+                if (cfg->policy_count == POLICY_MAX_FILES) {
+                    fprintf(stderr, "At most %d policy files\n", POLICY_MAX_FILES);
+                    return -1;
+                }
+                cfg->policy_files[cfg->policy_count++] = optarg;
+                break;
+            case OPT_QUEUE:
+                cfg->queue_id = atoi(optarg);
+                break;
+            case OPT_SHARD:
+                if (sscanf(optarg, "%u/%u", &cfg->shard_index, &cfg->shard_count) != 2 ||
+                    !cfg->shard_count || cfg->shard_index >= cfg->shard_count) {
+                    fprintf(stderr, "Shard must be i/N with 0 <= i < N: %s\n", optarg);
+                    return -1;
+                }
+                break;
+            case OPT_CHECKPOINT:
+                cfg->checkpoint_file = optarg;
+                break;
+            case OPT_CHECKPOINT_INTERVAL:
+                cfg->checkpoint_interval = atoi(optarg);
+                if (cfg->checkpoint_interval == 0) {
+                    fprintf(stderr, "Checkpoint interval must be at least 1 second\n");
+                    return -1;
+                }
+                break;
+            case OPT_RESUME:
+                cfg->resume = true;
+                break;
+            case OPT_LOG_LEVEL:
+                if (log_level_parse(optarg, &cfg->log.level) != 0) {
+                    fprintf(stderr, "Unknown log level: %s\n", optarg);
+                    return -1;
+                }
+                break;
+            case OPT_LOG_FILE:
+                cfg->log.file = optarg;
+                break;
+            case OPT_LOG_FORMAT:
+                if (log_format_parse(optarg, &cfg->log.format) != 0) {
+                    fprintf(stderr, "Unknown log format: %s\n", optarg);
+                    return -1;
+                }
+                break;
+            case OPT_NO_LOG_TIMESTAMPS:
+                cfg->log.timestamps = false;
+                break;
+            case OPT_RESOLVER_SELECT:
+                if (resolvers_select_parse(optarg, &cfg->resolver_select) != 0) {
+                    fprintf(stderr, "Unknown resolver selection: %s\n", optarg);
+                    return -1;
+                }
+                break;
+            case OPT_TX_CSUM:
+                if (packet_csum_mode_parse(optarg, &cfg->tx_csum) != 0) {
+                    fprintf(stderr, "Unknown TX checksum mode: %s\n", optarg);
+                    return -1;
+                }
+                break;
+            case OPT_DNSSEC:
+                cfg->dnssec = true;
+                break;
+            case OPT_DNSSEC_THREADS:
+                cfg->dnssec_threads = atoi(optarg);
+                if (cfg->dnssec_threads < 1 || cfg->dnssec_threads > VALIDATOR_MAX_WORKERS) {
+                    fprintf(stderr, "DNSSEC threads must be 1-%d\n", VALIDATOR_MAX_WORKERS);
+                    return -1;
+                }
+                break;
+            case OPT_TRUST_ANCHORS:
+                cfg->trust_anchors = optarg;
+                break;
+            case 'E':
+                cfg->edns_size = atoi(optarg);
+                if (cfg->edns_size && (cfg->edns_size < DNS_MAX_UDP_SIZE || cfg->edns_size > 65535)) {
+                    fprintf(stderr, "EDNS buffer size must be 0 or 512-65535\n");
+                    return -1;
+                }
+                break;
             case 'h':
                 printf("Usage: %s -i <interface> -d <domains_file> -r <resolvers_file> [options]\n", argv[0]);
                 printf("Options:\n");
                 printf("  -i, --interface    Network interface to use\n");
-                printf("  -d, --domains      File containing domains to resolve\n");
+                printf("  -d, --domains      File containing domains to resolve (bulk mode)\n");
                 printf("  -r, --resolvers    File containing DNS resolvers\n");
+                printf("      --resolver-select  Spread queries by p2c (latency and loss) or rr (default: p2c)\n");
                 printf("  -l, --rate-limit   Query rate limit (default: 5000)\n");
                 printf("  -o, --output       Output file for results\n");
                 printf("  -c, --cache-size   Cache size (default: 10000)\n");
-                printf("  -n, --numa-node    NUMA node to use (default: auto)\n");
+                printf("      --no-admission  Let every miss displace its cache slot (no TinyLFU filter)\n");
+                printf("  -n, --numa-node    NUMA node for memory and threads (default: the NIC's)\n");
+                printf("      --hugepages    Page size for UMEM and cache: auto, 4k, 2m, 1g (default: auto)\n");
                 printf("  -p, --cpu-core     CPU core to use (default: auto)\n");
+                printf("  -m, --rx-mode      RX strategy: busy, wakeup, adaptive (default: adaptive)\n");
+                printf("  -b, --busy-budget  Packets per busy-poll NAPI run (default: %d)\n", XSK_BUSY_POLL_BUDGET);
+                printf("  -k, --backend      Packet I/O backend: afxdp, mem (default: afxdp)\n");
+                printf("  -R, --replay       pcap file replayed by the mem backend\n");
+                printf("      --queue        NIC queue to bind the AF_XDP socket to (default: 0)\n");
+                printf("  -g, --generic      Attach XDP in generic (SKB) mode, e.g. on veth\n");
+                printf("      --tx-csum      UDP checksums: software, offload, none (default: software)\n");
+                printf("      --shard        Resolve only shard i of N of the domains (i/N, by name hash)\n");
+                printf("      --checkpoint   Save scan progress to this file\n");
+                printf("      --checkpoint-interval  Seconds between checkpoints (default: %d)\n",
+                       SCAN_CHECKPOINT_INTERVAL);
+                printf("      --resume       Continue the scan recorded in --checkpoint\n");
+                printf("  -T, --qtype        Record type for bulk queries (default: A)\n");
+                printf("  -t, --timeout      Upstream query timeout in ms (default: %d)\n", SCAN_TIMEOUT_MS);
+                printf("  -x, --retries      Upstream query retransmits (default: %d)\n", SCAN_RETRIES);
+                printf("  -S, --src-ip       Source IPv4 address (default: interface address)\n");
+                printf("  -M, --src-mac      Source MAC address (default: interface address)\n");
+                printf("  -G, --gateway-mac  MAC address of the next hop to the resolvers\n");
+                printf("  -N, --no-tcp-fallback  Do not retry truncated answers over TCP\n");
+                printf("  -E, --edns-size    EDNS(0) UDP buffer size, 0 disables EDNS (default: %d)\n",
+                       DNS_EDNS_BUFFER_SIZE);
+                printf("      --zone         Answer authoritatively from this master file (repeatable)\n");
+                printf("      --policy       Block or redirect names matching rules in this file (repeatable)\n");
+                printf("      --dnssec       Validate signed answers and set AD on secure cache hits\n");
+                printf("      --dnssec-threads  Crypto threads verifying signatures (default: 1)\n");
+                printf("      --trust-anchors  DS or DNSKEY records to validate from (default: root KSKs)\n");
+                printf("      --allow        Only answer queries from CIDRs in this file (XDP)\n");
+                printf("      --deny         Drop packets from CIDRs in this file (XDP)\n");
+                printf("      --rate-limit-ip  Queries/sec allowed per source prefix (XDP, default: off)\n");
+                printf("      --rrl-burst    Queries a source may burst (default: rate)\n");
+                printf("      --rrl-slip     Answer every Nth limited query with TC, 0 drops all (default: %d)\n",
+                       XDP_FILTER_SLIP);
+                printf("      --rrl-prefix   Source prefix length sharing one limit (default: %d)\n",
+                       XDP_FILTER_PREFIX);
+                printf("      --passive      Only observe DNS traffic, emit analytics to -o or stdout\n");
+                printf("      --metrics-interval  Seconds between analytics reports (default: %d)\n",
+                       ANALYTICS_METRICS_INTERVAL);
+                printf("      --xdp-prog     XDP filter object (default: %s)\n", WHACK_BPF_OBJ);
+                printf("      --log-level    Least severe messages logged: debug, info, warn, error (default: info)\n");
+                printf("      --log-file     Append log lines to this file (default: stderr)\n");
+                printf("      --log-format   Log line format: text, json (default: text)\n");
+                printf("      --no-log-timestamps  Leave timestamps out of log lines\n");
                 printf("  -h, --help         Show this help message\n");
                 return 1;
             default:
@@ -150,11 +869,28 @@ static int parse_args(int argc, char **argv, struct config *cfg) {
         }
     }
 
-    // Validate required arguments
-    if (!cfg->interface || !cfg->domains_file || !cfg->resolvers_file) {
+    if (strcmp(cfg->backend, "afxdp") != 0 && strcmp(cfg->backend, "mem") != 0) {
+        fprintf(stderr, "Unknown backend: %s\n", cfg->backend);
+        return -1;
+    }
+
+    // Validate required arguments, passive mode never talks to a resolver
+    if ((!cfg->interface && strcmp(cfg->backend, "afxdp") == 0) || (!cfg->resolvers_file && !cfg->passive)) {
         fprintf(stderr, "Missing required arguments\n");
         return -1;
     }
+    if (cfg->passive && cfg->domains_file) {
+        fprintf(stderr, "Passive mode cannot resolve a domain list\n");
+        return -1;
+    }
+    if (cfg->resume && !cfg->checkpoint_file) {
+        fprintf(stderr, "--resume needs --checkpoint\n");
+        return -1;
+    }
+    if ((cfg->trust_anchors || cfg->dnssec_threads != 1) && !cfg->dnssec) {
+        fprintf(stderr, "--dnssec-threads and --trust-anchors need --dnssec\n");
+        return -1;
+    }
 
     return 0;
 }
@@ -172,16 +908,87 @@ int main(int argc, char **argv) {
         return 1;
     }
 
+    // Logger thread first, before placement pins this thread to its core
+    int ret = log_init(&cfg.log);
+    if (ret) {
+        fprintf(stderr, "Failed to start logging to %s: %s\n", cfg.log.file ? cfg.log.file : "stderr",
+                strerror(-ret));
+        return 1;
+    }
+
+    // Crypto threads too, so they stay off the packet core. Only a server
+    // has answers to validate.
+    if (cfg.dnssec && (cfg.passive || cfg.domains_file)) {
+        fprintf(stderr, "Only serving mode validates DNSSEC, ignoring --dnssec\n");
+    } else if (cfg.dnssec) {
+        struct validator_config validator_cfg = {
+            .workers = cfg.dnssec_threads,
+            .anchors_file = cfg.trust_anchors
+        };
+        ret = validator_init(&validator_cfg);
+        if (ret) {
+            fprintf(stderr, "Failed to start DNSSEC validation: %s\n", strerror(-ret));
+            log_destroy();
+            return 1;
+        }
+    }
+
     // Set up signal handlers
     signal(SIGINT, signal_handler);
     signal(SIGTERM, signal_handler);
+    signal(SIGHUP, reload_handler);
+
+    // Load upstream resolvers
+    if (cfg.resolvers_file && resolvers_load(cfg.resolvers_file) != 0) {
+        fprintf(stderr, "Failed to load resolvers from %s\n", cfg.resolvers_file);
+        return 1;
+    }
+    resolvers_set_select(cfg.resolver_select);
+
+    // Placement first, everything below allocates on the chosen node
+    if (init_placement(&cfg) != 0) {
+        fprintf(stderr, "Failed to set up memory placement\n");
+        return 1;
+    }
 
     // Initialize cache
+    memset(&cache_cfg, 0, sizeof(cache_cfg));
     cache_cfg.max_entries = cfg.cache_size;
     cache_cfg.default_ttl = cfg.cache_ttl;
     cache_cfg.cleanup_interval = 60;  // Cleanup every minute
+    cache_cfg.admission = cfg.cache_admission;
     cache_init(&cache_cfg);
 
+    // Firewall rules, checked before the zones and the cache
+    if (cfg.policy_count) {
+        if (cfg.passive) {
+            fprintf(stderr, "Passive mode does not answer queries, ignoring policy files\n");
+        } else if (policy_load(cfg.policy_files, cfg.policy_count) != 0) {
+            log_flush();
+            fprintf(stderr, "Failed to load policy files\n");
+            cache_destroy();
+            log_destroy();
+            return 1;
+        } else {
+            print_policy_rules();
+        }
+    }
+
+    // Authoritative data, answered ahead of the cache
+    if (cfg.zone_count) {
+        if (cfg.passive) {
+            fprintf(stderr, "Passive mode does not answer queries, ignoring zone files\n");
+        } else if (zone_load(cfg.zone_files, cfg.zone_count) != 0) {
+            log_flush();
+            fprintf(stderr, "Failed to load zone files\n");
+            cache_destroy();
+            log_destroy();
+            return 1;
+        } else {
+            print_zone_stats();
+        }
+    }
+
     // Configure XDP socket
     memset(&xsk_cfg, 0, sizeof(xsk_cfg));
     xsk_cfg.rx_size = XSK_RING_SIZE;
@@ -189,37 +996,202 @@ int main(int argc, char **argv) {
     xsk_cfg.batch_size = XSK_BATCH_SIZE;
     xsk_cfg.bind_flags = XDP_USE_NEED_WAKEUP;
     xsk_cfg.xdp_flags = true;  // Use native mode if available
+    xsk_cfg.xdp_generic = cfg.xdp_generic;
     xsk_cfg.ifname = cfg.interface;
+    xsk_cfg.queue_id = cfg.queue_id;
+    xsk_cfg.rx_mode = cfg.rx_mode;
+    xsk_cfg.busy_poll_budget = cfg.busy_poll_budget;
+    xsk_cfg.tx_csum_offload = cfg.tx_csum == PACKET_CSUM_OFFLOAD;
 
-    // Initialize AF_XDP socket
-    if (af_xdp_socket_init(&xsk, &xsk_cfg) != 0) {
-        fprintf(stderr, "Failed to initialize AF_XDP socket\n");
-        return 1;
+    // Initialize the packet I/O backend
+    bool replay_mode = strcmp(cfg.backend, "mem") == 0;
+    if (replay_mode) {
+        struct mem_backend_config mem_cfg = {
+            .workload = &replay,
+            .loops = 1,
+        };
+        if (cfg.replay_file && workload_load_pcap(&replay, cfg.replay_file) != 0) {
+            fprintf(stderr, "Failed to load %s\n", cfg.replay_file);
+            return 1;
+        }
+        if (io_backend_mem_init(&io, &mem_cfg) != 0) {
+            fprintf(stderr, "Failed to initialize in-memory backend\n");
+            return 1;
+        }
+    } else {
+        // Our XDP program goes on first, the socket then joins its XSKMAP
+        if (filter_enabled(&cfg) || fallback_needs_filter(&cfg)) {
+            struct xdp_filter_config filter_cfg = {
+                .ifname = cfg.interface,
+                .object_path = cfg.xdp_prog,
+                .generic = cfg.xdp_generic,
+                .rate_limit = cfg.rrl_rate,
+                .burst = cfg.rrl_burst,
+                .slip = cfg.rrl_slip,
+                .prefix = cfg.rrl_prefix,
+                .allow_file = cfg.allow_file,
+                .deny_file = cfg.deny_file
+            };
+            ret = xdp_filter_init(&filter_cfg);
+            if (ret && fallback_needs_filter(&cfg)) {
+                fprintf(stderr, "Failed to load XDP filter (%s), TCP answers would not reach the kernel: "
+                        "disabling TCP fallback\n", strerror(-ret));
+                cfg.tcp_fallback = false;
+            } else if (ret) {
+                fprintf(stderr, "Failed to load XDP filter: %s\n", strerror(-ret));
+                return 1;
+            } else {
+                xsk_cfg.xsks_map_fd = xdp_filter_xsks_map_fd();
+            }
+        }
+        if (io_backend_afxdp_init(&io, &xsk, &xsk_cfg) != 0) {
+            fprintf(stderr, "Failed to initialize AF_XDP socket\n");
+            xdp_filter_destroy();
+            return 1;
+        }
     }
 
-    // Set CPU affinity if specified
-    if (cfg.cpu_core >= 0) {
-        if (set_cpu_affinity(cfg.cpu_core) != 0) {
-            fprintf(stderr, "Warning: Failed to set CPU affinity\n");
+    // Offload only where the socket got TX metadata from kernel and driver
+    enum packet_csum_mode tx_csum = cfg.tx_csum;
+    if (tx_csum == PACKET_CSUM_OFFLOAD && !xsk.tx_csum_offload) {
+        tx_csum = PACKET_CSUM_SOFTWARE;
+    }
+    packet_set_csum_mode(tx_csum);
+    pipeline_init(&io);
+
+    // Bulk-resolver mode when a domain list is given
+    bool scanning = cfg.domains_file != NULL;
+    FILE *metrics = stdout;
+    struct analytics_summary *report = NULL;
+    if (cfg.passive) {
+        // Reports go to the output file, one JSON line per interval
+        if (cfg.output_file && !(metrics = fopen(cfg.output_file, "w"))) {
+            fprintf(stderr, "Failed to open %s: %s\n", cfg.output_file, strerror(errno));
+            io_backend_cleanup(&io);
+            return 1;
+        }
+        report = analytics_summary_alloc();
+        if (!report || analytics_core_init(&passive_core) != 0) {
+            fprintf(stderr, "Failed to allocate analytics summaries\n");
+            io_backend_cleanup(&io);
+            return 1;
+        }
+    } else if (scanning) {
+        struct scan_config scan_cfg;
+        if (init_scan_config(&cfg, &scan_cfg) != 0 || scan_init(&scan_cfg, &io) != 0) {
+            fprintf(stderr, "Failed to start scan of %s\n", cfg.domains_file);
+            io_backend_cleanup(&io);
+            return 1;
+        }
+        pipeline_set_response_handler(scan_handle_response);
+    } else {
+        // Serving clients: cache misses are resolved through the same rings
+        struct forward_config fwd_cfg;
+        if (init_forward_config(&cfg, &fwd_cfg) != 0 || forward_init(&fwd_cfg, &io) != 0) {
+            fprintf(stderr, "Failed to set up forwarding to %s\n", cfg.resolvers_file);
+            io_backend_cleanup(&io);
+            return 1;
         }
     }
 
-    printf("whack started on interface %s\n", cfg.interface);
+    if (cfg.interface) {
+        printf("whack started on interface %s (%s backend)\n", cfg.interface, io.name);
+    } else {
+        printf("whack started (%s backend)\n", io.name);
+    }
+    if (cfg.passive) {
+        printf("Passive mode: analytics every %u s to %s\n", cfg.metrics_interval,
+               cfg.output_file ? cfg.output_file : "stdout");
+    }
     printf("Cache size: %zu entries\n", cfg.cache_size);
+    if (validator_running()) {
+        printf("DNSSEC: validating on %u threads, anchors from %s\n", validator_workers(),
+               cfg.trust_anchors ? cfg.trust_anchors : "the root KSKs");
+    }
     printf("Rate limit: %u queries/sec\n", cfg.rate_limit);
+    if (resolvers_count()) {
+        printf("Resolvers: %zu, %s selection\n", resolvers_count(), resolvers_select_name(cfg.resolver_select));
+    }
     if (cfg.cpu_core >= 0) {
         printf("CPU core: %d\n", cfg.cpu_core);
     }
     if (cfg.numa_node >= 0) {
         printf("NUMA node: %d\n", cfg.numa_node);
     }
+    print_placement(&cfg);
+    printf("RX mode: %s", af_xdp_rx_mode_name(cfg.rx_mode));
+    if (cfg.rx_mode == XSK_RX_MODE_BUSY_POLL) {
+        printf(" (%s)", xsk.busy_poll ? "kernel busy polling" : "userspace spinning only");
+    }
+    printf("\n");
+    printf("TX checksums: %s", packet_csum_mode_name(tx_csum));
+    if (tx_csum == PACKET_CSUM_SOFTWARE) {
+        printf(" (%s)", csum_impl_name());
+    }
+    if (tx_csum != cfg.tx_csum) {
+        printf(", offload not supported by the kernel or driver");
+    }
+    printf("\n");
 
     // Main processing loop
+    time_t last_metrics = time(NULL);
     while (running) {
-        // Poll for packets
-        if (af_xdp_socket_poll(&xsk, 1000) > 0) {
+        // Wait for packets using the configured RX strategy, briefly while
+        // queries remain to be sent or answered
+        if (io_backend_wait(&io, scanning || forward_pending() || validator_pending() ? 1 : 1000) > 0) {
             // Process received packets
-            af_xdp_socket_rx(&xsk, process_packet);
+            io_backend_rx(&io, cfg.passive ? passive_process_packet : pipeline_process_packet);
+        }
+        io_backend_flush(&io);
+
+        // Send queries and handle retransmits
+        if (cfg.passive) {
+            analytics_core_poll(&passive_core);
+        } else if (scanning) {
+            scan_tick();
+            if (scan_done()) {
+                running = 0;
+            }
+        } else {
+            forward_tick();
+            validator_poll();
+        }
+
+        // A finished replay ends the run
+        if (replay_mode && !scanning && io_backend_mem_done(&io)) {
+            running = 0;
+        }
+
+        // Pick up edited allow/deny lists without dropping traffic
+        if (reload_lists) {
+            reload_lists = 0;
+            ret = xdp_filter_reload();
+            if (ret && ret != -ENODEV) {
+                log_error("Failed to reload XDP filter lists: errno %d", -ret);
+            }
+
+            // Neither a bad policy file nor a bad zone stops what is loaded.
+            // This is the packet thread: everything goes through the logger.
+            if (cfg.policy_count && !cfg.passive) {
+                if (policy_load(cfg.policy_files, cfg.policy_count) == 0) {
+                    struct policy_stats stats;
+                    policy_get_stats(&stats);
+                    log_info("Reloaded policy: %zu rules on %zu names, built in %.1f ms",
+                             stats.rules, stats.names, stats.build_ns / 1e6);
+                } else {
+                    log_error("Failed to reload policy files, keeping the loaded rules");
+                }
+            }
+            if (cfg.zone_count && !cfg.passive) {
+                if (zone_load(cfg.zone_files, cfg.zone_count) == 0) {
+                    struct zone_stats stats;
+                    zone_get_stats(&stats);
+                    log_info("Reloaded zones: %zu zones, %zu names, %zu records, built in %.1f ms",
+                             stats.zones, stats.names, stats.records, stats.build_ns / 1e6);
+                } else {
+                    log_error("Failed to reload zone files, keeping the loaded zones");
+                }
+            }
         }
 
         // Periodic cache cleanup
@@ -229,18 +1201,64 @@ int main(int argc, char **argv) {
             cache_cleanup();
             last_cleanup = now;
         }
+
+        // Periodic analytics report
+        if (cfg.passive && now - last_metrics >= cfg.metrics_interval) {
+            emit_metrics(report, metrics, now, now - last_metrics);
+            last_metrics = now;
+        }
     }
 
     // Cleanup
     printf("\nShutting down...\n");
-    af_xdp_socket_cleanup(&xsk);
+    if (io.priv == &xsk) {
+        print_rx_stats(&xsk);
+    }
+    print_pipeline_stats();
+    if (cfg.policy_count && !cfg.passive) {
+        print_policy_matches();
+    }
+    if (cfg.passive) {
+        // What arrived since the last report
+        time_t now = time(NULL);
+        emit_metrics(report, metrics, now, now - last_metrics);
+        if (metrics != stdout) {
+            fclose(metrics);
+        }
+        analytics_core_free(&passive_core);
+        free(report);
+    } else if (scanning) {
+        // Also after an interrupt, so a restart with --resume picks up here
+        scan_checkpoint();
+        print_scan_stats();
+        print_resolver_stats();
+        scan_destroy();
+    } else {
+        print_forward_stats();
+        print_resolver_stats();
+        forward_destroy();
+        if (validator_running()) {
+            print_validator_stats();
+            validator_destroy();
+        }
+    }
+    print_filter_stats();
+    io_backend_cleanup(&io);
+    xdp_filter_destroy();
+    resolvers_destroy();
+    workload_free(&replay);
+    zone_destroy();
+    policy_destroy();
     cache_destroy();
 
     // Print statistics
     printf("Cache statistics:\n");
     printf("  Hits: %zu\n", cache_get_hit_count());
     printf("  Misses: %zu\n", cache_get_miss_count());
+    printf("  Rejected by admission filter: %zu\n", cache_get_rejected_count());
     printf("  Hit ratio: %.2f%%\n", cache_get_hit_ratio() * 100);
+    print_log_stats();
+    log_destroy();
 
     return 0;
 }
@@ -0,0 +1,251 @@
+#include "../include/packet.h"
+#include "../include/checksum.h"
+#include <string.h>
+#include <arpa/inet.h>
+#include <linux/if_ether.h>
+#include <linux/ip.h>
+#include <linux/udp.h>
+#include <netinet/in.h>
+
+// UDP checksum handling for every frame built
+static enum packet_csum_mode csum_mode = PACKET_CSUM_SOFTWARE;
+
+int packet_parse(const uint8_t *frame, size_t len, struct packet_info *info) {
+    if (len < PACKET_HDR_LEN) {
+        return -1;
+    }
+
+    // Only untagged IPv4 is handled
+    const struct ethhdr *eth = (const struct ethhdr *)frame;
+    if (eth->h_proto != htons(ETH_P_IP)) {
+        return -1;
+    }
+
+    const struct iphdr *ip = (const struct iphdr *)(frame + ETH_HDR_LEN);
+    size_t ihl = ip->ihl * 4;
+    if (ip->version != 4 || ihl < IPV4_HDR_LEN || ip->protocol != IPPROTO_UDP) {
+        return -1;
+    }
+
+    // Fragments never carry a complete DNS message
+    if (ip->frag_off & htons(0x3FFF)) {
+        return -1;
+    }
+
+    size_t ip_len = ntohs(ip->tot_len);
+    if (ip_len < ihl + UDP_HDR_LEN || ETH_HDR_LEN + ip_len > len) {
+        return -1;
+    }
+
+    const struct udphdr *udp = (const struct udphdr *)((const uint8_t *)ip + ihl);
+    size_t udp_len = ntohs(udp->len);
+    if (udp_len < UDP_HDR_LEN || udp_len > ip_len - ihl) {
+        return -1;
+    }
+
+    memcpy(info->src.mac, eth->h_source, ETH_ADDR_LEN);
+    memcpy(info->dst.mac, eth->h_dest, ETH_ADDR_LEN);
+    info->src.ip = ip->saddr;
+    info->dst.ip = ip->daddr;
+    info->src.port = udp->source;
+    info->dst.port = udp->dest;
+    info->payload = (const uint8_t *)udp + UDP_HDR_LEN;
+    info->payload_len = udp_len - UDP_HDR_LEN;
+    info->ttl = ip->ttl;
+
+    return 0;
+}
+
+int packet_build_udp(uint8_t *frame, size_t frame_len,
+                     const struct packet_endpoint *src, const struct packet_endpoint *dst,
+                     const uint8_t *payload, size_t payload_len) {
+    size_t total = PACKET_HDR_LEN + payload_len;
+    if (total > frame_len || payload_len > 0xFFFF - IPV4_HDR_LEN - UDP_HDR_LEN) {
+        return -1;
+    }
+
+    // Ethernet header
+    struct ethhdr *eth = (struct ethhdr *)frame;
+    memcpy(eth->h_dest, dst->mac, ETH_ADDR_LEN);
+    memcpy(eth->h_source, src->mac, ETH_ADDR_LEN);
+    eth->h_proto = htons(ETH_P_IP);
+
+    // IPv4 header
+    struct iphdr *ip = (struct iphdr *)(frame + ETH_HDR_LEN);
+    ip->version = 4;
+    ip->ihl = IPV4_HDR_LEN / 4;
+    ip->tos = 0;
+    ip->tot_len = htons(IPV4_HDR_LEN + UDP_HDR_LEN + payload_len);
+    ip->id = 0;
+    ip->frag_off = htons(0x4000);  // Don't fragment
+    ip->ttl = 64;
+    ip->protocol = IPPROTO_UDP;
+    ip->check = 0;
+    ip->saddr = src->ip;
+    ip->daddr = dst->ip;
+
+    // Checksums are summed from the values rather than read back from the
+    // frame, where the loads would stall waiting on the stores just made
+    uint32_t ip_sum = (uint32_t)htons(0x4500) + ip->tot_len + htons(0x4000) + htons(64 << 8 | IPPROTO_UDP);
+    ip->check = csum_fold(csum_add(csum_add(ip_sum, src->ip), dst->ip));
+
+    // UDP header
+    struct udphdr *udp = (struct udphdr *)(frame + ETH_HDR_LEN + IPV4_HDR_LEN);
+    uint16_t udp_len = UDP_HDR_LEN + payload_len;
+    udp->source = src->port;
+    udp->dest = dst->port;
+    udp->len = htons(udp_len);
+    udp->check = 0;
+
+    // The payload is summed where the caller left it, before any move
+    uint32_t pseudo = csum_pseudo_udp(src->ip, dst->ip, udp_len);
+    uint32_t sum = 0;
+    if (csum_mode == PACKET_CSUM_SOFTWARE) {
+        sum = csum_add(pseudo, (uint32_t)src->port + dst->port + htons(udp_len));
+        sum = csum_partial(payload ? payload : frame + PACKET_HDR_LEN, payload_len, sum);
+    }
+
+    // Payload may already be in place when the caller built it in the frame
+    if (payload && payload != frame + PACKET_HDR_LEN) {
+        memmove(frame + PACKET_HDR_LEN, payload, payload_len);
+    }
+
+    switch (csum_mode) {
+        case PACKET_CSUM_SOFTWARE:
+            // A sum of zero goes out as all ones, zero means no checksum
+            udp->check = csum_fold(sum);
+            if (!udp->check) {
+                udp->check = 0xFFFF;
+            }
+            break;
+        case PACKET_CSUM_OFFLOAD:
+            // The NIC adds the datagram to this and stores the complement
+            udp->check = (uint16_t)~csum_fold(pseudo);
+            break;
+        case PACKET_CSUM_NONE:
+            break;
+    }
+
+    return (int)total;
+}
+
+int packet_build_reply(uint8_t *frame, size_t frame_len, const struct packet_info *request,
+                       const uint8_t *payload, size_t payload_len) {
+    // Swap both ends of the request
+    return packet_build_udp(frame, frame_len, &request->dst, &request->src, payload, payload_len);
+}
+
+uint16_t packet_ipv4_checksum(const void *header, size_t len) {
+    return csum_fold(csum_partial(header, len, 0));
+}
+
+// Carry a change into the UDP checksum: a 32-bit address, which is in the
+// pseudo-header, or a 16-bit header or payload word. In offload mode the
+// field holds the plain pseudo-header sum, so only addresses move it.
+static void udp_check_replace(struct udphdr *udp, uint32_t old, uint32_t new, bool address) {
+    switch (csum_mode) {
+        case PACKET_CSUM_SOFTWARE:
+            udp->check = address ? csum_replace32(udp->check, old, new) :
+                                   csum_replace16(udp->check, (uint16_t)old, (uint16_t)new);
+            if (!udp->check) {
+                udp->check = 0xFFFF;
+            }
+            break;
+        case PACKET_CSUM_OFFLOAD:
+            if (address) {
+                udp->check = (uint16_t)~csum_replace32((uint16_t)~udp->check, old, new);
+            }
+            break;
+        case PACKET_CSUM_NONE:
+            break;
+    }
+}
+
+void packet_rewrite_udp(uint8_t *frame, const struct packet_endpoint *src, const struct packet_endpoint *dst) {
+    struct ethhdr *eth = (struct ethhdr *)frame;
+    struct iphdr *ip = (struct iphdr *)(frame + ETH_HDR_LEN);
+    struct udphdr *udp = (struct udphdr *)(frame + ETH_HDR_LEN + IPV4_HDR_LEN);
+
+    memcpy(eth->h_dest, dst->mac, ETH_ADDR_LEN);
+    memcpy(eth->h_source, src->mac, ETH_ADDR_LEN);
+
+    // Addresses are in the IPv4 header and the UDP pseudo-header
+    if (ip->saddr != src->ip) {
+        ip->check = csum_replace32(ip->check, ip->saddr, src->ip);
+        udp_check_replace(udp, ip->saddr, src->ip, true);
+        ip->saddr = src->ip;
+    }
+    if (ip->daddr != dst->ip) {
+        ip->check = csum_replace32(ip->check, ip->daddr, dst->ip);
+        udp_check_replace(udp, ip->daddr, dst->ip, true);
+        ip->daddr = dst->ip;
+    }
+    if (udp->source != src->port) {
+        udp_check_replace(udp, udp->source, src->port, false);
+        udp->source = src->port;
+    }
+    if (udp->dest != dst->port) {
+        udp_check_replace(udp, udp->dest, dst->port, false);
+        udp->dest = dst->port;
+    }
+}
+
+void packet_rewrite_payload16(uint8_t *frame, size_t offset, uint16_t value) {
+    struct udphdr *udp = (struct udphdr *)(frame + ETH_HDR_LEN + IPV4_HDR_LEN);
+    uint8_t *word = frame + PACKET_HDR_LEN + offset;
+    uint16_t old;
+
+    memcpy(&old, word, sizeof(old));
+    if (old != value) {
+        udp_check_replace(udp, old, value, false);
+        memcpy(word, &value, sizeof(value));
+    }
+}
+
+bool packet_udp_checksum_ok(const uint8_t *frame, size_t len) {
+    struct packet_info info;
+    if (packet_parse(frame, len, &info) != 0) {
+        return false;
+    }
+
+    const struct udphdr *udp = (const struct udphdr *)(info.payload - UDP_HDR_LEN);
+    size_t udp_len = UDP_HDR_LEN + info.payload_len;
+    if (!udp->check) {
+        return true;
+    }
+    uint32_t pseudo = csum_pseudo_udp(info.src.ip, info.dst.ip, udp_len);
+    return csum_fold(csum_partial(udp, udp_len, pseudo)) == 0;
+}
+
+void packet_set_csum_mode(enum packet_csum_mode mode) {
+    csum_mode = mode;
+}
+
+enum packet_csum_mode packet_get_csum_mode(void) {
+    return csum_mode;
+}
+
+int packet_csum_mode_parse(const char *name, enum packet_csum_mode *mode) {
+    if (strcmp(name, "software") == 0 || strcmp(name, "sw") == 0) {
+        *mode = PACKET_CSUM_SOFTWARE;
+    } else if (strcmp(name, "offload") == 0) {
+        *mode = PACKET_CSUM_OFFLOAD;
+    } else if (strcmp(name, "none") == 0) {
+        *mode = PACKET_CSUM_NONE;
+    } else {
+        return -1;
+    }
+    return 0;
+}
+
+const char *packet_csum_mode_name(enum packet_csum_mode mode) {
+    switch (mode) {
+        case PACKET_CSUM_SOFTWARE:
+            return "software";
+        case PACKET_CSUM_OFFLOAD:
+            return "offload";
+        case PACKET_CSUM_NONE:
+            return "none";
+    }
+    return "unknown";
+}
@@ -0,0 +1,328 @@
+#include "../include/pipeline.h"
+#include "../include/io_backend.h"
+#include "../include/packet.h"
+#include "../include/dns_query.h"
+#include "../include/cache.h"
+#include "../include/forward.h"
+#include "../include/zone.h"
+#include "../include/policy.h"
+#include "../include/validator.h"
+#include <string.h>
+#include <stdbool.h>
+#include <arpa/inet.h>
+
+// Pipeline state
+static struct io_backend *io = NULL;
+static struct pipeline_stats stats;
+static pipeline_response_handler response_handler = NULL;
+
+void pipeline_init(struct io_backend *backend) {
+    io = backend;
+    response_handler = NULL;
+    memset(&stats, 0, sizeof(stats));
+}
+
+void pipeline_set_response_handler(pipeline_response_handler handler) {
+    response_handler = handler;
+}
+
+// Wrap a DNS payload in a UDP frame from src to dst and queue it
+static void send_reply(const struct packet_endpoint *src, const struct packet_endpoint *dst,
+                       const uint8_t *payload, size_t payload_len) {
+    size_t capacity;
+    uint8_t *frame = io_backend_tx_buffer(io, &capacity);
+    if (!frame) {
+        stats.tx_failures++;
+        return;
+    }
+
+    int len = packet_build_udp(frame, capacity, src, dst, payload, payload_len);
+    if (len < 0 || io_backend_tx(io, frame, len) != 0) {
+        stats.tx_failures++;
+        return;
+    }
+
+    stats.replies++;
+}
+
+// Largest UDP reply the client accepts
+static uint16_t udp_limit(const struct dns_edns *edns) {
+    if (edns->present && edns->udp_size > DNS_MAX_UDP_SIZE) {
+        return edns->udp_size;
+    }
+    return DNS_MAX_UDP_SIZE;
+}
+
+// Cap a reply at the client's UDP limit, truncating to the question with TC set
+static void send_sized_reply(const struct packet_endpoint *src, const struct packet_endpoint *dst,
+                             size_t limit, uint8_t *payload, size_t payload_len) {
+    if (payload_len > limit) {
+        if (dns_truncate(payload, &payload_len) != 0) {
+            stats.tx_failures++;
+            return;
+        }
+        stats.truncated++;
+    }
+
+    send_reply(src, dst, payload, payload_len);
+}
+
+// Cache scope of an answer: the subnet it declared valid for, or global,
+// and the DO bit of the query it answers
+static void answer_scope(const struct dns_edns *edns, bool dnssec_ok, struct cache_scope *scope) {
+    if (edns->has_ecs && edns->ecs.scope_prefix) {
+        cache_scope_init(scope, edns->ecs.family, edns->ecs.address, edns->ecs.scope_prefix);
+    } else {
+        cache_scope_init(scope, 0, NULL, 0);
+    }
+    scope->dnssec_ok = dnssec_ok;
+}
+
+// Type and class of the question ending at question_end
+static void question_key(const uint8_t *msg, int question_end, struct cache_scope *scope) {
+    scope->qtype = (uint16_t)(msg[question_end - 4] << 8 | msg[question_end - 3]);
+    scope->qclass = (uint16_t)(msg[question_end - 2] << 8 | msg[question_end - 1]);
+}
+
+// Build one waiting client's reply in a TX frame, cut to its UDP limit
+static int build_client_reply(uint8_t *frame, size_t capacity, const struct forward_client *client,
+                              const uint8_t *payload, size_t payload_len) {
+    uint8_t *msg = frame + PACKET_HDR_LEN;
+    size_t len = payload_len;
+    bool truncate = len > client->udp_limit;
+    if (truncate) {
+        int end = dns_question_end(payload, payload_len);
+        if (end < 0) {
+            return -1;
+        }
+        len = end;
+    }
+    if (capacity < PACKET_HDR_LEN + len) {
+        return -1;
+    }
+
+    memcpy(msg, payload, len);
+    memcpy(msg, &client->id, sizeof(client->id));
+
+    // When validating, AD is ours and nothing relayed has been checked yet
+    if (validator_running()) {
+        msg[3] &= ~0x20;
+    }
+    if (truncate) {
+        dns_truncate(msg, &len);
+        stats.truncated++;
+    }
+    return packet_build_udp(frame, capacity, &client->local, &client->addr, msg, len);
+}
+
+// Write a template answer straight into a TX frame, no copy through the stack
+static void send_template(const struct packet_info *info, const struct dns_edns *edns,
+                             const uint8_t *tmpl, size_t template_len, size_t question_end) {
+    size_t capacity;
+    uint8_t *frame = io_backend_tx_buffer(io, &capacity);
+    if (!frame || capacity < PACKET_HDR_LEN) {
+        stats.tx_failures++;
+        return;
+    }
+
+    uint8_t *msg = frame + PACKET_HDR_LEN;
+    int written = zone_write(tmpl, template_len, info->payload, question_end, edns, msg,
+                             capacity - PACKET_HDR_LEN);
+    size_t len = written;
+    if (written < 0 || (len > udp_limit(edns) && dns_truncate(msg, &len) != 0)) {
+        stats.tx_failures++;
+        return;
+    }
+    if (len < (size_t)written) {
+        stats.truncated++;
+    }
+
+    int frame_len = packet_build_udp(frame, capacity, &info->dst, &info->src, msg, len);
+    if (frame_len < 0 || io_backend_tx(io, frame, frame_len) != 0) {
+        stats.tx_failures++;
+        return;
+    }
+    stats.replies++;
+}
+
+// Hand an upstream answer to every client waiting on it, caching it on the way
+static void relay_answer(const struct packet_info *info, const struct forward_client *clients, size_t count) {
+    const uint8_t *response = info->payload;
+    size_t response_len = info->payload_len;
+
+    // Complete answers and NXDOMAIN are cached for as long as their records live
+    const char *qname = (const char *)(response + sizeof(struct dns_header));
+    uint8_t rcode = response[3] & 0x0F;
+    struct dns_edns edns;
+    uint32_t ttl;
+    int question_end = dns_question_end(response, response_len);
+    if (!(response[2] & 0x02) && (rcode == 0 || rcode == 3) && question_end > 0 &&
+        dns_parse_edns(response, response_len, &edns) == 0 &&
+        dns_answer_ttl(response, response_len, &ttl) == 0 && ttl > 0) {
+        struct cache_scope scope;
+        answer_scope(&edns, clients[0].dnssec_ok, &scope);
+        question_key(response, question_end, &scope);
+        cache_insert_scoped(qname, &scope, response, response_len, ttl < FORWARD_MAX_TTL ? ttl : FORWARD_MAX_TTL);
+
+        // Signed answers only come back to DO queries; the crypto workers
+        // mark the entry secure later, this thread never waits for them
+        if (scope.dnssec_ok && validator_running() && validator_submit(qname, &scope, response, response_len) == 0) {
+            stats.validations++;
+        }
+    }
+
+    // One frame per client, queued together. The first reply of each size
+    // is built in full; the rest copy it and rewrite addresses and ID, with
+    // checksums updated per field rather than summed over the answer again.
+    uint8_t *frames[FORWARD_MAX_CLIENTS];
+    uint32_t lens[FORWARD_MAX_CLIENTS];
+    int built[2] = {-1, -1};        // Index into frames, whole and truncated
+    size_t n = 0;
+    for (size_t i = 0; i < count; i++) {
+        size_t capacity;
+        uint8_t *frame = io_backend_tx_buffer(io, &capacity);
+        bool truncate = response_len > clients[i].udp_limit;
+        int first = built[truncate];
+        int len = -1;
+        if (frame && first >= 0 && capacity >= lens[first]) {
+            len = lens[first];
+            memcpy(frame, frames[first], len);
+            packet_rewrite_udp(frame, &clients[i].local, &clients[i].addr);
+            packet_rewrite_payload16(frame, 0, clients[i].id);
+            stats.truncated += truncate;
+        } else if (frame) {
+            len = build_client_reply(frame, capacity, &clients[i], response, response_len);
+            built[truncate] = len < 0 ? -1 : (int)n;
+        }
+        if (len < 0) {
+            stats.tx_failures++;
+            continue;
+        }
+        frames[n] = frame;
+        lens[n++] = len;
+    }
+
+    if (n && io_backend_tx_batch(io, frames, lens, n) != 0) {
+        stats.tx_failures += n;
+        return;
+    }
+    stats.replies += n;
+    stats.relayed += n;
+}
+
+// Process received DNS packet
+void pipeline_process_packet(const uint8_t *packet, size_t length) {
+    struct packet_info info;
+    struct dns_query query;
+    struct dns_edns edns;
+    struct forward_client waiting[FORWARD_MAX_CLIENTS];
+    struct cache_scope client;
+    uint8_t response[CACHE_MAX_RESPONSE];
+    size_t response_len = sizeof(response);
+
+    stats.packets++;
+
+    // First check if this is a DNS message over UDP
+    if (packet_parse(packet, length, &info) != 0 || info.payload_len < sizeof(struct dns_header)) {
+        stats.malformed++;
+        return;
+    }
+
+    // The wire-format name is used as the cache key, so it must be terminated
+    const char *qname = (const char *)(info.payload + sizeof(struct dns_header));
+    if (!memchr(qname, 0, info.payload_len - sizeof(struct dns_header))) {
+        stats.malformed++;
+        return;
+    }
+
+    // Parse the DNS header
+    memcpy(&query.header, info.payload, sizeof(struct dns_header));
+    if (query.header.flags & htons(0x8000)) {
+        stats.responses++;
+        int count = forward_match(&info, waiting);
+        if (count > 0) {
+            relay_answer(&info, waiting, count);
+        } else if (response_handler) {
+            response_handler(&info);
+        }
+        return;
+    }
+    stats.queries++;
+
+    // The OPT record gives the client's UDP limit and, optionally, its subnet
+    if (dns_parse_edns(info.payload, info.payload_len, &edns) != 0) {
+        stats.malformed++;
+        return;
+    }
+    if (edns.has_ecs) {
+        stats.ecs_queries++;
+        cache_scope_init(&client, edns.ecs.family, edns.ecs.address, edns.ecs.source_prefix);
+    } else {
+        cache_scope_init(&client, 0, NULL, 0);
+    }
+    client.dnssec_ok = edns.dnssec_ok;
+
+    // Policy rules come first, blocked names never reach the zones or the cache
+    int question_end = dns_question_end(info.payload, info.payload_len);
+    if (question_end > 0) {
+        question_key(info.payload, question_end, &client);
+    }
+    size_t template_len;
+    enum policy_action action;
+    const uint8_t *tmpl = question_end > 0 ?
+        policy_lookup(info.payload, question_end, &template_len, &action) : NULL;
+    if (tmpl) {
+        stats.policy_answers++;
+        send_template(&info, &edns, tmpl, template_len, question_end);
+        return;
+    }
+
+    // Names under a loaded zone are answered from its precomputed templates
+    tmpl = question_end > 0 ? zone_lookup(info.payload, question_end, &template_len) : NULL;
+    if (tmpl) {
+        stats.zone_answers++;
+        send_template(&info, &edns, tmpl, template_len, question_end);
+        return;
+    }
+
+    // Check the cache next; entries are keyed by the question, subnet and
+    // DO, and keep a bounded copy of the name, so the question must match
+    bool secure = false;
+    uint32_t age = 0;
+    if (question_end > 0 && cache_lookup_scoped(qname, &client, response, &response_len, &secure, &age) &&
+        response_len >= (size_t)question_end &&
+        memcmp(response + sizeof(struct dns_header), info.payload + sizeof(struct dns_header),
+               question_end - sizeof(struct dns_header)) == 0) {
+        stats.cache_hits++;
+
+        // Answer with the client's transaction ID and what is left of the TTLs
+        memcpy(response, &query.header.id, sizeof(query.header.id));
+        if (age) {
+            dns_age_ttls(response, response_len, age);
+        }
+
+        // When validating, AD is ours: set for verified answers to clients
+        // that asked with DO or AD (RFC 6840 section 5.8), cleared otherwise
+        if (validator_running()) {
+            bool ad = secure && (edns.dnssec_ok || (info.payload[3] & 0x20));
+            response[3] = (response[3] & ~0x20) | (ad ? 0x20 : 0);
+            stats.secure_hits += ad;
+        }
+        send_sized_reply(&info.dst, &info.src, udp_limit(&edns), response, response_len);
+        return;
+    }
+    stats.cache_misses++;
+
+    // Resolve upstream, the answer comes back through relay_answer
+    if (forward_query(&info, &edns, udp_limit(&edns)) != 0) {
+        stats.unforwarded++;
+    }
+}
+
+void pipeline_get_stats(struct pipeline_stats *out) {
+    *out = stats;
+}
+
+void pipeline_reset_stats(void) {
+    memset(&stats, 0, sizeof(stats));
+}
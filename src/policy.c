@@ -0,0 +1,520 @@
+#include "../include/policy.h"
+#include "../include/dns_query.h"
+#include "../include/hugemem.h"
+#include "../include/log.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <errno.h>
+#include <time.h>
+#include <arpa/inet.h>
+
+#define HDR_LEN             12      // DNS header, the question follows
+#define QTYPE_A             1
+#define QTYPE_AAAA          28
+#define QTYPE_ANY           255
+#define QCLASS_IN           1
+#define MAX_LABELS          128
+#define MAX_TEMPLATE        40      // Header plus one AAAA record
+
+// Fixed verdicts, redirects follow
+#define VERDICT_NONE        0
+#define VERDICT_PASSTHRU    1
+#define VERDICT_NXDOMAIN    2
+#define VERDICT_NODATA      3
+#define VERDICT_REDIRECT    4
+
+// Rule scope: the name itself, the names under it, or both
+#define SCOPE_SELF          1
+#define SCOPE_BELOW         2
+
+// One rule name in the table. Names are not stored: the 64-bit seeded hash
+// stands in for the name, two names colliding among 10M rules has odds of
+// a few in a million per load.
+struct policy_slot {
+    uint64_t hash;                  // 0 marks an empty slot
+    uint16_t self;                  // Verdict for the name itself
+    uint16_t below;                 // Verdict for every name under it
+};
+
+// Action and the response template answering it
+struct policy_verdict {
+    uint8_t action;
+    uint8_t len;
+    uint16_t qtype;                 // Type a redirect answers, others get NODATA
+    uint8_t answer[MAX_TEMPLATE];
+};
+
+// Compiled rules: an open-addressing table keyed by per-suffix hashes
+struct policy_index {
+    struct policy_slot *table;
+    size_t mask;
+    uint64_t seed;
+    struct policy_verdict *verdicts;
+    size_t verdict_count;
+    uint64_t self_depths[2];        // Bit n set when some name rule has n labels
+    uint64_t below_depths[2];       // Same for rules on the names under a suffix
+    struct policy_stats stats;
+};
+
+// Static policy state, match counters survive reloads
+static struct policy_index current;
+static uint64_t matches[POLICY_ACTIONS];
+
+static inline uint16_t get16(const uint8_t *p) {
+    return (uint16_t)(p[0] << 8 | p[1]);
+}
+
+static inline void put16(uint8_t *p, uint16_t v) {
+    p[0] = v >> 8;
+    p[1] = v & 0xFF;
+}
+
+static inline uint64_t mix64(uint64_t x) {
+    x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    x = (x ^ (x >> 27)) * 0x94D049BB133111EBULL;
+    return x ^ (x >> 31);
+}
+
+// ASCII upper case to lower case, eight bytes at a time
+static inline uint64_t lower_word(uint64_t w) {
+    const uint64_t ones = 0x0101010101010101ULL;
+    uint64_t low7 = w & (0x7F * ones);
+    uint64_t from_a = low7 + (0x80 - 'A') * ones;
+    uint64_t past_z = low7 + (0x80 - 'Z' - 1) * ones;
+    uint64_t upper = (from_a ^ past_z) & ~w & (0x80 * ones);
+    return w | upper >> 2;
+}
+
+// Hash of the suffix starting at label, given the hash of the suffix after
+// it. Names hash label by label from the root, so one pass over a query
+// yields the hash of every suffix.
+static uint64_t suffix_hash(uint64_t parent, const uint8_t *label) {
+    size_t len = (size_t)label[0] + 1;
+    uint64_t h = parent;
+    size_t i = 0;
+    for (; i + 8 <= len; i += 8) {
+        uint64_t w;
+        memcpy(&w, label + i, 8);
+        h = (h ^ lower_word(w)) * 0xFF51AFD7ED558CCDULL;
+        h ^= h >> 32;
+    }
+    if (i < len) {
+        uint64_t w = 0;
+        memcpy(&w, label + i, len - i);
+        h = (h ^ lower_word(w)) * 0xFF51AFD7ED558CCDULL;
+    }
+    h = mix64(h);
+    return h ? h : 1;
+}
+
+static inline bool depth_set(const uint64_t *bits, size_t depth) {
+    return bits[depth / 64] >> (depth % 64) & 1;
+}
+
+static const struct policy_slot *find(uint64_t hash) {
+    for (size_t i = hash & current.mask;; i = (i + 1) & current.mask) {
+        const struct policy_slot *slot = &current.table[i];
+        if (slot->hash == hash || !slot->hash) {
+            return slot->hash ? slot : NULL;
+        }
+    }
+}
+
+// Template for a query a rule blocks or rewrites. The most specific rule
+// wins: one on the name itself, else the one on its longest listed suffix.
+const uint8_t *policy_lookup(const uint8_t *msg, size_t question_end, size_t *template_len,
+                             enum policy_action *action) {
+    *action = POLICY_NONE;
+    if (!current.table || question_end < HDR_LEN + 5 || get16(msg + 4) != 1 || (msg[2] & 0x78)) {
+        return NULL;
+    }
+
+    size_t len = question_end - HDR_LEN - 4;
+    const uint8_t *qname = msg + HDR_LEN;
+    if (len >= DNS_NAME_MAX || get16(qname + len + 2) != QCLASS_IN) {
+        return NULL;
+    }
+    uint16_t qtype = get16(qname + len);
+
+    uint8_t labels[MAX_LABELS];
+    size_t count = 0;
+    for (size_t off = 0;;) {
+        uint8_t c = qname[off];
+        if (c & 0xC0 || off + c + 1 > len) {
+            return NULL;
+        }
+        if (c == 0) {
+            if (off + 1 != len) {
+                return NULL;
+            }
+            break;
+        }
+        labels[count++] = off;
+        off += c + 1;
+    }
+
+    // Suffix hashes from the root up, only depths some rule has are probed,
+    // and those probes are issued together so their misses overlap
+    uint64_t hashes[MAX_LABELS];
+    uint64_t h = current.seed;
+    for (size_t i = count; i-- > 0;) {
+        h = suffix_hash(h, qname + labels[i]);
+        hashes[i] = h;
+        if (i ? depth_set(current.below_depths, count - i) : depth_set(current.self_depths, count)) {
+            __builtin_prefetch(&current.table[h & current.mask]);
+        }
+    }
+
+    uint16_t verdict = VERDICT_NONE;
+    if (count && depth_set(current.self_depths, count)) {
+        const struct policy_slot *slot = find(hashes[0]);
+        verdict = slot ? slot->self : VERDICT_NONE;
+    }
+    for (size_t i = 1; i < count && verdict == VERDICT_NONE; i++) {
+        if (depth_set(current.below_depths, count - i)) {
+            const struct policy_slot *slot = find(hashes[i]);
+            verdict = slot ? slot->below : VERDICT_NONE;
+        }
+    }
+    if (verdict == VERDICT_NONE) {
+        return NULL;
+    }
+
+    const struct policy_verdict *v = &current.verdicts[verdict];
+    matches[v->action]++;
+    *action = v->action;
+    if (v->action == POLICY_PASSTHRU) {
+        return NULL;
+    }
+    if (v->action == POLICY_REDIRECT && qtype != v->qtype && qtype != QTYPE_ANY) {
+        v = &current.verdicts[VERDICT_NODATA];
+    }
+    *template_len = v->len;
+    return v->answer;
+}
+
+void policy_get_stats(struct policy_stats *out) {
+    *out = current.stats;
+    memcpy(out->matches, matches, sizeof(matches));
+}
+
+const char *policy_action_name(enum policy_action action) {
+    switch (action) {
+        case POLICY_PASSTHRU:
+            return "passthru";
+        case POLICY_NXDOMAIN:
+            return "nxdomain";
+        case POLICY_NODATA:
+            return "nodata";
+        case POLICY_REDIRECT:
+            return "redirect";
+        default:
+            return "none";
+    }
+}
+
+static void free_index(struct policy_index *index) {
+    hugemem_free(index->table);
+    free(index->verdicts);
+    memset(index, 0, sizeof(*index));
+}
+
+void policy_destroy(void) {
+    free_index(&current);
+    memset(matches, 0, sizeof(matches));
+}
+
+// Loader
+
+// Rule as parsed, before it goes into the table
+struct rule {
+    uint64_t hash;
+    uint16_t verdict;
+    uint8_t scope;
+    uint8_t depth;
+};
+
+struct builder {
+    struct policy_index index;
+    struct rule *rules;
+    size_t rule_count, rule_cap;
+    const char *path;
+    size_t line;
+};
+
+// Errors go through the logger, a reload runs on the packet thread
+static int parse_error(const struct builder *b, const char *msg) {
+    log_error("%s:%zu: %s", b->path, b->line, msg);
+    return -EINVAL;
+}
+
+// Text name to a wire name, counting its labels
+static int encode_name(const char *text, uint8_t *out, size_t *out_len, size_t *depth) {
+    size_t len = 0, labels = 0;
+    while (*text) {
+        const char *dot = strchr(text, '.');
+        size_t n = dot ? (size_t)(dot - text) : strlen(text);
+        if (n == 0 || n > 63 || len + n + 2 > 255) {
+            return -1;
+        }
+        out[len++] = n;
+        memcpy(out + len, text, n);
+        len += n;
+        labels++;
+        text += n + (dot ? 1 : 0);
+    }
+    out[len++] = 0;
+    *out_len = len;
+    *depth = labels;
+    return labels ? 0 : -1;
+}
+
+// Template header: QR and RA set, RD comes from the query
+static void put_header(struct policy_verdict *v, uint8_t rcode, uint16_t answers) {
+    memset(v->answer, 0, HDR_LEN);
+    v->answer[2] = 0x80;
+    v->answer[3] = 0x80 | rcode;
+    put16(v->answer + 4, 1);
+    put16(v->answer + 6, answers);
+    v->len = HDR_LEN;
+}
+
+static int redirect_verdict(struct builder *b, const char *target, uint16_t *verdict) {
+    uint8_t addr[16];
+    uint16_t qtype, rdlen;
+    if (inet_pton(AF_INET, target, addr) == 1) {
+        qtype = QTYPE_A;
+        rdlen = 4;
+    } else if (inet_pton(AF_INET6, target, addr) == 1) {
+        qtype = QTYPE_AAAA;
+        rdlen = 16;
+    } else {
+        return parse_error(b, "redirect target must be an IPv4 or IPv6 address");
+    }
+
+    // Rules sharing a target share its template
+    struct policy_index *index = &b->index;
+    for (size_t i = VERDICT_REDIRECT; i < index->verdict_count; i++) {
+        const struct policy_verdict *v = &index->verdicts[i];
+        if (v->qtype == qtype && memcmp(v->answer + v->len - rdlen, addr, rdlen) == 0) {
+            *verdict = i;
+            return 0;
+        }
+    }
+    if (index->verdict_count == VERDICT_REDIRECT + POLICY_MAX_REDIRECTS) {
+        return parse_error(b, "too many redirect targets");
+    }
+
+    struct policy_verdict *v = &index->verdicts[index->verdict_count];
+    put_header(v, 0, 1);
+    v->action = POLICY_REDIRECT;
+    v->qtype = qtype;
+    uint8_t *rr = v->answer + HDR_LEN;
+    rr[0] = 0xC0;       // Owner: the question name
+    rr[1] = HDR_LEN;
+    put16(rr + 2, qtype);
+    put16(rr + 4, QCLASS_IN);
+    put16(rr + 6, POLICY_TTL >> 16);
+    put16(rr + 8, POLICY_TTL & 0xFFFF);
+    put16(rr + 10, rdlen);
+    memcpy(rr + 12, addr, rdlen);
+    v->len = HDR_LEN + 12 + rdlen;
+    *verdict = index->verdict_count++;
+    return 0;
+}
+
+// "<name> [action [target]]": name alone matches only itself, "*.name" the
+// names under it, ".name" both. The action defaults to nxdomain.
+static int parse_rule(struct builder *b, char *line) {
+    char *hash = strchr(line, '#');
+    if (hash) {
+        *hash = '\0';
+    }
+    char *save;
+    char *pattern = strtok_r(line, " \t\r\n", &save);
+    if (!pattern) {
+        return 0;
+    }
+    char *action = strtok_r(NULL, " \t\r\n", &save);
+    char *target = action ? strtok_r(NULL, " \t\r\n", &save) : NULL;
+    if (target && strtok_r(NULL, " \t\r\n", &save)) {
+        return parse_error(b, "trailing text after rule");
+    }
+
+    uint8_t scope = SCOPE_SELF;
+    if (strncmp(pattern, "*.", 2) == 0) {
+        scope = SCOPE_BELOW;
+        pattern += 2;
+    } else if (pattern[0] == '.') {
+        scope = SCOPE_SELF | SCOPE_BELOW;
+        pattern++;
+    }
+    uint8_t name[256];
+    size_t name_len, depth;
+    size_t text_len = strlen(pattern);
+    if (text_len && pattern[text_len - 1] == '.') {
+        pattern[text_len - 1] = '\0';
+    }
+    if (encode_name(pattern, name, &name_len, &depth) != 0) {
+        return parse_error(b, "bad domain name");
+    }
+
+    uint16_t verdict;
+    if (!action || strcasecmp(action, "nxdomain") == 0) {
+        verdict = VERDICT_NXDOMAIN;
+    } else if (strcasecmp(action, "nodata") == 0) {
+        verdict = VERDICT_NODATA;
+    } else if (strcasecmp(action, "passthru") == 0) {
+        verdict = VERDICT_PASSTHRU;
+    } else if (strcasecmp(action, "redirect") == 0) {
+        if (!target) {
+            return parse_error(b, "redirect needs a target address");
+        }
+        int ret = redirect_verdict(b, target, &verdict);
+        if (ret) {
+            return ret;
+        }
+    } else {
+        return parse_error(b, "unknown action");
+    }
+    if (target && verdict < VERDICT_REDIRECT) {
+        return parse_error(b, "only redirect takes a target");
+    }
+
+    if (b->rule_count == b->rule_cap) {
+        size_t cap = b->rule_cap ? b->rule_cap * 2 : 4096;
+        struct rule *rules = realloc(b->rules, cap * sizeof(*rules));
+        if (!rules) {
+            return -ENOMEM;
+        }
+        b->rules = rules;
+        b->rule_cap = cap;
+    }
+
+    // Same walk as the lookup, from the root
+    uint8_t starts[MAX_LABELS];
+    size_t count = 0;
+    for (size_t off = 0; name[off]; off += name[off] + 1) {
+        starts[count++] = off;
+    }
+    uint64_t h = b->index.seed;
+    for (size_t i = count; i-- > 0;) {
+        h = suffix_hash(h, name + starts[i]);
+    }
+
+    struct rule *rule = &b->rules[b->rule_count++];
+    rule->hash = h;
+    rule->verdict = verdict;
+    rule->scope = scope;
+    rule->depth = depth;
+    return 0;
+}
+
+static int load_file(struct builder *b, const char *path) {
+    FILE *fp = fopen(path, "r");
+    if (!fp) {
+        int err = errno;
+        log_error("Failed to open policy file %s: errno %d", path, err);
+        return -err;
+    }
+    b->path = path;
+    b->line = 0;
+
+    char *line = NULL;
+    size_t cap = 0;
+    int ret = 0;
+    while (!ret && getline(&line, &cap, fp) != -1) {
+        b->line++;
+        ret = parse_rule(b, line);
+    }
+    free(line);
+    fclose(fp);
+    return ret;
+}
+
+// Later rules for the same name and scope replace earlier ones
+static int build_table(struct builder *b) {
+    struct policy_index *index = &b->index;
+    size_t capacity = 16;
+    while (capacity < b->rule_count + b->rule_count / 3 + 1) {
+        capacity *= 2;
+    }
+    index->table = hugemem_alloc("policy table", capacity * sizeof(*index->table));
+    if (!index->table) {
+        return -ENOMEM;
+    }
+    index->mask = capacity - 1;
+    index->stats.table_bytes = capacity * sizeof(*index->table);
+
+    for (size_t r = 0; r < b->rule_count; r++) {
+        const struct rule *rule = &b->rules[r];
+        size_t i = rule->hash & index->mask;
+        while (index->table[i].hash && index->table[i].hash != rule->hash) {
+            i = (i + 1) & index->mask;
+        }
+        struct policy_slot *slot = &index->table[i];
+        if (!slot->hash) {
+            slot->hash = rule->hash;
+            index->stats.names++;
+        }
+        if (rule->scope & SCOPE_SELF) {
+            slot->self = rule->verdict;
+            index->self_depths[rule->depth / 64] |= 1ULL << (rule->depth % 64);
+        }
+        if (rule->scope & SCOPE_BELOW) {
+            slot->below = rule->verdict;
+            index->below_depths[rule->depth / 64] |= 1ULL << (rule->depth % 64);
+        }
+    }
+    index->stats.rules = b->rule_count;
+    return 0;
+}
+
+static inline uint64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+// Parse every file and build a new table, the loaded rules stay in force
+// unless all of it succeeds
+int policy_load(const char *const *paths, size_t count) {
+    uint64_t start = now_ns();
+    struct builder b = {0};
+
+    // Hashes are seeded per load so nobody can aim names at a collision
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    b.index.seed = mix64((uint64_t)ts.tv_sec << 32 ^ ts.tv_nsec ^ (uintptr_t)&b);
+
+    b.index.verdicts = calloc(VERDICT_REDIRECT + POLICY_MAX_REDIRECTS, sizeof(*b.index.verdicts));
+    if (!b.index.verdicts) {
+        return -ENOMEM;
+    }
+    b.index.verdict_count = VERDICT_REDIRECT;
+    b.index.verdicts[VERDICT_PASSTHRU].action = POLICY_PASSTHRU;
+    b.index.verdicts[VERDICT_NXDOMAIN].action = POLICY_NXDOMAIN;
+    put_header(&b.index.verdicts[VERDICT_NXDOMAIN], 3, 0);
+    b.index.verdicts[VERDICT_NODATA].action = POLICY_NODATA;
+    put_header(&b.index.verdicts[VERDICT_NODATA], 0, 0);
+
+    int ret = 0;
+    for (size_t i = 0; i < count && !ret; i++) {
+        ret = load_file(&b, paths[i]);
+    }
+    if (!ret) {
+        ret = build_table(&b);
+    }
+    free(b.rules);
+    if (ret) {
+        free_index(&b.index);
+        return ret;
+    }
+
+    b.index.stats.build_ns = now_ns() - start;
+    free_index(&current);
+    current = b.index;
+    return 0;
+}
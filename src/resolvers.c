@@ -0,0 +1,327 @@
+#include "../include/resolvers.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <errno.h>
+#include <arpa/inet.h>
+
+// Static resolver list
+static struct resolver *resolvers = NULL;
+static size_t resolver_count = 0;
+static size_t resolver_capacity = 0;
+static size_t next_resolver = 0;
+static enum resolver_select select_mode = RESOLVER_SELECT_P2C;
+static uint64_t next_probe_ns = UINT64_MAX;    // Earliest quarantine end
+static int selected_probe = -1;                // Becomes a probe once sent
+static uint64_t rng_state = 0x9E3779B97F4A7C15ULL;
+
+int resolvers_add(uint32_t ip, uint16_t port, const char *desc) {
+    if (resolver_count == resolver_capacity) {
+        size_t capacity = resolver_capacity ? resolver_capacity * 2 : 16;
+        struct resolver *items = realloc(resolvers, capacity * sizeof(*items));
+        if (!items) {
+            return -ENOMEM;
+        }
+        resolvers = items;
+        resolver_capacity = capacity;
+    }
+
+    struct resolver *r = &resolvers[resolver_count++];
+    memset(r, 0, sizeof(*r));
+    r->ip = ip;
+    r->port = port;
+    if (desc) {
+        strncpy(r->desc, desc, sizeof(r->desc) - 1);
+    }
+    return 0;
+}
+
+// Lines look like "8.8.8.8[:53]   # description"
+int resolvers_load(const char *path) {
+    FILE *fp = fopen(path, "r");
+    if (!fp) {
+        return -errno;
+    }
+
+    char line[256];
+    int ret = 0;
+    while (fgets(line, sizeof(line), fp)) {
+        char *p = line;
+        while (isspace((unsigned char)*p)) {
+            p++;
+        }
+        if (*p == '#' || *p == '\0') {
+            continue;
+        }
+
+        // Split off the description
+        char *desc = strchr(p, '#');
+        if (desc) {
+            *desc++ = '\0';
+            while (isspace((unsigned char)*desc)) {
+                desc++;
+            }
+            desc[strcspn(desc, "\r\n")] = '\0';
+        }
+        p[strcspn(p, " \t\r\n")] = '\0';
+
+        uint16_t port = htons(53);
+        char *colon = strchr(p, ':');
+        if (colon) {
+            *colon = '\0';
+            int value = atoi(colon + 1);
+            if (value <= 0 || value > 65535) {
+                ret = -EINVAL;
+                break;
+            }
+            port = htons(value);
+        }
+
+        struct in_addr addr;
+        if (inet_pton(AF_INET, p, &addr) != 1) {
+            ret = -EINVAL;
+            break;
+        }
+
+        ret = resolvers_add(addr.s_addr, port, desc);
+        if (ret) {
+            break;
+        }
+    }
+
+    fclose(fp);
+    if (ret == 0 && resolver_count == 0) {
+        ret = -ENOENT;
+    }
+    return ret;
+}
+
+size_t resolvers_count(void) {
+    return resolver_count;
+}
+
+const struct resolver *resolvers_get(size_t index) {
+    return index < resolver_count ? &resolvers[index] : NULL;
+}
+
+int resolvers_find(uint32_t ip, uint16_t port) {
+    for (size_t i = 0; i < resolver_count; i++) {
+        if (resolvers[i].ip == ip && resolvers[i].port == port) {
+            return (int)i;
+        }
+    }
+    return -1;
+}
+
+// Round-robin selection
+int resolvers_next(void) {
+    if (!resolver_count) {
+        return -1;
+    }
+    int index = next_resolver % resolver_count;
+    next_resolver++;
+    return index;
+}
+
+void resolvers_set_select(enum resolver_select mode) {
+    select_mode = mode;
+}
+
+static inline uint32_t random_below(uint32_t bound) {
+    rng_state ^= rng_state << 13;
+    rng_state ^= rng_state >> 7;
+    rng_state ^= rng_state << 17;
+    return (uint32_t)(((rng_state >> 32) * bound) >> 32);
+}
+
+// Expected cost of one more query: the smoothed RTT, scaled by the queries
+// already waiting on the resolver and inflated by its loss. Spreads load so
+// that each resolver's queue drains in about the same time.
+static double cost(const struct resolver_health *h) {
+    double rtt = h->srtt_us ? h->srtt_us + h->rttvar_us : RESOLVER_INITIAL_RTT_US;
+    double delivered = h->loss < 0.95 ? 1.0 - h->loss : 0.05;
+    return rtt * (h->inflight + 1) / delivered;
+}
+
+static inline bool eligible(size_t index, int avoid) {
+    return !resolvers[index].health.quarantined_until_ns && (int)index != avoid;
+}
+
+// A quarantined resolver due for a probe, sent one real query. It stays due
+// until resolvers_sent, so a send that fails leaves it for the next query.
+static int take_probe(uint64_t now_ns, int avoid) {
+    int probe = -1;
+    next_probe_ns = UINT64_MAX;
+    for (size_t i = 0; i < resolver_count; i++) {
+        struct resolver_health *h = &resolvers[i].health;
+        if (!h->quarantined_until_ns || h->probing) {
+            continue;
+        }
+        if (probe < 0 && h->quarantined_until_ns <= now_ns && (int)i != avoid) {
+            probe = (int)i;
+        }
+        if (h->quarantined_until_ns < next_probe_ns) {
+            next_probe_ns = h->quarantined_until_ns;
+        }
+    }
+    return probe;
+}
+
+// Every resolver ruled out: the one nearest the end of its quarantine
+static int least_bad(int avoid) {
+    int best = -1;
+    for (size_t i = 0; i < resolver_count; i++) {
+        if ((int)i == avoid && resolver_count > 1) {
+            continue;
+        }
+        if (best < 0 || resolvers[i].health.quarantined_until_ns < resolvers[best].health.quarantined_until_ns) {
+            best = (int)i;
+        }
+    }
+    return best;
+}
+
+// Power of two choices over the healthy resolvers
+int resolvers_select(uint64_t now_ns, int avoid) {
+    selected_probe = -1;
+    if (!resolver_count) {
+        return -1;
+    }
+    if (select_mode == RESOLVER_SELECT_ROUND_ROBIN) {
+        return resolvers_next();
+    }
+    if (now_ns >= next_probe_ns) {
+        selected_probe = take_probe(now_ns, avoid);
+        if (selected_probe >= 0) {
+            return selected_probe;
+        }
+    }
+
+    int a = -1, b = -1;
+    for (int tries = 0; tries < 8 && b < 0; tries++) {
+        size_t i = random_below(resolver_count);
+        if (!eligible(i, avoid) || (int)i == a) {
+            continue;
+        }
+        if (a < 0) {
+            a = (int)i;
+        } else {
+            b = (int)i;
+        }
+    }
+    if (a < 0) {
+        // Mostly quarantined, look at every one
+        for (size_t i = 0; i < resolver_count; i++) {
+            if (eligible(i, avoid) && (a < 0 || cost(&resolvers[i].health) < cost(&resolvers[a].health))) {
+                a = (int)i;
+            }
+        }
+        return a >= 0 ? a : least_bad(avoid);
+    }
+    if (b < 0) {
+        return a;
+    }
+    return cost(&resolvers[b].health) < cost(&resolvers[a].health) ? b : a;
+}
+
+void resolvers_sent(int index) {
+    if (index < 0 || (size_t)index >= resolver_count) {
+        return;
+    }
+    struct resolver_health *h = &resolvers[index].health;
+    h->queries++;
+    h->inflight++;
+    if (index == selected_probe) {
+        h->probing = true;
+        h->probes++;
+        selected_probe = -1;
+    }
+}
+
+void resolvers_answered(int index, uint64_t rtt_ns) {
+    if (index < 0 || (size_t)index >= resolver_count) {
+        return;
+    }
+    struct resolver_health *h = &resolvers[index].health;
+    h->answers++;
+    if (h->inflight) {
+        h->inflight--;
+    }
+    h->loss -= h->loss / 16;
+    h->failures = 0;
+    h->probing = false;
+    h->quarantined_until_ns = 0;
+    h->backoff_ms = 0;
+
+    if (rtt_ns) {
+        uint32_t rtt = rtt_ns / 1000 ? (uint32_t)(rtt_ns / 1000) : 1;
+        if (!h->srtt_us) {
+            h->srtt_us = rtt;
+            h->rttvar_us = rtt / 2;
+        } else {
+            uint32_t delta = h->srtt_us > rtt ? h->srtt_us - rtt : rtt - h->srtt_us;
+            h->rttvar_us = h->rttvar_us - h->rttvar_us / 4 + delta / 4;
+            h->srtt_us = h->srtt_us - h->srtt_us / 8 + rtt / 8;
+        }
+    }
+}
+
+void resolvers_timed_out(int index, uint64_t now_ns) {
+    if (index < 0 || (size_t)index >= resolver_count) {
+        return;
+    }
+    struct resolver_health *h = &resolvers[index].health;
+    h->timeouts++;
+    if (h->inflight) {
+        h->inflight--;
+    }
+    h->loss += (1.0 - h->loss) / 16;
+    h->failures++;
+
+    if (h->quarantined_until_ns) {
+        if (!h->probing) {
+            return;     // A query sent before the quarantine
+        }
+        h->probing = false;
+        h->backoff_ms = h->backoff_ms * 2 < RESOLVER_QUARANTINE_MAX_MS ? h->backoff_ms * 2 : RESOLVER_QUARANTINE_MAX_MS;
+    } else if (h->failures >= RESOLVER_QUARANTINE_FAILURES) {
+        h->backoff_ms = RESOLVER_QUARANTINE_MS;
+        h->quarantines++;
+    } else {
+        return;
+    }
+    h->quarantined_until_ns = now_ns + (uint64_t)h->backoff_ms * 1000000ULL;
+    if (h->quarantined_until_ns < next_probe_ns) {
+        next_probe_ns = h->quarantined_until_ns;
+    }
+}
+
+bool resolvers_quarantined(int index) {
+    return index >= 0 && (size_t)index < resolver_count && resolvers[index].health.quarantined_until_ns;
+}
+
+int resolvers_select_parse(const char *name, enum resolver_select *mode) {
+    if (strcmp(name, "p2c") == 0) {
+        *mode = RESOLVER_SELECT_P2C;
+    } else if (strcmp(name, "rr") == 0 || strcmp(name, "round-robin") == 0) {
+        *mode = RESOLVER_SELECT_ROUND_ROBIN;
+    } else {
+        return -1;
+    }
+    return 0;
+}
+
+const char *resolvers_select_name(enum resolver_select mode) {
+    return mode == RESOLVER_SELECT_ROUND_ROBIN ? "round-robin" : "p2c";
+}
+
+void resolvers_destroy(void) {
+    free(resolvers);
+    resolvers = NULL;
+    resolver_count = 0;
+    resolver_capacity = 0;
+    next_resolver = 0;
+    next_probe_ns = UINT64_MAX;
+    selected_probe = -1;
+}
@@ -0,0 +1,857 @@
+#include "../include/scan.h"
+#include "../include/io_backend.h"
+#include "../include/resolvers.h"
+#include "../include/tcp_fallback.h"
+#include "../include/log.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <sched.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <arpa/inet.h>
+
+#define SCAN_QUERY_MAX      320     // Header, name, question and EDNS room
+#define SCAN_BURST          64      // Token bucket depth
+#define CHECKPOINT_VERSION  1
+
+enum scan_slot_state {
+    SCAN_SLOT_FREE,
+    SCAN_SLOT_UDP,                  // Waiting for a UDP answer
+    SCAN_SLOT_TCP                   // Handed to the TCP fallback
+};
+
+// One outstanding domain; the slot index is its DNS message ID
+struct scan_slot {
+    uint64_t sent_ns;               // Last transmission
+    uint64_t first_sent_ns;         // First transmission
+    uint32_t generation;            // Bumped on reuse, stale timers are ignored
+    int resolver;                   // Resolver of the last transmission
+    uint8_t attempts;
+    uint8_t state;
+    uint16_t query_len;
+    uint16_t question_end;          // Offset past the question, the OPT record follows
+    uint8_t query[SCAN_QUERY_MAX];  // Wire-format query
+};
+
+// Retransmit timer, queued in send order
+struct scan_timer {
+    uint64_t deadline_ns;
+    uint32_t slot;
+    uint32_t generation;
+};
+
+// Progress as of one turn of the packet loop, written out off the loop
+struct checkpoint_state {
+    bool complete;
+    off_t input_offset;
+    off_t output_length;
+    int output_fd;                  // Synced before the checkpoint names its length, -1 = none
+    uint64_t domains;
+    uint64_t other_shards;
+    uint64_t answers;
+    uint64_t timeouts;
+    size_t pending;
+    char *names;                    // Pending domains, one per line
+    size_t names_len;
+    size_t names_capacity;
+};
+
+// Static scan state
+static struct scan_config config;
+static struct io_backend *io = NULL;
+static FILE *domains = NULL;
+static FILE *output = NULL;
+static struct scan_slot *slots = NULL;
+static uint32_t *free_slots = NULL;
+static uint32_t free_count = 0;
+static struct scan_timer *timers = NULL;
+static size_t timer_head = 0;
+static size_t timer_count = 0;
+static size_t timer_capacity = 0;
+static uint16_t id_key = 0;
+static bool input_done = false;
+static double tokens = 0.0;
+static uint64_t last_refill_ns = 0;
+static uint64_t next_checkpoint_ns = 0;
+static char (*resume_names)[DNS_NAME_MAX] = NULL;  // Outstanding when the checkpoint was taken
+static size_t resume_count = 0;
+static size_t resume_next = 0;
+static struct scan_stats stats;
+static struct checkpoint_state snapshot;   // Owned by the helper while checkpoint_busy
+static pthread_t checkpoint_thread;
+static bool checkpoint_started = false;     // Helper not joined yet
+static atomic_bool checkpoint_busy = false;
+static int checkpoint_result = 0;
+
+static inline uint64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+// A query has one live timer at most, so the ring, twice the slot count, is
+// never short of room once the stale timers of finished queries are dropped
+static void timer_push(uint32_t slot, uint64_t deadline_ns) {
+    if (timer_count == timer_capacity) {
+        size_t kept = 0;
+        for (size_t i = 0; i < timer_count; i++) {
+            const struct scan_timer *t = &timers[(timer_head + i) % timer_capacity];
+            const struct scan_slot *owner = &slots[t->slot];
+            if (owner->state == SCAN_SLOT_UDP && owner->generation == t->generation) {
+                timers[(timer_head + kept++) % timer_capacity] = *t;
+            }
+        }
+        timer_count = kept;
+    }
+
+    struct scan_timer *t = &timers[(timer_head + timer_count++) % timer_capacity];
+    t->deadline_ns = deadline_ns;
+    t->slot = slot;
+    t->generation = slots[slot].generation;
+}
+
+static int send_query(uint32_t index) {
+    struct scan_slot *slot = &slots[index];
+    slot->attempts++;
+
+    // A retransmit goes to another resolver when there is one
+    uint64_t now = now_ns();
+    int resolver = resolvers_select(now, slot->attempts > 1 ? slot->resolver : -1);
+    const struct resolver *r = resolvers_get(resolver);
+    slot->resolver = -1;
+    if (!r) {
+        return -ENOENT;
+    }
+
+    size_t capacity;
+    uint8_t *frame = io_backend_tx_buffer(io, &capacity);
+    if (!frame) {
+        stats.tx_failures++;
+        return -ENOBUFS;
+    }
+
+    struct packet_endpoint dst = {
+        .ip = r->ip,
+        .port = r->port
+    };
+    memcpy(dst.mac, config.gateway_mac, ETH_ADDR_LEN);
+
+    int len = packet_build_udp(frame, capacity, &config.src, &dst, slot->query, slot->query_len);
+    if (len < 0 || io_backend_tx(io, frame, len) != 0) {
+        stats.tx_failures++;
+        return -ENOBUFS;
+    }
+
+    slot->resolver = resolver;
+    slot->sent_ns = now;
+    resolvers_sent(resolver);
+    stats.queries++;
+    timer_push(index, slot->sent_ns + (uint64_t)config.timeout_ms * 1000000ULL);
+    return 0;
+}
+
+static void release_slot(uint32_t index) {
+    slots[index].state = SCAN_SLOT_FREE;
+    slots[index].generation++;
+    free_slots[free_count++] = index;
+}
+
+// Names are taken from the input as they are, quotes, backslashes and
+// control bytes included
+static void write_json_string(FILE *fp, const char *text) {
+    fputc('"', fp);
+    for (const unsigned char *p = (const unsigned char *)text; *p; p++) {
+        if (*p == '"' || *p == '\\') {
+            fprintf(fp, "\\%c", *p);
+        } else if (*p < 0x20 || *p >= 0x7F) {
+            fprintf(fp, "\\u%04x", *p);
+        } else {
+            fputc(*p, fp);
+        }
+    }
+    fputc('"', fp);
+}
+
+static void write_result(const struct scan_slot *slot, int rcode, uint16_t ancount, bool tcp) {
+    if (!output) {
+        return;
+    }
+
+    char domain[256];
+    dns_name_to_text(slot->query + sizeof(struct dns_header), slot->question_end - sizeof(struct dns_header),
+                     domain, sizeof(domain));
+
+    char resolver[INET_ADDRSTRLEN] = "";
+    const struct resolver *r = resolvers_get(slot->resolver);
+    if (r) {
+        inet_ntop(AF_INET, &r->ip, resolver, sizeof(resolver));
+    }
+
+    fputs("{\"domain\":", output);
+    write_json_string(output, domain);
+    fprintf(output,
+            ",\"record_type\":\"%s\",\"rcode\":%d,\"answers\":%u,"
+            "\"resolver\":\"%s\",\"response_time_us\":%lu,\"tcp\":%s}\n",
+            dns_qtype_name(config.qtype), rcode, ancount, resolver,
+            (unsigned long)((now_ns() - slot->first_sent_ns) / 1000), tcp ? "true" : "false");
+}
+
+// Count an answer and free its slot
+static void complete(uint32_t index, const uint8_t *msg, size_t len, bool tcp) {
+    struct dns_header header;
+    memcpy(&header, msg, sizeof(header));
+    (void)len;
+
+    int rcode = ntohs(header.flags) & 0x000F;
+    stats.answers++;
+    stats.rcodes[rcode]++;
+    if (tcp) {
+        stats.tcp_answers++;
+    }
+
+    write_result(&slots[index], rcode, ntohs(header.ancount), tcp);
+    release_slot(index);
+}
+
+// Cookie layout: generation in the high half, slot in the low half
+static void tcp_answer(uint64_t cookie, const uint8_t *msg, size_t len, int status) {
+    uint32_t index = (uint32_t)cookie;
+    uint32_t generation = (uint32_t)(cookie >> 32);
+
+    if (index >= config.max_inflight || slots[index].state != SCAN_SLOT_TCP ||
+        slots[index].generation != generation) {
+        return;
+    }
+
+    if (status != 0 || len < sizeof(struct dns_header)) {
+        stats.tcp_failures++;
+        write_result(&slots[index], -1, 0, true);
+        release_slot(index);
+        return;
+    }
+
+    complete(index, msg, len, true);
+}
+
+// FNV-1a over the lower-case name without its trailing dot, so every
+// instance on every host splits a list the same way
+uint32_t scan_shard_of(const char *domain, uint32_t shard_count) {
+    if (shard_count <= 1) {
+        return 0;
+    }
+
+    size_t len = strlen(domain);
+    if (len && domain[len - 1] == '.') {
+        len--;
+    }
+    uint64_t hash = 0xCBF29CE484222325ULL;
+    for (size_t i = 0; i < len; i++) {
+        hash ^= (uint8_t)tolower((unsigned char)domain[i]);
+        hash *= 0x100000001B3ULL;
+    }
+    return (uint32_t)(hash % shard_count);
+}
+
+// Copy the next domain into name, returns its length or 0 at end of input
+static size_t next_domain(char *name, size_t name_len) {
+    char line[512];
+
+    // Domains outstanding at the checkpoint go out again first
+    if (resume_next < resume_count) {
+        size_t n = strlen(resume_names[resume_next]);
+        memcpy(name, resume_names[resume_next++], n + 1);
+        return n;
+    }
+
+    while (fgets(line, sizeof(line), domains)) {
+        char *p = line;
+        while (isspace((unsigned char)*p)) {
+            p++;
+        }
+        p[strcspn(p, " \t\r\n#")] = '\0';
+        if (*p == '\0') {
+            continue;
+        }
+        if (config.shard_count > 1 && scan_shard_of(p, config.shard_count) != config.shard_index) {
+            stats.other_shards++;
+            continue;
+        }
+
+        stats.domains++;
+        size_t n = strlen(p);
+        if (n >= name_len) {
+            continue;   // Longer than any valid name, skip it
+        }
+        memcpy(name, p, n + 1);
+        return n;
+    }
+
+    return 0;
+}
+
+static int snapshot_name(const char *name) {
+    size_t len = strlen(name);
+    if (snapshot.names_len + len + 1 > snapshot.names_capacity) {
+        size_t capacity = snapshot.names_capacity ? snapshot.names_capacity : 1 << 16;
+        while (capacity < snapshot.names_len + len + 1) {
+            capacity *= 2;
+        }
+        char *names = realloc(snapshot.names, capacity);
+        if (!names) {
+            return -ENOMEM;
+        }
+        snapshot.names = names;
+        snapshot.names_capacity = capacity;
+    }
+    memcpy(snapshot.names + snapshot.names_len, name, len);
+    snapshot.names[snapshot.names_len + len] = '\n';
+    snapshot.names_len += len + 1;
+    return 0;
+}
+
+// Everything before the input offset is answered, timed out or listed as
+// pending. Only the output's stdio buffer is written here; syncing is left
+// to write_checkpoint.
+static int take_snapshot(void) {
+    if (output && fflush(output) != 0) {
+        int ret = -errno;
+        log_error("Failed to flush scan output %s: errno %d", config.output_file, -ret);
+        return ret;
+    }
+
+    size_t inflight = config.max_inflight - free_count;
+    snapshot.complete = scan_done();
+    snapshot.input_offset = ftello(domains);
+    snapshot.output_length = output ? ftello(output) : 0;
+    snapshot.output_fd = output ? fileno(output) : -1;
+    snapshot.domains = stats.domains;
+    snapshot.other_shards = stats.other_shards;
+    snapshot.answers = stats.answers;
+    snapshot.timeouts = stats.timeouts;
+    snapshot.pending = resume_count - resume_next + inflight;
+    snapshot.names_len = 0;
+    for (size_t i = resume_next; i < resume_count; i++) {
+        if (snapshot_name(resume_names[i]) != 0) {
+            return -ENOMEM;
+        }
+    }
+    for (uint32_t i = 0; i < config.max_inflight && inflight; i++) {
+        const struct scan_slot *slot = &slots[i];
+        if (slot->state == SCAN_SLOT_FREE) {
+            continue;
+        }
+        char domain[DNS_NAME_MAX];
+        dns_name_to_text(slot->query + sizeof(struct dns_header), slot->question_end - sizeof(struct dns_header),
+                         domain, sizeof(domain));
+        if (snapshot_name(domain) != 0) {
+            return -ENOMEM;
+        }
+        inflight--;
+    }
+    return 0;
+}
+
+// The output is synced up to the snapshot's length first, then the file is
+// replaced atomically, a crash leaves the previous one intact. Runs on the
+// helper thread, or on the caller's once no helper is running.
+static int write_checkpoint(const struct checkpoint_state *state) {
+    if (state->output_fd >= 0 && fsync(state->output_fd) != 0) {
+        int ret = -errno;
+        log_error("Failed to sync scan output %s: errno %d", config.output_file, -ret);
+        return ret;
+    }
+
+    char tmp[4096];
+    snprintf(tmp, sizeof(tmp), "%s.tmp", config.checkpoint_file);
+    FILE *fp = fopen(tmp, "w");
+    if (!fp) {
+        int ret = -errno;
+        log_error("Failed to write scan checkpoint %s: errno %d", config.checkpoint_file, -ret);
+        return ret;
+    }
+
+    fprintf(fp, "# whack scan checkpoint\n");
+    fprintf(fp, "version %d\n", CHECKPOINT_VERSION);
+    fprintf(fp, "status %s\n", state->complete ? "complete" : "running");
+    fprintf(fp, "shard %u/%u\n", config.shard_index, config.shard_count ? config.shard_count : 1);
+    fprintf(fp, "qtype %s\n", dns_qtype_name(config.qtype));
+    fprintf(fp, "input_offset %lld\n", (long long)state->input_offset);
+    fprintf(fp, "output_length %lld\n", (long long)state->output_length);
+    fprintf(fp, "domains %llu\n", (unsigned long long)state->domains);
+    fprintf(fp, "other_shards %llu\n", (unsigned long long)state->other_shards);
+    fprintf(fp, "answers %llu\n", (unsigned long long)state->answers);
+    fprintf(fp, "timeouts %llu\n", (unsigned long long)state->timeouts);
+    fprintf(fp, "pending %zu\n", state->pending);
+    fwrite(state->names, 1, state->names_len, fp);
+
+    int ret = fflush(fp) != 0 || fsync(fileno(fp)) != 0 ? -errno : 0;
+    if (fclose(fp) != 0 && !ret) {
+        ret = -errno;
+    }
+    if (!ret && rename(tmp, config.checkpoint_file) != 0) {
+        ret = -errno;
+    }
+    if (ret) {
+        log_error("Failed to write scan checkpoint %s: errno %d", config.checkpoint_file, -ret);
+        unlink(tmp);
+    }
+    return ret;
+}
+
+static void *checkpoint_main(void *arg) {
+    (void)arg;
+    checkpoint_result = write_checkpoint(&snapshot);
+    atomic_store_explicit(&checkpoint_busy, false, memory_order_release);
+    return NULL;
+}
+
+// Join the helper and count what it wrote; blocks while it is still busy
+static void checkpoint_join(void) {
+    if (!checkpoint_started) {
+        return;
+    }
+    pthread_join(checkpoint_thread, NULL);
+    checkpoint_started = false;
+    if (checkpoint_result == 0) {
+        stats.checkpoints++;
+    }
+}
+
+// Snapshot on the loop, write on a helper thread. Returns -EBUSY while the
+// previous checkpoint is still being written.
+static int checkpoint_start(void) {
+    if (atomic_load_explicit(&checkpoint_busy, memory_order_acquire)) {
+        return -EBUSY;
+    }
+    checkpoint_join();
+    int ret = take_snapshot();
+    if (ret) {
+        return ret;
+    }
+
+    // The loop is pinned by now; the helper may run on any CPU, so its
+    // writes stay off the packet core
+    pthread_attr_t attr;
+    pthread_attr_init(&attr);
+    cpu_set_t cpus;
+    CPU_ZERO(&cpus);
+    long count = sysconf(_SC_NPROCESSORS_CONF);
+    for (long i = 0; i < count && i < CPU_SETSIZE; i++) {
+        CPU_SET(i, &cpus);
+    }
+    pthread_attr_setaffinity_np(&attr, sizeof(cpus), &cpus);
+
+    atomic_store_explicit(&checkpoint_busy, true, memory_order_relaxed);
+    ret = -pthread_create(&checkpoint_thread, &attr, checkpoint_main, NULL);
+    pthread_attr_destroy(&attr);
+    if (ret) {
+        atomic_store_explicit(&checkpoint_busy, false, memory_order_relaxed);
+        log_error("Failed to start the scan checkpoint thread: errno %d", -ret);
+        return ret;
+    }
+    checkpoint_started = true;
+    return 0;
+}
+
+// Write a checkpoint now, after any the helper is still writing
+int scan_checkpoint(void) {
+    if (!slots || !config.checkpoint_file) {
+        return 0;
+    }
+    checkpoint_join();
+    int ret = take_snapshot();
+    if (!ret) {
+        ret = write_checkpoint(&snapshot);
+    }
+    if (!ret) {
+        stats.checkpoints++;
+    }
+    return ret;
+}
+
+// Read a checkpoint of the same shard and record type. Returns 1 when there
+// is none yet, the scan then starts from the top.
+static int load_checkpoint(off_t *input_offset, off_t *output_length) {
+    FILE *fp = fopen(config.checkpoint_file, "r");
+    if (!fp) {
+        return errno == ENOENT ? 1 : -errno;
+    }
+
+    char line[512];
+    char qtype[16] = "";
+    unsigned int version = 0, index = 0, count = 0;
+    unsigned long long value, pending = 0;
+    bool have_pending = false;
+    while (!have_pending && fgets(line, sizeof(line), fp)) {
+        char key[32];
+        if (line[0] == '#' || sscanf(line, "version %u", &version) == 1 ||
+            sscanf(line, "shard %u/%u", &index, &count) == 2 || sscanf(line, "qtype %15s", qtype) == 1 ||
+            sscanf(line, "%31s %llu", key, &value) != 2) {
+            continue;
+        }
+        if (strcmp(key, "input_offset") == 0) {
+            *input_offset = (off_t)value;
+        } else if (strcmp(key, "output_length") == 0) {
+            *output_length = (off_t)value;
+        } else if (strcmp(key, "domains") == 0) {
+            stats.domains = value;
+        } else if (strcmp(key, "other_shards") == 0) {
+            stats.other_shards = value;
+        } else if (strcmp(key, "answers") == 0) {
+            stats.answers = value;
+        } else if (strcmp(key, "timeouts") == 0) {
+            stats.timeouts = value;
+        } else if (strcmp(key, "pending") == 0) {
+            pending = value;
+            have_pending = true;
+        }
+    }
+
+    int ret = 0;
+    uint32_t shards = config.shard_count ? config.shard_count : 1;
+    if (version != CHECKPOINT_VERSION || !have_pending) {
+        fprintf(stderr, "Checkpoint %s is incomplete or of another version\n", config.checkpoint_file);
+        ret = -EINVAL;
+    } else if (index != config.shard_index || count != shards) {
+        fprintf(stderr, "Checkpoint %s is for shard %u/%u, not %u/%u\n", config.checkpoint_file,
+                index, count, config.shard_index, shards);
+        ret = -EINVAL;
+    } else if (strcmp(qtype, dns_qtype_name(config.qtype)) != 0) {
+        fprintf(stderr, "Checkpoint %s is for %s queries, not %s\n", config.checkpoint_file, qtype,
+                dns_qtype_name(config.qtype));
+        ret = -EINVAL;
+    } else if (pending && !(resume_names = malloc(pending * sizeof(*resume_names)))) {
+        ret = -ENOMEM;
+    }
+
+    while (!ret && resume_count < pending && fgets(line, sizeof(line), fp)) {
+        line[strcspn(line, "\r\n")] = '\0';
+        if (line[0] && strlen(line) < DNS_NAME_MAX) {
+            memcpy(resume_names[resume_count++], line, strlen(line) + 1);
+        }
+    }
+    fclose(fp);
+    stats.resumed = resume_count;
+    return ret;
+}
+
+// Output of a resumed scan: cut back to the checkpoint, then appended to
+static FILE *reopen_output(off_t length) {
+    FILE *fp = fopen(config.output_file, "r+");
+    if (!fp && errno == ENOENT && length == 0) {
+        return fopen(config.output_file, "w");
+    }
+    if (fp && (ftruncate(fileno(fp), length) != 0 || fseeko(fp, 0, SEEK_END) != 0)) {
+        int err = errno;
+        fclose(fp);
+        errno = err;
+        return NULL;
+    }
+    return fp;
+}
+
+int scan_init(const struct scan_config *cfg, struct io_backend *backend) {
+    checkpoint_join();
+    memset(&stats, 0, sizeof(stats));
+    config = *cfg;
+    io = backend;
+
+    if (!config.timeout_ms) {
+        config.timeout_ms = SCAN_TIMEOUT_MS;
+    }
+    if (!config.max_inflight || config.max_inflight > SCAN_MAX_INFLIGHT) {
+        config.max_inflight = SCAN_MAX_INFLIGHT;
+    }
+    if (!resolvers_count()) {
+        return -ENOENT;
+    }
+
+    if (config.shard_count > 1 && config.shard_index >= config.shard_count) {
+        return -EINVAL;
+    }
+    if (!config.checkpoint_interval) {
+        config.checkpoint_interval = SCAN_CHECKPOINT_INTERVAL;
+    }
+
+    domains = fopen(config.domains_file, "r");
+    if (!domains) {
+        return -errno;
+    }
+
+    // A resumed scan skips what the checkpoint covers
+    off_t input_offset = 0, output_length = 0;
+    bool resumed = false;
+    if (config.resume && config.checkpoint_file) {
+        int ret = load_checkpoint(&input_offset, &output_length);
+        if (ret < 0 || (ret == 0 && fseeko(domains, input_offset, SEEK_SET) != 0)) {
+            ret = ret < 0 ? ret : -errno;
+            scan_destroy();
+            return ret;
+        }
+        resumed = ret == 0;
+    }
+
+    if (config.output_file) {
+        output = resumed ? reopen_output(output_length) : fopen(config.output_file, "w");
+        if (!output) {
+            int ret = -errno;
+            scan_destroy();
+            return ret;
+        }
+        // Results are written in large blocks
+        setvbuf(output, NULL, _IOFBF, 1 << 20);
+    }
+
+    slots = calloc(config.max_inflight, sizeof(*slots));
+    free_slots = malloc(config.max_inflight * sizeof(*free_slots));
+    timer_capacity = 2 * (size_t)config.max_inflight;
+    timers = malloc(timer_capacity * sizeof(*timers));
+    if (!slots || !free_slots || !timers) {
+        scan_destroy();
+        return -ENOMEM;
+    }
+
+    // Lowest IDs are handed out first
+    free_count = 0;
+    for (uint32_t i = config.max_inflight; i > 0; i--) {
+        free_slots[free_count++] = i - 1;
+    }
+
+    if (config.tcp_fallback) {
+        int ret = tcp_fallback_init(NULL, tcp_answer);
+        if (ret) {
+            scan_destroy();
+            return ret;
+        }
+    }
+
+    // IDs are not guessable from the slot number
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    id_key = (uint16_t)(ts.tv_nsec ^ (ts.tv_nsec >> 16));
+
+    input_done = false;
+    tokens = SCAN_BURST;
+    last_refill_ns = now_ns();
+    next_checkpoint_ns = last_refill_ns + (uint64_t)config.checkpoint_interval * 1000000000ULL;
+    return 0;
+}
+
+// Refill the token bucket, unlimited when no rate is configured
+static bool take_token(uint64_t now) {
+    if (!config.rate_limit) {
+        return true;
+    }
+
+    tokens += (double)(now - last_refill_ns) * config.rate_limit / 1e9;
+    last_refill_ns = now;
+    if (tokens > SCAN_BURST) {
+        tokens = SCAN_BURST;
+    }
+    if (tokens < 1.0) {
+        return false;
+    }
+    tokens -= 1.0;
+    return true;
+}
+
+static void expire_timers(uint64_t now) {
+    while (timer_count) {
+        struct scan_timer *t = &timers[timer_head];
+        if (t->deadline_ns > now) {
+            break;
+        }
+
+        struct scan_slot *slot = &slots[t->slot];
+        bool live = slot->state == SCAN_SLOT_UDP && slot->generation == t->generation;
+        if (live && slot->attempts <= config.retries) {
+            // Retransmits share the query budget
+            if (!take_token(now)) {
+                break;
+            }
+        }
+
+        uint32_t index = t->slot;
+        timer_head = (timer_head + 1) % timer_capacity;
+        timer_count--;
+        if (!live) {
+            continue;
+        }
+
+        resolvers_timed_out(slot->resolver, now);
+        if (slot->attempts > config.retries) {
+            stats.timeouts++;
+            write_result(slot, -1, 0, false);
+            release_slot(index);
+            continue;
+        }
+
+        stats.retransmits++;
+        if (send_query(index) != 0) {
+            // Try again on the next timeout
+            timer_push(index, now + (uint64_t)config.timeout_ms * 1000000ULL);
+        }
+    }
+}
+
+void scan_tick(void) {
+    if (!slots) {
+        return;
+    }
+
+    uint64_t now = now_ns();
+    expire_timers(now);
+
+    // New queries while the window and the rate allow, built a batch at a time
+    while (!input_done && free_count) {
+        static char names[DNS_BATCH_MAX][DNS_NAME_MAX];
+        struct dns_batch_query batch[DNS_BATCH_MAX];
+        uint8_t *buffers[DNS_BATCH_MAX];
+        uint16_t lengths[DNS_BATCH_MAX];
+        uint32_t indexes[DNS_BATCH_MAX];
+        size_t n = 0;
+
+        while (n < DNS_BATCH_MAX && n < free_count && take_token(now)) {
+            size_t len = next_domain(names[n], sizeof(names[n]));
+            if (!len) {
+                input_done = true;
+                if (config.rate_limit) {
+                    tokens += 1.0;
+                }
+                break;
+            }
+
+            // Lowest free slots first; the slot index is the message ID
+            uint32_t index = free_slots[free_count - 1 - n];
+            indexes[n] = index;
+            buffers[n] = slots[index].query;
+            batch[n].name = names[n];
+            batch[n].name_len = len;
+            batch[n].qtype = config.qtype;
+            batch[n].id = (uint16_t)index ^ id_key;
+            n++;
+        }
+        if (!n) {
+            break;
+        }
+        free_count -= n;
+
+        dns_construct_batch(batch, n, config.edns_buffer_size, buffers, SCAN_QUERY_MAX, lengths);
+        for (size_t i = 0; i < n; i++) {
+            uint32_t index = indexes[i];
+            struct scan_slot *slot = &slots[index];
+            if (!lengths[i]) {
+                release_slot(index);    // Unencodable name, skip it
+                continue;
+            }
+
+            slot->query_len = lengths[i];
+            slot->question_end = dns_question_end(slot->query, slot->query_len);
+            slot->state = SCAN_SLOT_UDP;
+            slot->attempts = 0;
+            slot->first_sent_ns = now;
+            if (send_query(index) != 0) {
+                timer_push(index, now + (uint64_t)config.timeout_ms * 1000000ULL);
+            }
+        }
+    }
+
+    if (config.tcp_fallback && tcp_fallback_pending()) {
+        tcp_fallback_poll(0);
+    }
+
+    // Retried on the next turn while the previous one is still being written
+    if (config.checkpoint_file && now >= next_checkpoint_ns && checkpoint_start() != -EBUSY) {
+        next_checkpoint_ns = now + (uint64_t)config.checkpoint_interval * 1000000000ULL;
+    }
+}
+
+void scan_handle_response(const struct packet_info *info) {
+    if (!slots || info->payload_len < sizeof(struct dns_header) || info->dst.port != config.src.port) {
+        return;
+    }
+
+    uint16_t id;
+    memcpy(&id, info->payload, sizeof(id));
+    uint32_t index = (uint16_t)(ntohs(id) ^ id_key);
+    if (index >= config.max_inflight) {
+        stats.unmatched++;
+        return;
+    }
+
+    // Must come from the resolver we asked, for the question we asked
+    struct scan_slot *slot = &slots[index];
+    const struct resolver *r = resolvers_get(slot->resolver);
+    size_t question_len = slot->question_end - sizeof(struct dns_header);
+    if (slot->state != SCAN_SLOT_UDP || !r || r->ip != info->src.ip ||
+        info->payload_len < slot->question_end ||
+        memcmp(info->payload + sizeof(struct dns_header), slot->query + sizeof(struct dns_header),
+               question_len) != 0) {
+        stats.unmatched++;
+        return;
+    }
+
+    // Karn: only answers to a single transmission time the resolver
+    resolvers_answered(slot->resolver, slot->attempts == 1 ? now_ns() - slot->sent_ns : 0);
+
+    uint16_t flags;
+    memcpy(&flags, info->payload + 2, sizeof(flags));
+    if (ntohs(flags) & 0x0200) {
+        stats.truncated++;
+        if (config.tcp_fallback) {
+            uint64_t cookie = ((uint64_t)slot->generation << 32) | index;
+            if (tcp_fallback_submit(r->ip, r->port, slot->query, slot->query_len, cookie) == 0) {
+                slot->state = SCAN_SLOT_TCP;
+                return;
+            }
+        }
+    }
+
+    complete(index, info->payload, info->payload_len, false);
+}
+
+bool scan_done(void) {
+    return input_done && free_count == config.max_inflight;
+}
+
+size_t scan_inflight(void) {
+    return slots ? config.max_inflight - free_count : 0;
+}
+
+void scan_get_stats(struct scan_stats *out) {
+    *out = stats;
+}
+
+void scan_destroy(void) {
+    // The helper syncs the output, finish before closing it
+    checkpoint_join();
+    if (config.tcp_fallback) {
+        tcp_fallback_destroy();
+    }
+    if (domains) {
+        fclose(domains);
+        domains = NULL;
+    }
+    if (output) {
+        fclose(output);
+        output = NULL;
+    }
+    free(slots);
+    free(free_slots);
+    free(timers);
+    free(resume_names);
+    free(snapshot.names);
+    memset(&snapshot, 0, sizeof(snapshot));
+    resume_names = NULL;
+    resume_count = resume_next = 0;
+    slots = NULL;
+    free_slots = NULL;
+    timers = NULL;
+    timer_head = timer_count = timer_capacity = 0;
+    free_count = 0;
+}
@@ -0,0 +1,597 @@
+#include "../include/tcp_fallback.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+
+// RFC 7766 connection pool: queries are pipelined on a few long-lived
+// connections per resolver and answers are matched by message ID, in any order
+
+#define TCP_WAIT_QUEUE      4096    // Queries parked per resolver while all connections are full
+#define TCP_EPOLL_EVENTS    64
+#define TCP_MAX_RETRIES     1
+#define TCP_FRAME_MAX       (TCP_MAX_QUERY + 2)
+
+enum tcp_conn_state {
+    TCP_CONN_CLOSED,
+    TCP_CONN_CONNECTING,
+    TCP_CONN_OPEN
+};
+
+// A query waiting for its answer
+struct tcp_query {
+    uint64_t cookie;
+    uint64_t deadline_ns;
+    uint16_t len;                   // Framed length, including the 2-byte prefix
+    uint8_t retries;
+    bool in_use;
+    uint8_t frame[TCP_FRAME_MAX];   // Length prefix and message
+};
+
+struct tcp_pool;
+
+struct tcp_conn {
+    int fd;
+    enum tcp_conn_state state;
+    struct tcp_pool *pool;
+    struct tcp_query *queries;      // max_pipeline slots
+    size_t outstanding;
+    uint8_t *wbuf;                  // Framed queries not yet written
+    size_t wlen;
+    size_t woff;
+    uint8_t *rbuf;                  // Partial answers
+    size_t rlen;
+    bool want_write;                // EPOLLOUT registered
+    uint64_t last_active_ns;
+};
+
+// Connections and parked queries for one resolver
+struct tcp_pool {
+    uint32_t ip;
+    uint16_t port;
+    struct tcp_conn *conns;
+    struct tcp_query *waiting;      // Ring of TCP_WAIT_QUEUE queries
+    size_t wait_head;
+    size_t wait_count;
+};
+
+// Static module state
+static struct tcp_fallback_config config;
+static tcp_answer_handler answer_handler = NULL;
+static struct tcp_pool **pools = NULL;
+static size_t pool_count = 0;
+static size_t pool_capacity = 0;
+static int epoll_fd = -1;
+static size_t pending_total = 0;
+static uint64_t last_sweep_ns = 0;
+static struct tcp_fallback_stats stats;
+
+static inline uint64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static inline uint16_t frame_id(const struct tcp_query *q) {
+    uint16_t id;
+    memcpy(&id, q->frame + 2, sizeof(id));
+    return id;
+}
+
+static void deliver(uint64_t cookie, const uint8_t *msg, size_t len, int status) {
+    pending_total--;
+    if (status == 0) {
+        stats.answers++;
+    } else {
+        stats.failures++;
+    }
+    if (answer_handler) {
+        answer_handler(cookie, msg, len, status);
+    }
+}
+
+static void conn_update_events(struct tcp_conn *conn) {
+    bool want_write = conn->state == TCP_CONN_CONNECTING || conn->woff < conn->wlen;
+    if (want_write == conn->want_write) {
+        return;
+    }
+
+    struct epoll_event ev = {
+        .events = EPOLLIN | (want_write ? EPOLLOUT : 0),
+        .data.ptr = conn
+    };
+    epoll_ctl(epoll_fd, EPOLL_CTL_MOD, conn->fd, &ev);
+    conn->want_write = want_write;
+}
+
+static void conn_flush(struct tcp_conn *conn) {
+    while (conn->woff < conn->wlen) {
+        ssize_t n = send(conn->fd, conn->wbuf + conn->woff, conn->wlen - conn->woff,
+                         MSG_DONTWAIT | MSG_NOSIGNAL);
+        if (n <= 0) {
+            break;
+        }
+        conn->woff += n;
+    }
+
+    if (conn->woff == conn->wlen) {
+        conn->woff = conn->wlen = 0;
+    }
+    conn_update_events(conn);
+}
+
+static int pool_park(struct tcp_pool *pool, const struct tcp_query *q) {
+    if (pool->wait_count == TCP_WAIT_QUEUE) {
+        return -ENOBUFS;
+    }
+    size_t slot = (pool->wait_head + pool->wait_count++) % TCP_WAIT_QUEUE;
+    pool->waiting[slot] = *q;
+    return 0;
+}
+
+static void conn_close(struct tcp_conn *conn) {
+    if (conn->state == TCP_CONN_CLOSED) {
+        return;
+    }
+
+    epoll_ctl(epoll_fd, EPOLL_CTL_DEL, conn->fd, NULL);
+    close(conn->fd);
+    conn->fd = -1;
+    conn->state = TCP_CONN_CLOSED;
+    conn->wlen = conn->woff = conn->rlen = 0;
+    conn->want_write = false;
+
+    // Servers may close at any time; unanswered queries get one more try.
+    // It starts a fresh deadline, which also keeps the wait queue in
+    // deadline order for the sweep.
+    uint64_t deadline_ns = now_ns() + (uint64_t)config.query_timeout_ms * 1000000ULL;
+    for (size_t i = 0; i < config.max_pipeline; i++) {
+        struct tcp_query *q = &conn->queries[i];
+        if (!q->in_use) {
+            continue;
+        }
+        q->in_use = false;
+        conn->outstanding--;
+
+        if (q->retries < TCP_MAX_RETRIES) {
+            q->retries++;
+            q->deadline_ns = deadline_ns;
+            stats.retries++;
+            if (pool_park(conn->pool, q) == 0) {
+                continue;
+            }
+        }
+        deliver(q->cookie, NULL, 0, -ECONNRESET);
+    }
+}
+
+static int conn_open(struct tcp_conn *conn) {
+    int fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+        return -errno;
+    }
+
+    // Queries are small and latency bound
+    int one = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+    struct sockaddr_in addr = {
+        .sin_family = AF_INET,
+        .sin_port = conn->pool->port,
+        .sin_addr.s_addr = conn->pool->ip
+    };
+    if (connect(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0 && errno != EINPROGRESS) {
+        int ret = -errno;
+        close(fd);
+        return ret;
+    }
+
+    struct epoll_event ev = {
+        .events = EPOLLIN | EPOLLOUT,
+        .data.ptr = conn
+    };
+    if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fd, &ev) != 0) {
+        int ret = -errno;
+        close(fd);
+        return ret;
+    }
+
+    conn->fd = fd;
+    conn->state = TCP_CONN_CONNECTING;
+    conn->want_write = true;
+    conn->last_active_ns = now_ns();
+    stats.connects++;
+    return 0;
+}
+
+// Room for a free pipeline slot and len more unsent bytes
+static bool conn_has_room(const struct tcp_conn *conn, size_t len) {
+    return conn->outstanding < config.max_pipeline &&
+           conn->wlen - conn->woff + len <= config.max_pipeline * TCP_FRAME_MAX;
+}
+
+// Queue a query on a connection, -ENOBUFS when it has no room left
+static int conn_send(struct tcp_conn *conn, const struct tcp_query *q) {
+    struct tcp_query *slot = NULL;
+    for (size_t i = 0; i < config.max_pipeline && conn_has_room(conn, q->len); i++) {
+        if (!conn->queries[i].in_use) {
+            slot = &conn->queries[i];
+            break;
+        }
+    }
+    if (!slot) {
+        return -ENOBUFS;
+    }
+
+    *slot = *q;
+    slot->in_use = true;
+    conn->outstanding++;
+    if (conn->outstanding > stats.max_pipelined) {
+        stats.max_pipelined = conn->outstanding;
+    }
+
+    if (conn->state == TCP_CONN_OPEN) {
+        stats.reused++;
+    }
+
+    // Compact so unsent bytes never exceed one frame per pipeline slot
+    if (conn->woff) {
+        memmove(conn->wbuf, conn->wbuf + conn->woff, conn->wlen - conn->woff);
+        conn->wlen -= conn->woff;
+        conn->woff = 0;
+    }
+    memcpy(conn->wbuf + conn->wlen, q->frame, q->len);
+    conn->wlen += q->len;
+    if (conn->state == TCP_CONN_OPEN) {
+        conn_flush(conn);
+    }
+    return 0;
+}
+
+// Least loaded connection with room, opening a new one if that helps
+static struct tcp_conn *pool_pick(struct tcp_pool *pool) {
+    struct tcp_conn *best = NULL;
+    struct tcp_conn *closed = NULL;
+
+    for (size_t i = 0; i < config.conns_per_resolver; i++) {
+        struct tcp_conn *conn = &pool->conns[i];
+        if (conn->state == TCP_CONN_CLOSED) {
+            if (!closed) {
+                closed = conn;
+            }
+            continue;
+        }
+        if (conn_has_room(conn, TCP_FRAME_MAX) && (!best || conn->outstanding < best->outstanding)) {
+            best = conn;
+        }
+    }
+
+    // Spread load once the existing connections are busy
+    if (closed && (!best || best->outstanding > 0)) {
+        if (conn_open(closed) == 0) {
+            return closed;
+        }
+    }
+    return best;
+}
+
+static void pool_drain(struct tcp_pool *pool) {
+    while (pool->wait_count) {
+        struct tcp_conn *conn = pool_pick(pool);
+        if (!conn || conn_send(conn, &pool->waiting[pool->wait_head]) != 0) {
+            return;
+        }
+        pool->wait_head = (pool->wait_head + 1) % TCP_WAIT_QUEUE;
+        pool->wait_count--;
+    }
+}
+
+static struct tcp_pool *pool_get(uint32_t ip, uint16_t port) {
+    for (size_t i = 0; i < pool_count; i++) {
+        if (pools[i]->ip == ip && pools[i]->port == port) {
+            return pools[i];
+        }
+    }
+
+    if (pool_count == pool_capacity) {
+        size_t capacity = pool_capacity ? pool_capacity * 2 : 16;
+        struct tcp_pool **grown = realloc(pools, capacity * sizeof(*grown));
+        if (!grown) {
+            return NULL;
+        }
+        pools = grown;
+        pool_capacity = capacity;
+    }
+
+    struct tcp_pool *pool = calloc(1, sizeof(*pool));
+    if (!pool) {
+        return NULL;
+    }
+    pool->ip = ip;
+    pool->port = port;
+    pool->conns = calloc(config.conns_per_resolver, sizeof(*pool->conns));
+    pool->waiting = malloc(TCP_WAIT_QUEUE * sizeof(*pool->waiting));
+    if (!pool->conns || !pool->waiting) {
+        goto fail;
+    }
+
+    for (size_t i = 0; i < config.conns_per_resolver; i++) {
+        struct tcp_conn *conn = &pool->conns[i];
+        conn->fd = -1;
+        conn->pool = pool;
+        conn->queries = calloc(config.max_pipeline, sizeof(*conn->queries));
+        conn->wbuf = malloc(config.max_pipeline * TCP_FRAME_MAX);
+        conn->rbuf = malloc(TCP_MAX_MESSAGE + 2);
+        if (!conn->queries || !conn->wbuf || !conn->rbuf) {
+            goto fail;
+        }
+    }
+
+    pools[pool_count++] = pool;
+    return pool;
+
+fail:
+    if (pool->conns) {
+        for (size_t i = 0; i < config.conns_per_resolver; i++) {
+            free(pool->conns[i].queries);
+            free(pool->conns[i].wbuf);
+            free(pool->conns[i].rbuf);
+        }
+    }
+    free(pool->conns);
+    free(pool->waiting);
+    free(pool);
+    return NULL;
+}
+
+int tcp_fallback_init(const struct tcp_fallback_config *cfg, tcp_answer_handler handler) {
+    memset(&config, 0, sizeof(config));
+    if (cfg) {
+        config = *cfg;
+    }
+    if (!config.conns_per_resolver) {
+        config.conns_per_resolver = TCP_CONNS_PER_RESOLVER;
+    }
+    if (!config.max_pipeline) {
+        config.max_pipeline = TCP_MAX_PIPELINE;
+    }
+    if (!config.query_timeout_ms) {
+        config.query_timeout_ms = TCP_QUERY_TIMEOUT_MS;
+    }
+    if (!config.idle_timeout_ms) {
+        config.idle_timeout_ms = TCP_IDLE_TIMEOUT_MS;
+    }
+
+    epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    if (epoll_fd < 0) {
+        return -errno;
+    }
+
+    answer_handler = handler;
+    pending_total = 0;
+    memset(&stats, 0, sizeof(stats));
+    return 0;
+}
+
+int tcp_fallback_submit(uint32_t ip, uint16_t port, const uint8_t *query, size_t len, uint64_t cookie) {
+    if (epoll_fd < 0 || len < 2 || len > TCP_MAX_QUERY) {
+        return -EINVAL;
+    }
+
+    struct tcp_pool *pool = pool_get(ip, port);
+    if (!pool) {
+        return -ENOMEM;
+    }
+
+    struct tcp_query q;
+    q.cookie = cookie;
+    q.deadline_ns = now_ns() + (uint64_t)config.query_timeout_ms * 1000000ULL;
+    q.retries = 0;
+    q.in_use = false;
+    q.len = len + 2;
+    q.frame[0] = len >> 8;
+    q.frame[1] = len & 0xFF;
+    memcpy(q.frame + 2, query, len);
+
+    // Keep FIFO order behind parked queries, park when no connection has room
+    struct tcp_conn *conn = pool->wait_count ? NULL : pool_pick(pool);
+    if ((!conn || conn_send(conn, &q) != 0) && pool_park(pool, &q) != 0) {
+        return -ENOBUFS;
+    }
+
+    pending_total++;
+    stats.queries++;
+    return 0;
+}
+
+// Hand complete length-prefixed answers to the handler
+static void conn_consume(struct tcp_conn *conn) {
+    size_t off = 0;
+
+    while (conn->rlen - off >= 2) {
+        size_t len = ((size_t)conn->rbuf[off] << 8) | conn->rbuf[off + 1];
+        if (conn->rlen - off < len + 2) {
+            break;
+        }
+        const uint8_t *msg = conn->rbuf + off + 2;
+        off += len + 2;
+
+        if (len < 2) {
+            continue;
+        }
+
+        // Answers may come back in any order
+        uint16_t id;
+        memcpy(&id, msg, sizeof(id));
+        for (size_t i = 0; i < config.max_pipeline; i++) {
+            struct tcp_query *q = &conn->queries[i];
+            if (q->in_use && frame_id(q) == id) {
+                q->in_use = false;
+                conn->outstanding--;
+                deliver(q->cookie, msg, len, 0);
+                break;
+            }
+        }
+    }
+
+    if (off) {
+        memmove(conn->rbuf, conn->rbuf + off, conn->rlen - off);
+        conn->rlen -= off;
+    }
+}
+
+static void conn_event(struct tcp_conn *conn, uint32_t events) {
+    conn->last_active_ns = now_ns();
+
+    if (conn->state == TCP_CONN_CONNECTING && (events & (EPOLLOUT | EPOLLERR | EPOLLHUP))) {
+        int err = 0;
+        socklen_t err_len = sizeof(err);
+        getsockopt(conn->fd, SOL_SOCKET, SO_ERROR, &err, &err_len);
+        if (err) {
+            conn_close(conn);
+            return;
+        }
+        conn->state = TCP_CONN_OPEN;
+    }
+
+    if (events & EPOLLIN) {
+        for (;;) {
+            ssize_t n = recv(conn->fd, conn->rbuf + conn->rlen, TCP_MAX_MESSAGE + 2 - conn->rlen, MSG_DONTWAIT);
+            if (n > 0) {
+                conn->rlen += n;
+                conn_consume(conn);
+                continue;
+            }
+            if (n == 0 || (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)) {
+                conn_close(conn);
+                return;
+            }
+            break;
+        }
+    } else if (events & (EPOLLERR | EPOLLHUP)) {
+        conn_close(conn);
+        return;
+    }
+
+    if (conn->state == TCP_CONN_OPEN) {
+        conn_flush(conn);
+    }
+}
+
+// Expire overdue queries and idle connections
+static void sweep(uint64_t now) {
+    uint64_t idle_ns = (uint64_t)config.idle_timeout_ms * 1000000ULL;
+
+    for (size_t p = 0; p < pool_count; p++) {
+        struct tcp_pool *pool = pools[p];
+
+        // Parked queries are in deadline order
+        while (pool->wait_count && pool->waiting[pool->wait_head].deadline_ns <= now) {
+            uint64_t cookie = pool->waiting[pool->wait_head].cookie;
+            pool->wait_head = (pool->wait_head + 1) % TCP_WAIT_QUEUE;
+            pool->wait_count--;
+            deliver(cookie, NULL, 0, -ETIMEDOUT);
+        }
+
+        for (size_t c = 0; c < config.conns_per_resolver; c++) {
+            struct tcp_conn *conn = &pool->conns[c];
+            if (conn->state == TCP_CONN_CLOSED) {
+                continue;
+            }
+
+            bool expired = false;
+            for (size_t i = 0; i < config.max_pipeline && conn->outstanding; i++) {
+                struct tcp_query *q = &conn->queries[i];
+                if (q->in_use && q->deadline_ns <= now) {
+                    q->in_use = false;
+                    conn->outstanding--;
+                    deliver(q->cookie, NULL, 0, -ETIMEDOUT);
+                    expired = true;
+                }
+            }
+
+            // Frames of expired queries may still sit unwritten in wbuf, and
+            // a connection that stalls that long is no use: start over
+            if (expired && conn->woff < conn->wlen) {
+                conn_close(conn);
+                continue;
+            }
+
+            if (!conn->outstanding && now - conn->last_active_ns > idle_ns) {
+                conn_close(conn);
+            }
+        }
+    }
+}
+
+int tcp_fallback_poll(int timeout_ms) {
+    if (epoll_fd < 0) {
+        return -EINVAL;
+    }
+
+    uint64_t answers = stats.answers;
+    struct epoll_event events[TCP_EPOLL_EVENTS];
+    int n = epoll_wait(epoll_fd, events, TCP_EPOLL_EVENTS, timeout_ms);
+    for (int i = 0; i < n; i++) {
+        conn_event(events[i].data.ptr, events[i].events);
+    }
+
+    for (size_t p = 0; p < pool_count; p++) {
+        pool_drain(pools[p]);
+    }
+
+    // Timeouts have millisecond granularity at best
+    uint64_t now = now_ns();
+    if (now - last_sweep_ns >= 10000000ULL) {
+        sweep(now);
+        last_sweep_ns = now;
+    }
+
+    return (int)(stats.answers - answers);
+}
+
+size_t tcp_fallback_pending(void) {
+    return pending_total;
+}
+
+void tcp_fallback_get_stats(struct tcp_fallback_stats *out) {
+    *out = stats;
+}
+
+void tcp_fallback_destroy(void) {
+    for (size_t p = 0; p < pool_count; p++) {
+        struct tcp_pool *pool = pools[p];
+        for (size_t c = 0; c < config.conns_per_resolver; c++) {
+            struct tcp_conn *conn = &pool->conns[c];
+            if (conn->state != TCP_CONN_CLOSED) {
+                epoll_ctl(epoll_fd, EPOLL_CTL_DEL, conn->fd, NULL);
+                close(conn->fd);
+            }
+            free(conn->queries);
+            free(conn->wbuf);
+            free(conn->rbuf);
+        }
+        free(pool->conns);
+        free(pool->waiting);
+        free(pool);
+    }
+    free(pools);
+    pools = NULL;
+    pool_count = 0;
+    pool_capacity = 0;
+
+    if (epoll_fd >= 0) {
+        close(epoll_fd);
+        epoll_fd = -1;
+    }
+    answer_handler = NULL;
+    pending_total = 0;
+}
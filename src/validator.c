@@ -0,0 +1,1456 @@
+#include "../include/validator.h"
+#include "../include/dns_query.h"
+#include "../include/log.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <strings.h>
+#include <errno.h>
+#include <signal.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include <time.h>
+#include <openssl/evp.h>
+#include <openssl/bn.h>
+#include <openssl/core_names.h>
+#include <openssl/param_build.h>
+
+#define TYPE_SRV            33
+#define TYPE_DNAME          39
+#define TYPE_DS             43
+#define TYPE_RRSIG          46
+#define TYPE_DNSKEY         48
+#define TYPE_ANY            255
+
+#define ALG_RSASHA256       8
+#define ALG_RSASHA512       10
+#define ALG_ECDSAP256       13
+#define ALG_ECDSAP384       14
+#define ALG_ED25519         15
+
+#define DNSKEY_ZONE_FLAG    0x0100
+#define DNSKEY_PROTOCOL     3
+
+#define WIRE_NAME_MAX       255
+#define RRSIG_FIXED_LEN     18      // RRSIG rdata before the signer name
+#define RRSET_DATA          4096    // Record bytes of one RRset
+#define RRSET_SIG_DATA      2048    // RRSIG bytes covering one RRset
+#define RRSET_RECORDS       64      // Records of one RRset put in canonical order
+#define MESSAGE_RRSETS      32      // RRsets validated per answer
+#define SIGNED_DATA_MAX     65536   // RRSIG prefix plus the records it covers
+#define KEY_CACHE_SLOTS     256     // Decoded public keys per worker
+#define MEMO_SLOTS          4096    // Verified signatures remembered per worker
+
+// One RRset in canonical form (RFC 4034 section 6): names expanded and lower
+// cased, records and their RRSIGs each stored as rdlength then rdata
+struct rrset {
+    uint8_t owner[WIRE_NAME_MAX];
+    uint8_t owner_len;
+    uint8_t labels;                 // Owner labels, a leading '*' not counted
+    uint16_t type;
+    uint16_t rclass;
+    uint32_t ttl;                   // Smallest of the records'
+    uint16_t count;
+    uint16_t sigs;
+    uint16_t len;
+    uint16_t sig_len;
+    uint8_t data[RRSET_DATA];
+    uint8_t sig_data[RRSET_SIG_DATA];
+};
+
+// RRSIG rdata fields, pointing into its canonical form
+struct rrsig {
+    uint16_t covered;
+    uint8_t alg;
+    uint8_t labels;
+    uint32_t orig_ttl;
+    uint32_t expiration;
+    uint32_t inception;
+    uint16_t tag;
+    const uint8_t *signer;
+    size_t signer_len;
+    const uint8_t *rdata;           // Signed along with the records: rdata up to the signature
+    size_t prefix_len;
+    const uint8_t *signature;
+    size_t signature_len;
+};
+
+// DNSKEY and DS sets of one zone as last seen in an answer. Trust is
+// established lazily, the first time an answer needs the zone's keys.
+struct zone_entry {
+    uint32_t generation;            // Bumped whenever either set changes
+    struct rrset dnskey;
+    bool dnskey_trusted;
+    uint32_t dnskey_until;
+    struct rrset ds;
+    bool ds_trusted;
+    uint32_t ds_until;
+};
+
+struct anchor {
+    uint8_t owner[WIRE_NAME_MAX];
+    uint8_t owner_len;
+    uint16_t type;                  // TYPE_DS or TYPE_DNSKEY
+    uint16_t rdlen;
+    uint8_t rdata[1024];
+};
+
+struct key_slot {
+    uint8_t *rdata;
+    uint16_t len;
+    EVP_PKEY *pkey;
+};
+
+// Answer copied from the packet core, verified in place
+struct validator_job {
+    char domain[DNS_NAME_MAX];      // Cache key: the wire name of the question
+    struct cache_scope scope;
+    uint16_t response_len;
+    uint8_t status;
+    uint8_t response[CACHE_MAX_RESPONSE];
+};
+
+// One crypto thread. The packet core fills jobs at head and applies
+// results up to done; the worker verifies from done to head. Each index
+// has one writer and sits on its own cache line.
+struct worker {
+    _Alignas(64) _Atomic uint64_t head;
+    _Alignas(64) _Atomic uint64_t done;
+    _Alignas(64) uint64_t tail;     // Packet core: next result to apply
+    struct validator_job *jobs;
+    pthread_t thread;
+    bool started;
+
+    _Atomic uint64_t validated;
+    _Atomic uint64_t batches;
+    _Atomic uint64_t signatures;
+    _Atomic uint64_t memo_hits;
+    _Atomic uint64_t busy_ns;
+
+    // Worker only
+    EVP_MD_CTX *verify_ctx;
+    EVP_MD_CTX *hash_ctx;
+    struct key_slot keys[KEY_CACHE_SLOTS];
+    uint8_t (*memo)[32];
+    uint8_t signed_data[SIGNED_DATA_MAX];
+    struct rrset sets[MESSAGE_RRSETS];
+};
+
+// Static validator state
+static struct worker *workers[VALIDATOR_MAX_WORKERS];
+static unsigned int worker_count = 0;
+static unsigned int next_worker = 0;
+static _Atomic bool running = false;
+static bool active = false;
+static uint64_t start_ns = 0;
+static struct validator_stats stats;        // Packet core counters
+static _Atomic uint64_t key_sets = 0;
+
+// Read-only while the workers run
+static struct anchor anchors[VALIDATOR_MAX_ANCHORS];
+static size_t anchor_count = 0;
+
+// Shared by the workers, never touched by the packet core
+static struct zone_entry *zones[VALIDATOR_ZONES];
+static uint8_t zone_names[VALIDATOR_ZONES][WIRE_NAME_MAX];
+static pthread_mutex_t zones_lock = PTHREAD_MUTEX_INITIALIZER;
+
+// Root zone KSKs, 2017 and 2024 (https://data.iana.org/root-anchors/)
+static const char *root_anchors[] = {
+    ". IN DS 20326 8 2 E06D44B80B8F1D39A95C0B0D7C65D08458E880409BBC683457104237C7F8EC8D",
+    ". IN DS 38696 8 2 683D2D0ACB8C9B712A1948B27F741219298D0A450D612C483AF444A4C0FB2B16",
+};
+
+static const char *status_names[VALIDATOR_STATUSES] = {"secure", "insecure", "bogus", "indeterminate"};
+
+static inline uint64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static inline uint16_t get16(const uint8_t *p) {
+    return (uint16_t)(p[0] << 8 | p[1]);
+}
+
+static inline uint32_t get32(const uint8_t *p) {
+    return (uint32_t)p[0] << 24 | (uint32_t)p[1] << 16 | (uint32_t)p[2] << 8 | p[3];
+}
+
+static inline void put16(uint8_t *p, uint16_t v) {
+    p[0] = v >> 8;
+    p[1] = v & 0xFF;
+}
+
+// Worst of two outcomes: bogus over indeterminate over insecure over secure
+static enum validator_status worse(enum validator_status a, enum validator_status b) {
+    static const int rank[VALIDATOR_STATUSES] = {0, 1, 3, 2};
+    return rank[a] >= rank[b] ? a : b;
+}
+
+static bool algorithm_supported(uint8_t alg) {
+    return alg == ALG_RSASHA256 || alg == ALG_RSASHA512 || alg == ALG_ECDSAP256 ||
+           alg == ALG_ECDSAP384 || alg == ALG_ED25519;
+}
+
+// ---- Names and records ----
+
+// Expand the name at offset into canonical form. Returns the offset past
+// the name in the message, -1 when malformed.
+static int read_name(const uint8_t *msg, size_t len, size_t offset, uint8_t *out, size_t *out_len) {
+    size_t n = 0, end = 0;
+    for (int jumps = 0; jumps < 128;) {
+        if (offset >= len) {
+            return -1;
+        }
+        uint8_t c = msg[offset];
+        if ((c & 0xC0) == 0xC0) {
+            if (offset + 1 >= len) {
+                return -1;
+            }
+            if (!end) {
+                end = offset + 2;
+            }
+            offset = (size_t)(c & 0x3F) << 8 | msg[offset + 1];
+            jumps++;
+            continue;
+        }
+        if (c & 0xC0 || n + c + 1 > WIRE_NAME_MAX || offset + c + 1 > len) {
+            return -1;
+        }
+        out[n++] = c;
+        if (c == 0) {
+            *out_len = n;
+            return end ? (int)end : (int)(offset + 1);
+        }
+        for (size_t i = 0; i < c; i++) {
+            out[n++] = tolower(msg[offset + 1 + i]);
+        }
+        offset += c + 1;
+    }
+    return -1;
+}
+
+// Labels of a canonical name, the root and a leading '*' not counted
+static uint8_t name_labels(const uint8_t *name) {
+    uint8_t labels = 0;
+    if (name[0] == 1 && name[1] == '*') {
+        name += 2;
+    }
+    for (; *name; name += *name + 1) {
+        labels++;
+    }
+    return labels;
+}
+
+// Length of a canonical name, 0 if it runs past max
+static size_t name_length(const uint8_t *name, size_t max) {
+    size_t n = 0;
+    while (n < max && name[n]) {
+        n += name[n] + 1;
+    }
+    return n < max ? n + 1 : 0;
+}
+
+// Whether ancestor is name or one of its parent zones
+static bool name_under(const uint8_t *name, size_t len, const uint8_t *ancestor, size_t ancestor_len) {
+    for (size_t at = 0; at < len; at += name[at] + 1) {
+        if (len - at == ancestor_len && memcmp(name + at, ancestor, ancestor_len) == 0) {
+            return true;
+        }
+        if (!name[at]) {
+            break;
+        }
+    }
+    return false;
+}
+
+// Canonical rdata: embedded names of the types that may be compressed
+// (RFC 3597) expanded and lower cased, anything else copied as is
+static int canonical_rdata(const uint8_t *msg, size_t len, size_t offset, uint16_t rdlen, uint16_t type,
+                           uint8_t *out, size_t cap) {
+    size_t end = offset + rdlen, fixed = 0, names = 1, tail = 0, n = 0;
+    switch (type) {
+        case NS:
+        case CNAME:
+        case PTR:
+        case TYPE_DNAME:
+            break;
+        case MX:
+            fixed = 2;
+            break;
+        case TYPE_SRV:
+            fixed = 6;
+            break;
+        case SOA:
+            names = 2;
+            tail = 20;
+            break;
+        case TYPE_RRSIG:
+            fixed = RRSIG_FIXED_LEN;
+            tail = SIZE_MAX;        // The signature
+            break;
+        default:
+            if (rdlen > cap) {
+                return -1;
+            }
+            memcpy(out, msg + offset, rdlen);
+            return rdlen;
+    }
+
+    if (fixed > rdlen || fixed > cap) {
+        return -1;
+    }
+    memcpy(out, msg + offset, fixed);
+    n = fixed;
+    offset += fixed;
+    for (size_t i = 0; i < names; i++) {
+        uint8_t name[WIRE_NAME_MAX];
+        size_t name_len;
+        int next = read_name(msg, len, offset, name, &name_len);
+        if (next < 0 || (size_t)next > end || n + name_len > cap) {
+            return -1;
+        }
+        memcpy(out + n, name, name_len);
+        n += name_len;
+        offset = next;
+    }
+    if (tail == SIZE_MAX) {
+        tail = end - offset;
+    }
+    if (offset + tail != end || n + tail > cap) {
+        return -1;
+    }
+    memcpy(out + n, msg + offset, tail);
+    return (int)(n + tail);
+}
+
+// RRset of the answer with this owner, type and class, added if new
+static struct rrset *find_rrset(struct rrset *sets, size_t *count, const uint8_t *owner, size_t owner_len,
+                                uint16_t type, uint16_t rclass, uint32_t ttl) {
+    for (size_t i = 0; i < *count; i++) {
+        struct rrset *s = &sets[i];
+        if (s->type == type && s->rclass == rclass && s->owner_len == owner_len &&
+            memcmp(s->owner, owner, owner_len) == 0) {
+            if (ttl < s->ttl) {
+                s->ttl = ttl;
+            }
+            return s;
+        }
+    }
+    if (*count == MESSAGE_RRSETS) {
+        return NULL;
+    }
+    struct rrset *s = &sets[(*count)++];
+    memcpy(s->owner, owner, owner_len);
+    s->owner_len = owner_len;
+    s->labels = name_labels(owner);
+    s->type = type;
+    s->rclass = rclass;
+    s->ttl = ttl;
+    s->count = s->sigs = s->len = s->sig_len = 0;
+    return s;
+}
+
+// Split the answer section into RRsets, each with the RRSIGs covering it.
+// Returns the number of sets, -1 when malformed or over our limits.
+static int parse_answer(const uint8_t *msg, size_t len, struct rrset *sets) {
+    int offset = dns_question_end(msg, len);
+    if (offset < 0) {
+        return -1;
+    }
+
+    size_t count = 0;
+    for (uint16_t i = get16(msg + 6); i > 0; i--) {
+        uint8_t owner[WIRE_NAME_MAX];
+        size_t owner_len;
+        offset = read_name(msg, len, offset, owner, &owner_len);
+        if (offset < 0 || (size_t)offset + 10 > len) {
+            return -1;
+        }
+        const uint8_t *rr = msg + offset;
+        uint16_t type = get16(rr), rclass = get16(rr + 2), rdlen = get16(rr + 8);
+        uint32_t ttl = get32(rr + 4);
+        size_t rdata = offset + 10;
+        if (rdata + rdlen > len) {
+            return -1;
+        }
+        offset = rdata + rdlen;
+
+        // Signatures join the set they cover
+        bool sig = type == TYPE_RRSIG;
+        if (sig && rdlen < 2) {
+            return -1;
+        }
+        struct rrset *s = find_rrset(sets, &count, owner, owner_len, sig ? get16(msg + rdata) : type,
+                                     rclass, ttl);
+        if (!s) {
+            return -1;
+        }
+        uint8_t *out = sig ? s->sig_data + s->sig_len : s->data + s->len;
+        size_t cap = (sig ? RRSET_SIG_DATA - s->sig_len : RRSET_DATA - s->len);
+        if (cap < 2 || (!sig && s->count == RRSET_RECORDS)) {
+            return -1;
+        }
+        int n = canonical_rdata(msg, len, rdata, rdlen, type, out + 2, cap - 2);
+        if (n < 0) {
+            return -1;
+        }
+        put16(out, n);
+        if (sig) {
+            s->sig_len += n + 2;
+            s->sigs++;
+        } else {
+            s->len += n + 2;
+            s->count++;
+        }
+    }
+    return (int)count;
+}
+
+static int parse_rrsig(const uint8_t *rdata, size_t len, struct rrsig *sig) {
+    if (len < RRSIG_FIXED_LEN + 1) {
+        return -1;
+    }
+    sig->covered = get16(rdata);
+    sig->alg = rdata[2];
+    sig->labels = rdata[3];
+    sig->orig_ttl = get32(rdata + 4);
+    sig->expiration = get32(rdata + 8);
+    sig->inception = get32(rdata + 12);
+    sig->tag = get16(rdata + 16);
+    sig->signer = rdata + RRSIG_FIXED_LEN;
+    sig->signer_len = name_length(sig->signer, len - RRSIG_FIXED_LEN);
+    if (!sig->signer_len) {
+        return -1;
+    }
+    sig->rdata = rdata;
+    sig->prefix_len = RRSIG_FIXED_LEN + sig->signer_len;
+    sig->signature = rdata + sig->prefix_len;
+    sig->signature_len = len - sig->prefix_len;
+    return sig->signature_len ? 0 : -1;
+}
+
+// RFC 4034 appendix B
+static uint16_t key_tag(const uint8_t *rdata, size_t len) {
+    uint32_t ac = 0;
+    for (size_t i = 0; i < len; i++) {
+        ac += i & 1 ? rdata[i] : (uint32_t)rdata[i] << 8;
+    }
+    ac += ac >> 16 & 0xFFFF;
+    return ac & 0xFFFF;
+}
+
+struct record_ref {
+    const uint8_t *rdata;
+    uint16_t len;
+};
+
+// Canonical RR ordering: rdata compared as left-justified octet strings
+static int compare_records(const void *a, const void *b) {
+    const struct record_ref *x = a, *y = b;
+    int c = memcmp(x->rdata, y->rdata, x->len < y->len ? x->len : y->len);
+    return c ? c : (int)x->len - (int)y->len;
+}
+
+// The data an RRSIG signs (RFC 4034 section 3.1.8.1), 0 if too large
+static size_t build_signed_data(uint8_t *out, const struct rrset *set, const struct rrsig *sig) {
+    struct record_ref records[RRSET_RECORDS];
+    size_t count = 0;
+    for (size_t at = 0; at < set->len; at += get16(set->data + at) + 2) {
+        records[count].len = get16(set->data + at);
+        records[count++].rdata = set->data + at + 2;
+    }
+    qsort(records, count, sizeof(records[0]), compare_records);
+
+    // A wildcard expansion is signed under the wildcard owner
+    uint8_t owner[WIRE_NAME_MAX];
+    const uint8_t *name = set->owner;
+    size_t owner_len = set->owner_len;
+    if (sig->labels < set->labels) {
+        for (uint8_t skip = set->labels - sig->labels; skip > 0; skip--) {
+            name += *name + 1;
+        }
+        owner_len = set->owner_len - (name - set->owner) + 2;
+        owner[0] = 1;
+        owner[1] = '*';
+        memcpy(owner + 2, name, owner_len - 2);
+        name = owner;
+    }
+
+    size_t n = sig->prefix_len;
+    memcpy(out, sig->rdata, n);
+    for (size_t i = 0; i < count; i++) {
+        if (i && compare_records(&records[i - 1], &records[i]) == 0) {
+            continue;       // Duplicates are signed once
+        }
+        if (n + owner_len + 10 + records[i].len > SIGNED_DATA_MAX) {
+            return 0;
+        }
+        memcpy(out + n, name, owner_len);
+        n += owner_len;
+        put16(out + n, set->type);
+        put16(out + n + 2, set->rclass);
+        memcpy(out + n + 4, sig->rdata + 4, 4);     // Original TTL
+        put16(out + n + 8, records[i].len);
+        memcpy(out + n + 10, records[i].rdata, records[i].len);
+        n += 10 + records[i].len;
+    }
+    return n;
+}
+
+// ---- Crypto ----
+
+static EVP_PKEY *pkey_from_params(const char *type, OSSL_PARAM_BLD *bld) {
+    EVP_PKEY *pkey = NULL;
+    OSSL_PARAM *params = OSSL_PARAM_BLD_to_param(bld);
+    EVP_PKEY_CTX *ctx = EVP_PKEY_CTX_new_from_name(NULL, type, NULL);
+    if (!params || !ctx || EVP_PKEY_fromdata_init(ctx) != 1 ||
+        EVP_PKEY_fromdata(ctx, &pkey, EVP_PKEY_PUBLIC_KEY, params) != 1) {
+        pkey = NULL;
+    }
+    EVP_PKEY_CTX_free(ctx);
+    OSSL_PARAM_free(params);
+    return pkey;
+}
+
+// RFC 3110 exponent and modulus
+static EVP_PKEY *decode_rsa(const uint8_t *key, size_t len) {
+    size_t exp_len, at = 1;
+    if (len < 3) {
+        return NULL;
+    }
+    exp_len = key[0];
+    if (!exp_len) {
+        exp_len = get16(key + 1);
+        at = 3;
+    }
+    if (!exp_len || at + exp_len >= len || len - at - exp_len < 64) {
+        return NULL;
+    }
+
+    EVP_PKEY *pkey = NULL;
+    BIGNUM *e = BN_bin2bn(key + at, exp_len, NULL);
+    BIGNUM *n = BN_bin2bn(key + at + exp_len, len - at - exp_len, NULL);
+    OSSL_PARAM_BLD *bld = OSSL_PARAM_BLD_new();
+    if (e && n && bld && OSSL_PARAM_BLD_push_BN(bld, OSSL_PKEY_PARAM_RSA_N, n) &&
+        OSSL_PARAM_BLD_push_BN(bld, OSSL_PKEY_PARAM_RSA_E, e)) {
+        pkey = pkey_from_params("RSA", bld);
+    }
+    OSSL_PARAM_BLD_free(bld);
+    BN_free(e);
+    BN_free(n);
+    return pkey;
+}
+
+// RFC 6605: the point's X and Y, uncompressed
+static EVP_PKEY *decode_ecdsa(const char *group, const uint8_t *key, size_t len) {
+    uint8_t point[97];
+    if (len + 1 > sizeof(point)) {
+        return NULL;
+    }
+    point[0] = 0x04;
+    memcpy(point + 1, key, len);
+
+    EVP_PKEY *pkey = NULL;
+    OSSL_PARAM_BLD *bld = OSSL_PARAM_BLD_new();
+    if (bld && OSSL_PARAM_BLD_push_utf8_string(bld, OSSL_PKEY_PARAM_GROUP_NAME, group, 0) &&
+        OSSL_PARAM_BLD_push_octet_string(bld, OSSL_PKEY_PARAM_PUB_KEY, point, len + 1)) {
+        pkey = pkey_from_params("EC", bld);
+    }
+    OSSL_PARAM_BLD_free(bld);
+    return pkey;
+}
+
+// DNSKEY rdata to a public key, NULL for unsupported algorithms
+static EVP_PKEY *decode_key(const uint8_t *rdata, size_t len) {
+    const uint8_t *key = rdata + 4;
+    len -= 4;
+    switch (rdata[3]) {
+        case ALG_RSASHA256:
+        case ALG_RSASHA512:
+            return decode_rsa(key, len);
+        case ALG_ECDSAP256:
+            return len == 64 ? decode_ecdsa("P-256", key, len) : NULL;
+        case ALG_ECDSAP384:
+            return len == 96 ? decode_ecdsa("P-384", key, len) : NULL;
+        case ALG_ED25519:
+            return len == 32 ? EVP_PKEY_new_raw_public_key(EVP_PKEY_ED25519, NULL, key, len) : NULL;
+        default:
+            return NULL;
+    }
+}
+
+// Decoding a key costs more than many verifications, each worker keeps them
+static EVP_PKEY *worker_key(struct worker *w, const uint8_t *rdata, size_t len) {
+    uint32_t hash = 2166136261u;
+    for (size_t i = 0; i < len; i++) {
+        hash = (hash ^ rdata[i]) * 16777619u;
+    }
+    struct key_slot *slot = &w->keys[hash % KEY_CACHE_SLOTS];
+    if (slot->pkey && slot->len == len && memcmp(slot->rdata, rdata, len) == 0) {
+        return slot->pkey;
+    }
+
+    EVP_PKEY *pkey = decode_key(rdata, len);
+    uint8_t *copy = pkey ? malloc(len) : NULL;
+    if (!copy) {
+        EVP_PKEY_free(pkey);
+        return NULL;
+    }
+    EVP_PKEY_free(slot->pkey);
+    free(slot->rdata);
+    memcpy(copy, rdata, len);
+    slot->rdata = copy;
+    slot->len = len;
+    slot->pkey = pkey;
+    return pkey;
+}
+
+// ECDSA signatures travel as r | s, OpenSSL wants DER
+static size_t ecdsa_der(const uint8_t *sig, size_t half, uint8_t *out) {
+    size_t n = 2;
+    for (int i = 0; i < 2; i++) {
+        const uint8_t *v = sig + i * half;
+        size_t len = half;
+        while (len > 1 && !*v) {
+            v++;
+            len--;
+        }
+        bool pad = *v & 0x80;
+        out[n++] = 0x02;
+        out[n++] = len + pad;
+        if (pad) {
+            out[n++] = 0;
+        }
+        memcpy(out + n, v, len);
+        n += len;
+    }
+    out[0] = 0x30;
+    out[1] = n - 2;
+    return n;
+}
+
+static bool crypto_verify(struct worker *w, uint8_t alg, EVP_PKEY *pkey, const uint8_t *data, size_t len,
+                          const uint8_t *sig, size_t sig_len) {
+    const EVP_MD *md = NULL;
+    uint8_t der[128];
+    switch (alg) {
+        case ALG_RSASHA256:
+            md = EVP_sha256();
+            break;
+        case ALG_RSASHA512:
+            md = EVP_sha512();
+            break;
+        case ALG_ECDSAP256:
+        case ALG_ECDSAP384: {
+            size_t half = alg == ALG_ECDSAP256 ? 32 : 48;
+            if (sig_len != 2 * half) {
+                return false;
+            }
+            md = alg == ALG_ECDSAP256 ? EVP_sha256() : EVP_sha384();
+            sig_len = ecdsa_der(sig, half, der);
+            sig = der;
+            break;
+        }
+        case ALG_ED25519:
+            break;
+        default:
+            return false;
+    }
+
+    EVP_MD_CTX_reset(w->verify_ctx);
+    return EVP_DigestVerifyInit(w->verify_ctx, NULL, md, NULL, pkey) == 1 &&
+           EVP_DigestVerify(w->verify_ctx, sig, sig_len, data, len) == 1;
+}
+
+// Verify one signature with one DNSKEY. The same RRset is often checked
+// many times (answers cached per subnet, refetched after expiry, keys on
+// every chain walk), so a digest of key, signature and data that verified
+// once is remembered.
+static bool verify_signature(struct worker *w, const uint8_t *key, size_t key_len, const struct rrsig *sig,
+                             const uint8_t *data, size_t data_len) {
+    uint8_t digest[32];
+    unsigned int digest_len = 0;
+    bool hashed = EVP_DigestInit_ex(w->hash_ctx, EVP_sha256(), NULL) == 1 &&
+                  EVP_DigestUpdate(w->hash_ctx, key, key_len) == 1 &&
+                  EVP_DigestUpdate(w->hash_ctx, sig->signature, sig->signature_len) == 1 &&
+                  EVP_DigestUpdate(w->hash_ctx, data, data_len) == 1 &&
+                  EVP_DigestFinal_ex(w->hash_ctx, digest, &digest_len) == 1;
+    uint8_t *memo = w->memo[get32(digest) % MEMO_SLOTS];
+    if (hashed && memcmp(memo, digest, sizeof(digest)) == 0) {
+        atomic_fetch_add_explicit(&w->memo_hits, 1, memory_order_relaxed);
+        return true;
+    }
+
+    EVP_PKEY *pkey = worker_key(w, key, key_len);
+    if (!pkey) {
+        return false;
+    }
+    atomic_fetch_add_explicit(&w->signatures, 1, memory_order_relaxed);
+    if (!crypto_verify(w, sig->alg, pkey, data, data_len, sig->signature, sig->signature_len)) {
+        return false;
+    }
+    if (hashed) {
+        memcpy(memo, digest, sizeof(digest));
+    }
+    return true;
+}
+
+// Whether a DS record (or DS anchor) commits to this DNSKEY of owner
+static bool ds_matches(const uint8_t *ds, size_t ds_len, const uint8_t *owner, size_t owner_len,
+                       const uint8_t *key, size_t key_len) {
+    if (ds_len < 5 || get16(ds) != key_tag(key, key_len) || ds[2] != key[3]) {
+        return false;
+    }
+    const EVP_MD *md = ds[3] == 2 ? EVP_sha256() : ds[3] == 4 ? EVP_sha384() : ds[3] == 1 ? EVP_sha1() : NULL;
+    if (!md || ds_len - 4 != (size_t)EVP_MD_get_size(md)) {
+        return false;
+    }
+
+    uint8_t digest[EVP_MAX_MD_SIZE];
+    unsigned int digest_len = 0;
+    EVP_MD_CTX *ctx = EVP_MD_CTX_new();
+    bool ok = ctx && EVP_DigestInit_ex(ctx, md, NULL) == 1 && EVP_DigestUpdate(ctx, owner, owner_len) == 1 &&
+              EVP_DigestUpdate(ctx, key, key_len) == 1 && EVP_DigestFinal_ex(ctx, digest, &digest_len) == 1 &&
+              digest_len == ds_len - 4 && memcmp(digest, ds + 4, digest_len) == 0;
+    EVP_MD_CTX_free(ctx);
+    return ok;
+}
+
+// ---- Zone keys, shared by the workers ----
+
+static uint32_t zone_slot(const uint8_t *name, size_t len) {
+    uint32_t hash = 2166136261u;
+    for (size_t i = 0; i < len; i++) {
+        hash = (hash ^ name[i]) * 16777619u;
+    }
+    return hash % VALIDATOR_ZONES;
+}
+
+static bool rrset_equal(const struct rrset *a, const struct rrset *b) {
+    return a->count == b->count && a->sigs == b->sigs && a->len == b->len && a->sig_len == b->sig_len &&
+           memcmp(a->data, b->data, a->len) == 0 && memcmp(a->sig_data, b->sig_data, a->sig_len) == 0;
+}
+
+// Remember a DNSKEY or DS set seen in an answer. A set that differs from
+// the one held must earn trust again.
+static void zones_put(const struct rrset *set) {
+    uint32_t slot = zone_slot(set->owner, set->owner_len);
+    pthread_mutex_lock(&zones_lock);
+    struct zone_entry *z = zones[slot];
+    if (!z && !(z = zones[slot] = calloc(1, sizeof(*z)))) {
+        pthread_mutex_unlock(&zones_lock);
+        return;
+    }
+    if (memcmp(zone_names[slot], set->owner, set->owner_len) != 0) {
+        uint32_t generation = z->generation + 1;
+        memset(z, 0, sizeof(*z));
+        z->generation = generation;
+        memcpy(zone_names[slot], set->owner, set->owner_len);
+    }
+
+    struct rrset *held = set->type == TYPE_DNSKEY ? &z->dnskey : &z->ds;
+    bool *trusted = set->type == TYPE_DNSKEY ? &z->dnskey_trusted : &z->ds_trusted;
+    if (!held->owner_len || !rrset_equal(held, set)) {
+        *held = *set;
+        *trusted = false;
+        z->generation++;
+    }
+    pthread_mutex_unlock(&zones_lock);
+}
+
+// Copy a zone's DNSKEY or DS set. Returns false when none is held.
+static bool zones_get(const uint8_t *name, size_t len, uint16_t type, struct rrset *out, bool *trusted,
+                      uint32_t *until, uint32_t *generation) {
+    uint32_t slot = zone_slot(name, len);
+    bool found = false;
+    pthread_mutex_lock(&zones_lock);
+    struct zone_entry *z = zones[slot];
+    if (z && memcmp(zone_names[slot], name, len) == 0) {
+        const struct rrset *held = type == TYPE_DNSKEY ? &z->dnskey : &z->ds;
+        if (held->owner_len) {
+            *out = *held;
+            *trusted = type == TYPE_DNSKEY ? z->dnskey_trusted : z->ds_trusted;
+            *until = type == TYPE_DNSKEY ? z->dnskey_until : z->ds_until;
+            *generation = z->generation;
+            found = true;
+        }
+    }
+    pthread_mutex_unlock(&zones_lock);
+    return found;
+}
+
+// Record that a set verified, unless it was replaced in the meantime
+static void zones_trust(const uint8_t *name, size_t len, uint16_t type, uint32_t generation, uint32_t until) {
+    uint32_t slot = zone_slot(name, len);
+    pthread_mutex_lock(&zones_lock);
+    struct zone_entry *z = zones[slot];
+    if (z && z->generation == generation && memcmp(zone_names[slot], name, len) == 0) {
+        if (type == TYPE_DNSKEY) {
+            z->dnskey_trusted = true;
+            z->dnskey_until = until;
+        } else {
+            z->ds_trusted = true;
+            z->ds_until = until;
+        }
+    }
+    pthread_mutex_unlock(&zones_lock);
+}
+
+// ---- Validation ----
+
+static enum validator_status verify_rrset(struct worker *w, const struct rrset *set, uint32_t now, int depth,
+                                          bool below_signer, uint32_t *until);
+
+static bool signature_current(const struct rrsig *sig, uint32_t now) {
+    // Serial number arithmetic (RFC 4034 section 3.1.5)
+    return (int32_t)(now - sig->inception) >= 0 && (int32_t)(sig->expiration - now) >= 0;
+}
+
+// How long a verified set may be trusted: its TTL, within the signature's validity
+static uint32_t trust_until(const struct rrset *set, const struct rrsig *sig, uint32_t now) {
+    uint32_t ttl = set->ttl < sig->orig_ttl ? set->ttl : sig->orig_ttl;
+    uint32_t left = sig->expiration - now;
+    return now + (ttl < left ? ttl : left);
+}
+
+// Whether a DNSKEY of zone is one of its trust points: an anchor, or a
+// record of the zone's validated DS set
+static bool key_anchored(const uint8_t *zone, size_t zone_len, const struct rrset *ds,
+                         const uint8_t *key, size_t key_len) {
+    for (size_t i = 0; i < anchor_count; i++) {
+        const struct anchor *a = &anchors[i];
+        if (a->owner_len != zone_len || memcmp(a->owner, zone, zone_len) != 0) {
+            continue;
+        }
+        if (a->type == TYPE_DNSKEY ? a->rdlen == key_len && memcmp(a->rdata, key, key_len) == 0 :
+                                     ds_matches(a->rdata, a->rdlen, zone, zone_len, key, key_len)) {
+            return true;
+        }
+    }
+    for (size_t at = 0; ds && at < ds->len; at += get16(ds->data + at) + 2) {
+        if (ds_matches(ds->data + at + 2, get16(ds->data + at), zone, zone_len, key, key_len)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static bool zone_has_anchor(const uint8_t *zone, size_t zone_len) {
+    for (size_t i = 0; i < anchor_count; i++) {
+        if (anchors[i].owner_len == zone_len && memcmp(anchors[i].owner, zone, zone_len) == 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// Whether any trust point could be checked at all: an anchor, or a DS
+// record with an algorithm and digest we implement (RFC 4035 section 5.2)
+static bool ds_usable(const struct rrset *ds) {
+    for (size_t at = 0; at < ds->len; at += get16(ds->data + at) + 2) {
+        const uint8_t *r = ds->data + at + 2;
+        if (get16(ds->data + at) >= 4 && algorithm_supported(r[2]) && (r[3] == 1 || r[3] == 2 || r[3] == 4)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// The zone's DNSKEY set, once it chains up to a trust anchor: one of its
+// keys matches a trust point and signed the set
+static enum validator_status zone_keys(struct worker *w, const uint8_t *zone, size_t zone_len, uint32_t now,
+                                       int depth, struct rrset *keys) {
+    bool trusted;
+    uint32_t until, generation;
+    if (depth > VALIDATOR_MAX_DEPTH) {
+        return VALIDATOR_INDETERMINATE;
+    }
+    if (!zones_get(zone, zone_len, TYPE_DNSKEY, keys, &trusted, &until, &generation)) {
+        return VALIDATOR_INDETERMINATE;
+    }
+    if (trusted && (int32_t)(until - now) >= 0) {
+        return VALIDATOR_SECURE;
+    }
+
+    // Without an anchor the trust points are the DS set, signed by the parent
+    struct rrset ds;
+    bool has_ds = false;
+    if (!zone_has_anchor(zone, zone_len)) {
+        bool ds_trusted;
+        uint32_t ds_until, ds_generation;
+        if (!zones_get(zone, zone_len, TYPE_DS, &ds, &ds_trusted, &ds_until, &ds_generation)) {
+            return VALIDATOR_INDETERMINATE;
+        }
+        if (!ds_trusted || (int32_t)(ds_until - now) < 0) {
+            enum validator_status status = verify_rrset(w, &ds, now, depth + 1, true, &ds_until);
+            if (status != VALIDATOR_SECURE) {
+                return status;
+            }
+            zones_trust(zone, zone_len, TYPE_DS, ds_generation, ds_until);
+        }
+        if (!ds_usable(&ds)) {
+            return VALIDATOR_INSECURE;
+        }
+        has_ds = true;
+    }
+
+    for (size_t at = 0; at < keys->len; at += get16(keys->data + at) + 2) {
+        const uint8_t *key = keys->data + at + 2;
+        size_t key_len = get16(keys->data + at);
+        if (key_len < 5 || !(get16(key) & DNSKEY_ZONE_FLAG) || key[2] != DNSKEY_PROTOCOL ||
+            !key_anchored(zone, zone_len, has_ds ? &ds : NULL, key, key_len)) {
+            continue;
+        }
+
+        // The set must be self-signed by the anchored key
+        uint16_t tag = key_tag(key, key_len);
+        for (size_t s = 0; s < keys->sig_len; s += get16(keys->sig_data + s) + 2) {
+            struct rrsig sig;
+            if (parse_rrsig(keys->sig_data + s + 2, get16(keys->sig_data + s), &sig) != 0 ||
+                sig.tag != tag || sig.alg != key[3] || sig.labels > keys->labels ||
+                sig.signer_len != zone_len || memcmp(sig.signer, zone, zone_len) != 0 ||
+                !signature_current(&sig, now)) {
+                continue;
+            }
+            size_t len = build_signed_data(w->signed_data, keys, &sig);
+            if (len && verify_signature(w, key, key_len, &sig, w->signed_data, len)) {
+                zones_trust(zone, zone_len, TYPE_DNSKEY, generation, trust_until(keys, &sig, now));
+                atomic_fetch_add_explicit(&key_sets, 1, memory_order_relaxed);
+                return VALIDATOR_SECURE;
+            }
+        }
+    }
+    return VALIDATOR_BOGUS;
+}
+
+// One RRset against its signatures. below_signer: the signer must be a
+// proper ancestor of the owner, as for a DS set signed by the parent.
+static enum validator_status verify_rrset(struct worker *w, const struct rrset *set, uint32_t now, int depth,
+                                          bool below_signer, uint32_t *until) {
+    enum validator_status status = VALIDATOR_INSECURE;
+    struct rrset keys;
+    bool expanded = false;
+
+    for (size_t s = 0; s < set->sig_len; s += get16(set->sig_data + s) + 2) {
+        struct rrsig sig;
+        if (parse_rrsig(set->sig_data + s + 2, get16(set->sig_data + s), &sig) != 0 ||
+            !algorithm_supported(sig.alg)) {
+            continue;
+        }
+        if (sig.labels > set->labels || !name_under(set->owner, set->owner_len, sig.signer, sig.signer_len) ||
+            (below_signer && sig.signer_len == set->owner_len) || !signature_current(&sig, now)) {
+            status = worse(status, VALIDATOR_BOGUS);
+            continue;
+        }
+
+        enum validator_status chain = zone_keys(w, sig.signer, sig.signer_len, now, depth, &keys);
+        if (chain != VALIDATOR_SECURE) {
+            status = worse(status, chain);
+            continue;
+        }
+        size_t len = build_signed_data(w->signed_data, set, &sig);
+        bool verified = false;
+        for (size_t at = 0; len && !verified && at < keys.len; at += get16(keys.data + at) + 2) {
+            const uint8_t *key = keys.data + at + 2;
+            size_t key_len = get16(keys.data + at);
+            verified = key_len >= 5 && get16(key) & DNSKEY_ZONE_FLAG && key[3] == sig.alg &&
+                       key_tag(key, key_len) == sig.tag &&
+                       verify_signature(w, key, key_len, &sig, w->signed_data, len);
+        }
+        if (!verified) {
+            status = worse(status, VALIDATOR_BOGUS);
+        } else if (sig.labels < set->labels) {
+            // An authentic wildcard expansion, but without NSEC/NSEC3 nothing
+            // proves the name had no closer match (RFC 4035 section 5.3.4)
+            expanded = true;
+        } else {
+            *until = trust_until(set, &sig, now);
+            return VALIDATOR_SECURE;
+        }
+    }
+    return expanded ? VALIDATOR_INSECURE : status;
+}
+
+// Whether every RRset holding records answers the question: the RRset of
+// the question name and type, or a CNAME chain from the question name to
+// it. An authentic RRset for another name says nothing about the question.
+static bool answers_question(const uint8_t *msg, size_t len, const struct rrset *sets, int count) {
+    uint8_t name[WIRE_NAME_MAX];
+    size_t name_len;
+    int offset = read_name(msg, len, sizeof(struct dns_header), name, &name_len);
+    if (offset < 0 || (size_t)offset + 4 > len) {
+        return false;
+    }
+    uint16_t qtype = get16(msg + offset);
+
+    bool on_chain[MESSAGE_RRSETS] = {false};
+    for (int step = 0; step < count; step++) {
+        const struct rrset *cname = NULL;
+        bool answered = false;
+        for (int i = 0; i < count; i++) {
+            const struct rrset *s = &sets[i];
+            if (s->owner_len != name_len || memcmp(s->owner, name, name_len) != 0) {
+                continue;
+            }
+            if (s->type == qtype || qtype == TYPE_ANY) {
+                on_chain[i] = answered = true;
+            } else if (s->type == CNAME && s->count == 1) {
+                on_chain[i] = true;
+                cname = s;
+            }
+        }
+        if (answered || !cname) {
+            break;
+        }
+        name_len = name_length(cname->data + 2, get16(cname->data));
+        if (!name_len) {
+            return false;
+        }
+        memcpy(name, cname->data + 2, name_len);
+    }
+
+    for (int i = 0; i < count; i++) {
+        if (sets[i].count && !on_chain[i]) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Validate every RRset of an answer. Keys and DS records in it are kept
+// for later answers first, so a DNSKEY answer validates against itself.
+static enum validator_status validate_message(struct worker *w, const uint8_t *msg, size_t len, uint32_t now) {
+    if (len < sizeof(struct dns_header)) {
+        return VALIDATOR_BOGUS;
+    }
+    int count = parse_answer(msg, len, w->sets);
+    if (count < 0) {
+        return VALIDATOR_INDETERMINATE;
+    }
+    for (int i = 0; i < count; i++) {
+        const struct rrset *s = &w->sets[i];
+        if ((s->type == TYPE_DNSKEY || s->type == TYPE_DS) && s->count && s->sigs) {
+            zones_put(s);
+        }
+    }
+
+    // Denial of existence (NSEC/NSEC3) is not proven, negative answers stay insecure
+    if ((msg[3] & 0x0F) != 0 || count == 0 || !answers_question(msg, len, w->sets, count)) {
+        return VALIDATOR_INSECURE;
+    }
+
+    enum validator_status status = VALIDATOR_INSECURE;
+    bool first = true;
+    for (int i = 0; i < count; i++) {
+        uint32_t until;
+        if (!w->sets[i].count) {
+            continue;       // Signatures without their records
+        }
+        // A DS set is signed by the parent, never by the zone it delegates to
+        enum validator_status set_status = verify_rrset(w, &w->sets[i], now, 0, w->sets[i].type == TYPE_DS, &until);
+        status = first ? set_status : worse(status, set_status);
+        first = false;
+    }
+    return status;
+}
+
+static void *worker_main(void *arg) {
+    struct worker *w = arg;
+    struct timespec pause = {.tv_sec = 0, .tv_nsec = VALIDATOR_IDLE_US * 1000L};
+
+    while (atomic_load_explicit(&running, memory_order_relaxed)) {
+        uint64_t done = atomic_load_explicit(&w->done, memory_order_relaxed);
+        uint64_t head = atomic_load_explicit(&w->head, memory_order_acquire);
+        if (done == head) {
+            nanosleep(&pause, NULL);
+            continue;
+        }
+
+        // A batch shares one clock read and is published with one store
+        uint64_t end = head - done > VALIDATOR_BATCH ? done + VALIDATOR_BATCH : head;
+        uint64_t start = now_ns();
+        uint32_t now = (uint32_t)time(NULL);
+        for (uint64_t i = done; i < end; i++) {
+            struct validator_job *job = &w->jobs[i & (VALIDATOR_RING_JOBS - 1)];
+            job->status = validate_message(w, job->response, job->response_len, now);
+        }
+        atomic_store_explicit(&w->done, end, memory_order_release);
+
+        atomic_fetch_add_explicit(&w->validated, end - done, memory_order_relaxed);
+        atomic_fetch_add_explicit(&w->batches, 1, memory_order_relaxed);
+        atomic_fetch_add_explicit(&w->busy_ns, now_ns() - start, memory_order_relaxed);
+    }
+    return NULL;
+}
+
+// ---- Trust anchors ----
+
+// Text name to a lower case wire name
+static int encode_name(const char *text, uint8_t *out, size_t *out_len) {
+    size_t len = 0;
+    while (*text) {
+        const char *dot = strchr(text, '.');
+        size_t n = dot ? (size_t)(dot - text) : strlen(text);
+        if (n == 0 && dot && text[1] == '\0' && len == 0) {
+            break;      // The root
+        }
+        if (n == 0 || n > 63 || len + n + 2 > WIRE_NAME_MAX) {
+            return -1;
+        }
+        out[len++] = n;
+        for (size_t i = 0; i < n; i++) {
+            out[len++] = tolower((unsigned char)text[i]);
+        }
+        text += n + (dot ? 1 : 0);
+    }
+    out[len++] = 0;
+    *out_len = len;
+    return 0;
+}
+
+// "<owner> [ttl] [IN] DS <tag> <algorithm> <digest type> <digest>" or
+// "<owner> [ttl] [IN] DNSKEY <flags> <protocol> <algorithm> <key>"
+static int parse_anchor(char *line, struct anchor *a) {
+    char *save = NULL, *token = strtok_r(line, " \t\r\n", &save);
+    size_t owner_len;
+    if (!token || encode_name(token, a->owner, &owner_len) != 0) {
+        return -1;
+    }
+    a->owner_len = owner_len;
+
+    while ((token = strtok_r(NULL, " \t\r\n", &save)) && (isdigit((unsigned char)*token) ||
+                                                         strcasecmp(token, "IN") == 0)) {
+    }
+    if (!token) {
+        return -1;
+    }
+    bool ds = strcasecmp(token, "DS") == 0;
+    if (!ds && strcasecmp(token, "DNSKEY") != 0) {
+        return -1;
+    }
+    a->type = ds ? TYPE_DS : TYPE_DNSKEY;
+
+    unsigned long fields[3];
+    for (int i = 0; i < 3; i++) {
+        char *end;
+        if (!(token = strtok_r(NULL, " \t\r\n", &save)) || (fields[i] = strtoul(token, &end, 10), *end)) {
+            return -1;
+        }
+    }
+    // Key tag, algorithm, digest type; or flags, protocol, algorithm
+    put16(a->rdata, fields[0]);
+    a->rdata[2] = fields[1];
+    a->rdata[3] = fields[2];
+
+    // Digest in hex or key in base64, possibly split over several fields
+    char text[2048];
+    size_t text_len = 0;
+    while ((token = strtok_r(NULL, " \t\r\n", &save))) {
+        size_t n = strlen(token);
+        if (text_len + n >= sizeof(text)) {
+            return -1;
+        }
+        memcpy(text + text_len, token, n);
+        text_len += n;
+    }
+    text[text_len] = '\0';
+
+    size_t len = 4;
+    if (ds) {
+        if (text_len % 2 || text_len / 2 > sizeof(a->rdata) - 4) {
+            return -1;
+        }
+        for (size_t i = 0; i < text_len; i += 2) {
+            unsigned int byte;
+            if (!isxdigit((unsigned char)text[i]) || sscanf(text + i, "%2x", &byte) != 1) {
+                return -1;
+            }
+            a->rdata[len++] = byte;
+        }
+    } else {
+        if (text_len % 4 || text_len / 4 * 3 > sizeof(a->rdata) - 4) {
+            return -1;
+        }
+        int n = EVP_DecodeBlock(a->rdata + 4, (const unsigned char *)text, (int)text_len);
+        if (n < 0) {
+            return -1;
+        }
+        len += n - (text_len && text[text_len - 1] == '=') - (text_len > 1 && text[text_len - 2] == '=');
+    }
+    a->rdlen = len;
+    return len > 4 ? 0 : -1;
+}
+
+static int load_anchors(const char *path) {
+    FILE *fp = fopen(path, "r");
+    if (!fp) {
+        return -errno;
+    }
+
+    char line[4096];
+    size_t line_no = 0;
+    int ret = 0;
+    while (fgets(line, sizeof(line), fp)) {
+        line_no++;
+        char *comment = strpbrk(line, ";#");
+        if (comment) {
+            *comment = '\0';
+        }
+        if (strspn(line, " \t\r\n") == strlen(line)) {
+            continue;
+        }
+        if (anchor_count == VALIDATOR_MAX_ANCHORS || parse_anchor(line, &anchors[anchor_count]) != 0) {
+            fprintf(stderr, "%s:%zu: bad trust anchor\n", path, line_no);
+            ret = -EINVAL;
+            break;
+        }
+        anchor_count++;
+    }
+    fclose(fp);
+    return ret;
+}
+
+// ---- Lifecycle ----
+
+static void free_worker(struct worker *w) {
+    for (size_t i = 0; i < KEY_CACHE_SLOTS; i++) {
+        EVP_PKEY_free(w->keys[i].pkey);
+        free(w->keys[i].rdata);
+    }
+    EVP_MD_CTX_free(w->verify_ctx);
+    EVP_MD_CTX_free(w->hash_ctx);
+    free(w->memo);
+    free(w->jobs);
+    free(w);
+}
+
+static struct worker *alloc_worker(void) {
+    struct worker *w = aligned_alloc(64, (sizeof(struct worker) + 63) & ~(size_t)63);
+    if (!w) {
+        return NULL;
+    }
+    memset(w, 0, sizeof(*w));
+    w->jobs = malloc(VALIDATOR_RING_JOBS * sizeof(*w->jobs));
+    w->memo = calloc(MEMO_SLOTS, sizeof(*w->memo));
+    w->verify_ctx = EVP_MD_CTX_new();
+    w->hash_ctx = EVP_MD_CTX_new();
+    if (!w->jobs || !w->memo || !w->verify_ctx || !w->hash_ctx) {
+        free_worker(w);
+        return NULL;
+    }
+    return w;
+}
+
+// Start the crypto threads. Like the logger, before the calling thread is
+// pinned: the workers inherit the affinity they are created with.
+int validator_init(const struct validator_config *cfg) {
+    if (active) {
+        return -EBUSY;
+    }
+
+    anchor_count = 0;
+    if (cfg->anchors_file) {
+        int ret = load_anchors(cfg->anchors_file);
+        if (ret) {
+            return ret;
+        }
+    } else {
+        for (size_t i = 0; i < sizeof(root_anchors) / sizeof(root_anchors[0]); i++) {
+            char line[256];
+            snprintf(line, sizeof(line), "%s", root_anchors[i]);
+            parse_anchor(line, &anchors[anchor_count++]);
+        }
+    }
+    if (!anchor_count) {
+        return -EINVAL;
+    }
+
+    unsigned int count = cfg->workers ? cfg->workers : 1;
+    if (count > VALIDATOR_MAX_WORKERS) {
+        return -EINVAL;
+    }
+    memset(&stats, 0, sizeof(stats));
+    atomic_store(&key_sets, 0);
+    next_worker = 0;
+    start_ns = now_ns();
+    atomic_store(&running, true);
+
+    // Signals stay with the packet threads
+    sigset_t all, old;
+    sigfillset(&all);
+    pthread_sigmask(SIG_SETMASK, &all, &old);
+    int ret = 0;
+    for (worker_count = 0; worker_count < count; worker_count++) {
+        struct worker *w = alloc_worker();
+        if (!w) {
+            ret = -ENOMEM;
+            break;
+        }
+        workers[worker_count] = w;
+        if ((ret = -pthread_create(&w->thread, NULL, worker_main, w)) != 0) {
+            worker_count++;
+            break;
+        }
+        w->started = true;
+        char name[16];
+        snprintf(name, sizeof(name), "whack-dnssec%u", worker_count);
+        pthread_setname_np(w->thread, name);
+    }
+    pthread_sigmask(SIG_SETMASK, &old, NULL);
+
+    active = true;
+    if (ret) {
+        validator_destroy();
+    }
+    return ret;
+}
+
+bool validator_running(void) {
+    return active;
+}
+
+unsigned int validator_workers(void) {
+    return worker_count;
+}
+
+// Stop the workers; answers still queued are never marked
+void validator_destroy(void) {
+    if (!active) {
+        return;
+    }
+    atomic_store(&running, false);
+    for (unsigned int i = 0; i < worker_count; i++) {
+        if (workers[i] && workers[i]->started) {
+            pthread_join(workers[i]->thread, NULL);
+        }
+    }
+    validator_get_stats(&stats);    // Totals stay readable after shutdown
+    for (unsigned int i = 0; i < worker_count; i++) {
+        if (workers[i]) {
+            free_worker(workers[i]);
+        }
+        workers[i] = NULL;
+    }
+    worker_count = 0;
+
+    for (size_t i = 0; i < VALIDATOR_ZONES; i++) {
+        free(zones[i]);
+        zones[i] = NULL;
+    }
+    memset(zone_names, 0, sizeof(zone_names));
+    anchor_count = 0;
+    active = false;
+}
+
+int validator_submit(const char *domain, const struct cache_scope *scope,
+                     const uint8_t *response, size_t response_len) {
+    if (!active) {
+        return -ENODEV;
+    }
+    size_t domain_len = strlen(domain);
+    if (response_len > CACHE_MAX_RESPONSE || domain_len >= DNS_NAME_MAX) {
+        return -EMSGSIZE;
+    }
+
+    // Round robin over the workers, skipping full rings
+    for (unsigned int i = 0; i < worker_count; i++) {
+        struct worker *w = workers[next_worker];
+        next_worker = next_worker + 1 < worker_count ? next_worker + 1 : 0;
+        uint64_t head = atomic_load_explicit(&w->head, memory_order_relaxed);
+        if (head - w->tail == VALIDATOR_RING_JOBS) {
+            continue;
+        }
+
+        struct validator_job *job = &w->jobs[head & (VALIDATOR_RING_JOBS - 1)];
+        memcpy(job->domain, domain, domain_len + 1);
+        if (scope) {
+            job->scope = *scope;
+        } else {
+            memset(&job->scope, 0, sizeof(job->scope));
+        }
+        memcpy(job->response, response, response_len);
+        job->response_len = response_len;
+        atomic_store_explicit(&w->head, head + 1, memory_order_release);
+        stats.queued++;
+        return 0;
+    }
+    stats.dropped++;
+    return -EAGAIN;
+}
+
+size_t validator_poll(void) {
+    size_t count = 0;
+    for (unsigned int i = 0; i < worker_count; i++) {
+        struct worker *w = workers[i];
+        uint64_t done = atomic_load_explicit(&w->done, memory_order_acquire);
+        for (; w->tail < done; w->tail++) {
+            const struct validator_job *job = &w->jobs[w->tail & (VALIDATOR_RING_JOBS - 1)];
+            stats.results[job->status]++;
+            if (job->status == VALIDATOR_SECURE &&
+                cache_set_secure(job->domain, &job->scope, job->response, job->response_len)) {
+                stats.marked++;
+            }
+            count++;
+        }
+    }
+    return count;
+}
+
+size_t validator_pending(void) {
+    size_t pending = 0;
+    for (unsigned int i = 0; i < worker_count; i++) {
+        pending += atomic_load_explicit(&workers[i]->head, memory_order_relaxed) - workers[i]->tail;
+    }
+    return pending;
+}
+
+void validator_flush(void) {
+    struct timespec pause = {.tv_sec = 0, .tv_nsec = VALIDATOR_IDLE_US * 1000L};
+    for (unsigned int i = 0; i < worker_count; i++) {
+        while (atomic_load_explicit(&workers[i]->done, memory_order_acquire) !=
+               atomic_load_explicit(&workers[i]->head, memory_order_relaxed)) {
+            nanosleep(&pause, NULL);
+        }
+    }
+}
+
+void validator_get_worker_stats(unsigned int worker, struct validator_worker_stats *out) {
+    memset(out, 0, sizeof(*out));
+    if (worker >= worker_count || !workers[worker]) {
+        return;
+    }
+    struct worker *w = workers[worker];
+    out->validated = atomic_load_explicit(&w->validated, memory_order_relaxed);
+    out->batches = atomic_load_explicit(&w->batches, memory_order_relaxed);
+    out->signatures = atomic_load_explicit(&w->signatures, memory_order_relaxed);
+    out->memo_hits = atomic_load_explicit(&w->memo_hits, memory_order_relaxed);
+    out->busy_ns = atomic_load_explicit(&w->busy_ns, memory_order_relaxed);
+}
+
+void validator_get_stats(struct validator_stats *out) {
+    if (out != &stats) {
+        *out = stats;
+    }
+    if (!active) {
+        return;
+    }
+    memset(&out->total, 0, sizeof(out->total));
+    for (unsigned int i = 0; i < worker_count; i++) {
+        struct validator_worker_stats w;
+        validator_get_worker_stats(i, &w);
+        out->total.validated += w.validated;
+        out->total.batches += w.batches;
+        out->total.signatures += w.signatures;
+        out->total.memo_hits += w.memo_hits;
+        out->total.busy_ns += w.busy_ns;
+    }
+    out->key_sets = atomic_load_explicit(&key_sets, memory_order_relaxed);
+    out->wall_ns = now_ns() - start_ns;
+}
+
+const char *validator_status_name(enum validator_status status) {
+    return status < VALIDATOR_STATUSES ? status_names[status] : "unknown";
+}
@@ -0,0 +1,254 @@
+#include "../include/workload.h"
+#include "../include/dns_query.h"
+#include "../include/packet.h"
+#include <stdio.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <math.h>
+#include <arpa/inet.h>
+
+// pcap file format constants
+#define PCAP_MAGIC_USEC     0xA1B2C3D4
+#define PCAP_MAGIC_NSEC     0xA1B23C4D
+#define PCAP_LINKTYPE_ETH   1
+#define PCAP_MAX_SNAPLEN    65535
+
+struct pcap_file_header {
+    uint32_t magic;
+    uint16_t version_major;
+    uint16_t version_minor;
+    int32_t thiszone;
+    uint32_t sigfigs;
+    uint32_t snaplen;
+    uint32_t linktype;
+};
+
+struct pcap_record_header {
+    uint32_t ts_sec;
+    uint32_t ts_frac;
+    uint32_t caplen;
+    uint32_t len;
+};
+
+static int workload_reserve(struct workload *wl, size_t frame_len) {
+    if (wl->count == wl->capacity) {
+        size_t capacity = wl->capacity ? wl->capacity * 2 : 1024;
+        size_t *offsets = realloc(wl->offsets, capacity * sizeof(*offsets));
+        if (!offsets) {
+            return -ENOMEM;
+        }
+        wl->offsets = offsets;
+
+        uint32_t *lengths = realloc(wl->lengths, capacity * sizeof(*lengths));
+        if (!lengths) {
+            return -ENOMEM;
+        }
+        wl->lengths = lengths;
+        wl->capacity = capacity;
+    }
+
+    if (wl->data_len + frame_len > wl->data_cap) {
+        size_t data_cap = wl->data_cap ? wl->data_cap * 2 : 256 * 1024;
+        while (data_cap < wl->data_len + frame_len) {
+            data_cap *= 2;
+        }
+        uint8_t *data = realloc(wl->data, data_cap);
+        if (!data) {
+            return -ENOMEM;
+        }
+        wl->data = data;
+        wl->data_cap = data_cap;
+    }
+
+    return 0;
+}
+
+int workload_add(struct workload *wl, const uint8_t *frame, size_t len) {
+    int ret = workload_reserve(wl, len);
+    if (ret) {
+        return ret;
+    }
+
+    memcpy(wl->data + wl->data_len, frame, len);
+    wl->offsets[wl->count] = wl->data_len;
+    wl->lengths[wl->count] = len;
+    wl->data_len += len;
+    wl->count++;
+    return 0;
+}
+
+static uint32_t swap32(uint32_t v) {
+    return __builtin_bswap32(v);
+}
+
+int workload_load_pcap(struct workload *wl, const char *path) {
+    FILE *fp = fopen(path, "rb");
+    if (!fp) {
+        return -errno;
+    }
+
+    struct pcap_file_header fh;
+    if (fread(&fh, sizeof(fh), 1, fp) != 1) {
+        fclose(fp);
+        return -EINVAL;
+    }
+
+    // Captures from the other endianness are byte swapped
+    bool swapped = false;
+    if (fh.magic == swap32(PCAP_MAGIC_USEC) || fh.magic == swap32(PCAP_MAGIC_NSEC)) {
+        swapped = true;
+        fh.linktype = swap32(fh.linktype);
+    } else if (fh.magic != PCAP_MAGIC_USEC && fh.magic != PCAP_MAGIC_NSEC) {
+        fclose(fp);
+        return -EINVAL;
+    }
+
+    if (fh.linktype != PCAP_LINKTYPE_ETH) {
+        fclose(fp);
+        return -EPROTONOSUPPORT;
+    }
+
+    uint8_t *frame = malloc(PCAP_MAX_SNAPLEN);
+    if (!frame) {
+        fclose(fp);
+        return -ENOMEM;
+    }
+
+    int ret = 0;
+    struct pcap_record_header rh;
+    while (fread(&rh, sizeof(rh), 1, fp) == 1) {
+        uint32_t caplen = swapped ? swap32(rh.caplen) : rh.caplen;
+        if (caplen > PCAP_MAX_SNAPLEN || fread(frame, 1, caplen, fp) != caplen) {
+            ret = -EINVAL;
+            break;
+        }
+        ret = workload_add(wl, frame, caplen);
+        if (ret) {
+            break;
+        }
+    }
+
+    free(frame);
+    fclose(fp);
+    return ret;
+}
+
+// xorshift64*, good enough for traffic generation
+static uint64_t next_random(uint64_t *state) {
+    uint64_t x = *state;
+    x ^= x >> 12;
+    x ^= x << 25;
+    x ^= x >> 27;
+    *state = x;
+    return x * 0x2545F4914F6CDD1DULL;
+}
+
+// Cumulative Zipf distribution over ranks 1..n
+static double *zipf_cdf(size_t n, double s) {
+    double *cdf = malloc(n * sizeof(*cdf));
+    if (!cdf) {
+        return NULL;
+    }
+
+    double sum = 0.0;
+    for (size_t i = 0; i < n; i++) {
+        sum += s > 0.0 ? 1.0 / pow((double)(i + 1), s) : 1.0;
+        cdf[i] = sum;
+    }
+    for (size_t i = 0; i < n; i++) {
+        cdf[i] /= sum;
+    }
+    return cdf;
+}
+
+static size_t zipf_sample(const double *cdf, size_t n, double u) {
+    size_t lo = 0, hi = n - 1;
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        if (cdf[mid] < u) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    return lo;
+}
+
+int workload_synthesize(struct workload *wl, const struct workload_config *config) {
+    size_t domains = config->domains ? config->domains : 1;
+    size_t clients = config->clients ? config->clients : 1;
+    uint64_t state = config->seed ? config->seed : 0x9E3779B97F4A7C15ULL;
+
+    double *cdf = zipf_cdf(domains, config->zipf_s);
+    if (!cdf) {
+        return -ENOMEM;
+    }
+
+    struct packet_endpoint server = {
+        .mac = {0x02, 0x00, 0x00, 0x00, 0x00, 0x01},
+        .ip = htonl(0x0A000001),   // 10.0.0.1
+        .port = htons(DNS_PORT)
+    };
+
+    int ret = 0;
+    uint8_t frame[PACKET_HDR_LEN + 512];
+    for (size_t i = 0; i < config->packets; i++) {
+        double u = (double)(next_random(&state) >> 11) / (double)(1ULL << 53);
+        size_t rank = zipf_sample(cdf, domains, u);
+        uint32_t client = next_random(&state) % clients;
+
+        // Random-subdomain traffic asks for names nobody will ask for again
+        char name[64];
+        if (config->random_subdomains > 0.0 &&
+            (double)(next_random(&state) >> 11) / (double)(1ULL << 53) < config->random_subdomains) {
+            snprintf(name, sizeof(name), "r%016llx.zone%zu.example",
+                     (unsigned long long)next_random(&state), rank % 97);
+        } else {
+            snprintf(name, sizeof(name), "host%zu.zone%zu.example", rank, rank % 97);
+        }
+
+        struct packet_endpoint src = {
+            .mac = {0x02, 0x00, 0x00, 0x00, 0x00, 0x02},
+            .ip = htonl(0x0A010000 + client),   // 10.1.0.0/16 and up
+            .port = htons(1024 + (client % 60000))
+        };
+
+        struct dns_query query;
+        init_query(&query, name, A);
+        if (config->ecs_prefix) {
+            // As a forwarder would, from the client's own address
+            dns_ecs_init(&query.edns.ecs, DNS_ECS_FAMILY_IPV4, &src.ip, config->ecs_prefix);
+            query.edns.has_ecs = true;
+        }
+
+        uint8_t *payload = frame + PACKET_HDR_LEN;
+        size_t payload_len = sizeof(frame) - PACKET_HDR_LEN;
+        if (construct_query(&query, payload, &payload_len) != 0) {
+            ret = -EINVAL;
+            break;
+        }
+
+        int len = packet_build_udp(frame, sizeof(frame), &src, &server, payload, payload_len);
+        if (len < 0) {
+            ret = -EINVAL;
+            break;
+        }
+
+        ret = workload_add(wl, frame, len);
+        if (ret) {
+            break;
+        }
+    }
+
+    free(cdf);
+    return ret;
+}
+
+void workload_free(struct workload *wl) {
+    free(wl->data);
+    free(wl->offsets);
+    free(wl->lengths);
+    memset(wl, 0, sizeof(*wl));
+}
@@ -0,0 +1,310 @@
+#include "../include/xdp_filter.h"
+#include "../include/xdp_filter_maps.h"
+#include "../include/log.h"
+#include <xdp/libxdp.h>
+#include <bpf/libbpf.h>
+#include <bpf/bpf.h>
+#include <net/if.h>
+#include <arpa/inet.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <errno.h>
+
+// Static filter state
+static struct xdp_program *prog = NULL;
+static int ifindex = 0;
+static enum xdp_attach_mode attach_mode = XDP_MODE_NATIVE;
+static int xsks_fd = -1;
+static int allow_fd = -1;
+static int deny_fd = -1;
+static int limits_fd = -1;
+static int counters_fd = -1;
+static struct xdp_filter_limits limits;
+static const char *list_files[2];
+
+// "a.b.c.d[/len]", host bits beyond the prefix are cleared
+static int parse_cidr(const char *text, struct xdp_filter_lpm_key *key) {
+    char buf[64];
+    if (strlen(text) >= sizeof(buf)) {
+        return -EINVAL;
+    }
+    strcpy(buf, text);
+
+    unsigned long prefix = 32;
+    char *slash = strchr(buf, '/');
+    if (slash) {
+        char *end;
+        *slash = '\0';
+        prefix = strtoul(slash + 1, &end, 10);
+        if (end == slash + 1 || *end != '\0' || prefix > 32) {
+            return -EINVAL;
+        }
+    }
+
+    struct in_addr addr;
+    if (inet_pton(AF_INET, buf, &addr) != 1) {
+        return -EINVAL;
+    }
+
+    uint32_t mask = prefix ? ~0U << (32 - prefix) : 0;
+    key->prefixlen = prefix;
+    key->addr = addr.s_addr & htonl(mask);
+    return 0;
+}
+
+static int cmp_key(const void *a, const void *b) {
+    return memcmp(a, b, sizeof(struct xdp_filter_lpm_key));
+}
+
+static int list_fd(enum xdp_filter_list list) {
+    return list == XDP_FILTER_ALLOW ? allow_fd : deny_fd;
+}
+
+static int map_fd(struct bpf_object *obj, const char *name) {
+    struct bpf_map *map = bpf_object__find_map_by_name(obj, name);
+    return map ? bpf_map__fd(map) : -ENOENT;
+}
+
+static int write_limits(void) {
+    uint32_t zero = 0;
+    return bpf_map_update_elem(limits_fd, &zero, &limits, BPF_ANY);
+}
+
+int xdp_filter_add(enum xdp_filter_list list, const char *cidr) {
+    struct xdp_filter_lpm_key key;
+    uint8_t one = 1;
+
+    if (parse_cidr(cidr, &key) != 0) {
+        return -EINVAL;
+    }
+    return bpf_map_update_elem(list_fd(list), &key, &one, BPF_ANY);
+}
+
+int xdp_filter_remove(enum xdp_filter_list list, const char *cidr) {
+    struct xdp_filter_lpm_key key;
+
+    if (parse_cidr(cidr, &key) != 0) {
+        return -EINVAL;
+    }
+    return bpf_map_delete_elem(list_fd(list), &key);
+}
+
+// Add every CIDR in the file, then delete entries that are no longer
+// listed, so a reload never exposes an empty list to the data path
+static int load_list(enum xdp_filter_list list, const char *path) {
+    int fd = list_fd(list);
+    uint8_t one = 1;
+
+    FILE *fp = fopen(path, "r");
+    if (!fp) {
+        return -errno;
+    }
+
+    struct xdp_filter_lpm_key *keys = NULL;
+    size_t count = 0, capacity = 0;
+    char line[256];
+    size_t line_no = 0;
+    int ret = 0;
+
+    while (fgets(line, sizeof(line), fp)) {
+        line_no++;
+        char *p = line;
+        while (isspace((unsigned char)*p)) {
+            p++;
+        }
+        p[strcspn(p, " \t\r\n#")] = '\0';
+        if (*p == '\0') {
+            continue;
+        }
+
+        struct xdp_filter_lpm_key key;
+        if (parse_cidr(p, &key) != 0) {
+            log_warn("%s:%zu: ignoring invalid CIDR", path, line_no);
+            continue;
+        }
+
+        if (count == capacity) {
+            capacity = capacity ? capacity * 2 : 256;
+            struct xdp_filter_lpm_key *grown = realloc(keys, capacity * sizeof(*keys));
+            if (!grown) {
+                ret = -ENOMEM;
+                break;
+            }
+            keys = grown;
+        }
+        keys[count++] = key;
+
+        ret = bpf_map_update_elem(fd, &key, &one, BPF_ANY);
+        if (ret) {
+            break;
+        }
+    }
+    fclose(fp);
+
+    if (ret == 0) {
+        // Collect stale keys first, deleting while iterating restarts the walk
+        struct xdp_filter_lpm_key cur, next, *stale = NULL;
+        size_t stale_count = 0, stale_capacity = 0;
+        void *prev = NULL;
+
+        qsort(keys, count, sizeof(*keys), cmp_key);
+        while (bpf_map_get_next_key(fd, prev, &next) == 0) {
+            if (!bsearch(&next, keys, count, sizeof(*keys), cmp_key)) {
+                if (stale_count == stale_capacity) {
+                    stale_capacity = stale_capacity ? stale_capacity * 2 : 64;
+                    struct xdp_filter_lpm_key *grown = realloc(stale, stale_capacity * sizeof(*stale));
+                    if (!grown) {
+                        ret = -ENOMEM;
+                        break;
+                    }
+                    stale = grown;
+                }
+                stale[stale_count++] = next;
+            }
+            cur = next;
+            prev = &cur;
+        }
+
+        for (size_t i = 0; i < stale_count; i++) {
+            bpf_map_delete_elem(fd, &stale[i]);
+        }
+        free(stale);
+    }
+
+    free(keys);
+    return ret;
+}
+
+int xdp_filter_reload(void) {
+    if (!prog) {
+        return -ENODEV;
+    }
+
+    if (list_files[XDP_FILTER_DENY]) {
+        int ret = load_list(XDP_FILTER_DENY, list_files[XDP_FILTER_DENY]);
+        if (ret) {
+            return ret;
+        }
+    }
+
+    // An allow list, even an empty one, restricts queries to its sources
+    if (list_files[XDP_FILTER_ALLOW]) {
+        int ret = load_list(XDP_FILTER_ALLOW, list_files[XDP_FILTER_ALLOW]);
+        if (ret) {
+            return ret;
+        }
+    }
+    limits.allow_only = list_files[XDP_FILTER_ALLOW] != NULL;
+    return write_limits();
+}
+
+int xdp_filter_set_limits(uint32_t rate, uint32_t burst, uint32_t slip, uint8_t prefix) {
+    if (!prog) {
+        return -ENODEV;
+    }
+
+    limits.rate = rate;
+    limits.burst = burst ? burst : rate ? rate : 1;
+    limits.slip = slip;
+    limits.prefix = prefix ? (prefix > 32 ? 32 : prefix) : XDP_FILTER_PREFIX;
+    return write_limits();
+}
+
+int xdp_filter_init(const struct xdp_filter_config *config) {
+    ifindex = if_nametoindex(config->ifname);
+    if (!ifindex) {
+        return -errno;
+    }
+
+    const char *path = config->object_path ? config->object_path : WHACK_BPF_OBJ;
+    prog = xdp_program__open_file(path, "xdp", NULL);
+    long err = libxdp_get_error(prog);
+    if (err) {
+        prog = NULL;
+        return (int)err;
+    }
+
+    attach_mode = config->generic ? XDP_MODE_SKB : XDP_MODE_NATIVE;
+    err = xdp_program__attach(prog, ifindex, attach_mode, 0);
+    if (err) {
+        xdp_program__close(prog);
+        prog = NULL;
+        return (int)err;
+    }
+
+    // Maps exist once the program is loaded
+    struct bpf_object *obj = xdp_program__bpf_obj(prog);
+    xsks_fd = map_fd(obj, "xsks_map");
+    allow_fd = map_fd(obj, "allow_v4");
+    deny_fd = map_fd(obj, "deny_v4");
+    limits_fd = map_fd(obj, "limits");
+    counters_fd = map_fd(obj, "counters");
+    if (xsks_fd < 0 || allow_fd < 0 || deny_fd < 0 || limits_fd < 0 || counters_fd < 0) {
+        xdp_filter_destroy();
+        return -ENOENT;
+    }
+
+    list_files[XDP_FILTER_ALLOW] = config->allow_file;
+    list_files[XDP_FILTER_DENY] = config->deny_file;
+
+    int ret = xdp_filter_set_limits(config->rate_limit, config->burst, config->slip, config->prefix);
+    if (ret == 0) {
+        ret = xdp_filter_reload();
+    }
+    if (ret) {
+        xdp_filter_destroy();
+    }
+    return ret;
+}
+
+int xdp_filter_xsks_map_fd(void) {
+    return xsks_fd;
+}
+
+int xdp_filter_get_stats(struct xdp_filter_stats *stats) {
+    memset(stats, 0, sizeof(*stats));
+    if (!prog) {
+        return -ENODEV;
+    }
+
+    int cpus = libbpf_num_possible_cpus();
+    if (cpus <= 0) {
+        return cpus ? cpus : -EINVAL;
+    }
+    uint64_t *values = calloc(cpus, sizeof(*values));
+    if (!values) {
+        return -ENOMEM;
+    }
+
+    // Per-CPU slots are summed here, the data path never shares a counter
+    uint64_t totals[XDP_FILTER_COUNTERS] = {0};
+    for (uint32_t counter = 0; counter < XDP_FILTER_COUNTERS; counter++) {
+        if (bpf_map_lookup_elem(counters_fd, &counter, values) != 0) {
+            continue;
+        }
+        for (int cpu = 0; cpu < cpus; cpu++) {
+            totals[counter] += values[cpu];
+        }
+    }
+    free(values);
+
+    stats->passed = totals[XDP_FILTER_PASSED];
+    stats->redirected = totals[XDP_FILTER_REDIRECTED];
+    stats->denied = totals[XDP_FILTER_DENIED];
+    stats->not_allowed = totals[XDP_FILTER_NOT_ALLOWED];
+    stats->rate_limited = totals[XDP_FILTER_RATE_LIMITED];
+    stats->slipped = totals[XDP_FILTER_SLIPPED];
+    return 0;
+}
+
+void xdp_filter_destroy(void) {
+    if (prog) {
+        xdp_program__detach(prog, ifindex, attach_mode, 0);
+        xdp_program__close(prog);
+        prog = NULL;
+    }
+    xsks_fd = allow_fd = deny_fd = limits_fd = counters_fd = -1;
+    memset(&limits, 0, sizeof(limits));
+}
@@ -0,0 +1,1330 @@
+#include "../include/zone.h"
+#include "../include/hugemem.h"
+#include "../include/log.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <ctype.h>
+#include <errno.h>
+#include <time.h>
+#include <arpa/inet.h>
+
+#define HDR_LEN             12      // DNS header, the question follows
+#define QTYPE_ANY           255
+#define QCLASS_IN           1
+#define ENTRY_MAX           65536   // Text of one record, parentheses included
+#define MAX_TOKENS          1024
+#define NO_RECORD           UINT32_MAX
+#define DISPLACE_DIRECT     0x80000000u     // Bucket of one name: the low bits are its slot
+#define DISPLACE_TRIES      (1u << 20)
+#define SEED_TRIES          8
+
+// Index slot of one owner name
+struct zone_name {
+    uint64_t hash;
+    uint32_t name;                  // Blob offset of the lower-case wire name
+    uint32_t answers;               // Blob offset of the first zone_answer
+    uint16_t count;                 // Answers, 0 for an empty non-terminal
+    uint16_t zone;                  // Zone whose SOA negative answers carry
+    uint8_t name_len;
+};
+
+// One precomputed response: header and records, the client's question
+// is copied in between. Type 0 answers every type a CNAME owner lacks.
+struct zone_answer {
+    uint32_t offset;                // Blob offset of the template
+    uint16_t len;
+    uint16_t qtype;
+};
+
+// NXDOMAIN and NODATA templates of one zone, both carry its SOA
+struct zone_negative {
+    uint32_t nxdomain;
+    uint32_t nodata;
+    uint16_t len;
+};
+
+// Compiled, read-only index: a hash-and-displace minimal perfect hash over
+// the owner names, and one blob holding names, answer lists and templates.
+// Everything lives in a single arena from the hugemem placement policy.
+struct zone_index {
+    uint8_t *arena;
+    const uint32_t *displace;       // Per bucket: displacement or DISPLACE_DIRECT | slot
+    const struct zone_name *names;
+    const struct zone_negative *negatives;
+    const uint8_t *blob;
+    size_t buckets;
+    size_t name_count;
+    uint64_t seed;
+    uint64_t apex_lengths[4];       // Bit n set when some apex name is n bytes long
+    struct zone_stats stats;
+};
+
+// Static zone state
+static struct zone_index current;
+
+// Record as parsed, before compilation
+struct record {
+    uint32_t owner;                 // Data offset of the lower-case wire name
+    uint32_t rdata;                 // Data offset
+    uint32_t ttl;
+    uint32_t seq;                   // File order, kept within an RRset
+    uint16_t type;
+    uint16_t rdlen;
+    uint8_t owner_len;
+    uint32_t line;                  // Where it was read, for compile errors
+    const char *path;
+};
+
+// Name to index: an owner or an empty non-terminal above one
+struct key {
+    uint64_t hash;
+    uint32_t name;                  // Data offset
+    uint32_t first;                 // First record of the owner, NO_RECORD for an empty non-terminal
+    uint16_t zone;
+    uint8_t len;
+};
+
+struct zone_apex {
+    uint32_t name;                  // Data offset
+    uint32_t soa;                   // Record index
+    uint8_t len;
+};
+
+struct token {
+    const char *text;
+    size_t len;
+    bool quoted;
+};
+
+struct builder {
+    struct record *records;
+    size_t count, capacity;
+    uint8_t *data;                  // Owner names and rdata, back to back
+    size_t data_len, data_cap;
+    uint8_t *blob;                  // Compiled names, answer lists and templates
+    size_t blob_len, blob_cap;
+    struct zone_apex *zones;
+    size_t zone_count, zone_cap;
+    struct key *keys;
+    size_t key_count, key_cap;
+    size_t answers;
+
+    // Parser state
+    const char *path;
+    unsigned int line;
+    uint8_t origin[DNS_NAME_MAX];
+    size_t origin_len;
+    uint8_t owner[DNS_NAME_MAX];
+    size_t owner_len;
+    uint32_t owner_offset;          // Data offset of owner, NO_RECORD until stored
+    uint32_t default_ttl;           // $TTL, else the last explicit TTL
+    char text[ENTRY_MAX];
+    size_t text_len;
+    struct token tokens[MAX_TOKENS];
+    size_t token_count;
+    bool blank_owner;               // Entry starts with white space: previous owner
+    uint8_t rdata[65535];
+};
+
+static inline uint64_t clock_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static inline uint16_t get16(const uint8_t *p) {
+    return (uint16_t)(p[0] << 8 | p[1]);
+}
+
+static inline void put16(uint8_t *p, uint16_t v) {
+    p[0] = v >> 8;
+    p[1] = v & 0xFF;
+}
+
+static inline void put32(uint8_t *p, uint32_t v) {
+    put16(p, v >> 16);
+    put16(p + 2, v & 0xFFFF);
+}
+
+static inline uint64_t mix64(uint64_t x) {
+    x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    x = (x ^ (x >> 27)) * 0x94D049BB133111EBULL;
+    return x ^ (x >> 31);
+}
+
+// Word-at-a-time hash of a lower-case wire name
+static uint64_t hash_name(const uint8_t *name, size_t len, uint64_t seed) {
+    uint64_t h = seed ^ (len * 0x9E3779B97F4A7C15ULL);
+    size_t i = 0;
+    for (; i + 8 <= len; i += 8) {
+        uint64_t w;
+        memcpy(&w, name + i, 8);
+        h = (h ^ w) * 0xFF51AFD7ED558CCDULL;
+        h ^= h >> 32;
+    }
+    if (i < len) {
+        uint64_t w = 0;
+        memcpy(&w, name + i, len - i);
+        h = (h ^ w) * 0xFF51AFD7ED558CCDULL;
+    }
+    return mix64(h);
+}
+
+// Map 32 random bits onto 0..n-1 without a division
+static inline size_t reduce(uint32_t x, size_t n) {
+    return (size_t)(((uint64_t)x * n) >> 32);
+}
+
+static inline size_t bucket_of(uint64_t hash, size_t buckets) {
+    return reduce(hash >> 32, buckets);
+}
+
+static inline size_t displaced_slot(uint64_t hash, uint32_t d, size_t n) {
+    return reduce((uint32_t)mix64(hash + d * 0x9E3779B97F4A7C15ULL), n);
+}
+
+static const struct zone_name *find_name(const uint8_t *name, size_t len) {
+    uint64_t hash = hash_name(name, len, current.seed);
+    uint32_t d = current.displace[bucket_of(hash, current.buckets)];
+    size_t slot = d & DISPLACE_DIRECT ? d & ~DISPLACE_DIRECT : displaced_slot(hash, d, current.name_count);
+
+    const struct zone_name *entry = &current.names[slot];
+    if (entry->hash != hash || entry->name_len != len || memcmp(current.blob + entry->name, name, len) != 0) {
+        return NULL;
+    }
+    return entry;
+}
+
+static const uint8_t *negative(uint16_t zone, bool nxdomain, size_t *template_len) {
+    const struct zone_negative *neg = &current.negatives[zone];
+    *template_len = neg->len;
+    return current.blob + (nxdomain ? neg->nxdomain : neg->nodata);
+}
+
+// Template for a standard query's question, or NULL when no loaded zone is
+// authoritative for it
+const uint8_t *zone_lookup(const uint8_t *msg, size_t question_end, size_t *template_len) {
+    if (!current.name_count || question_end < HDR_LEN + 5 || get16(msg + 4) != 1 || (msg[2] & 0x78)) {
+        return NULL;
+    }
+
+    size_t len = question_end - HDR_LEN - 4;
+    const uint8_t *qname = msg + HDR_LEN;
+    if (len >= DNS_NAME_MAX || get16(qname + len + 2) != QCLASS_IN) {
+        return NULL;
+    }
+    uint16_t qtype = get16(qname + len);
+
+    // Lower-case copy, remembering where each label starts
+    uint8_t name[DNS_NAME_MAX];
+    uint8_t labels[128];
+    size_t label_count = 0;
+    for (size_t off = 0;;) {
+        uint8_t c = qname[off];
+        if (c & 0xC0 || off + c + 1 > len) {
+            return NULL;    // Compressed or malformed, never one of ours
+        }
+        labels[label_count++] = off;
+        name[off] = c;
+        if (c == 0) {
+            if (off + 1 != len) {
+                return NULL;
+            }
+            break;
+        }
+        for (size_t i = off + 1; i <= off + c; i++) {
+            uint8_t ch = qname[i];
+            name[i] = ch + ((uint8_t)(ch - 'A') < 26 ? 32 : 0);
+        }
+        off += c + 1;
+    }
+
+    const struct zone_name *entry = find_name(name, len);
+    if (entry) {
+        // Exact types come first, the CNAME fallback last
+        const struct zone_answer *answers = (const struct zone_answer *)(current.blob + entry->answers);
+        for (size_t i = 0; i < entry->count; i++) {
+            if (answers[i].qtype == qtype || answers[i].qtype == 0 || qtype == QTYPE_ANY) {
+                *template_len = answers[i].len;
+                return current.blob + answers[i].offset;
+            }
+        }
+        return negative(entry->zone, false, template_len);
+    }
+
+    // Below a name we hold but not in the data: the closest one decides the zone
+    for (size_t i = 1; i < label_count; i++) {
+        size_t suffix = len - labels[i];
+        if (!(current.apex_lengths[suffix / 64] >> (suffix % 64) & 1)) {
+            continue;
+        }
+        entry = find_name(name + labels[i], suffix);
+        if (entry) {
+            return negative(entry->zone, true, template_len);
+        }
+    }
+    return NULL;
+}
+
+// Reply = template header with the client's ID and RD bit, the client's
+// question as sent, the template's records, and an OPT record if the client
+// sent one
+int zone_write(const uint8_t *tmpl, size_t template_len, const uint8_t *msg, size_t question_end,
+               const struct dns_edns *edns, uint8_t *out, size_t out_len) {
+    size_t len = template_len + question_end - HDR_LEN;
+    if (question_end > out_len) {
+        return -1;
+    }
+
+    memcpy(out, tmpl, HDR_LEN);
+    memcpy(out, msg, 2);
+    out[2] |= msg[2] & 0x01;
+    memcpy(out + HDR_LEN, msg + HDR_LEN, question_end - HDR_LEN);
+
+    // An answer larger than the buffer goes out as the question with TC set
+    if (len + (edns->present ? DNS_OPT_RR_LEN : 0) > out_len) {
+        out[2] |= 0x02;
+        memset(out + 6, 0, 6);
+        return (int)question_end;
+    }
+    memcpy(out + question_end, tmpl + HDR_LEN, template_len - HDR_LEN);
+
+    if (edns->present) {
+        uint8_t *opt = out + len;
+        opt[0] = 0;
+        put16(opt + 1, OPT);
+        put16(opt + 3, DNS_EDNS_BUFFER_SIZE);
+        memset(opt + 5, 0, 6);
+        put16(out + 10, 1);
+        len += DNS_OPT_RR_LEN;
+    }
+    return (int)len;
+}
+
+void zone_get_stats(struct zone_stats *out) {
+    *out = current.stats;
+}
+
+void zone_destroy(void) {
+    hugemem_free(current.arena);
+    memset(&current, 0, sizeof(current));
+}
+
+// Loader
+
+static int grow(void **buf, size_t *cap, size_t need, size_t size) {
+    if (need <= *cap) {
+        return 0;
+    }
+    size_t n = *cap ? *cap : 1024;
+    while (n < need) {
+        n *= 2;
+    }
+    void *p = realloc(*buf, n * size);
+    if (!p) {
+        return -ENOMEM;
+    }
+    *buf = p;
+    *cap = n;
+    return 0;
+}
+
+// Errors go through the logger, a reload runs on the packet thread
+static int parse_error(struct builder *b, const char *msg) {
+    log_error("%s:%u: %s", b->path, b->line, msg);
+    return -EINVAL;
+}
+
+// Offset of bytes appended to the data arena, or -1
+static int64_t add_data(struct builder *b, const uint8_t *bytes, size_t len) {
+    if (b->data_len + len > UINT32_MAX ||
+        grow((void **)&b->data, &b->data_cap, b->data_len + len, 1) != 0) {
+        return -1;
+    }
+    memcpy(b->data + b->data_len, bytes, len);
+    b->data_len += len;
+    return (int64_t)(b->data_len - len);
+}
+
+static int add_token(struct builder *b, const char *text, size_t len, bool quoted) {
+    if (b->token_count == MAX_TOKENS || b->text_len + len + 1 > sizeof(b->text)) {
+        return parse_error(b, "record too long");
+    }
+    char *copy = b->text + b->text_len;
+    memcpy(copy, text, len);
+    copy[len] = '\0';
+    b->text_len += len + 1;
+    b->tokens[b->token_count++] = (struct token){copy, len, quoted};
+    return 0;
+}
+
+// Split one line into the current entry's tokens; parentheses continue an
+// entry on the next line, ';' starts a comment
+static int tokenize(struct builder *b, const char *line, int *depth) {
+    const char *p = line;
+    while (*p) {
+        if (isspace((unsigned char)*p)) {
+            p++;
+        } else if (*p == ';') {
+            break;
+        } else if (*p == '(') {
+            (*depth)++;
+            p++;
+        } else if (*p == ')') {
+            if (--(*depth) < 0) {
+                return parse_error(b, "unbalanced parentheses");
+            }
+            p++;
+        } else if (*p == '"') {
+            const char *start = ++p;
+            while (*p && *p != '"') {
+                p += p[0] == '\\' && p[1] ? 2 : 1;
+            }
+            if (*p != '"') {
+                return parse_error(b, "unterminated string");
+            }
+            int ret = add_token(b, start, p - start, true);
+            if (ret) {
+                return ret;
+            }
+            p++;
+        } else {
+            const char *start = p;
+            while (*p && !isspace((unsigned char)*p) && !strchr(";()\"", *p)) {
+                p += p[0] == '\\' && p[1] ? 2 : 1;
+            }
+            int ret = add_token(b, start, p - start, false);
+            if (ret) {
+                return ret;
+            }
+        }
+    }
+    return 0;
+}
+
+// Text name to lower-case wire format; relative names get $ORIGIN appended
+static int parse_name(struct builder *b, const struct token *t, uint8_t *out, size_t *out_len) {
+    if (t->len == 1 && t->text[0] == '@') {
+        if (!b->origin_len) {
+            return parse_error(b, "@ used without $ORIGIN");
+        }
+        memcpy(out, b->origin, b->origin_len);
+        *out_len = b->origin_len;
+        return 0;
+    }
+    if (t->len == 1 && t->text[0] == '.') {
+        out[0] = 0;
+        *out_len = 1;
+        return 0;
+    }
+
+    size_t label = 0, pos = 1;
+    bool absolute = false;
+    out[0] = 0;
+    for (size_t i = 0; i < t->len; i++) {
+        unsigned int c = (unsigned char)t->text[i];
+        if (c == '.') {
+            if (pos - label == 1) {
+                return parse_error(b, "empty label");
+            }
+            out[label] = pos - label - 1;
+            if (i + 1 == t->len) {
+                absolute = true;
+                break;
+            }
+            label = pos++;
+            continue;
+        }
+        if (c == '\\' && i + 1 < t->len) {
+            const char *d = t->text + i + 1;
+            if (i + 3 < t->len && isdigit((unsigned char)d[0]) && isdigit((unsigned char)d[1]) &&
+                isdigit((unsigned char)d[2])) {
+                c = (d[0] - '0') * 100 + (d[1] - '0') * 10 + (d[2] - '0');
+                i += 3;
+                if (c > 255) {
+                    return parse_error(b, "bad escape in name");
+                }
+            } else {
+                c = (unsigned char)t->text[++i];
+            }
+        }
+        if (pos - label > 63 || pos >= DNS_NAME_MAX - 1) {
+            return parse_error(b, "name or label too long");
+        }
+        out[pos++] = tolower(c);
+    }
+
+    if (absolute) {
+        out[pos++] = 0;
+    } else {
+        if (pos - label == 1) {
+            return parse_error(b, "empty label");
+        }
+        out[label] = pos - label - 1;
+        if (!b->origin_len) {
+            return parse_error(b, "relative name without $ORIGIN");
+        }
+        if (pos + b->origin_len >= DNS_NAME_MAX) {
+            return parse_error(b, "name too long");
+        }
+        memcpy(out + pos, b->origin, b->origin_len);
+        pos += b->origin_len;
+    }
+    *out_len = pos;
+    return 0;
+}
+
+static int parse_u32(struct builder *b, const struct token *t, uint32_t max, uint32_t *value) {
+    uint64_t v = 0;
+    if (t->quoted || t->len == 0) {
+        return parse_error(b, "number expected");
+    }
+    for (size_t i = 0; i < t->len; i++) {
+        if (!isdigit((unsigned char)t->text[i]) || (v = v * 10 + (t->text[i] - '0')) > max) {
+            return parse_error(b, "bad number");
+        }
+    }
+    *value = (uint32_t)v;
+    return 0;
+}
+
+// TTLs are seconds, optionally with BIND units: 1h30m, 2d, 1w
+static int parse_ttl(struct builder *b, const struct token *t, uint32_t *ttl) {
+    uint64_t total = 0, v = 0;
+    bool digits = false;
+    for (size_t i = 0; i < t->len; i++) {
+        char c = tolower((unsigned char)t->text[i]);
+        if (isdigit((unsigned char)c)) {
+            v = v * 10 + (c - '0');
+            digits = true;
+        } else if (digits && strchr("smhdw", c)) {
+            static const uint32_t unit[] = {['s' - 'a'] = 1, ['m' - 'a'] = 60, ['h' - 'a'] = 3600,
+                                            ['d' - 'a'] = 86400, ['w' - 'a'] = 604800};
+            total += v * unit[c - 'a'];
+            v = 0;
+            digits = false;
+        } else {
+            return parse_error(b, "bad TTL");
+        }
+        if (v > INT32_MAX || total > INT32_MAX) {
+            return parse_error(b, "TTL too large");
+        }
+    }
+    total += v;
+    if (t->len == 0 || total > INT32_MAX) {
+        return parse_error(b, "bad TTL");
+    }
+    *ttl = (uint32_t)total;
+    return 0;
+}
+
+static bool is_ttl(const struct token *t) {
+    return !t->quoted && isdigit((unsigned char)t->text[0]);
+}
+
+// <character-string> with \X and \DDD escapes
+static int parse_string(struct builder *b, const struct token *t, uint8_t *out, size_t *pos) {
+    size_t start = (*pos)++;
+    for (size_t i = 0; i < t->len; i++) {
+        unsigned int c = (unsigned char)t->text[i];
+        if (c == '\\' && i + 1 < t->len) {
+            const char *d = t->text + i + 1;
+            if (i + 3 < t->len && isdigit((unsigned char)d[0]) && isdigit((unsigned char)d[1]) &&
+                isdigit((unsigned char)d[2])) {
+                c = (d[0] - '0') * 100 + (d[1] - '0') * 10 + (d[2] - '0');
+                i += 3;
+            } else {
+                c = (unsigned char)t->text[++i];
+            }
+        }
+        if (c > 255 || *pos - start > 255 || *pos >= sizeof(b->rdata)) {
+            return parse_error(b, "TXT string too long");
+        }
+        out[(*pos)++] = c;
+    }
+    out[start] = *pos - start - 1;
+    return 0;
+}
+
+static const struct {
+    const char *name;
+    uint16_t type;
+    size_t fields;                  // Rdata tokens, 0 = one or more
+} record_types[] = {
+    {"A", A, 1}, {"NS", NS, 1}, {"CNAME", CNAME, 1}, {"SOA", SOA, 7}, {"PTR", PTR, 1},
+    {"MX", MX, 2}, {"TXT", TXT, 0}, {"AAAA", AAAA, 1}, {"SRV", 33, 4}
+};
+
+static int parse_rdata(struct builder *b, uint16_t type, const struct token *t, size_t n, size_t *rdlen) {
+    uint8_t *out = b->rdata;
+    size_t pos = 0, len;
+    uint32_t v;
+    int ret = 0;
+
+    switch (type) {
+        case A:
+            ret = inet_pton(AF_INET, t[0].text, out) == 1 ? 0 : parse_error(b, "bad IPv4 address");
+            pos = 4;
+            break;
+        case AAAA:
+            ret = inet_pton(AF_INET6, t[0].text, out) == 1 ? 0 : parse_error(b, "bad IPv6 address");
+            pos = 16;
+            break;
+        case NS:
+        case CNAME:
+        case PTR:
+            ret = parse_name(b, &t[0], out, &pos);
+            break;
+        case MX:
+            if ((ret = parse_u32(b, &t[0], 65535, &v)) == 0 && (ret = parse_name(b, &t[1], out + 2, &len)) == 0) {
+                put16(out, v);
+                pos = 2 + len;
+            }
+            break;
+        case 33:    // SRV: priority weight port target
+            for (size_t i = 0; i < 3 && !ret; i++) {
+                if ((ret = parse_u32(b, &t[i], 65535, &v)) == 0) {
+                    put16(out + i * 2, v);
+                }
+            }
+            if (!ret && (ret = parse_name(b, &t[3], out + 6, &len)) == 0) {
+                pos = 6 + len;
+            }
+            break;
+        case TXT:
+            for (size_t i = 0; i < n && !ret; i++) {
+                ret = parse_string(b, &t[i], out, &pos);
+            }
+            break;
+        case SOA:
+            if ((ret = parse_name(b, &t[0], out, &pos)) != 0 || (ret = parse_name(b, &t[1], out + pos, &len)) != 0) {
+                break;
+            }
+            pos += len;
+            if ((ret = parse_u32(b, &t[2], UINT32_MAX, &v)) == 0) {
+                put32(out + pos, v);
+                pos += 4;
+            }
+            for (size_t i = 3; i < 7 && !ret; i++) {
+                if ((ret = parse_ttl(b, &t[i], &v)) == 0) {
+                    put32(out + pos, v);
+                    pos += 4;
+                }
+            }
+            break;
+    }
+
+    *rdlen = pos;
+    return ret;
+}
+
+static int add_record(struct builder *b, uint16_t type, uint32_t ttl, size_t rdlen) {
+    if (b->owner_offset == NO_RECORD) {
+        int64_t off = add_data(b, b->owner, b->owner_len);
+        if (off < 0) {
+            return -ENOMEM;
+        }
+        b->owner_offset = off;
+    }
+    int64_t rdata = add_data(b, b->rdata, rdlen);
+    if (rdata < 0 || grow((void **)&b->records, &b->capacity, b->count + 1, sizeof(*b->records)) != 0) {
+        return -ENOMEM;
+    }
+
+    b->records[b->count] = (struct record){
+        .owner = b->owner_offset,
+        .rdata = rdata,
+        .ttl = ttl,
+        .seq = b->count,
+        .type = type,
+        .rdlen = rdlen,
+        .owner_len = b->owner_len,
+        .line = b->line,
+        .path = b->path
+    };
+    b->count++;
+    return 0;
+}
+
+// One complete entry: a directive or "[owner] [ttl] [class] type rdata"
+static int process_entry(struct builder *b) {
+    struct token *t = b->tokens;
+    size_t n = b->token_count;
+    size_t i = 0;
+
+    if (!b->blank_owner && t[0].text[0] == '$') {
+        if (strcasecmp(t[0].text, "$ORIGIN") == 0 && n == 2) {
+            uint8_t origin[DNS_NAME_MAX];
+            size_t len;
+            int ret = parse_name(b, &t[1], origin, &len);
+            if (!ret) {
+                memcpy(b->origin, origin, len);
+                b->origin_len = len;
+            }
+            return ret;
+        }
+        if (strcasecmp(t[0].text, "$TTL") == 0 && n == 2) {
+            return parse_ttl(b, &t[1], &b->default_ttl);
+        }
+        return parse_error(b, "unsupported directive");
+    }
+
+    if (!b->blank_owner) {
+        int ret = parse_name(b, &t[i++], b->owner, &b->owner_len);
+        if (ret) {
+            return ret;
+        }
+        b->owner_offset = NO_RECORD;
+    } else if (!b->owner_len) {
+        return parse_error(b, "record without an owner");
+    }
+
+    // TTL and class, in either order
+    uint32_t ttl = b->default_ttl;
+    for (int k = 0; k < 2 && i < n; k++) {
+        if (is_ttl(&t[i])) {
+            int ret = parse_ttl(b, &t[i++], &ttl);
+            if (ret) {
+                return ret;
+            }
+            b->default_ttl = ttl;
+        } else if (strcasecmp(t[i].text, "IN") == 0) {
+            i++;
+        } else if (strcasecmp(t[i].text, "CH") == 0 || strcasecmp(t[i].text, "HS") == 0 ||
+                   strcasecmp(t[i].text, "CS") == 0) {
+            return parse_error(b, "only class IN is supported");
+        } else {
+            break;
+        }
+    }
+    if (i == n) {
+        return parse_error(b, "missing record type");
+    }
+
+    const char *type_name = t[i++].text;
+    for (size_t k = 0; k < sizeof(record_types) / sizeof(record_types[0]); k++) {
+        if (strcasecmp(type_name, record_types[k].name) != 0) {
+            continue;
+        }
+        size_t fields = n - i;
+        if (record_types[k].fields ? fields != record_types[k].fields : fields == 0) {
+            return parse_error(b, "wrong number of fields");
+        }
+        size_t rdlen;
+        int ret = parse_rdata(b, record_types[k].type, t + i, fields, &rdlen);
+        return ret ? ret : add_record(b, record_types[k].type, ttl, rdlen);
+    }
+    return parse_error(b, "unsupported record type");
+}
+
+static int load_file(struct builder *b, const char *path) {
+    FILE *fp = fopen(path, "r");
+    if (!fp) {
+        int err = errno;
+        log_error("%s: cannot open, errno %d", path, err);
+        return -err;
+    }
+
+    b->path = path;
+    b->line = 0;
+    b->origin_len = 0;
+    b->owner_len = 0;
+    b->default_ttl = ZONE_DEFAULT_TTL;
+
+    char *line = NULL;
+    size_t line_cap = 0;
+    int depth = 0;
+    int ret = 0;
+    while (getline(&line, &line_cap, fp) >= 0) {
+        b->line++;
+        if (depth == 0) {
+            b->token_count = 0;
+            b->text_len = 0;
+            b->blank_owner = line[0] == ' ' || line[0] == '\t';
+        }
+        if ((ret = tokenize(b, line, &depth)) != 0) {
+            break;
+        }
+        if (depth == 0 && b->token_count && (ret = process_entry(b)) != 0) {
+            break;
+        }
+    }
+    if (!ret && depth) {
+        ret = parse_error(b, "unbalanced parentheses");
+    }
+
+    free(line);
+    fclose(fp);
+    return ret;
+}
+
+// Compiler
+
+static const uint8_t *sort_data;    // qsort has no context argument
+
+static int compare_names(const uint8_t *a, size_t alen, const uint8_t *b, size_t blen) {
+    int c = memcmp(a, b, alen < blen ? alen : blen);
+    return c ? c : (int)alen - (int)blen;
+}
+
+static int compare_records(const void *pa, const void *pb) {
+    const struct record *a = pa, *b = pb;
+    int c = compare_names(sort_data + a->owner, a->owner_len, sort_data + b->owner, b->owner_len);
+    if (c) {
+        return c;
+    }
+    if (a->type != b->type) {
+        return a->type < b->type ? -1 : 1;
+    }
+    return a->seq < b->seq ? -1 : a->seq > b->seq;
+}
+
+static int compare_apexes(const void *pa, const void *pb) {
+    const struct zone_apex *a = pa, *b = pb;
+    return compare_names(sort_data + a->name, a->len, sort_data + b->name, b->len);
+}
+
+// Owners before the empty non-terminals of the same name
+static int compare_keys(const void *pa, const void *pb) {
+    const struct key *a = pa, *b = pb;
+    int c = compare_names(sort_data + a->name, a->len, sort_data + b->name, b->len);
+    if (c) {
+        return c;
+    }
+    return (a->first == NO_RECORD) - (b->first == NO_RECORD);
+}
+
+// First record owned by name, or -1
+static int64_t find_owner(const struct builder *b, const uint8_t *name, size_t len) {
+    size_t lo = 0, hi = b->count;
+    while (lo < hi) {
+        size_t mid = (lo + hi) / 2;
+        const struct record *r = &b->records[mid];
+        if (compare_names(b->data + r->owner, r->owner_len, name, len) < 0) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    if (lo < b->count && compare_names(b->data + b->records[lo].owner, b->records[lo].owner_len, name, len) == 0) {
+        return (int64_t)lo;
+    }
+    return -1;
+}
+
+// Innermost zone holding name, or -1
+static int find_zone(const struct builder *b, const uint8_t *name, size_t len) {
+    for (size_t off = 0; off < len; off += name[off] + 1) {
+        size_t lo = 0, hi = b->zone_count;
+        while (lo < hi) {
+            size_t mid = (lo + hi) / 2;
+            int c = compare_names(b->data + b->zones[mid].name, b->zones[mid].len, name + off, len - off);
+            if (c == 0) {
+                return (int)mid;
+            }
+            if (c < 0) {
+                lo = mid + 1;
+            } else {
+                hi = mid;
+            }
+        }
+        if (name[off] == 0) {
+            break;
+        }
+    }
+    return -1;
+}
+
+// End of the records sharing the owner, or the owner and type, of record i
+static size_t run_end(const struct builder *b, size_t i, bool same_type) {
+    const struct record *first = &b->records[i];
+    size_t j = i + 1;
+    while (j < b->count && b->records[j].owner_len == first->owner_len &&
+           memcmp(b->data + b->records[j].owner, b->data + first->owner, first->owner_len) == 0 &&
+           (!same_type || b->records[j].type == first->type)) {
+        j++;
+    }
+    return j;
+}
+
+// Named by the record's file and line: the logger cannot carry the owner's
+// text, only static strings
+static int compile_error(const struct record *r, const char *msg) {
+    log_error("%s:%u: %s", r->path, r->line, msg);
+    return -EINVAL;
+}
+
+// Append to the blob, returning the offset of the bytes, or -1
+static int64_t blob_put(struct builder *b, const void *bytes, size_t len) {
+    if (b->blob_len + len > UINT32_MAX ||
+        grow((void **)&b->blob, &b->blob_cap, b->blob_len + len, 1) != 0) {
+        return -1;
+    }
+    if (bytes) {
+        memcpy(b->blob + b->blob_len, bytes, len);
+    } else {
+        memset(b->blob + b->blob_len, 0, len);
+    }
+    b->blob_len += len;
+    return (int64_t)(b->blob_len - len);
+}
+
+static int blob_align(struct builder *b, size_t align) {
+    size_t pad = (align - b->blob_len % align) % align;
+    return pad && blob_put(b, NULL, pad) < 0 ? -ENOMEM : 0;
+}
+
+static int64_t put_header(struct builder *b, uint8_t rcode, uint16_t ancount, uint16_t nscount) {
+    uint8_t hdr[HDR_LEN] = {0x00, 0x00, 0x84, rcode};    // QR and AA
+    put16(hdr + 4, 1);
+    put16(hdr + 6, ancount);
+    put16(hdr + 8, nscount);
+    return blob_put(b, hdr, sizeof(hdr));
+}
+
+// Records [lo, hi) with the given owner, or a pointer to the question's name
+static int put_records(struct builder *b, size_t lo, size_t hi, const uint8_t *owner, size_t owner_len,
+                       uint32_t ttl_cap) {
+    static const uint8_t question_name[2] = {0xC0, HDR_LEN};
+    for (size_t i = lo; i < hi; i++) {
+        const struct record *r = &b->records[i];
+        uint8_t fixed[10];
+        put16(fixed, r->type);
+        put16(fixed + 2, QCLASS_IN);
+        put32(fixed + 4, r->ttl < ttl_cap ? r->ttl : ttl_cap);
+        put16(fixed + 8, r->rdlen);
+        if ((owner ? blob_put(b, owner, owner_len) : blob_put(b, question_name, 2)) < 0 ||
+            blob_put(b, fixed, sizeof(fixed)) < 0 || blob_put(b, b->data + r->rdata, r->rdlen) < 0) {
+            return -ENOMEM;
+        }
+    }
+    return 0;
+}
+
+static int end_template(struct builder *b, int64_t start, size_t answer, uint16_t qtype) {
+    if (start < 0) {
+        return -ENOMEM;
+    }
+    size_t len = b->blob_len - start;
+    if (len > ZONE_MAX_TEMPLATE) {
+        return -EMSGSIZE;
+    }
+    struct zone_answer entry = {.offset = start, .len = len, .qtype = qtype};
+    memcpy(b->blob + answer, &entry, sizeof(entry));
+    b->answers++;
+    return 0;
+}
+
+// One template: the CNAME chain, then records [lo, hi) owned by its end.
+// The first owner is always the question's name.
+static int put_answer(struct builder *b, const size_t *chain, size_t hops, size_t lo, size_t hi,
+                      size_t entry, uint16_t qtype) {
+    int64_t start = put_header(b, 0, hops + (hi - lo), 0);
+    int ret = start < 0 ? -ENOMEM : 0;
+    for (size_t k = 0; k < hops && !ret; k++) {
+        const struct record *link = &b->records[chain[k]];
+        ret = put_records(b, chain[k], chain[k] + 1, k ? b->data + link->owner : NULL, link->owner_len, UINT32_MAX);
+    }
+    if (!ret && hi > lo) {
+        const struct record *r = &b->records[lo];
+        ret = put_records(b, lo, hi, hops ? b->data + r->owner : NULL, r->owner_len, UINT32_MAX);
+    }
+    return ret ? ret : end_template(b, start, entry, qtype);
+}
+
+// Answers of an owner: one per RRset, or for a CNAME the chain followed
+// through the zone data, one answer per type at its end, and the chain
+// alone for every other type
+static int compile_answers(struct builder *b, size_t first, struct zone_name *entry) {
+    size_t end = run_end(b, first, false);
+    const struct record *r = &b->records[first];
+    bool cname = false;
+    for (size_t i = first; i < end; i++) {
+        cname |= b->records[i].type == CNAME;
+    }
+
+    size_t chain[ZONE_MAX_CNAME];
+    size_t hops = 0;
+    size_t lo = first, hi = end;
+    if (cname) {
+        if (end - first != 1) {
+            return compile_error(r, "CNAME and other data");
+        }
+        chain[hops++] = first;
+        lo = hi = 0;
+        for (;;) {
+            const struct record *link = &b->records[chain[hops - 1]];
+            int64_t target = find_owner(b, b->data + link->rdata, link->rdlen);
+            if (target < 0) {
+                break;
+            }
+            if (b->records[target].type != CNAME) {
+                lo = target;
+                hi = run_end(b, target, false);
+                break;
+            }
+            if (hops == ZONE_MAX_CNAME) {
+                break;      // Too long or a loop: answer with the chain so far
+            }
+            chain[hops++] = target;
+        }
+    }
+
+    size_t count = cname ? 2 : 0;
+    for (size_t i = lo; i < hi; i = run_end(b, i, true)) {
+        count++;
+    }
+    if (count > UINT16_MAX || blob_align(b, 4) != 0) {
+        return -ENOMEM;
+    }
+    int64_t list = blob_put(b, NULL, count * sizeof(struct zone_answer));
+    if (list < 0) {
+        return -ENOMEM;
+    }
+    entry->answers = list;
+    entry->count = count;
+
+    // Exact types first, the CNAME fallback last
+    size_t next = list;
+    int ret = 0;
+    if (cname) {
+        ret = put_answer(b, chain, hops, 0, 0, next, CNAME);
+        next += sizeof(struct zone_answer);
+    }
+    for (size_t i = lo; i < hi && !ret; i = run_end(b, i, true)) {
+        ret = put_answer(b, chain, hops, i, run_end(b, i, true), next, b->records[i].type);
+        next += sizeof(struct zone_answer);
+    }
+    if (cname && !ret) {
+        ret = put_answer(b, chain, hops, 0, 0, next, 0);
+    }
+    if (ret == -EMSGSIZE) {
+        return compile_error(r, "answer larger than the template limit");
+    }
+    return ret;
+}
+
+// Keys for every owner and the empty non-terminals between it and its apex
+static int collect_keys(struct builder *b) {
+    for (size_t i = 0; i < b->count; i = run_end(b, i, false)) {
+        const struct record *r = &b->records[i];
+        const uint8_t *owner = b->data + r->owner;
+        int zone = find_zone(b, owner, r->owner_len);
+        if (zone < 0) {
+            return compile_error(r, "outside every zone (no SOA above it)");
+        }
+
+        // Served as plain data these would be wrong answers, not missing ones
+        size_t apex_len = b->zones[zone].len;
+        if (owner[0] == 1 && owner[1] == '*') {
+            return compile_error(r, "wildcard owners not supported");
+        }
+        for (size_t j = i; j < run_end(b, i, false) && r->owner_len != apex_len; j++) {
+            if (b->records[j].type == NS) {
+                return compile_error(r, "delegation below apex not supported");
+            }
+        }
+        for (size_t off = 0; r->owner_len - off >= apex_len; off += owner[off] + 1) {
+            if (grow((void **)&b->keys, &b->key_cap, b->key_count + 1, sizeof(*b->keys)) != 0) {
+                return -ENOMEM;
+            }
+            b->keys[b->key_count++] = (struct key){
+                .name = r->owner + off,
+                .first = off ? NO_RECORD : i,
+                .zone = zone,
+                .len = r->owner_len - off
+            };
+            if (r->owner_len - off == apex_len) {
+                break;
+            }
+        }
+    }
+
+    // One key per name, owners win over empty non-terminals
+    qsort(b->keys, b->key_count, sizeof(*b->keys), compare_keys);
+    size_t unique = 0;
+    for (size_t i = 0; i < b->key_count; i++) {
+        if (unique && b->keys[unique - 1].len == b->keys[i].len &&
+            memcmp(b->data + b->keys[unique - 1].name, b->data + b->keys[i].name, b->keys[i].len) == 0) {
+            continue;
+        }
+        b->keys[unique++] = b->keys[i];
+    }
+    b->key_count = unique;
+    return 0;
+}
+
+static size_t *bucket_order_sizes;
+
+static int compare_bucket_size(const void *pa, const void *pb) {
+    size_t a = *(const uint32_t *)pa, b = *(const uint32_t *)pb;
+    size_t sa = bucket_order_sizes[a + 1] - bucket_order_sizes[a];
+    size_t sb = bucket_order_sizes[b + 1] - bucket_order_sizes[b];
+    return sa < sb ? 1 : sa > sb ? -1 : 0;
+}
+
+// Hash and displace: place the largest buckets first, each with the first
+// displacement that lands all its names on free slots; a bucket of one
+// name just takes the next free slot and stores it directly
+static int build_mph(struct builder *b, uint64_t seed, uint32_t *displace, size_t buckets, uint32_t *slots) {
+    size_t n = b->key_count;
+    size_t *start = calloc(buckets + 1, sizeof(*start));
+    size_t *fill = calloc(buckets, sizeof(*fill));
+    uint32_t *members = malloc(n * sizeof(*members));
+    uint32_t *order = malloc(buckets * sizeof(*order));
+    uint8_t *taken = calloc(n, 1);
+    int ret = 0;
+    if (!start || !fill || !members || !order || !taken) {
+        ret = -ENOMEM;
+        goto out;
+    }
+
+    for (size_t i = 0; i < n; i++) {
+        b->keys[i].hash = hash_name(b->data + b->keys[i].name, b->keys[i].len, seed);
+        start[bucket_of(b->keys[i].hash, buckets) + 1]++;
+    }
+    for (size_t i = 0; i < buckets; i++) {
+        start[i + 1] += start[i];
+        order[i] = i;
+    }
+    for (size_t i = 0; i < n; i++) {
+        size_t bucket = bucket_of(b->keys[i].hash, buckets);
+        members[start[bucket] + fill[bucket]++] = i;
+    }
+    bucket_order_sizes = start;
+    qsort(order, buckets, sizeof(*order), compare_bucket_size);
+
+    size_t free_cursor = 0;
+    for (size_t k = 0; k < buckets; k++) {
+        size_t bucket = order[k];
+        const uint32_t *m = members + start[bucket];
+        size_t size = start[bucket + 1] - start[bucket];
+
+        if (size <= 1) {
+            while (free_cursor < n && taken[free_cursor]) {
+                free_cursor++;
+            }
+            size_t slot = size ? free_cursor : 0;
+            if (size) {
+                taken[slot] = 1;
+                slots[m[0]] = slot;
+            }
+            displace[bucket] = DISPLACE_DIRECT | slot;
+            continue;
+        }
+
+        uint32_t d;
+        for (d = 0; d < DISPLACE_TRIES; d++) {
+            size_t j;
+            for (j = 0; j < size; j++) {
+                size_t slot = displaced_slot(b->keys[m[j]].hash, d, n);
+                if (taken[slot]) {
+                    break;
+                }
+                taken[slot] = 2;        // Provisional, undone on failure
+                slots[m[j]] = slot;
+            }
+            if (j == size) {
+                break;
+            }
+            while (j-- > 0) {
+                taken[slots[m[j]]] = 0;
+            }
+        }
+        if (d == DISPLACE_TRIES) {
+            ret = -EAGAIN;
+            goto out;
+        }
+        for (size_t j = 0; j < size; j++) {
+            taken[slots[m[j]]] = 1;
+        }
+        displace[bucket] = d;
+    }
+
+out:
+    free(start);
+    free(fill);
+    free(members);
+    free(order);
+    free(taken);
+    return ret;
+}
+
+// Turn the parsed records into the read-only index
+static int compile(struct builder *b, struct zone_index *index) {
+    sort_data = b->data;
+    qsort(b->records, b->count, sizeof(*b->records), compare_records);
+
+    // Every SOA owner is a zone apex
+    for (size_t i = 0; i < b->count; i++) {
+        const struct record *r = &b->records[i];
+        if (r->type != SOA) {
+            continue;
+        }
+        if (b->zone_count && b->zones[b->zone_count - 1].len == r->owner_len &&
+            memcmp(b->data + b->zones[b->zone_count - 1].name, b->data + r->owner, r->owner_len) == 0) {
+            return compile_error(r, "more than one SOA");
+        }
+        if (b->zone_count == UINT16_MAX) {
+            return compile_error(r, "too many zones");
+        }
+        if (grow((void **)&b->zones, &b->zone_cap, b->zone_count + 1, sizeof(*b->zones)) != 0) {
+            return -ENOMEM;
+        }
+        b->zones[b->zone_count++] = (struct zone_apex){r->owner, i, r->owner_len};
+    }
+    if (!b->zone_count) {
+        log_error("zone: no SOA record, nothing to be authoritative for");
+        return -EINVAL;
+    }
+    qsort(b->zones, b->zone_count, sizeof(*b->zones), compare_apexes);
+
+    int ret = collect_keys(b);
+    if (ret) {
+        return ret;
+    }
+
+    // Names and answers go to the blob in key order
+    size_t n = b->key_count;
+    struct zone_name *names = calloc(n, sizeof(*names));
+    struct zone_negative *negatives = calloc(b->zone_count, sizeof(*negatives));
+    if (!names || !negatives) {
+        free(names);
+        free(negatives);
+        return -ENOMEM;
+    }
+    for (size_t i = 0; i < n && !ret; i++) {
+        const struct key *key = &b->keys[i];
+        int64_t name = blob_put(b, b->data + key->name, key->len);
+        names[i].name = name;
+        names[i].name_len = key->len;
+        names[i].zone = key->zone;
+        ret = name < 0 ? -ENOMEM : key->first == NO_RECORD ? 0 : compile_answers(b, key->first, &names[i]);
+    }
+
+    // Negative answers carry the SOA with the TTL capped at its minimum (RFC 2308)
+    for (size_t z = 0; z < b->zone_count && !ret; z++) {
+        const struct zone_apex *apex = &b->zones[z];
+        const struct record *soa = &b->records[apex->soa];
+        const uint8_t *minimum = b->data + soa->rdata + soa->rdlen - 4;
+        uint32_t ttl = (uint32_t)minimum[0] << 24 | minimum[1] << 16 | minimum[2] << 8 | minimum[3];
+        int64_t nxdomain = put_header(b, 3, 0, 1);
+        if (nxdomain < 0 || put_records(b, apex->soa, apex->soa + 1, b->data + apex->name, apex->len, ttl) != 0) {
+            ret = -ENOMEM;
+            break;
+        }
+        int64_t nodata = blob_put(b, b->blob + nxdomain, b->blob_len - nxdomain);
+        if (nodata < 0) {
+            ret = -ENOMEM;
+            break;
+        }
+        b->blob[nodata + 3] = 0;
+        negatives[z].nxdomain = nxdomain;
+        negatives[z].nodata = nodata;
+        negatives[z].len = nodata - nxdomain;
+    }
+
+    // Perfect hash over the names, reseeded in the unlikely case it gets stuck
+    size_t buckets = (n + ZONE_BUCKET_KEYS - 1) / ZONE_BUCKET_KEYS;
+    uint32_t *displace = calloc(buckets, sizeof(*displace));
+    uint32_t *slots = calloc(n, sizeof(*slots));
+    uint64_t seed = 0;
+    if (!ret && (!displace || !slots)) {
+        ret = -ENOMEM;
+    }
+    if (!ret && n >= DISPLACE_DIRECT) {
+        ret = -E2BIG;
+    }
+    for (int attempt = 0; !ret; attempt++) {
+        seed = mix64(0x5EED + attempt);
+        ret = build_mph(b, seed, displace, buckets, slots);
+        if (ret != -EAGAIN) {
+            break;
+        }
+        ret = attempt + 1 < SEED_TRIES ? 0 : -EAGAIN;
+    }
+
+    // Lay the index out in one arena: displacements, slots, negatives, blob
+    size_t names_off = (buckets * sizeof(*displace) + 7) & ~(size_t)7;
+    size_t negatives_off = names_off + n * sizeof(*names);
+    size_t blob_off = (negatives_off + b->zone_count * sizeof(*negatives) + 7) & ~(size_t)7;
+    size_t size = blob_off + b->blob_len;
+    uint8_t *arena = ret ? NULL : hugemem_alloc("zone index", size);
+    if (!ret && !arena) {
+        ret = -ENOMEM;
+    }
+    if (!ret) {
+        memcpy(arena, displace, buckets * sizeof(*displace));
+        struct zone_name *placed = (struct zone_name *)(arena + names_off);
+        for (size_t i = 0; i < n; i++) {
+            placed[slots[i]] = names[i];
+            placed[slots[i]].hash = b->keys[i].hash;
+        }
+        memcpy(arena + negatives_off, negatives, b->zone_count * sizeof(*negatives));
+        memcpy(arena + blob_off, b->blob, b->blob_len);
+
+        memset(index, 0, sizeof(*index));
+        index->arena = arena;
+        index->displace = (const uint32_t *)arena;
+        index->names = placed;
+        index->negatives = (const struct zone_negative *)(arena + negatives_off);
+        index->blob = arena + blob_off;
+        index->buckets = buckets;
+        index->name_count = n;
+        index->seed = seed;
+        for (size_t z = 0; z < b->zone_count; z++) {
+            index->apex_lengths[b->zones[z].len / 64] |= 1ULL << (b->zones[z].len % 64);
+        }
+        index->stats.zones = b->zone_count;
+        index->stats.names = n;
+        index->stats.records = b->count;
+        index->stats.answers = b->answers;
+        index->stats.index_bytes = size;
+    }
+
+    free(names);
+    free(negatives);
+    free(displace);
+    free(slots);
+    return ret;
+}
+
+static void builder_free(struct builder *b) {
+    free(b->records);
+    free(b->data);
+    free(b->blob);
+    free(b->zones);
+    free(b->keys);
+    free(b);
+}
+
+// Parse and compile the master files, then swap the new index in; the
+// loaded one stays when anything fails
+int zone_load(const char *const *paths, size_t count) {
+    uint64_t start = clock_ns();
+    struct builder *b = calloc(1, sizeof(*b));
+    if (!b) {
+        return -ENOMEM;
+    }
+
+    int ret = 0;
+    for (size_t i = 0; i < count && !ret; i++) {
+        ret = load_file(b, paths[i]);
+    }
+
+    struct zone_index index;
+    if (!ret) {
+        ret = compile(b, &index);
+    }
+    builder_free(b);
+    if (ret) {
+        return ret;
+    }
+
+    zone_destroy();
+    current = index;
+    current.stats.build_ns = clock_ns() - start;
+    return 0;
+}
@@ -0,0 +1,187 @@
+#include "../include/analytics.h"
+#include "../include/dns_query.h"
+#include "../include/packet.h"
+#include <unity.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <arpa/inet.h>
+
+// Test fixtures
+static const struct packet_endpoint server = {
+    .mac = {0x02, 0x00, 0x00, 0x00, 0x00, 0x02},
+    .ip = 0x0201010A,   // 10.1.1.2
+    .port = 0x3500      // 53
+};
+
+static struct analytics_summary *summary;
+
+void setUp(void) {
+    summary = analytics_summary_alloc();
+    TEST_ASSERT_NOT_NULL(summary);
+}
+
+void tearDown(void) {
+    free(summary);
+}
+
+// A query for name from client_ip (host byte order), or its response when rcode >= 0
+static void observe(struct analytics_summary *s, const char *name, enum DnsQType type,
+                    uint32_t client_ip, int rcode, size_t pad) {
+    struct dns_query query;
+    uint8_t msg[2048] = {0};
+    size_t msg_len = sizeof(msg);
+    init_query(&query, name, type);
+    TEST_ASSERT_EQUAL_INT(0, construct_query(&query, msg, &msg_len));
+
+    struct packet_endpoint client = server;
+    client.ip = htonl(client_ip);
+    client.port = htons(40000);
+
+    uint8_t frame[2200];
+    int len;
+    if (rcode >= 0) {
+        msg[2] |= 0x80;
+        msg[3] = (msg[3] & 0xF0) | rcode;
+        len = packet_build_udp(frame, sizeof(frame), &server, &client, msg, msg_len + pad);
+    } else {
+        len = packet_build_udp(frame, sizeof(frame), &client, &server, msg, msg_len);
+    }
+    TEST_ASSERT_GREATER_THAN(0, len);
+    analytics_observe(s, frame, len);
+}
+
+static void entry_name(const struct analytics_topk_entry *entry, char *out, size_t out_len) {
+    dns_name_to_text(analytics_topk_key(&summary->names, entry), entry->len, out, out_len);
+}
+
+void test_analytics_heavy_hitters(void) {
+    // Three popular names hidden in a stream of one-off names
+    for (int i = 0; i < 2000; i++) {
+        char name[64];
+        snprintf(name, sizeof(name), "once%d.example", i);
+        observe(summary, name, A, 0x0A000100, -1, 0);
+        if (i % 4 == 0) {
+            observe(summary, "first.example", A, 0x0A000001, -1, 0);
+        }
+        if (i % 8 == 0) {
+            observe(summary, "second.example", A, 0x0A000002, -1, 0);
+        }
+        if (i % 16 == 0) {
+            observe(summary, "third.example", A, 0x0A000003, -1, 0);
+        }
+    }
+
+    const struct analytics_topk_entry *top[3];
+    TEST_ASSERT_EQUAL_UINT(3, analytics_top(&summary->names, top, 3));
+    const char *expected[] = {"first.example", "second.example", "third.example"};
+    const uint64_t truth[] = {500, 250, 125};
+    for (int i = 0; i < 3; i++) {
+        char name[DNS_NAME_MAX];
+        entry_name(top[i], name, sizeof(name));
+        TEST_ASSERT_EQUAL_STRING(expected[i], name);
+        // Space-Saving over-counts by at most error, never under-counts
+        TEST_ASSERT_TRUE(top[i]->count >= truth[i]);
+        TEST_ASSERT_TRUE(top[i]->count - top[i]->error <= truth[i]);
+    }
+
+    // The one-off client sent most queries
+    TEST_ASSERT_EQUAL_UINT(1, analytics_top(&summary->clients, top, 1));
+    TEST_ASSERT_EQUAL_UINT64(2000, top[0]->count);
+    TEST_ASSERT_EQUAL_UINT64(2875, summary->queries);
+}
+
+void test_analytics_distinct_counts(void) {
+    for (int i = 0; i < 20000; i++) {
+        char name[64];
+        snprintf(name, sizeof(name), "host%d.example", i);
+        observe(summary, name, A, 0x0A000000 + i % 500, -1, 0);
+    }
+
+    // About 1.6% standard error, allow three of them
+    uint64_t names = analytics_distinct_names(summary);
+    TEST_ASSERT_UINT_WITHIN(1000, 20000, (unsigned)names);
+    uint64_t clients = analytics_distinct_clients(summary);
+    TEST_ASSERT_UINT_WITHIN(25, 500, (unsigned)clients);
+}
+
+void test_analytics_histograms(void) {
+    observe(summary, "Example.COM", A, 0x0A000001, -1, 0);
+    observe(summary, "example.com", AAAA, 0x0A000001, -1, 0);
+    observe(summary, "example.com", MX, 0x0A000002, -1, 0);
+    observe(summary, "example.com", A, 0x0A000001, 0, 0);
+    observe(summary, "missing.example", A, 0x0A000001, 3, 0);
+    observe(summary, "big.example", TXT, 0x0A000001, 0, 1500);
+
+    TEST_ASSERT_EQUAL_UINT64(3, summary->queries);
+    TEST_ASSERT_EQUAL_UINT64(3, summary->responses);
+    TEST_ASSERT_EQUAL_UINT64(1, summary->qtypes[A]);
+    TEST_ASSERT_EQUAL_UINT64(1, summary->qtypes[AAAA]);
+    TEST_ASSERT_EQUAL_UINT64(1, summary->qtypes[MX]);
+    TEST_ASSERT_EQUAL_UINT64(2, summary->rcodes[0]);
+    TEST_ASSERT_EQUAL_UINT64(1, summary->rcodes[3]);
+    TEST_ASSERT_EQUAL_UINT64(2, summary->sizes[0]);    // Up to 64 bytes
+    TEST_ASSERT_EQUAL_UINT64(1, summary->sizes[5]);    // 1025 to 2048 bytes
+
+    // Case does not split a name
+    const struct analytics_topk_entry *top[2];
+    TEST_ASSERT_EQUAL_UINT(1, analytics_top(&summary->names, top, 2));
+    TEST_ASSERT_EQUAL_UINT64(3, top[0]->count);
+
+    // Reports are one JSON line
+    FILE *fp = tmpfile();
+    TEST_ASSERT_NOT_NULL(fp);
+    TEST_ASSERT_EQUAL_INT(0, analytics_report(fp, summary, 1700000000, 10));
+    char line[4096];
+    rewind(fp);
+    TEST_ASSERT_NOT_NULL(fgets(line, sizeof(line), fp));
+    fclose(fp);
+    TEST_ASSERT_NOT_NULL(strstr(line, "\"top_names\":[{\"name\":\"example.com\",\"count\":3,\"error\":0}]"));
+    TEST_ASSERT_NOT_NULL(strstr(line, "\"qtypes\":{\"A\":1,\"MX\":1,\"AAAA\":1}"));
+    TEST_ASSERT_NOT_NULL(strstr(line, "\"rcodes\":{\"NOERROR\":2,\"NXDOMAIN\":1}"));
+    TEST_ASSERT_EQUAL_INT('\n', line[strlen(line) - 1]);
+}
+
+void test_analytics_core_handoff(void) {
+    struct analytics_core cores[2];
+    TEST_ASSERT_EQUAL_INT(0, analytics_core_init(&cores[0]));
+    TEST_ASSERT_EQUAL_INT(0, analytics_core_init(&cores[1]));
+
+    for (int i = 0; i < 100; i++) {
+        observe(analytics_core_summary(&cores[i % 2]), "shared.example", A, 0x0A000001 + i % 2, -1, 0);
+    }
+
+    // Nothing is handed over until the worker retires its summary
+    analytics_core_request(&cores[0]);
+    analytics_core_request(&cores[1]);
+    TEST_ASSERT_FALSE(analytics_core_collect(&cores[0], summary));
+    analytics_core_poll(&cores[0]);
+    analytics_core_poll(&cores[1]);
+
+    // Queries after the flip land in the next interval
+    observe(analytics_core_summary(&cores[0]), "later.example", A, 0x0A000001, -1, 0);
+
+    TEST_ASSERT_TRUE(analytics_core_collect(&cores[0], summary));
+    TEST_ASSERT_TRUE(analytics_core_collect(&cores[1], summary));
+    TEST_ASSERT_FALSE(analytics_core_collect(&cores[1], summary));
+    TEST_ASSERT_EQUAL_UINT64(100, summary->queries);
+    TEST_ASSERT_UINT_WITHIN(1, 1, (unsigned)analytics_distinct_names(summary));
+    TEST_ASSERT_UINT_WITHIN(1, 2, (unsigned)analytics_distinct_clients(summary));
+
+    const struct analytics_topk_entry *top[1];
+    TEST_ASSERT_EQUAL_UINT(1, analytics_top(&summary->names, top, 1));
+    TEST_ASSERT_EQUAL_UINT64(100, top[0]->count);
+    TEST_ASSERT_EQUAL_UINT64(1, analytics_core_summary(&cores[0])->queries);
+
+    analytics_core_free(&cores[0]);
+    analytics_core_free(&cores[1]);
+}
+
+int main(void) {
+    UNITY_BEGIN();
+    RUN_TEST(test_analytics_heavy_hitters);
+    RUN_TEST(test_analytics_distinct_counts);
+    RUN_TEST(test_analytics_histograms);
+    RUN_TEST(test_analytics_core_handoff);
+    return UNITY_END();
+}
@@ -1,6 +1,8 @@
 #include "../include/cache.h"
 #include <unity.h>
+#include <stdio.h>
 #include <string.h>
+#include <unistd.h>
 
 // Test fixtures
 static struct cache_config test_config = {
@@ -79,10 +81,12 @@ void test_cache_cleanup(void) {
     // First entry should be gone
     TEST_ASSERT_FALSE(cache_lookup(domain1, response, &response_len));
     
-    // Second entry should still be there
+    // Second entry should still be there, held for as long as we slept
+    uint32_t age = 0;
     response_len = sizeof(response);
-    TEST_ASSERT_TRUE(cache_lookup(domain2, response, &response_len));
+    TEST_ASSERT_TRUE(cache_lookup_scoped(domain2, NULL, response, &response_len, NULL, &age));
     TEST_ASSERT_EQUAL_UINT8_ARRAY(test_data, response, test_data_len);
+    TEST_ASSERT_TRUE(age >= 2 && age <= 3);
 }
 
 void test_cache_statistics(void) {
@@ -112,6 +116,229 @@ void test_cache_statistics(void) {
     TEST_ASSERT_EQUAL_FLOAT(0.5, cache_get_hit_ratio());
 }
 
+void test_cache_scoped_entries(void) {
+    const char *domain = "cdn.example.com";
+    const uint8_t global_data[] = {0x10};
+    const uint8_t subnet_data[] = {0x20};
+    const uint8_t client_a[4] = {198, 51, 100, 10};
+    const uint8_t client_b[4] = {203, 0, 113, 10};
+    struct cache_scope scope_a, scope_b;
+    uint8_t response[512];
+    size_t response_len;
+
+    cache_scope_init(&scope_a, 1, client_a, 32);
+    cache_scope_init(&scope_b, 1, client_b, 32);
+
+    // A /24 answer for client A's subnet next to a global answer
+    struct cache_scope subnet;
+    cache_scope_init(&subnet, 1, client_a, 24);
+    cache_insert_scoped(domain, &subnet, subnet_data, sizeof(subnet_data), 60);
+    cache_insert(domain, global_data, sizeof(global_data), 60);
+
+    response_len = sizeof(response);
+    TEST_ASSERT_TRUE(cache_lookup_scoped(domain, &scope_a, response, &response_len, NULL, NULL));
+    TEST_ASSERT_EQUAL_UINT8(0x20, response[0]);
+
+    response_len = sizeof(response);
+    TEST_ASSERT_TRUE(cache_lookup_scoped(domain, &scope_b, response, &response_len, NULL, NULL));
+    TEST_ASSERT_EQUAL_UINT8(0x10, response[0]);
+
+    // Clients without a subnet only see the global answer
+    response_len = sizeof(response);
+    TEST_ASSERT_TRUE(cache_lookup(domain, response, &response_len));
+    TEST_ASSERT_EQUAL_UINT8(0x10, response[0]);
+}
+
+void test_cache_set_secure(void) {
+    const char *domain = "signed.example.com";
+    const uint8_t answer[] = {0x01, 0x02, 0x03};
+    const uint8_t newer[] = {0x01, 0x02, 0x04};
+    const uint8_t client[4] = {198, 51, 100, 10};
+    struct cache_scope subnet;
+    uint8_t response[512];
+    size_t response_len = sizeof(response);
+    bool secure = true;
+
+    cache_insert(domain, answer, sizeof(answer), 60);
+    TEST_ASSERT_TRUE(cache_lookup_scoped(domain, NULL, response, &response_len, &secure, NULL));
+    TEST_ASSERT_FALSE(secure);
+
+    // Only the entry holding exactly the validated answer is marked
+    cache_scope_init(&subnet, 1, client, 24);
+    TEST_ASSERT_FALSE(cache_set_secure(domain, &subnet, answer, sizeof(answer)));
+    TEST_ASSERT_FALSE(cache_set_secure(domain, NULL, newer, sizeof(newer)));
+    TEST_ASSERT_TRUE(cache_set_secure(domain, NULL, answer, sizeof(answer)));
+    response_len = sizeof(response);
+    TEST_ASSERT_TRUE(cache_lookup_scoped(domain, NULL, response, &response_len, &secure, NULL));
+    TEST_ASSERT_TRUE(secure);
+
+    // A new answer in the slot starts out unvalidated
+    cache_insert(domain, newer, sizeof(newer), 60);
+    response_len = sizeof(response);
+    TEST_ASSERT_TRUE(cache_lookup_scoped(domain, NULL, response, &response_len, &secure, NULL));
+    TEST_ASSERT_FALSE(secure);
+}
+
+void test_cache_keyed_on_do(void) {
+    const char *domain = "signed.example.com";
+    const uint8_t plain[] = {0x01};
+    const uint8_t with_sigs[] = {0x02};
+    struct cache_scope do_scope;
+    uint8_t response[512];
+    size_t response_len = sizeof(response);
+
+    // Answers to DO queries carry RRSIGs and are kept apart
+    cache_scope_init(&do_scope, 0, NULL, 0);
+    do_scope.dnssec_ok = true;
+    cache_insert(domain, plain, sizeof(plain), 60);
+    TEST_ASSERT_FALSE(cache_lookup_scoped(domain, &do_scope, response, &response_len, NULL, NULL));
+
+    cache_insert_scoped(domain, &do_scope, with_sigs, sizeof(with_sigs), 60);
+    response_len = sizeof(response);
+    TEST_ASSERT_TRUE(cache_lookup_scoped(domain, &do_scope, response, &response_len, NULL, NULL));
+    TEST_ASSERT_EQUAL_UINT8(0x02, response[0]);
+    response_len = sizeof(response);
+    TEST_ASSERT_TRUE(cache_lookup(domain, response, &response_len));
+    TEST_ASSERT_EQUAL_UINT8(0x01, response[0]);
+
+    TEST_ASSERT_FALSE(cache_set_secure(domain, NULL, with_sigs, sizeof(with_sigs)));
+    TEST_ASSERT_TRUE(cache_set_secure(domain, &do_scope, with_sigs, sizeof(with_sigs)));
+}
+
+void test_cache_keyed_on_qtype(void) {
+    const char *domain = "dual.example.com";
+    const uint8_t v4[] = {0x04};
+    const uint8_t v6[] = {0x06};
+    struct cache_scope a_scope, aaaa_scope;
+    uint8_t response[512];
+    size_t response_len;
+
+    // A and AAAA answers for one name live side by side
+    cache_scope_init(&a_scope, 0, NULL, 0);
+    a_scope.qtype = 1;
+    a_scope.qclass = 1;
+    aaaa_scope = a_scope;
+    aaaa_scope.qtype = 28;
+    cache_insert_scoped(domain, &a_scope, v4, sizeof(v4), 60);
+    cache_insert_scoped(domain, &aaaa_scope, v6, sizeof(v6), 60);
+
+    response_len = sizeof(response);
+    TEST_ASSERT_TRUE(cache_lookup_scoped(domain, &a_scope, response, &response_len, NULL, NULL));
+    TEST_ASSERT_EQUAL_UINT8(0x04, response[0]);
+    response_len = sizeof(response);
+    TEST_ASSERT_TRUE(cache_lookup_scoped(domain, &aaaa_scope, response, &response_len, NULL, NULL));
+    TEST_ASSERT_EQUAL_UINT8(0x06, response[0]);
+
+    // Other types and classes miss rather than getting either answer
+    struct cache_scope mx_scope = a_scope;
+    mx_scope.qtype = 15;
+    response_len = sizeof(response);
+    TEST_ASSERT_FALSE(cache_lookup_scoped(domain, &mx_scope, response, &response_len, NULL, NULL));
+    struct cache_scope chaos_scope = a_scope;
+    chaos_scope.qclass = 3;
+    response_len = sizeof(response);
+    TEST_ASSERT_FALSE(cache_lookup_scoped(domain, &chaos_scope, response, &response_len, NULL, NULL));
+    TEST_ASSERT_FALSE(cache_set_secure(domain, &mx_scope, v4, sizeof(v4)));
+    TEST_ASSERT_TRUE(cache_set_secure(domain, &aaaa_scope, v6, sizeof(v6)));
+}
+
+void test_cache_large_response(void) {
+    static uint8_t large[CACHE_MAX_RESPONSE + 1];
+    static uint8_t response[CACHE_MAX_RESPONSE];
+    size_t response_len;
+
+    memset(large, 0xAB, sizeof(large));
+    cache_insert("large.com", large, 1400, 60);
+
+    // Too small a buffer is a miss, not an overflow
+    uint8_t small[512];
+    response_len = sizeof(small);
+    TEST_ASSERT_FALSE(cache_lookup("large.com", small, &response_len));
+
+    response_len = sizeof(response);
+    TEST_ASSERT_TRUE(cache_lookup("large.com", response, &response_len));
+    TEST_ASSERT_EQUAL_UINT(1400, response_len);
+    TEST_ASSERT_EQUAL_UINT8_ARRAY(large, response, 1400);
+
+    // Oversized answers are not cached
+    cache_insert("huge.com", large, CACHE_MAX_RESPONSE + 1, 60);
+    response_len = sizeof(response);
+    TEST_ASSERT_FALSE(cache_lookup("huge.com", response, &response_len));
+}
+
+// One slot behind the admission filter, so every name competes for it
+static void admission_cache(size_t sample) {
+    struct cache_config cfg = test_config;
+    cfg.max_entries = 1;
+    cfg.admission = true;
+    cfg.admission_sample = sample;
+    cache_destroy();
+    cache_init(&cfg);
+}
+
+static void lookup_times(const char *domain, int times) {
+    uint8_t response[512];
+    for (int i = 0; i < times; i++) {
+        size_t response_len = sizeof(response);
+        cache_lookup(domain, response, &response_len);
+    }
+}
+
+void test_cache_admission_keeps_popular(void) {
+    const uint8_t hot_data[] = {0x31};
+    const uint8_t cold_data[] = {0x32};
+    uint8_t response[512];
+    size_t response_len;
+    admission_cache(1000);
+
+    lookup_times("hot.com", 3);
+    cache_insert("hot.com", hot_data, sizeof(hot_data), 60);
+
+    // One-hit wonders never displace it
+    for (int i = 0; i < 100; i++) {
+        char name[32];
+        snprintf(name, sizeof(name), "rnd%d.hot.com", i);
+        lookup_times(name, 1);
+        cache_insert(name, cold_data, sizeof(cold_data), 60);
+    }
+    TEST_ASSERT_EQUAL_UINT(100, cache_get_rejected_count());
+    response_len = sizeof(response);
+    TEST_ASSERT_TRUE(cache_lookup("hot.com", response, &response_len));
+    TEST_ASSERT_EQUAL_UINT8_ARRAY(hot_data, response, sizeof(hot_data));
+
+    // A name asked for more often does
+    lookup_times("warm.com", 6);
+    cache_insert("warm.com", cold_data, sizeof(cold_data), 60);
+    response_len = sizeof(response);
+    TEST_ASSERT_TRUE(cache_lookup("warm.com", response, &response_len));
+    TEST_ASSERT_EQUAL_UINT(100, cache_get_rejected_count());
+}
+
+void test_cache_admission_ages(void) {
+    const uint8_t data[] = {0x41};
+    uint8_t response[512];
+    size_t response_len;
+    admission_cache(16);
+
+    lookup_times("old.com", 5);
+    cache_insert("old.com", data, sizeof(data), 60);
+    lookup_times("new.com", 2);
+    cache_insert("new.com", data, sizeof(data), 60);
+    TEST_ASSERT_EQUAL_UINT(1, cache_get_rejected_count());
+
+    // Once the counts have been halved a few times, old popularity is gone
+    for (int i = 0; i < 64; i++) {
+        char name[32];
+        snprintf(name, sizeof(name), "filler%d.com", i);
+        lookup_times(name, 1);
+    }
+    lookup_times("new.com", 2);
+    cache_insert("new.com", data, sizeof(data), 60);
+    TEST_ASSERT_EQUAL_UINT(1, cache_get_rejected_count());
+    response_len = sizeof(response);
+    TEST_ASSERT_TRUE(cache_lookup("new.com", response, &response_len));
+}
+
 int main(void) {
     UNITY_BEGIN();
     
@@ -119,6 +346,13 @@ int main(void) {
     RUN_TEST(test_cache_expired_entry);
     RUN_TEST(test_cache_cleanup);
     RUN_TEST(test_cache_statistics);
+    RUN_TEST(test_cache_scoped_entries);
+    RUN_TEST(test_cache_set_secure);
+    RUN_TEST(test_cache_keyed_on_do);
+    RUN_TEST(test_cache_keyed_on_qtype);
+    RUN_TEST(test_cache_large_response);
+    RUN_TEST(test_cache_admission_keeps_popular);
+    RUN_TEST(test_cache_admission_ages);
     
     return UNITY_END();
 }
@@ -0,0 +1,135 @@
+#include "../include/checksum.h"
+#include "../include/packet.h"
+#include <unity.h>
+#include <stdlib.h>
+#include <string.h>
+#include <arpa/inet.h>
+
+static const struct packet_endpoint client = {
+    .mac = {0x02, 0x00, 0x00, 0x00, 0x00, 0x02},
+    .ip = 0x0201010A,   // 10.1.1.2
+    .port = 0x3930      // 12345
+};
+
+static const struct packet_endpoint server = {
+    .mac = {0x02, 0x00, 0x00, 0x00, 0x00, 0x01},
+    .ip = 0x0100000A,   // 10.0.0.1
+    .port = 0x3500      // 53
+};
+
+static uint8_t data[70000];
+
+void setUp(void) {
+    srand(1);
+    for (size_t i = 0; i < sizeof(data); i++) {
+        data[i] = rand();
+    }
+}
+
+void tearDown(void) {
+    csum_set_simd(true);
+    packet_set_csum_mode(PACKET_CSUM_SOFTWARE);
+}
+
+void test_checksum_rfc1071_example(void) {
+    // RFC 1071 section 3: the words sum to 0xDDF2
+    static const uint8_t words[] = {0x00, 0x01, 0xF2, 0x03, 0xF4, 0xF5, 0xF6, 0xF7};
+    TEST_ASSERT_EQUAL_HEX16(0x220D, ntohs(csum_fold(csum_partial(words, sizeof(words), 0))));
+    TEST_ASSERT_EQUAL_HEX16(0x220D, ntohs(csum_fold(csum_partial_scalar(words, sizeof(words), 0))));
+
+    // An odd length pads the last byte with zero
+    TEST_ASSERT_EQUAL_HEX16(0x2304, ntohs(csum_fold(csum_partial(words, 7, 0))));
+}
+
+void test_checksum_kernels_agree(void) {
+    // Every length up to a jumbo frame at every alignment, then past the
+    // point where the vector kernel spills its lanes
+    for (size_t offset = 0; offset < 4; offset++) {
+        for (size_t len = 0; len <= 9000; len += len < 300 ? 1 : 37) {
+            uint16_t expect = csum_fold(csum_partial_scalar(data + offset, len, 0));
+            TEST_ASSERT_EQUAL_HEX16(expect, csum_fold(csum_partial(data + offset, len, 0)));
+        }
+    }
+    uint16_t expect = csum_fold(csum_partial_scalar(data + 1, sizeof(data) - 1, 0x1234));
+    TEST_ASSERT_EQUAL_HEX16(expect, csum_fold(csum_partial(data + 1, sizeof(data) - 1, 0x1234)));
+
+    // Worst case for carries: all ones
+    memset(data, 0xFF, sizeof(data));
+    TEST_ASSERT_EQUAL_HEX16(0, csum_fold(csum_partial(data, sizeof(data), 0xFFFFFFFF)));
+
+    // Pieces of even length chain into the same sum
+    csum_set_simd(false);
+    TEST_ASSERT_EQUAL_STRING("scalar", csum_impl_name());
+    uint32_t sum = csum_partial(data, 1000, 0);
+    TEST_ASSERT_EQUAL_HEX16(csum_fold(csum_partial(data, 3001, 0)), csum_fold(csum_partial(data + 1000, 2001, sum)));
+}
+
+void test_checksum_incremental_update(void) {
+    // RFC 1624 updates give the checksum a full recomputation would
+    uint16_t word = 0;
+    for (int i = 0; i < 10000; i++) {
+        size_t len = 20 + rand() % 200;
+        size_t at = (rand() % (len / 2 - 1)) * 2;
+        uint16_t check = csum_fold(csum_partial(data, len, 0));
+
+        memcpy(&word, data + at, 2);
+        uint16_t replaced = rand();
+        memcpy(data + at, &replaced, 2);
+        TEST_ASSERT_EQUAL_HEX16(csum_fold(csum_partial(data, len, 0)), csum_replace16(check, word, replaced));
+
+        uint32_t old, new = rand();
+        check = csum_fold(csum_partial(data, len, 0));
+        memcpy(&old, data + at, 4);
+        memcpy(data + at, &new, 4);
+        TEST_ASSERT_EQUAL_HEX16(csum_fold(csum_partial(data, len, 0)), csum_replace32(check, old, new));
+    }
+}
+
+void test_checksum_udp_frames(void) {
+    uint8_t frame[1024], fresh[1024];
+    struct packet_endpoint to = client;
+    to.ip = 0x6401A8C0;     // 192.168.1.100
+    to.port = 0x1027;
+
+    int len = packet_build_udp(frame, sizeof(frame), &server, &client, data, 300);
+    TEST_ASSERT_TRUE(packet_udp_checksum_ok(frame, len));
+    frame[PACKET_HDR_LEN + 17] ^= 1;
+    TEST_ASSERT_FALSE(packet_udp_checksum_ok(frame, len));
+    frame[PACKET_HDR_LEN + 17] ^= 1;
+
+    // A readdressed copy matches a frame built for the new client
+    uint16_t id = 0xBEEF;
+    packet_rewrite_udp(frame, &server, &to);
+    packet_rewrite_payload16(frame, 0, id);
+    memcpy(data, &id, sizeof(id));
+    TEST_ASSERT_EQUAL_INT(len, packet_build_udp(fresh, sizeof(fresh), &server, &to, data, 300));
+    TEST_ASSERT_EQUAL_MEMORY(fresh, frame, len);
+
+    // Offload leaves the pseudo-header sum for the NIC, payload edits
+    // don't touch it but address changes do
+    packet_set_csum_mode(PACKET_CSUM_OFFLOAD);
+    packet_build_udp(frame, sizeof(frame), &server, &client, data, 300);
+    packet_rewrite_udp(frame, &server, &to);
+    packet_rewrite_payload16(frame, 0, 0x1234);
+    packet_build_udp(fresh, sizeof(fresh), &server, &to, data, 300);
+    TEST_ASSERT_EQUAL_MEMORY(fresh, frame, PACKET_HDR_LEN);
+    uint16_t check, pseudo = ~csum_fold(csum_pseudo_udp(server.ip, to.ip, UDP_HDR_LEN + 300));
+    memcpy(&check, frame + ETH_HDR_LEN + IPV4_HDR_LEN + 6, sizeof(check));
+    TEST_ASSERT_EQUAL_HEX16(pseudo, check);
+
+    // None sends zero, which receivers accept
+    packet_set_csum_mode(PACKET_CSUM_NONE);
+    len = packet_build_udp(frame, sizeof(frame), &server, &client, data, 300);
+    memcpy(&check, frame + ETH_HDR_LEN + IPV4_HDR_LEN + 6, sizeof(check));
+    TEST_ASSERT_EQUAL_HEX16(0, check);
+    TEST_ASSERT_TRUE(packet_udp_checksum_ok(frame, len));
+}
+
+int main(void) {
+    UNITY_BEGIN();
+    RUN_TEST(test_checksum_rfc1071_example);
+    RUN_TEST(test_checksum_kernels_agree);
+    RUN_TEST(test_checksum_incremental_update);
+    RUN_TEST(test_checksum_udp_frames);
+    return UNITY_END();
+}
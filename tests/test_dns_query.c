@@ -101,6 +101,220 @@ void test_invalid_response(void) {
     TEST_ASSERT_NOT_EQUAL(0, result);
 }
 
+void test_edns_round_trip(void) {
+    struct dns_query query;
+    struct dns_edns edns;
+    uint8_t buffer[512];
+    size_t buffer_len = sizeof(buffer);
+    const uint8_t client[4] = {192, 0, 2, 77};
+
+    // Default OPT plus a /20 client subnet
+    init_query(&query, "example.com", AAAA);
+    dns_ecs_init(&query.edns.ecs, DNS_ECS_FAMILY_IPV4, client, 20);
+    query.edns.has_ecs = true;
+    TEST_ASSERT_EQUAL_INT(0, construct_query(&query, buffer, &buffer_len));
+
+    struct dns_header *header = (struct dns_header *)buffer;
+    TEST_ASSERT_EQUAL_INT(1, ntohs(header->arcount));
+    TEST_ASSERT_EQUAL_INT(sizeof(struct dns_header) + 13 + 4 + DNS_OPT_RR_LEN + 11, buffer_len);
+
+    TEST_ASSERT_EQUAL_INT(0, dns_parse_edns(buffer, buffer_len, &edns));
+    TEST_ASSERT_TRUE(edns.present);
+    TEST_ASSERT_EQUAL_INT(DNS_EDNS_BUFFER_SIZE, edns.udp_size);
+    TEST_ASSERT_TRUE(edns.has_ecs);
+    TEST_ASSERT_EQUAL_INT(DNS_ECS_FAMILY_IPV4, edns.ecs.family);
+    TEST_ASSERT_EQUAL_INT(20, edns.ecs.source_prefix);
+    TEST_ASSERT_EQUAL_INT(192, edns.ecs.address[0]);
+    TEST_ASSERT_EQUAL_INT(0, edns.ecs.address[2]);  // Masked past /20
+
+    // Without EDNS the message is plain RFC 1035
+    init_query(&query, "example.com", A);
+    query.edns.present = false;
+    buffer_len = sizeof(buffer);
+    TEST_ASSERT_EQUAL_INT(0, construct_query(&query, buffer, &buffer_len));
+    TEST_ASSERT_EQUAL_INT(0, dns_parse_edns(buffer, buffer_len, &edns));
+    TEST_ASSERT_FALSE(edns.present);
+}
+
+void test_edns_malformed(void) {
+    struct dns_query query;
+    struct dns_edns edns;
+    uint8_t buffer[512];
+    size_t buffer_len = sizeof(buffer);
+
+    init_query(&query, "example.com", A);
+    TEST_ASSERT_EQUAL_INT(0, construct_query(&query, buffer, &buffer_len));
+
+    // OPT cut short
+    TEST_ASSERT_NOT_EQUAL(0, dns_parse_edns(buffer, buffer_len - 1, &edns));
+
+    // Option length running past RDATA
+    buffer[buffer_len - 1] = 4;
+    buffer[buffer_len] = 0;
+    buffer[buffer_len + 1] = DNS_EDNS_OPT_ECS;
+    buffer[buffer_len + 2] = 0;
+    buffer[buffer_len + 3] = 9;
+    TEST_ASSERT_NOT_EQUAL(0, dns_parse_edns(buffer, buffer_len + 4, &edns));
+}
+
+void test_truncate(void) {
+    struct dns_query query;
+    uint8_t buffer[512];
+    size_t buffer_len = sizeof(buffer);
+
+    init_query(&query, "example.com", A);
+    TEST_ASSERT_EQUAL_INT(0, construct_query(&query, buffer, &buffer_len));
+
+    // Header and question survive, TC is set and the counts cleared
+    TEST_ASSERT_EQUAL_INT(0, dns_truncate(buffer, &buffer_len));
+    TEST_ASSERT_EQUAL_INT(sizeof(struct dns_header) + 13 + 4, buffer_len);
+    struct dns_header *header = (struct dns_header *)buffer;
+    TEST_ASSERT_TRUE(ntohs(header->flags) & 0x0200);
+    TEST_ASSERT_EQUAL_INT(1, ntohs(header->qdcount));
+    TEST_ASSERT_EQUAL_INT(0, ntohs(header->arcount));
+}
+
+void test_construct_batch(void) {
+    static const char *names[] = {"example.com", "www.example.org.", "bad..name", "a.b"};
+    struct dns_batch_query batch[4];
+    uint8_t frames[4][512];
+    uint8_t *buffers[4];
+    uint16_t lengths[4];
+
+    for (int i = 0; i < 4; i++) {
+        batch[i].name = names[i];
+        batch[i].name_len = strlen(names[i]);
+        batch[i].qtype = i == 3 ? MX : A;
+        batch[i].id = 0x1000 + i;
+        buffers[i] = frames[i];
+    }
+
+    // The malformed name is skipped, the rest are built
+    TEST_ASSERT_EQUAL_INT(3, dns_construct_batch(batch, 4, DNS_EDNS_BUFFER_SIZE, buffers, 512, lengths));
+    TEST_ASSERT_EQUAL_INT(0, lengths[2]);
+
+    // Byte-identical to the single-message path
+    struct dns_query query;
+    uint8_t expected[512];
+    size_t expected_len = sizeof(expected);
+    init_query(&query, "example.com", A);
+    query.header.id = htons(0x1000);
+    TEST_ASSERT_EQUAL_INT(0, construct_query(&query, expected, &expected_len));
+    TEST_ASSERT_EQUAL_INT(expected_len, lengths[0]);
+    TEST_ASSERT_EQUAL_UINT8_ARRAY(expected, frames[0], expected_len);
+
+    // Trailing dot dropped
+    TEST_ASSERT_EQUAL_INT(lengths[0] + 4, lengths[1]);
+}
+
+void test_parse_batch(void) {
+    struct dns_query query;
+    uint8_t good[512], refused[512], short_msg[8] = {0};
+    uint8_t bad_name[sizeof(struct dns_header) + 2] = {0, 1, 0x81, 0x80, 0, 1, 0, 0, 0, 0, 0, 0, 0x3F, 'a'};
+    size_t good_len = sizeof(good), refused_len = sizeof(refused);
+
+    init_query(&query, "example.com", A);
+    query.header.id = htons(7);
+    construct_query(&query, good, &good_len);
+    good[2] = 0x81;
+    good[3] = 0x80;
+    good[7] = 2;                    // ANCOUNT
+    memcpy(refused, good, good_len);
+    refused_len = good_len;
+    refused[3] = 0x85;              // REFUSED
+
+    const uint8_t *msgs[] = {good, short_msg, refused, bad_name};
+    const uint16_t lens[] = {good_len, sizeof(short_msg), refused_len, sizeof(bad_name)};
+    struct dns_batch_result result;
+    TEST_ASSERT_EQUAL_INT(0, dns_parse_batch(msgs, lens, 4, &result));
+
+    TEST_ASSERT_EQUAL_INT(4, result.count);
+    TEST_ASSERT_EQUAL_UINT64(0x5, result.valid);
+    TEST_ASSERT_EQUAL_INT(7, result.id[0]);
+    TEST_ASSERT_EQUAL_INT(0, result.rcode[0]);
+    TEST_ASSERT_EQUAL_INT(2, result.ancount[0]);
+    TEST_ASSERT_EQUAL_INT(sizeof(struct dns_header) + 13 + 4, result.answer_offset[0]);
+    TEST_ASSERT_EQUAL_INT(5, result.rcode[2]);
+    TEST_ASSERT_EQUAL_INT(0, result.answer_offset[3]);
+
+    // More than one mask's worth is refused
+    TEST_ASSERT_NOT_EQUAL(0, dns_parse_batch(msgs, lens, DNS_BATCH_MAX + 1, &result));
+}
+
+void test_answer_ttl(void) {
+    struct dns_query query;
+    uint8_t msg[512];
+    size_t len = sizeof(msg);
+    uint32_t ttl;
+
+    init_query(&query, "example.com", A);
+    query.edns.present = false;
+    TEST_ASSERT_EQUAL_INT(0, construct_query(&query, msg, &len));
+
+    // No records and no SOA: nothing to cache by
+    TEST_ASSERT_NOT_EQUAL(0, dns_answer_ttl(msg, len, &ttl));
+
+    // Two A records, the shorter TTL wins
+    static const uint8_t answers[] = {
+        0xC0, 0x0C, 0, 1, 0, 1, 0, 0, 0x0E, 0x10, 0, 4, 192, 0, 2, 1,    // 3600
+        0xC0, 0x0C, 0, 1, 0, 1, 0, 0, 0x01, 0x2C, 0, 4, 192, 0, 2, 2,    // 300
+    };
+    memcpy(msg + len, answers, sizeof(answers));
+    msg[7] = 2;
+    TEST_ASSERT_EQUAL_INT(0, dns_answer_ttl(msg, len + sizeof(answers), &ttl));
+    TEST_ASSERT_EQUAL_UINT32(300, ttl);
+
+    // NXDOMAIN with an SOA: its TTL capped by MINIMUM
+    static const uint8_t soa[] = {
+        0xC0, 0x0C, 0, 6, 0, 1, 0, 0, 0x0E, 0x10, 0, 22,
+        0, 0,                                   // MNAME, RNAME (root)
+        0, 0, 0, 1, 0, 0, 0, 1, 0, 0, 0, 1, 0, 0, 0, 1,
+        0, 0, 0, 60,                            // MINIMUM
+    };
+    memcpy(msg + len, soa, sizeof(soa));
+    msg[3] = 0x83;
+    msg[7] = 0;
+    msg[9] = 1;
+    TEST_ASSERT_EQUAL_INT(0, dns_answer_ttl(msg, len + sizeof(soa), &ttl));
+    TEST_ASSERT_EQUAL_UINT32(60, ttl);
+
+    // Truncated record
+    TEST_ASSERT_NOT_EQUAL(0, dns_answer_ttl(msg, len + sizeof(soa) - 1, &ttl));
+}
+
+void test_age_ttls(void) {
+    struct dns_query query;
+    uint8_t msg[512];
+    size_t len = sizeof(msg);
+
+    init_query(&query, "example.com", A);
+    query.edns.present = false;
+    TEST_ASSERT_EQUAL_INT(0, construct_query(&query, msg, &len));
+
+    // An answer, a record with the top bit set and the OPT record
+    static const uint8_t records[] = {
+        0xC0, 0x0C, 0, 1, 0, 1, 0, 0, 0x01, 0x2C, 0, 4, 192, 0, 2, 1,    // 300
+        0xC0, 0x0C, 0, 1, 0, 1, 0x80, 0, 0, 0, 0, 4, 192, 0, 2, 2,       // Counts as 0
+        0, 0, 41, 0x04, 0xD0, 0, 0, 0x80, 0, 0, 0,                        // DO
+    };
+    memcpy(msg + len, records, sizeof(records));
+    msg[7] = 2;
+    msg[11] = 1;
+    TEST_ASSERT_EQUAL_INT(0, dns_age_ttls(msg, len + sizeof(records), 100));
+
+    const uint8_t *rr = msg + len;
+    TEST_ASSERT_EQUAL_UINT8_ARRAY(((const uint8_t[]){0, 0, 0, 200}), rr + 6, 4);
+    TEST_ASSERT_EQUAL_UINT8_ARRAY(((const uint8_t[]){0, 0, 0, 0}), rr + 16 + 6, 4);
+    TEST_ASSERT_EQUAL_UINT8_ARRAY(((const uint8_t[]){0, 0, 0x80, 0}), rr + 32 + 5, 4);
+
+    // Never below zero
+    TEST_ASSERT_EQUAL_INT(0, dns_age_ttls(msg, len + sizeof(records), 1000));
+    TEST_ASSERT_EQUAL_UINT8_ARRAY(((const uint8_t[]){0, 0, 0, 0}), rr + 6, 4);
+
+    // Truncated record
+    TEST_ASSERT_NOT_EQUAL(0, dns_age_ttls(msg, len + sizeof(records) - 1, 1));
+}
+
 int main(void) {
     UNITY_BEGIN();
     
@@ -108,6 +322,13 @@ int main(void) {
     RUN_TEST(test_construct_query);
     RUN_TEST(test_parse_response);
     RUN_TEST(test_invalid_response);
+    RUN_TEST(test_edns_round_trip);
+    RUN_TEST(test_edns_malformed);
+    RUN_TEST(test_truncate);
+    RUN_TEST(test_construct_batch);
+    RUN_TEST(test_parse_batch);
+    RUN_TEST(test_answer_ttl);
+    RUN_TEST(test_age_ttls);
     
     return UNITY_END();
 }
@@ -0,0 +1,368 @@
+#include "../include/forward.h"
+#include "../include/pipeline.h"
+#include "../include/resolvers.h"
+#include "../include/io_backend.h"
+#include "../include/cache.h"
+#include "../include/dns_query.h"
+#include "../include/validator.h"
+#include <unity.h>
+#include <string.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+
+// Test fixtures
+static const struct packet_endpoint server = {
+    .mac = {0x02, 0x00, 0x00, 0x00, 0x00, 0x02},
+    .ip = 0x0201010A,   // 10.1.1.2
+    .port = 0x3500      // 53
+};
+
+static const struct packet_endpoint client = {
+    .mac = {0x02, 0x00, 0x00, 0x00, 0x00, 0x09},
+    .ip = 0x0901010A,   // 10.1.1.9
+    .port = 0xE914      // 5353
+};
+
+static const uint32_t resolver_ip = 0x0100000A;     // 10.0.0.1
+static struct io_backend io;
+
+void setUp(void) {
+    struct mem_backend_config mem_cfg = {0};
+    struct cache_config cache_cfg = {
+        .max_entries = 64,
+        .default_ttl = 60,
+        .cleanup_interval = 60
+    };
+    TEST_ASSERT_EQUAL_INT(0, io_backend_mem_init(&io, &mem_cfg));
+    TEST_ASSERT_EQUAL_INT(0, resolvers_add(resolver_ip, htons(53), "test"));
+    cache_init(&cache_cfg);
+    pipeline_init(&io);
+}
+
+void tearDown(void) {
+    forward_destroy();
+    validator_destroy();
+    resolvers_destroy();
+    cache_destroy();
+    io_backend_cleanup(&io);
+}
+
+static void start_forward(uint32_t timeout_ms, uint32_t retries) {
+    struct forward_config cfg = {
+        .timeout_ms = timeout_ms,
+        .retries = retries,
+        .src = server
+    };
+    cfg.src.port = htons(FORWARD_SRC_PORT);
+    TEST_ASSERT_EQUAL_INT(0, forward_init(&cfg, &io));
+}
+
+// A query for example.com from the given client arriving at the server
+static void query_with(const struct packet_endpoint *from, uint16_t id, bool dnssec_ok) {
+    struct dns_query query;
+    uint8_t msg[512];
+    size_t msg_len = sizeof(msg);
+    init_query(&query, "example.com", A);
+    query.header.id = htons(id);
+    query.edns.dnssec_ok = dnssec_ok;
+    TEST_ASSERT_EQUAL_INT(0, construct_query(&query, msg, &msg_len));
+
+    uint8_t frame[1024];
+    int len = packet_build_udp(frame, sizeof(frame), from, &server, msg, msg_len);
+    TEST_ASSERT_GREATER_THAN(0, len);
+    pipeline_process_packet(frame, len);
+}
+
+static void query_from(const struct packet_endpoint *from, uint16_t id) {
+    query_with(from, id, false);
+}
+
+static void client_query(uint16_t id) {
+    query_from(&client, id);
+}
+
+// Answer the upstream query in TX slot index with one A record, AD set
+// when ad
+static void resolver_answer_flags(size_t index, uint32_t from_ip, bool ad) {
+    size_t len;
+    const uint8_t *frame = io_backend_mem_tx_frame(&io, index, &len);
+    TEST_ASSERT_NOT_NULL(frame);
+
+    struct packet_info query;
+    TEST_ASSERT_EQUAL_INT(0, packet_parse(frame, len, &query));
+    TEST_ASSERT_EQUAL_UINT32(resolver_ip, query.dst.ip);
+
+    // Question only, then the answer
+    static const uint8_t record[] = {0xC0, 0x0C, 0, 1, 0, 1, 0, 0, 0x01, 0x2C, 0, 4, 192, 0, 2, 1};
+    uint8_t msg[512];
+    int end = dns_question_end(query.payload, query.payload_len);
+    TEST_ASSERT_GREATER_THAN(0, end);
+    memcpy(msg, query.payload, end);
+    memcpy(msg + end, record, sizeof(record));
+    msg[2] = 0x81;
+    msg[3] = ad ? 0xA0 : 0x80;
+    msg[7] = 1;
+    msg[11] = 0;
+
+    struct packet_endpoint from = query.dst;
+    from.ip = from_ip;
+    uint8_t reply[1024];
+    int reply_len = packet_build_udp(reply, sizeof(reply), &from, &query.src, msg, end + sizeof(record));
+    TEST_ASSERT_GREATER_THAN(0, reply_len);
+    pipeline_process_packet(reply, reply_len);
+}
+
+static void resolver_answer(size_t index, uint32_t from_ip) {
+    resolver_answer_flags(index, from_ip, false);
+}
+
+// Parsed DNS header of TX frame index, which must be addressed to the client
+static void client_reply(size_t index, struct dns_header *header) {
+    size_t len;
+    const uint8_t *frame = io_backend_mem_tx_frame(&io, index, &len);
+    TEST_ASSERT_NOT_NULL(frame);
+
+    struct packet_info info;
+    TEST_ASSERT_EQUAL_INT(0, packet_parse(frame, len, &info));
+    TEST_ASSERT_EQUAL_UINT32(client.ip, info.dst.ip);
+    TEST_ASSERT_EQUAL_UINT16(client.port, info.dst.port);
+    TEST_ASSERT_EQUAL_UINT32(server.ip, info.src.ip);
+    TEST_ASSERT_TRUE(packet_udp_checksum_ok(frame, len));
+
+    memcpy(header, info.payload, sizeof(*header));
+}
+
+// TTL of the first answer record in TX frame index
+static uint32_t reply_ttl(size_t index) {
+    size_t len;
+    const uint8_t *frame = io_backend_mem_tx_frame(&io, index, &len);
+    struct packet_info info;
+    if (!frame || packet_parse(frame, len, &info) != 0) {
+        return UINT32_MAX;
+    }
+    int offset = dns_question_end(info.payload, info.payload_len);
+    offset = offset < 0 ? -1 : dns_skip_name(info.payload, info.payload_len, offset);
+    if (offset < 0 || (size_t)offset + 10 > info.payload_len) {
+        return UINT32_MAX;
+    }
+    const uint8_t *ttl = info.payload + offset + 4;
+    return (uint32_t)ttl[0] << 24 | (uint32_t)ttl[1] << 16 | (uint32_t)ttl[2] << 8 | ttl[3];
+}
+
+void test_forward_resolves_and_caches(void) {
+    start_forward(1000, 1);
+
+    // Miss goes upstream with our own ID
+    client_query(0x1234);
+    TEST_ASSERT_EQUAL_UINT(1, io_backend_mem_tx_count(&io));
+    TEST_ASSERT_EQUAL_UINT(1, forward_pending());
+
+    // The answer reaches the client under its ID
+    resolver_answer(0, resolver_ip);
+    TEST_ASSERT_EQUAL_UINT(2, io_backend_mem_tx_count(&io));
+    TEST_ASSERT_EQUAL_UINT(0, forward_pending());
+    struct dns_header header;
+    client_reply(1, &header);
+    TEST_ASSERT_EQUAL_HEX16(0x1234, ntohs(header.id));
+    TEST_ASSERT_EQUAL_INT(1, ntohs(header.ancount));
+
+    // Second query is served from the cache without going upstream
+    client_query(0x5678);
+    TEST_ASSERT_EQUAL_UINT(3, io_backend_mem_tx_count(&io));
+    client_reply(2, &header);
+    TEST_ASSERT_EQUAL_HEX16(0x5678, ntohs(header.id));
+    TEST_ASSERT_EQUAL_INT(1, ntohs(header.ancount));
+
+    struct pipeline_stats stats;
+    pipeline_get_stats(&stats);
+    TEST_ASSERT_EQUAL_UINT64(1, stats.cache_hits);
+    TEST_ASSERT_EQUAL_UINT64(1, stats.cache_misses);
+    TEST_ASSERT_EQUAL_UINT64(1, stats.relayed);
+}
+
+void test_forward_rejects_spoofed(void) {
+    start_forward(1000, 1);
+    client_query(0x1234);
+
+    // Wrong source is ignored and the query stays outstanding
+    resolver_answer(0, resolver_ip + 1);
+    TEST_ASSERT_EQUAL_UINT(1, io_backend_mem_tx_count(&io));
+    TEST_ASSERT_EQUAL_UINT(1, forward_pending());
+
+    // A duplicate after the real answer is ignored too
+    resolver_answer(0, resolver_ip);
+    resolver_answer(0, resolver_ip);
+    TEST_ASSERT_EQUAL_UINT(2, io_backend_mem_tx_count(&io));
+
+    struct forward_stats stats;
+    forward_get_stats(&stats);
+    TEST_ASSERT_EQUAL_UINT64(1, stats.answers);
+    TEST_ASSERT_EQUAL_UINT64(2, stats.unmatched);
+}
+
+void test_forward_coalesces_misses(void) {
+    struct packet_endpoint other = client;
+    other.ip = 0x0A01010A;  // 10.1.1.10
+    start_forward(1000, 1);
+
+    // Three misses for one name, one upstream query
+    client_query(0x1111);
+    client_query(0x2222);
+    query_from(&other, 0x3333);
+    TEST_ASSERT_EQUAL_UINT(1, io_backend_mem_tx_count(&io));
+    TEST_ASSERT_EQUAL_UINT(1, forward_pending());
+
+    // One answer fans out to all three under their own IDs
+    resolver_answer(0, resolver_ip);
+    TEST_ASSERT_EQUAL_UINT(4, io_backend_mem_tx_count(&io));
+    struct dns_header header;
+    client_reply(1, &header);
+    TEST_ASSERT_EQUAL_HEX16(0x1111, ntohs(header.id));
+    client_reply(2, &header);
+    TEST_ASSERT_EQUAL_HEX16(0x2222, ntohs(header.id));
+
+    size_t len;
+    struct packet_info info;
+    const uint8_t *frame = io_backend_mem_tx_frame(&io, 3, &len);
+    TEST_ASSERT_EQUAL_INT(0, packet_parse(frame, len, &info));
+    TEST_ASSERT_EQUAL_UINT32(other.ip, info.dst.ip);
+    TEST_ASSERT_TRUE(packet_udp_checksum_ok(frame, len));
+    memcpy(&header, info.payload, sizeof(header));
+    TEST_ASSERT_EQUAL_HEX16(0x3333, ntohs(header.id));
+
+    struct forward_stats stats;
+    forward_get_stats(&stats);
+    TEST_ASSERT_EQUAL_UINT64(1, stats.forwarded);
+    TEST_ASSERT_EQUAL_UINT64(2, stats.coalesced);
+    TEST_ASSERT_EQUAL_UINT64(3, stats.fanout_max);
+    TEST_ASSERT_EQUAL_UINT(0, forward_pending());
+
+    // The key is free again once answered
+    cache_destroy();
+    struct cache_config cache_cfg = {.max_entries = 64, .default_ttl = 60, .cleanup_interval = 60};
+    cache_init(&cache_cfg);
+    client_query(0x4444);
+    TEST_ASSERT_EQUAL_UINT(5, io_backend_mem_tx_count(&io));
+    TEST_ASSERT_EQUAL_UINT(1, forward_pending());
+}
+
+void test_forward_timeout_servfail(void) {
+    start_forward(1, 1);
+    client_query(0x1234);
+
+    // First timeout resends, the second answers SERVFAIL
+    usleep(5000);
+    forward_tick();
+    TEST_ASSERT_EQUAL_UINT(2, io_backend_mem_tx_count(&io));
+    usleep(5000);
+    forward_tick();
+    TEST_ASSERT_EQUAL_UINT(3, io_backend_mem_tx_count(&io));
+    TEST_ASSERT_EQUAL_UINT(0, forward_pending());
+
+    struct dns_header header;
+    client_reply(2, &header);
+    TEST_ASSERT_EQUAL_HEX16(0x1234, ntohs(header.id));
+    TEST_ASSERT_EQUAL_HEX16(0x8182, ntohs(header.flags));
+    TEST_ASSERT_EQUAL_INT(1, ntohs(header.qdcount));
+
+    struct forward_stats stats;
+    forward_get_stats(&stats);
+    TEST_ASSERT_EQUAL_UINT64(1, stats.retransmits);
+    TEST_ASSERT_EQUAL_UINT64(1, stats.timeouts);
+}
+
+void test_forward_timers_never_run_out(void) {
+    struct forward_config cfg = {.timeout_ms = 1, .retries = 1, .max_pending = 2, .src = server};
+    cfg.src.port = htons(FORWARD_SRC_PORT);
+    TEST_ASSERT_EQUAL_INT(0, forward_init(&cfg, &io));
+
+    // Answered queries leave their timers behind, uncached ones many times
+    // over the slot count
+    cache_destroy();
+    for (size_t i = 0; i < 10; i++) {
+        client_query(0x1000 + i);
+        resolver_answer(2 * i, resolver_ip);
+    }
+    TEST_ASSERT_EQUAL_UINT(0, forward_pending());
+
+    // A query after them still gets its retransmit and its SERVFAIL
+    client_query(0x1234);
+    usleep(5000);
+    forward_tick();
+    TEST_ASSERT_EQUAL_UINT(22, io_backend_mem_tx_count(&io));
+    usleep(5000);
+    forward_tick();
+    TEST_ASSERT_EQUAL_UINT(23, io_backend_mem_tx_count(&io));
+    TEST_ASSERT_EQUAL_UINT(0, forward_pending());
+}
+
+void test_forward_cache_hits_age_ttls(void) {
+    start_forward(1000, 1);
+    client_query(0x1234);
+    resolver_answer(0, resolver_ip);
+    TEST_ASSERT_EQUAL_UINT32(300, reply_ttl(1));
+
+    // A hit tells the client how long the answer has left, not how long
+    // it had when it was cached
+    sleep(2);
+    client_query(0x5678);
+    TEST_ASSERT_EQUAL_UINT(3, io_backend_mem_tx_count(&io));
+    uint32_t ttl = reply_ttl(2);
+    TEST_ASSERT_TRUE(ttl >= 297 && ttl <= 298);
+}
+
+void test_forward_cache_keyed_on_do(void) {
+    start_forward(1000, 1);
+    client_query(0x1234);
+    resolver_answer(0, resolver_ip);
+
+    // The answer without RRSIGs is no answer for a DO client
+    query_with(&client, 0x2222, true);
+    TEST_ASSERT_EQUAL_UINT(3, io_backend_mem_tx_count(&io));
+    TEST_ASSERT_EQUAL_UINT(1, forward_pending());
+    resolver_answer(2, resolver_ip);
+    TEST_ASSERT_EQUAL_UINT(0, forward_pending());
+
+    // Each kind of client now hits its own entry
+    client_query(0x3333);
+    query_with(&client, 0x4444, true);
+    TEST_ASSERT_EQUAL_UINT(6, io_backend_mem_tx_count(&io));
+    struct pipeline_stats stats;
+    pipeline_get_stats(&stats);
+    TEST_ASSERT_EQUAL_UINT64(2, stats.cache_hits);
+    TEST_ASSERT_EQUAL_UINT64(2, stats.cache_misses);
+}
+
+void test_forward_clears_unvalidated_ad(void) {
+    struct validator_config validator_cfg = {.workers = 1};
+    TEST_ASSERT_EQUAL_INT(0, validator_init(&validator_cfg));
+    start_forward(1000, 1);
+
+    // The resolver's AD is not ours to pass on, relayed or from the cache
+    struct dns_header header;
+    query_with(&client, 0x1234, true);
+    resolver_answer_flags(0, resolver_ip, true);
+    client_reply(1, &header);
+    TEST_ASSERT_EQUAL_INT(0, ntohs(header.flags) & 0x20);
+    query_with(&client, 0x5678, true);
+    client_reply(2, &header);
+    TEST_ASSERT_EQUAL_INT(0, ntohs(header.flags) & 0x20);
+
+    struct pipeline_stats stats;
+    pipeline_get_stats(&stats);
+    TEST_ASSERT_EQUAL_UINT64(1, stats.validations);
+    TEST_ASSERT_EQUAL_UINT64(0, stats.secure_hits);
+}
+
+int main(void) {
+    UNITY_BEGIN();
+    RUN_TEST(test_forward_resolves_and_caches);
+    RUN_TEST(test_forward_rejects_spoofed);
+    RUN_TEST(test_forward_coalesces_misses);
+    RUN_TEST(test_forward_timeout_servfail);
+    RUN_TEST(test_forward_timers_never_run_out);
+    RUN_TEST(test_forward_cache_hits_age_ttls);
+    RUN_TEST(test_forward_cache_keyed_on_do);
+    RUN_TEST(test_forward_clears_unvalidated_ad);
+    return UNITY_END();
+}
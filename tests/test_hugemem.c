@@ -0,0 +1,98 @@
+#include "../include/hugemem.h"
+#include <unity.h>
+#include <string.h>
+
+#define MB (1UL << 20)
+
+static const struct hugemem_region *find_region(void *addr) {
+    const struct hugemem_region *regions;
+    size_t count = hugemem_regions(&regions);
+    for (size_t i = 0; i < count; i++) {
+        if (regions[i].addr == addr) {
+            return &regions[i];
+        }
+    }
+    return NULL;
+}
+
+static void use_pages(enum hugemem_pages pages, bool lock) {
+    struct hugemem_config cfg = {.numa_node = -1, .pages = pages, .lock = lock};
+    TEST_ASSERT_EQUAL_INT(0, hugemem_init(&cfg));
+}
+
+void setUp(void) {
+    use_pages(HUGEMEM_PAGES_4K, false);
+}
+
+void tearDown(void) {
+}
+
+void test_hugemem_tracks_regions(void) {
+    uint8_t *a = hugemem_alloc("first", 100);
+    uint8_t *b = hugemem_alloc("second", 5000);
+    TEST_ASSERT_NOT_NULL(a);
+    TEST_ASSERT_NOT_NULL(b);
+
+    // Zeroed like calloc, rounded up to whole pages
+    TEST_ASSERT_EQUAL_INT(0, a[99]);
+    memset(b, 0xAB, 5000);
+    const struct hugemem_region *region = find_region(b);
+    TEST_ASSERT_NOT_NULL(region);
+    TEST_ASSERT_EQUAL_STRING("second", region->name);
+    TEST_ASSERT_TRUE(region->size >= 5000);
+    TEST_ASSERT_EQUAL_UINT(0, region->size % region->page_size);
+
+    const struct hugemem_region *regions;
+    TEST_ASSERT_EQUAL_UINT(2, hugemem_regions(&regions));
+    hugemem_free(a);
+    TEST_ASSERT_NULL(find_region(a));
+    TEST_ASSERT_NOT_NULL(find_region(b));
+    hugemem_free(b);
+    TEST_ASSERT_EQUAL_UINT(0, hugemem_regions(&regions));
+}
+
+void test_hugemem_reports_page_size(void) {
+    // Small regions never take a huge page
+    use_pages(HUGEMEM_PAGES_AUTO, true);
+    void *small = hugemem_alloc("small", 64 * 1024);
+    TEST_ASSERT_NOT_NULL(small);
+    TEST_ASSERT_TRUE(find_region(small)->page_size < 2 * MB);
+    hugemem_free(small);
+
+    // Auto takes 2M pages when the pool has them and reports what it got
+    void *big = hugemem_alloc("big", 4 * MB);
+    TEST_ASSERT_NOT_NULL(big);
+    size_t page_size = find_region(big)->page_size;
+    TEST_ASSERT_EQUAL_STRING(page_size == 2 * MB ? "2M" : "4K", hugemem_page_name(page_size));
+    ((volatile uint8_t *)big)[4 * MB - 1] = 1;
+    hugemem_free(big);
+
+    // When auto had to fall back, asking for 2M explicitly fails
+    if (page_size < 2 * MB) {
+        use_pages(HUGEMEM_PAGES_2M, false);
+        TEST_ASSERT_NULL(hugemem_alloc("explicit", 4 * MB));
+        const struct hugemem_region *regions;
+        TEST_ASSERT_EQUAL_UINT(0, hugemem_regions(&regions));
+    }
+}
+
+void test_hugemem_helpers(void) {
+    enum hugemem_pages pages;
+    TEST_ASSERT_EQUAL_INT(0, hugemem_pages_parse("1G", &pages));
+    TEST_ASSERT_EQUAL_INT(HUGEMEM_PAGES_1G, pages);
+    TEST_ASSERT_EQUAL_INT(0, hugemem_pages_parse("off", &pages));
+    TEST_ASSERT_EQUAL_INT(HUGEMEM_PAGES_4K, pages);
+    TEST_ASSERT_EQUAL_INT(-1, hugemem_pages_parse("3m", &pages));
+
+    // Loopback has no device, so no node
+    TEST_ASSERT_EQUAL_INT(-1, hugemem_nic_node("lo"));
+    TEST_ASSERT_EQUAL_INT(-1, hugemem_nic_node("no-such-if0"));
+}
+
+int main(void) {
+    UNITY_BEGIN();
+    RUN_TEST(test_hugemem_tracks_regions);
+    RUN_TEST(test_hugemem_reports_page_size);
+    RUN_TEST(test_hugemem_helpers);
+    return UNITY_END();
+}
@@ -0,0 +1,161 @@
+#include "../include/log.h"
+#include <unity.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+
+static char path[64];
+static char contents[1 << 20];
+
+static void start(enum log_format format, bool timestamps, unsigned int burst) {
+    strcpy(path, "/tmp/test_log_XXXXXX");
+    int fd = mkstemp(path);
+    TEST_ASSERT_TRUE(fd >= 0);
+    close(fd);
+    struct log_config cfg = {
+        .level = LOG_LEVEL_INFO,
+        .file = path,
+        .format = format,
+        .timestamps = timestamps,
+        .rate_burst = burst
+    };
+    TEST_ASSERT_EQUAL_INT(0, log_init(&cfg));
+}
+
+// Stop the logger and return what it wrote
+static const char *finish(void) {
+    log_destroy();
+    FILE *fp = fopen(path, "r");
+    size_t len = fp ? fread(contents, 1, sizeof(contents) - 1, fp) : 0;
+    contents[len] = '\0';
+    if (fp) {
+        fclose(fp);
+    }
+    unlink(path);
+    return contents;
+}
+
+static size_t count_lines(const char *text) {
+    size_t lines = 0;
+    for (; *text; text++) {
+        lines += *text == '\n';
+    }
+    return lines;
+}
+
+void setUp(void) {
+}
+
+void tearDown(void) {
+    log_destroy();
+}
+
+void test_log_text_lines(void) {
+    start(LOG_FORMAT_TEXT, false, 0);
+    log_info("Cleaned %zu expired cache entries", (size_t)42);
+    log_debug("below the level, never queued %d", 1);
+    log_warn("%s: %d%% of %lu, %.2f, %x", "upstream", -5, 1000UL, 0.5, 255);
+    log_error("no arguments");
+
+    // Written once the writer gets to it, not before the flush returns
+    log_flush();
+    struct log_stats stats;
+    log_get_stats(&stats);
+    TEST_ASSERT_EQUAL_UINT(3, stats.records);
+    TEST_ASSERT_EQUAL_UINT(3, stats.lines);
+    TEST_ASSERT_EQUAL_UINT(0, stats.dropped);
+
+    TEST_ASSERT_EQUAL_STRING("INFO  Cleaned 42 expired cache entries\n"
+                             "WARN  upstream: -5% of 1000, 0.50, ff\n"
+                             "ERROR no arguments\n", finish());
+}
+
+void test_log_json_lines(void) {
+    start(LOG_FORMAT_JSON, true, 0);
+    log_info("zone %s loaded, %u names", "\"example\\com\"\n", 7u);
+    const char *text = finish();
+
+    TEST_ASSERT_EQUAL_INT(0, strncmp(text, "{\"time\":\"20", 11));
+    TEST_ASSERT_NOT_NULL(strstr(text, "Z\",\"level\":\"info\","
+                                      "\"msg\":\"zone \\\"example\\\\com\\\"\\u000a loaded, 7 names\"}\n"));
+    TEST_ASSERT_EQUAL_UINT(1, count_lines(text));
+}
+
+void test_log_rate_limit(void) {
+    // One call site over its budget, another still under it
+    start(LOG_FORMAT_TEXT, false, 5);
+    for (int i = 0; i < 100; i++) {
+        log_warn("retransmit %d", i);
+    }
+    log_info("other site");
+
+    struct log_stats stats;
+    log_flush();
+    log_get_stats(&stats);
+    const char *text = finish();
+
+    // A second boundary mid-loop lets a few more through
+    TEST_ASSERT_GREATER_OR_EQUAL(5, stats.lines);
+    TEST_ASSERT_LESS_OR_EQUAL(12, stats.lines);
+    TEST_ASSERT_EQUAL_UINT(101, stats.records);
+    TEST_ASSERT_NOT_NULL(strstr(text, "WARN  retransmit 0\nWARN  retransmit 1\n"));
+    TEST_ASSERT_NOT_NULL(strstr(text, "INFO  other site\n"));
+    TEST_ASSERT_NOT_NULL(strstr(text, "similar messages suppressed: retransmit %d\n"));
+    TEST_ASSERT_NULL(strstr(text, "retransmit 99\n"));
+}
+
+void test_log_full_ring_drops(void) {
+    // More records than a ring holds, queued faster than the writer wakes
+    const size_t total = LOG_RING_RECORDS * 4;
+    start(LOG_FORMAT_TEXT, false, 0);
+    for (size_t i = 0; i < total; i++) {
+        log_info("record %zu", i);
+    }
+    log_flush();
+
+    struct log_stats stats;
+    log_get_stats(&stats);
+    TEST_ASSERT_EQUAL_UINT(total, stats.records + stats.dropped);
+    const char *text = finish();
+    TEST_ASSERT_EQUAL_INT(0, strncmp(text, "INFO  record 0\n", 15));
+    if (stats.dropped) {
+        TEST_ASSERT_NOT_NULL(strstr(text, "log records dropped, ring full"));
+        TEST_ASSERT_GREATER_THAN(stats.records, count_lines(text));
+    } else {
+        TEST_ASSERT_EQUAL_UINT(total, count_lines(text));
+    }
+}
+
+static void *log_from_thread(void *arg) {
+    for (int i = 0; i < 1000; i++) {
+        log_info("thread %d line %d", (int)(intptr_t)arg, i);
+    }
+    return NULL;
+}
+
+void test_log_threads(void) {
+    // Each thread gets its own ring, every line arrives whole
+    start(LOG_FORMAT_TEXT, false, 0);
+    pthread_t threads[4];
+    for (intptr_t i = 0; i < 4; i++) {
+        TEST_ASSERT_EQUAL_INT(0, pthread_create(&threads[i], NULL, log_from_thread, (void *)i));
+    }
+    for (int i = 0; i < 4; i++) {
+        pthread_join(threads[i], NULL);
+    }
+    const char *text = finish();
+    TEST_ASSERT_EQUAL_UINT(4000, count_lines(text));
+    TEST_ASSERT_NOT_NULL(strstr(text, "INFO  thread 3 line 999\n"));
+}
+
+int main(void) {
+    UNITY_BEGIN();
+    RUN_TEST(test_log_text_lines);
+    RUN_TEST(test_log_json_lines);
+    RUN_TEST(test_log_rate_limit);
+    RUN_TEST(test_log_full_ring_drops);
+    RUN_TEST(test_log_threads);
+    return UNITY_END();
+}
@@ -0,0 +1,102 @@
+#include "../include/packet.h"
+#include <unity.h>
+#include <string.h>
+#include <arpa/inet.h>
+
+// Test fixtures
+static const struct packet_endpoint client = {
+    .mac = {0x02, 0x00, 0x00, 0x00, 0x00, 0x02},
+    .ip = 0x0201010A,   // 10.1.1.2
+    .port = 0x3930      // 12345
+};
+
+static const struct packet_endpoint server = {
+    .mac = {0x02, 0x00, 0x00, 0x00, 0x00, 0x01},
+    .ip = 0x0100000A,   // 10.0.0.1
+    .port = 0x3500      // 53
+};
+
+static const uint8_t payload[] = {0x12, 0x34, 0x01, 0x00, 0x00, 0x01, 0x00, 0x00,
+                                  0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x01, 0x00, 0x01};
+
+void setUp(void) {
+    // Setup code if needed
+}
+
+void tearDown(void) {
+    // Cleanup code if needed
+}
+
+void test_build_and_parse(void) {
+    uint8_t frame[256];
+    struct packet_info info;
+
+    int len = packet_build_udp(frame, sizeof(frame), &client, &server, payload, sizeof(payload));
+    TEST_ASSERT_EQUAL_INT(PACKET_HDR_LEN + sizeof(payload), len);
+
+    // Round trip through the parser
+    TEST_ASSERT_EQUAL_INT(0, packet_parse(frame, len, &info));
+    TEST_ASSERT_EQUAL_UINT32(client.ip, info.src.ip);
+    TEST_ASSERT_EQUAL_UINT32(server.ip, info.dst.ip);
+    TEST_ASSERT_EQUAL_UINT16(client.port, info.src.port);
+    TEST_ASSERT_EQUAL_UINT16(server.port, info.dst.port);
+    TEST_ASSERT_EQUAL_MEMORY(client.mac, info.src.mac, ETH_ADDR_LEN);
+    TEST_ASSERT_EQUAL_UINT(sizeof(payload), info.payload_len);
+    TEST_ASSERT_EQUAL_UINT8_ARRAY(payload, info.payload, sizeof(payload));
+
+    // A valid IPv4 header sums to zero including its checksum
+    TEST_ASSERT_EQUAL_HEX16(0, packet_ipv4_checksum(frame + ETH_HDR_LEN, IPV4_HDR_LEN));
+}
+
+void test_build_reply(void) {
+    uint8_t request[256], reply[256];
+    struct packet_info info, reply_info;
+
+    int len = packet_build_udp(request, sizeof(request), &client, &server, payload, sizeof(payload));
+    TEST_ASSERT_EQUAL_INT(0, packet_parse(request, len, &info));
+
+    len = packet_build_reply(reply, sizeof(reply), &info, payload, sizeof(payload));
+    TEST_ASSERT_TRUE(len > 0);
+    TEST_ASSERT_EQUAL_INT(0, packet_parse(reply, len, &reply_info));
+
+    // Both ends are swapped
+    TEST_ASSERT_EQUAL_UINT32(server.ip, reply_info.src.ip);
+    TEST_ASSERT_EQUAL_UINT32(client.ip, reply_info.dst.ip);
+    TEST_ASSERT_EQUAL_UINT16(server.port, reply_info.src.port);
+    TEST_ASSERT_EQUAL_UINT16(client.port, reply_info.dst.port);
+    TEST_ASSERT_EQUAL_MEMORY(client.mac, reply_info.dst.mac, ETH_ADDR_LEN);
+}
+
+void test_reject_invalid(void) {
+    uint8_t frame[256];
+    struct packet_info info;
+
+    int len = packet_build_udp(frame, sizeof(frame), &client, &server, payload, sizeof(payload));
+
+    // Truncated frame
+    TEST_ASSERT_NOT_EQUAL(0, packet_parse(frame, PACKET_HDR_LEN - 1, &info));
+    TEST_ASSERT_NOT_EQUAL(0, packet_parse(frame, len - 1, &info));
+
+    // Not IPv4
+    frame[12] = 0x86;
+    frame[13] = 0xDD;
+    TEST_ASSERT_NOT_EQUAL(0, packet_parse(frame, len, &info));
+
+    // Not UDP
+    len = packet_build_udp(frame, sizeof(frame), &client, &server, payload, sizeof(payload));
+    frame[ETH_HDR_LEN + 9] = 6;
+    TEST_ASSERT_NOT_EQUAL(0, packet_parse(frame, len, &info));
+
+    // Frame buffer too small to build into
+    TEST_ASSERT_TRUE(packet_build_udp(frame, PACKET_HDR_LEN, &client, &server, payload, sizeof(payload)) < 0);
+}
+
+int main(void) {
+    UNITY_BEGIN();
+
+    RUN_TEST(test_build_and_parse);
+    RUN_TEST(test_build_reply);
+    RUN_TEST(test_reject_invalid);
+
+    return UNITY_END();
+}
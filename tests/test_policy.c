@@ -0,0 +1,179 @@
+#include "../include/policy.h"
+#include "../include/zone.h"
+#include "../include/dns_query.h"
+#include <unity.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+static const char *rules =
+    "# Blocklist\n"
+    "bad.example                      # nxdomain by default\n"
+    ".ads.example       nxdomain      # ads.example and everything below\n"
+    "good.ads.example   passthru\n"
+    "*.tracker.example  nodata\n"
+    "Phish.Example.     redirect 192.0.2.66\n"
+    "phish6.example     redirect 2001:db8::66\n"
+    "\n";
+
+static char path[64];
+
+static int load(const char *text) {
+    strcpy(path, "/tmp/test_policy_XXXXXX");
+    int fd = mkstemp(path);
+    if (fd < 0 || write(fd, text, strlen(text)) != (ssize_t)strlen(text)) {
+        return -1;
+    }
+    close(fd);
+    const char *paths[] = {path};
+    int ret = policy_load(paths, 1);
+    unlink(path);
+    return ret;
+}
+
+void setUp(void) {
+    TEST_ASSERT_EQUAL_INT(0, load(rules));
+}
+
+void tearDown(void) {
+    policy_destroy();
+}
+
+// Action taken on a query for name, the reply written to reply (length in *len)
+static enum policy_action check(const char *name, enum DnsQType type, uint8_t *reply, int *len) {
+    struct dns_query query;
+    uint8_t msg[512];
+    size_t msg_len = sizeof(msg);
+    init_query(&query, name, type);
+    *len = -1;
+    if (construct_query(&query, msg, &msg_len) != 0) {
+        return POLICY_ACTIONS;
+    }
+
+    int question_end = dns_question_end(msg, msg_len);
+    struct dns_edns edns;
+    enum policy_action action;
+    size_t template_len;
+    if (question_end < 0 || dns_parse_edns(msg, msg_len, &edns) != 0) {
+        return POLICY_ACTIONS;
+    }
+    const uint8_t *tmpl = policy_lookup(msg, question_end, &template_len, &action);
+    if (tmpl) {
+        *len = zone_write(tmpl, template_len, msg, question_end, &edns, reply, 512);
+    }
+    return action;
+}
+
+void test_policy_rule_scopes(void) {
+    uint8_t reply[512];
+    int len;
+
+    // Exact rules match the name only
+    TEST_ASSERT_EQUAL_INT(POLICY_NXDOMAIN, check("bad.example", A, reply, &len));
+    TEST_ASSERT_GREATER_THAN(0, len);
+    TEST_ASSERT_EQUAL_INT(3, reply[3] & 0x0F);
+    TEST_ASSERT_EQUAL_INT(0x80, reply[2] & 0x80);
+    TEST_ASSERT_EQUAL_INT(POLICY_NONE, check("www.bad.example", A, reply, &len));
+    TEST_ASSERT_EQUAL_INT(-1, len);
+
+    // Suffix rules match the name and everything below it
+    TEST_ASSERT_EQUAL_INT(POLICY_NXDOMAIN, check("ads.example", A, reply, &len));
+    TEST_ASSERT_EQUAL_INT(POLICY_NXDOMAIN, check("a.b.c.ADS.example", AAAA, reply, &len));
+    TEST_ASSERT_EQUAL_INT(POLICY_NONE, check("notads.example", A, reply, &len));
+
+    // Wildcards match below the name, not the name
+    TEST_ASSERT_EQUAL_INT(POLICY_NONE, check("tracker.example", A, reply, &len));
+    TEST_ASSERT_EQUAL_INT(POLICY_NODATA, check("px.tracker.example", A, reply, &len));
+    TEST_ASSERT_EQUAL_INT(0, reply[3] & 0x0F);
+    TEST_ASSERT_EQUAL_UINT(0, reply[7]);
+
+    // The most specific rule wins
+    TEST_ASSERT_EQUAL_INT(POLICY_PASSTHRU, check("good.ads.example", A, reply, &len));
+    TEST_ASSERT_EQUAL_INT(-1, len);
+    TEST_ASSERT_EQUAL_INT(POLICY_NXDOMAIN, check("x.good.ads.example", A, reply, &len));
+}
+
+void test_policy_redirects(void) {
+    uint8_t reply[512];
+    int len;
+
+    // The rule's address for its own type, NODATA for the others
+    TEST_ASSERT_EQUAL_INT(POLICY_REDIRECT, check("phish.example", A, reply, &len));
+    TEST_ASSERT_GREATER_THAN(0, len);
+    TEST_ASSERT_EQUAL_UINT(1, reply[7]);
+    const uint8_t v4[] = {192, 0, 2, 66};
+    TEST_ASSERT_NOT_NULL(memmem(reply, len, v4, 4));
+    uint32_t ttl;
+    TEST_ASSERT_EQUAL_INT(0, dns_answer_ttl(reply, len, &ttl));
+    TEST_ASSERT_EQUAL_UINT(POLICY_TTL, ttl);
+
+    TEST_ASSERT_EQUAL_INT(POLICY_REDIRECT, check("phish.example", AAAA, reply, &len));
+    TEST_ASSERT_EQUAL_UINT(0, reply[7]);
+    TEST_ASSERT_EQUAL_INT(0, reply[3] & 0x0F);
+
+    TEST_ASSERT_EQUAL_INT(POLICY_REDIRECT, check("phish6.example", AAAA, reply, &len));
+    TEST_ASSERT_EQUAL_UINT(1, reply[7]);
+    const uint8_t v6[] = {0x20, 0x01, 0x0d, 0xb8, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0x66};
+    TEST_ASSERT_NOT_NULL(memmem(reply, len, v6, 16));
+
+    struct policy_stats stats;
+    policy_get_stats(&stats);
+    TEST_ASSERT_EQUAL_UINT(6, stats.rules);
+    TEST_ASSERT_EQUAL_UINT(3, stats.matches[POLICY_REDIRECT]);
+}
+
+void test_policy_rejects_bad_input(void) {
+    // A failed load keeps the loaded rules
+    TEST_ASSERT_NOT_EQUAL(0, load("bad..example\n"));
+    TEST_ASSERT_NOT_EQUAL(0, load("a.example block\n"));
+    TEST_ASSERT_NOT_EQUAL(0, load("a.example redirect\n"));
+    TEST_ASSERT_NOT_EQUAL(0, load("a.example redirect not-an-address\n"));
+    TEST_ASSERT_NOT_EQUAL(0, load("a.example nodata 192.0.2.1\n"));
+
+    uint8_t reply[512];
+    int len;
+    TEST_ASSERT_EQUAL_INT(POLICY_NXDOMAIN, check("bad.example", A, reply, &len));
+
+    // A later rule for the same name replaces the earlier one
+    TEST_ASSERT_EQUAL_INT(0, load("x.example nodata\nx.example nxdomain\n"));
+    TEST_ASSERT_EQUAL_INT(POLICY_NXDOMAIN, check("x.example", A, reply, &len));
+    TEST_ASSERT_EQUAL_INT(POLICY_NONE, check("bad.example", A, reply, &len));
+}
+
+void test_policy_large(void) {
+    // Many rules across depths, every one still found
+    const size_t count = 200000;
+    size_t cap = count * 32 + 64;
+    char *text = malloc(cap);
+    TEST_ASSERT_NOT_NULL(text);
+    size_t pos = 0;
+    for (size_t i = 0; i < count; i++) {
+        pos += snprintf(text + pos, cap - pos, i % 2 ? "h%zu.d%zu.test\n" : ".s%zu.d%zu.test\n", i, i % 50);
+    }
+    TEST_ASSERT_EQUAL_INT(0, load(text));
+    free(text);
+
+    struct policy_stats stats;
+    policy_get_stats(&stats);
+    TEST_ASSERT_EQUAL_UINT(count, stats.names);
+
+    uint8_t reply[512];
+    int len;
+    for (size_t i = 0; i < count; i += 101) {
+        char name[64];
+        snprintf(name, sizeof(name), i % 2 ? "h%zu.d%zu.test" : "www.s%zu.d%zu.test", i, i % 50);
+        TEST_ASSERT_EQUAL_INT(POLICY_NXDOMAIN, check(name, A, reply, &len));
+        snprintf(name, sizeof(name), "h%zu.d%zu.test", i + count, i % 50);
+        TEST_ASSERT_EQUAL_INT(POLICY_NONE, check(name, A, reply, &len));
+    }
+}
+
+int main(void) {
+    UNITY_BEGIN();
+    RUN_TEST(test_policy_rule_scopes);
+    RUN_TEST(test_policy_redirects);
+    RUN_TEST(test_policy_rejects_bad_input);
+    RUN_TEST(test_policy_large);
+    return UNITY_END();
+}
@@ -0,0 +1,185 @@
+#include "../include/resolvers.h"
+#include <unity.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+
+#define MS 1000000ULL
+
+void setUp(void) {
+    resolvers_set_select(RESOLVER_SELECT_P2C);
+    for (uint32_t i = 0; i < 4; i++) {
+        TEST_ASSERT_EQUAL_INT(0, resolvers_add(htonl(0x0A000001 + i), htons(53), "test"));
+    }
+}
+
+void tearDown(void) {
+    resolvers_destroy();
+}
+
+// Answer a query to index after rtt_ms
+static void answer(int index, uint64_t rtt_ms) {
+    resolvers_sent(index);
+    resolvers_answered(index, rtt_ms * MS);
+}
+
+static void time_out(int index, uint64_t now) {
+    resolvers_sent(index);
+    resolvers_timed_out(index, now);
+}
+
+void test_resolvers_load(void) {
+    resolvers_destroy();
+    char path[] = "/tmp/test_resolvers_XXXXXX";
+    int fd = mkstemp(path);
+    const char *text = "# Public resolvers\n8.8.8.8  # Google\n\n9.9.9.9:5353 # Quad9\n";
+    TEST_ASSERT_EQUAL_INT((int)strlen(text), (int)write(fd, text, strlen(text)));
+    close(fd);
+    TEST_ASSERT_EQUAL_INT(0, resolvers_load(path));
+    unlink(path);
+
+    TEST_ASSERT_EQUAL_UINT(2, resolvers_count());
+    TEST_ASSERT_EQUAL_UINT16(htons(5353), resolvers_get(1)->port);
+    TEST_ASSERT_EQUAL_STRING("Google", resolvers_get(0)->desc);
+    TEST_ASSERT_EQUAL_INT(1, resolvers_find(htonl(0x09090909), htons(5353)));
+    TEST_ASSERT_EQUAL_INT(-1, resolvers_find(htonl(0x09090909), htons(53)));
+}
+
+void test_resolvers_smoothed_rtt(void) {
+    // First sample sets the estimate, later ones move it by 1/8
+    answer(0, 80);
+    const struct resolver_health *h = &resolvers_get(0)->health;
+    TEST_ASSERT_EQUAL_UINT32(80000, h->srtt_us);
+    TEST_ASSERT_EQUAL_UINT32(40000, h->rttvar_us);
+    answer(0, 16);
+    TEST_ASSERT_EQUAL_UINT32(72000, h->srtt_us);
+    TEST_ASSERT_EQUAL_UINT32(46000, h->rttvar_us);
+
+    // Answers without a sample count but leave the estimate
+    answer(0, 0);
+    TEST_ASSERT_EQUAL_UINT32(72000, h->srtt_us);
+    TEST_ASSERT_EQUAL_UINT64(3, h->answers);
+    TEST_ASSERT_EQUAL_UINT32(0, h->inflight);
+}
+
+void test_resolvers_prefer_fast(void) {
+    // One fast resolver, three slow or lossy ones
+    for (int i = 0; i < 20; i++) {
+        answer(0, 2);
+        answer(1, 40);
+        answer(2, 40);
+        answer(3, 5);
+    }
+    for (int i = 0; i < 4; i++) {
+        time_out(3, 0);
+        answer(3, 5);
+    }
+
+    int picks[4] = {0};
+    for (int i = 0; i < 10000; i++) {
+        picks[resolvers_select(0, -1)]++;
+    }
+    TEST_ASSERT_GREATER_THAN(picks[1] * 3, picks[0]);
+    TEST_ASSERT_GREATER_THAN(picks[2] * 3, picks[0]);
+    TEST_ASSERT_GREATER_THAN(picks[3], picks[0]);
+
+    // Queries already waiting push new ones elsewhere
+    for (int i = 0; i < 100; i++) {
+        resolvers_sent(0);
+    }
+    memset(picks, 0, sizeof(picks));
+    for (int i = 0; i < 1000; i++) {
+        picks[resolvers_select(0, -1)]++;
+    }
+    TEST_ASSERT_GREATER_THAN(picks[0], picks[3]);
+
+    // A retransmit never returns to the resolver that timed out
+    for (int i = 0; i < 1000; i++) {
+        TEST_ASSERT_NOT_EQUAL(3, resolvers_select(0, 3));
+    }
+}
+
+void test_resolvers_quarantine_and_probe(void) {
+    uint64_t now = 1000 * MS;
+    for (int i = 0; i < RESOLVER_QUARANTINE_FAILURES - 1; i++) {
+        time_out(2, now);
+    }
+    TEST_ASSERT_FALSE(resolvers_quarantined(2));
+    time_out(2, now);
+    TEST_ASSERT_TRUE(resolvers_quarantined(2));
+    TEST_ASSERT_EQUAL_UINT64(1, resolvers_get(2)->health.quarantines);
+
+    // Left alone until the quarantine ends
+    for (int i = 0; i < 1000; i++) {
+        TEST_ASSERT_NOT_EQUAL(2, resolvers_select(now + 999 * MS, -1));
+    }
+
+    // Then one query probes it; a failed probe doubles the wait
+    now += RESOLVER_QUARANTINE_MS * MS;
+    TEST_ASSERT_EQUAL_INT(2, resolvers_select(now, -1));
+    resolvers_sent(2);
+    TEST_ASSERT_NOT_EQUAL(2, resolvers_select(now, -1));
+    resolvers_timed_out(2, now);
+    TEST_ASSERT_EQUAL_UINT32(2 * RESOLVER_QUARANTINE_MS, resolvers_get(2)->health.backoff_ms);
+    TEST_ASSERT_NOT_EQUAL(2, resolvers_select(now + (2 * RESOLVER_QUARANTINE_MS - 1) * MS, -1));
+
+    // An answered probe brings it back
+    now += 2 * RESOLVER_QUARANTINE_MS * MS;
+    TEST_ASSERT_EQUAL_INT(2, resolvers_select(now, -1));
+    answer(2, 10);
+    TEST_ASSERT_FALSE(resolvers_quarantined(2));
+    TEST_ASSERT_EQUAL_UINT64(2, resolvers_get(2)->health.probes);
+}
+
+void test_resolvers_probe_not_sent(void) {
+    uint64_t now = 1000 * MS;
+    for (int i = 0; i < RESOLVER_QUARANTINE_FAILURES; i++) {
+        time_out(1, now);
+    }
+
+    // The query picked to probe is never sent (no TX frame): the probe is
+    // still due for the next one
+    now += RESOLVER_QUARANTINE_MS * MS;
+    TEST_ASSERT_EQUAL_INT(1, resolvers_select(now, -1));
+    TEST_ASSERT_FALSE(resolvers_get(1)->health.probing);
+    TEST_ASSERT_EQUAL_UINT64(0, resolvers_get(1)->health.probes);
+    TEST_ASSERT_EQUAL_INT(1, resolvers_select(now + MS, -1));
+    resolvers_sent(1);
+    TEST_ASSERT_TRUE(resolvers_get(1)->health.probing);
+    TEST_ASSERT_EQUAL_UINT64(1, resolvers_get(1)->health.probes);
+
+    // Only one probe at a time, and an ordinary send is not one
+    TEST_ASSERT_NOT_EQUAL(1, resolvers_select(now + MS, -1));
+    answer(1, 10);
+    TEST_ASSERT_FALSE(resolvers_quarantined(1));
+    TEST_ASSERT_EQUAL_UINT64(1, resolvers_get(1)->health.probes);
+}
+
+void test_resolvers_all_quarantined(void) {
+    // Queries still go somewhere: the resolver nearest its next probe
+    for (int r = 0; r < 4; r++) {
+        for (int i = 0; i < RESOLVER_QUARANTINE_FAILURES; i++) {
+            time_out(r, (10 + r) * MS);
+        }
+    }
+    TEST_ASSERT_EQUAL_INT(0, resolvers_select(0, -1));
+    TEST_ASSERT_EQUAL_INT(1, resolvers_select(0, 0));
+
+    // Round robin ignores health
+    resolvers_set_select(RESOLVER_SELECT_ROUND_ROBIN);
+    TEST_ASSERT_EQUAL_INT(0, resolvers_select(0, -1));
+    TEST_ASSERT_EQUAL_INT(1, resolvers_select(0, -1));
+    TEST_ASSERT_EQUAL_INT(2, resolvers_select(0, -1));
+}
+
+int main(void) {
+    UNITY_BEGIN();
+    RUN_TEST(test_resolvers_load);
+    RUN_TEST(test_resolvers_smoothed_rtt);
+    RUN_TEST(test_resolvers_prefer_fast);
+    RUN_TEST(test_resolvers_quarantine_and_probe);
+    RUN_TEST(test_resolvers_probe_not_sent);
+    RUN_TEST(test_resolvers_all_quarantined);
+    return UNITY_END();
+}
@@ -0,0 +1,334 @@
+#include "../include/scan.h"
+#include "../include/resolvers.h"
+#include "../include/io_backend.h"
+#include "../include/packet.h"
+#include <unity.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+
+// Test fixtures
+static const struct packet_endpoint local = {
+    .mac = {0x02, 0x00, 0x00, 0x00, 0x00, 0x02},
+    .ip = 0x0201010A,   // 10.1.1.2
+    .port = 0x29B1      // 45353
+};
+
+static const uint32_t resolver_ip = 0x0100000A;     // 10.0.0.1
+static char domains_path[] = "/tmp/whack_scan_XXXXXX";
+static char output_path[] = "/tmp/whack_scan_out_XXXXXX";
+static char checkpoint_path[] = "/tmp/whack_scan_ckpt_XXXXXX";
+static struct io_backend io;
+
+void setUp(void) {
+    struct mem_backend_config mem_cfg = {0};
+    TEST_ASSERT_EQUAL_INT(0, io_backend_mem_init(&io, &mem_cfg));
+    TEST_ASSERT_EQUAL_INT(0, resolvers_add(resolver_ip, htons(53), "test"));
+}
+
+void tearDown(void) {
+    scan_destroy();
+    resolvers_destroy();
+    io_backend_cleanup(&io);
+}
+
+static void start_scan(uint32_t timeout_ms, uint32_t retries) {
+    struct scan_config cfg = {
+        .domains_file = domains_path,
+        .qtype = A,
+        .timeout_ms = timeout_ms,
+        .retries = retries,
+        .src = local
+    };
+    TEST_ASSERT_EQUAL_INT(0, scan_init(&cfg, &io));
+}
+
+static int start_job(uint32_t shard_index, uint32_t shard_count, bool resume) {
+    struct scan_config cfg = {
+        .domains_file = domains_path,
+        .output_file = output_path,
+        .qtype = A,
+        .timeout_ms = 1000,
+        .retries = 1,
+        .src = local,
+        .shard_index = shard_index,
+        .shard_count = shard_count,
+        .checkpoint_file = checkpoint_path,
+        .resume = resume
+    };
+    return scan_init(&cfg, &io);
+}
+
+static size_t count_lines(const char *path, const char *needle) {
+    FILE *f = fopen(path, "r");
+    char line[512];
+    size_t n = 0;
+    while (f && fgets(line, sizeof(line), f)) {
+        n += strstr(line, needle) != NULL;
+    }
+    if (f) {
+        fclose(f);
+    }
+    return n;
+}
+
+// Answer a transmitted query as the resolver would, with the given flags
+static void answer(size_t index, uint16_t flags, uint32_t from_ip) {
+    size_t len;
+    const uint8_t *frame = io_backend_mem_tx_frame(&io, index, &len);
+    TEST_ASSERT_NOT_NULL(frame);
+
+    struct packet_info query;
+    TEST_ASSERT_EQUAL_INT(0, packet_parse(frame, len, &query));
+
+    uint8_t msg[512];
+    memcpy(msg, query.payload, query.payload_len);
+    flags = htons(flags);
+    memcpy(msg + 2, &flags, sizeof(flags));
+
+    uint8_t reply[1024];
+    int reply_len = packet_build_reply(reply, sizeof(reply), &query, msg, query.payload_len);
+    TEST_ASSERT_GREATER_THAN(0, reply_len);
+
+    struct packet_info info;
+    TEST_ASSERT_EQUAL_INT(0, packet_parse(reply, reply_len, &info));
+    info.src.ip = from_ip;
+    scan_handle_response(&info);
+}
+
+void test_scan_answers(void) {
+    start_scan(1000, 1);
+    scan_tick();
+
+    // One query per domain, comments and blank lines skipped
+    TEST_ASSERT_EQUAL_UINT(3, io_backend_mem_tx_count(&io));
+    TEST_ASSERT_EQUAL_UINT(3, scan_inflight());
+    TEST_ASSERT_FALSE(scan_done());
+
+    answer(0, 0x8180, resolver_ip);
+    answer(1, 0x8183, resolver_ip);
+    answer(2, 0x8180, resolver_ip);
+    TEST_ASSERT_TRUE(scan_done());
+
+    struct scan_stats stats;
+    scan_get_stats(&stats);
+    TEST_ASSERT_EQUAL_UINT64(3, stats.domains);
+    TEST_ASSERT_EQUAL_UINT64(3, stats.answers);
+    TEST_ASSERT_EQUAL_UINT64(2, stats.rcodes[0]);
+    TEST_ASSERT_EQUAL_UINT64(1, stats.rcodes[3]);
+}
+
+void test_scan_rejects_spoofed(void) {
+    start_scan(1000, 1);
+    scan_tick();
+
+    // Wrong source, then a duplicate of a completed answer
+    answer(0, 0x8180, resolver_ip + 1);
+    answer(1, 0x8180, resolver_ip);
+    answer(1, 0x8180, resolver_ip);
+
+    struct scan_stats stats;
+    scan_get_stats(&stats);
+    TEST_ASSERT_EQUAL_UINT64(1, stats.answers);
+    TEST_ASSERT_EQUAL_UINT64(2, stats.unmatched);
+    TEST_ASSERT_EQUAL_UINT(2, scan_inflight());
+}
+
+void test_scan_retransmit_and_timeout(void) {
+    start_scan(1, 1);
+    scan_tick();
+    TEST_ASSERT_EQUAL_UINT(3, io_backend_mem_tx_count(&io));
+
+    // First timeout resends, the second gives up
+    usleep(5000);
+    scan_tick();
+    TEST_ASSERT_EQUAL_UINT(6, io_backend_mem_tx_count(&io));
+    usleep(5000);
+    scan_tick();
+    TEST_ASSERT_TRUE(scan_done());
+
+    struct scan_stats stats;
+    scan_get_stats(&stats);
+    TEST_ASSERT_EQUAL_UINT64(6, stats.queries);
+    TEST_ASSERT_EQUAL_UINT64(3, stats.retransmits);
+    TEST_ASSERT_EQUAL_UINT64(3, stats.timeouts);
+}
+
+void test_scan_shard_hash(void) {
+    // Stable across case and the trailing dot, and spread evenly
+    TEST_ASSERT_EQUAL_UINT(scan_shard_of("Example.COM.", 7), scan_shard_of("example.com", 7));
+    TEST_ASSERT_EQUAL_UINT(0, scan_shard_of("example.com", 1));
+
+    size_t counts[4] = {0};
+    for (int i = 0; i < 40000; i++) {
+        char name[64];
+        snprintf(name, sizeof(name), "host%d.example", i);
+        counts[scan_shard_of(name, 4)]++;
+    }
+    for (int i = 0; i < 4; i++) {
+        TEST_ASSERT_UINT_WITHIN(500, 10000, counts[i]);
+    }
+}
+
+void test_scan_shards_split_input(void) {
+    // Every domain goes to exactly one of the shards
+    uint64_t total = 0;
+    for (uint32_t shard = 0; shard < 2; shard++) {
+        TEST_ASSERT_EQUAL_INT(0, start_job(shard, 2, false));
+        scan_tick();
+
+        struct scan_stats stats;
+        scan_get_stats(&stats);
+        TEST_ASSERT_EQUAL_UINT64(3, stats.domains + stats.other_shards);
+        TEST_ASSERT_EQUAL_UINT(stats.domains, scan_inflight());
+        total += stats.domains;
+        scan_destroy();
+    }
+    TEST_ASSERT_EQUAL_UINT64(3, total);
+}
+
+void test_scan_checkpoint_resume(void) {
+    TEST_ASSERT_EQUAL_INT(0, start_job(0, 1, false));
+    scan_tick();
+    answer(0, 0x8180, resolver_ip);
+    TEST_ASSERT_EQUAL_INT(0, scan_checkpoint());
+
+    // Answered after the checkpoint, then the process dies
+    answer(1, 0x8180, resolver_ip);
+    scan_destroy();
+    TEST_ASSERT_EQUAL_UINT(2, count_lines(output_path, "\"rcode\":0"));
+    TEST_ASSERT_EQUAL_UINT(1, count_lines(checkpoint_path, "status running"));
+
+    // A checkpoint only resumes the job it was taken for
+    TEST_ASSERT_NOT_EQUAL(0, start_job(0, 2, true));
+
+    // Outstanding domains go out again, results after the checkpoint are redone once
+    TEST_ASSERT_EQUAL_INT(0, start_job(0, 1, true));
+    TEST_ASSERT_EQUAL_UINT(1, count_lines(output_path, "\"rcode\":0"));
+    size_t sent = io_backend_mem_tx_count(&io);
+    scan_tick();
+    TEST_ASSERT_EQUAL_UINT(sent + 2, io_backend_mem_tx_count(&io));
+    answer(sent, 0x8180, resolver_ip);
+    answer(sent + 1, 0x8180, resolver_ip);
+    TEST_ASSERT_TRUE(scan_done());
+
+    struct scan_stats stats;
+    scan_get_stats(&stats);
+    TEST_ASSERT_EQUAL_UINT64(3, stats.domains);
+    TEST_ASSERT_EQUAL_UINT64(3, stats.answers);
+    TEST_ASSERT_EQUAL_UINT64(2, stats.resumed);
+
+    TEST_ASSERT_EQUAL_INT(0, scan_checkpoint());
+    scan_destroy();
+    TEST_ASSERT_EQUAL_UINT(3, count_lines(output_path, "\"rcode\":0"));
+    TEST_ASSERT_EQUAL_UINT(1, count_lines(output_path, "example.com"));
+    TEST_ASSERT_EQUAL_UINT(1, count_lines(output_path, "example.net"));
+    TEST_ASSERT_EQUAL_UINT(1, count_lines(output_path, "example.org"));
+    TEST_ASSERT_EQUAL_UINT(1, count_lines(checkpoint_path, "status complete"));
+
+    // Resuming a finished job has nothing left to do
+    TEST_ASSERT_EQUAL_INT(0, start_job(0, 1, true));
+    scan_tick();
+    TEST_ASSERT_TRUE(scan_done());
+}
+
+void test_scan_checkpoint_in_background(void) {
+    struct scan_config cfg = {
+        .domains_file = domains_path,
+        .output_file = output_path,
+        .qtype = A,
+        .timeout_ms = 1000,
+        .retries = 1,
+        .src = local,
+        .checkpoint_file = checkpoint_path,
+        .checkpoint_interval = 1
+    };
+    unlink(checkpoint_path);
+    TEST_ASSERT_EQUAL_INT(0, scan_init(&cfg, &io));
+    scan_tick();
+    answer(0, 0x8180, resolver_ip);
+
+    // Due after a second, the tick hands it to the helper and returns
+    usleep(1100000);
+    scan_tick();
+    for (int i = 0; i < 200 && !count_lines(checkpoint_path, "pending 2"); i++) {
+        usleep(5000);
+        scan_tick();
+    }
+    TEST_ASSERT_EQUAL_UINT(1, count_lines(checkpoint_path, "pending 2"));
+    TEST_ASSERT_EQUAL_UINT(1, count_lines(checkpoint_path, "answers 1"));
+    TEST_ASSERT_EQUAL_UINT(1, count_lines(checkpoint_path, "example.net"));
+
+    // Counted once joined
+    scan_destroy();
+    struct scan_stats stats;
+    scan_get_stats(&stats);
+    TEST_ASSERT_EQUAL_UINT64(1, stats.checkpoints);
+    TEST_ASSERT_EQUAL_UINT(1, count_lines(output_path, "\"rcode\":0"));
+}
+
+void test_scan_escapes_domains(void) {
+    char path[] = "/tmp/whack_scan_names_XXXXXX";
+    int fd = mkstemp(path);
+    TEST_ASSERT_TRUE(fd >= 0);
+    FILE *f = fdopen(fd, "w");
+    fputs("quo\"te.example\nback\\slash.example\nbell\a.example\n", f);
+    fclose(f);
+
+    struct scan_config cfg = {
+        .domains_file = path,
+        .output_file = output_path,
+        .qtype = A,
+        .timeout_ms = 1000,
+        .retries = 1,
+        .src = local
+    };
+    TEST_ASSERT_EQUAL_INT(0, scan_init(&cfg, &io));
+    scan_tick();
+    for (size_t i = 0; i < 3; i++) {
+        answer(i, 0x8180, resolver_ip);
+    }
+    scan_destroy();
+    unlink(path);
+
+    // Every line stays valid JSON
+    TEST_ASSERT_EQUAL_UINT(1, count_lines(output_path, "{\"domain\":\"quo\\\"te.example\","));
+    TEST_ASSERT_EQUAL_UINT(1, count_lines(output_path, "{\"domain\":\"back\\\\slash.example\","));
+    TEST_ASSERT_EQUAL_UINT(1, count_lines(output_path, "{\"domain\":\"bell\\u0007.example\","));
+}
+
+int main(void) {
+    int fd = mkstemp(domains_path);
+    if (fd < 0) {
+        return 1;
+    }
+    FILE *f = fdopen(fd, "w");
+    fputs("# test domains\nexample.com\n\nexample.net.\nexample.org  # trailing comment\n", f);
+    fclose(f);
+    int out_fd = mkstemp(output_path);
+    int ckpt_fd = mkstemp(checkpoint_path);
+    if (out_fd < 0 || ckpt_fd < 0) {
+        return 1;
+    }
+    close(out_fd);
+    close(ckpt_fd);
+    unlink(checkpoint_path);
+
+    UNITY_BEGIN();
+    RUN_TEST(test_scan_answers);
+    RUN_TEST(test_scan_rejects_spoofed);
+    RUN_TEST(test_scan_retransmit_and_timeout);
+    RUN_TEST(test_scan_shard_hash);
+    RUN_TEST(test_scan_shards_split_input);
+    RUN_TEST(test_scan_checkpoint_resume);
+    RUN_TEST(test_scan_checkpoint_in_background);
+    RUN_TEST(test_scan_escapes_domains);
+    int ret = UNITY_END();
+
+    unlink(domains_path);
+    unlink(output_path);
+    unlink(checkpoint_path);
+    return ret;
+}
@@ -0,0 +1,174 @@
+#include "../include/tcp_fallback.h"
+#include <unity.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#define MAX_ANSWERS 16
+
+// Resolver fixture on loopback and the answers handed back
+static int listener = -1;
+static int filler = -1;
+static struct sockaddr_in resolver;
+static uint64_t cookies[MAX_ANSWERS];
+static int statuses[MAX_ANSWERS];
+static size_t answer_count;
+
+static void record_answer(uint64_t cookie, const uint8_t *msg, size_t len, int status) {
+    (void)msg;
+    (void)len;
+    if (answer_count < MAX_ANSWERS) {
+        cookies[answer_count] = cookie;
+        statuses[answer_count] = status;
+    }
+    answer_count++;
+}
+
+static void start_listener(int backlog) {
+    listener = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    TEST_ASSERT_TRUE(listener >= 0);
+    memset(&resolver, 0, sizeof(resolver));
+    resolver.sin_family = AF_INET;
+    resolver.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    TEST_ASSERT_EQUAL_INT(0, bind(listener, (struct sockaddr *)&resolver, sizeof(resolver)));
+    TEST_ASSERT_EQUAL_INT(0, listen(listener, backlog));
+    socklen_t len = sizeof(resolver);
+    TEST_ASSERT_EQUAL_INT(0, getsockname(listener, (struct sockaddr *)&resolver, &len));
+}
+
+static void start_fallback(size_t conns, size_t pipeline, uint32_t timeout_ms) {
+    struct tcp_fallback_config cfg = {
+        .conns_per_resolver = conns,
+        .max_pipeline = pipeline,
+        .query_timeout_ms = timeout_ms
+    };
+    TEST_ASSERT_EQUAL_INT(0, tcp_fallback_init(&cfg, record_answer));
+}
+
+static int submit(uint16_t id, size_t len) {
+    uint8_t query[TCP_MAX_QUERY] = {0};
+    query[0] = id >> 8;
+    query[1] = id & 0xFF;
+    query[5] = 1;
+    return tcp_fallback_submit(resolver.sin_addr.s_addr, resolver.sin_port, query, len, id);
+}
+
+static uint64_t elapsed_ms(const struct timespec *start) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)(now.tv_sec - start->tv_sec) * 1000 + (now.tv_nsec - start->tv_nsec) / 1000000;
+}
+
+// Poll until nothing is pending, for at most limit_ms
+static void poll_until_done(uint64_t limit_ms) {
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    while (tcp_fallback_pending() && elapsed_ms(&start) < limit_ms) {
+        tcp_fallback_poll(5);
+    }
+}
+
+void setUp(void) {
+    answer_count = 0;
+}
+
+void tearDown(void) {
+    tcp_fallback_destroy();
+    if (filler >= 0) {
+        close(filler);
+        filler = -1;
+    }
+    if (listener >= 0) {
+        close(listener);
+        listener = -1;
+    }
+}
+
+void test_tcp_fallback_pipelines_out_of_order(void) {
+    start_listener(16);
+    start_fallback(1, 4, 1000);
+    for (uint16_t id = 1; id <= 3; id++) {
+        TEST_ASSERT_EQUAL_INT(0, submit(id, 32));
+    }
+
+    // Read the three framed queries off one connection
+    int server = -1;
+    uint8_t in[3 * 34];
+    size_t got = 0;
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    while (got < sizeof(in) && elapsed_ms(&start) < 1000) {
+        tcp_fallback_poll(5);
+        if (server < 0) {
+            server = accept4(listener, NULL, NULL, SOCK_NONBLOCK);
+            continue;
+        }
+        ssize_t n = recv(server, in + got, sizeof(in) - got, 0);
+        if (n > 0) {
+            got += n;
+        }
+    }
+    TEST_ASSERT_EQUAL_UINT(sizeof(in), got);
+
+    // Answered last to first, each is still matched by its ID
+    for (int i = 2; i >= 0; i--) {
+        uint8_t *frame = in + i * 34;
+        frame[2 + 2] |= 0x80;
+        TEST_ASSERT_EQUAL_INT(34, (int)send(server, frame, 34, 0));
+    }
+    poll_until_done(1000);
+    close(server);
+
+    TEST_ASSERT_EQUAL_UINT(3, answer_count);
+    for (size_t i = 0; i < 3; i++) {
+        TEST_ASSERT_EQUAL_INT(0, statuses[i]);
+        TEST_ASSERT_EQUAL_UINT64(3 - i, cookies[i]);
+    }
+    struct tcp_fallback_stats stats;
+    tcp_fallback_get_stats(&stats);
+    TEST_ASSERT_EQUAL_UINT64(1, stats.connects);
+    TEST_ASSERT_EQUAL_UINT64(3, stats.max_pipelined);
+}
+
+void test_tcp_fallback_stalled_connection(void) {
+    // A full accept queue leaves our connection unestablished, so nothing
+    // queued on it is ever written
+    start_listener(0);
+    filler = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    TEST_ASSERT_EQUAL_INT(0, connect(filler, (struct sockaddr *)&resolver, sizeof(resolver)));
+    start_fallback(1, 2, 20);
+
+    // Timed out queries must not leave their frames behind, or the next
+    // pipeline's worth of the largest queries overflows the write buffer
+    for (int round = 0; round < 3; round++) {
+        for (uint16_t id = 1; id <= 4; id++) {
+            TEST_ASSERT_EQUAL_INT(0, submit(round * 4 + id, TCP_MAX_QUERY));
+        }
+        poll_until_done(1000);
+        TEST_ASSERT_EQUAL_UINT(0, tcp_fallback_pending());
+    }
+
+    TEST_ASSERT_EQUAL_UINT(12, answer_count);
+    for (size_t i = 0; i < MAX_ANSWERS && i < answer_count; i++) {
+        TEST_ASSERT_EQUAL_INT(-ETIMEDOUT, statuses[i]);
+    }
+
+    // The stalled connection was given up rather than reused
+    struct tcp_fallback_stats stats;
+    tcp_fallback_get_stats(&stats);
+    TEST_ASSERT_GREATER_THAN(1, stats.connects);
+    TEST_ASSERT_EQUAL_UINT64(0, stats.reused);
+}
+
+int main(void) {
+    UNITY_BEGIN();
+    RUN_TEST(test_tcp_fallback_pipelines_out_of_order);
+    RUN_TEST(test_tcp_fallback_stalled_connection);
+    return UNITY_END();
+}
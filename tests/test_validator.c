@@ -0,0 +1,535 @@
+#include "../include/validator.h"
+#include "../include/cache.h"
+#include <unity.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <errno.h>
+#include <openssl/evp.h>
+#include <openssl/bn.h>
+#include <openssl/ecdsa.h>
+#include <openssl/core_names.h>
+
+#define TYPE_A      1
+#define TYPE_CNAME  5
+#define TYPE_DS     43
+#define TYPE_RRSIG  46
+#define TYPE_DNSKEY 48
+
+// A signed zone: one key, flags 257, signing everything
+struct test_zone {
+    uint8_t name[64];
+    size_t name_len;
+    uint8_t alg;
+    EVP_PKEY *pkey;
+    uint8_t dnskey[600];
+    size_t dnskey_len;
+    uint16_t tag;
+};
+
+struct test_msg {
+    uint8_t buf[4096];
+    size_t len;
+};
+
+// One record to sign, rdata already canonical
+struct test_rr {
+    const uint8_t *rdata;
+    size_t len;
+};
+
+static struct test_zone root_zone, test_zone, example_zone;
+static char anchors_path[64];
+static uint32_t now;
+
+static size_t encode(const char *text, uint8_t *out) {
+    size_t len = 0;
+    while (*text && *text != '.') {
+        const char *dot = strchr(text, '.');
+        size_t n = dot ? (size_t)(dot - text) : strlen(text);
+        out[len++] = n;
+        memcpy(out + len, text, n);
+        len += n;
+        text += n + (dot ? 1 : 0);
+    }
+    out[len++] = 0;
+    return len;
+}
+
+static void put16(uint8_t *p, uint16_t v) {
+    p[0] = v >> 8;
+    p[1] = v;
+}
+
+static void put32(uint8_t *p, uint32_t v) {
+    put16(p, v >> 16);
+    put16(p + 2, v);
+}
+
+static uint16_t key_tag(const uint8_t *rdata, size_t len) {
+    uint32_t ac = 0;
+    for (size_t i = 0; i < len; i++) {
+        ac += i & 1 ? rdata[i] : (uint32_t)rdata[i] << 8;
+    }
+    ac += ac >> 16 & 0xFFFF;
+    return ac & 0xFFFF;
+}
+
+static void make_zone(struct test_zone *z, const char *name, uint8_t alg) {
+    z->name_len = encode(name, z->name);
+    z->alg = alg;
+    uint8_t *rdata = z->dnskey;
+    put16(rdata, 257);
+    rdata[2] = 3;
+    rdata[3] = alg;
+    size_t len = 4;
+
+    if (alg == 8) {
+        z->pkey = EVP_PKEY_Q_keygen(NULL, NULL, "RSA", (size_t)1024);
+        BIGNUM *e = NULL, *n = NULL;
+        TEST_ASSERT_TRUE(z->pkey && EVP_PKEY_get_bn_param(z->pkey, OSSL_PKEY_PARAM_RSA_E, &e) &&
+                         EVP_PKEY_get_bn_param(z->pkey, OSSL_PKEY_PARAM_RSA_N, &n));
+        rdata[len++] = BN_num_bytes(e);
+        len += BN_bn2bin(e, rdata + len);
+        len += BN_bn2bin(n, rdata + len);
+        BN_free(e);
+        BN_free(n);
+    } else if (alg == 13) {
+        uint8_t point[65];
+        size_t point_len;
+        z->pkey = EVP_PKEY_Q_keygen(NULL, NULL, "EC", "P-256");
+        TEST_ASSERT_TRUE(z->pkey && EVP_PKEY_get_octet_string_param(z->pkey, OSSL_PKEY_PARAM_PUB_KEY, point,
+                                                                    sizeof(point), &point_len));
+        TEST_ASSERT_EQUAL_UINT(65, point_len);
+        memcpy(rdata + len, point + 1, 64);
+        len += 64;
+    } else {
+        size_t key_len = 32;
+        z->pkey = EVP_PKEY_Q_keygen(NULL, NULL, "ED25519");
+        TEST_ASSERT_TRUE(z->pkey && EVP_PKEY_get_raw_public_key(z->pkey, rdata + len, &key_len));
+        len += key_len;
+    }
+    z->dnskey_len = len;
+    z->tag = key_tag(rdata, len);
+}
+
+// DS rdata for a zone's key, SHA-256 digest
+static size_t make_ds(const struct test_zone *z, uint8_t *out) {
+    unsigned int digest_len;
+    uint8_t data[700];
+    memcpy(data, z->name, z->name_len);
+    memcpy(data + z->name_len, z->dnskey, z->dnskey_len);
+    put16(out, z->tag);
+    out[2] = z->alg;
+    out[3] = 2;
+    EVP_Digest(data, z->name_len + z->dnskey_len, out + 4, &digest_len, EVP_sha256(), NULL);
+    return 4 + digest_len;
+}
+
+static size_t sign(const struct test_zone *z, const uint8_t *data, size_t len, uint8_t *sig) {
+    const EVP_MD *md = z->alg == 15 ? NULL : EVP_sha256();
+    EVP_MD_CTX *ctx = EVP_MD_CTX_new();
+    uint8_t der[600];
+    size_t der_len = sizeof(der);
+    int ok = EVP_DigestSignInit(ctx, NULL, md, NULL, z->pkey) == 1 &&
+             EVP_DigestSign(ctx, der, &der_len, data, len) == 1;
+    EVP_MD_CTX_free(ctx);
+    if (!ok) {
+        return 0;
+    }
+    if (z->alg != 13) {
+        memcpy(sig, der, der_len);
+        return der_len;
+    }
+
+    // ECDSA goes on the wire as r | s
+    const uint8_t *p = der;
+    ECDSA_SIG *ecdsa = d2i_ECDSA_SIG(NULL, &p, der_len);
+    BN_bn2binpad(ECDSA_SIG_get0_r(ecdsa), sig, 32);
+    BN_bn2binpad(ECDSA_SIG_get0_s(ecdsa), sig + 32, 32);
+    ECDSA_SIG_free(ecdsa);
+    return 64;
+}
+
+// RRSIG rdata over records (given in canonical order) of owner, signed as
+// signed_owner (the wildcard for expansions) with labels
+static size_t make_rrsig(const struct test_zone *z, const uint8_t *signed_owner, size_t owner_len, uint8_t labels,
+                         uint16_t type, uint32_t ttl, const struct test_rr *rrs, size_t count,
+                         uint32_t inception, uint32_t expiration, uint8_t *out) {
+    static uint8_t data[8192];
+    put16(out, type);
+    out[2] = z->alg;
+    out[3] = labels;
+    put32(out + 4, ttl);
+    put32(out + 8, expiration);
+    put32(out + 12, inception);
+    put16(out + 16, z->tag);
+    memcpy(out + 18, z->name, z->name_len);
+    size_t prefix = 18 + z->name_len;
+
+    size_t n = prefix;
+    memcpy(data, out, prefix);
+    for (size_t i = 0; i < count; i++) {
+        memcpy(data + n, signed_owner, owner_len);
+        n += owner_len;
+        put16(data + n, type);
+        put16(data + n + 2, 1);
+        put32(data + n + 4, ttl);
+        put16(data + n + 8, rrs[i].len);
+        memcpy(data + n + 10, rrs[i].rdata, rrs[i].len);
+        n += 10 + rrs[i].len;
+    }
+    return prefix + sign(z, data, n, out + prefix);
+}
+
+static void msg_start(struct test_msg *m, const uint8_t *qname, size_t qname_len, uint16_t qtype, uint8_t rcode) {
+    memset(m->buf, 0, 12);
+    m->buf[2] = 0x81;
+    m->buf[3] = 0x80 | rcode;
+    put16(m->buf + 4, 1);
+    memcpy(m->buf + 12, qname, qname_len);
+    m->len = 12 + qname_len;
+    put16(m->buf + m->len, qtype);
+    put16(m->buf + m->len + 2, 1);
+    m->len += 4;
+}
+
+// Owner NULL: a compression pointer to the question name
+static void msg_add(struct test_msg *m, const uint8_t *owner, size_t owner_len, uint16_t type, uint32_t ttl,
+                    const uint8_t *rdata, size_t rdlen) {
+    if (owner) {
+        memcpy(m->buf + m->len, owner, owner_len);
+        m->len += owner_len;
+    } else {
+        put16(m->buf + m->len, 0xC00C);
+        m->len += 2;
+    }
+    put16(m->buf + m->len, type);
+    put16(m->buf + m->len + 2, 1);
+    put32(m->buf + m->len + 4, ttl);
+    put16(m->buf + m->len + 8, rdlen);
+    memcpy(m->buf + m->len + 10, rdata, rdlen);
+    m->len += 10 + rdlen;
+    put16(m->buf + 6, (m->buf[6] << 8 | m->buf[7]) + 1);
+}
+
+// The zone's DNSKEY set answer, self-signed
+static void dnskey_answer(struct test_msg *m, const struct test_zone *z) {
+    uint8_t sig[700];
+    struct test_rr rr = {z->dnskey, z->dnskey_len};
+    uint8_t labels = 0;
+    for (const uint8_t *p = z->name; *p; p += *p + 1) {
+        labels++;
+    }
+    size_t sig_len = make_rrsig(z, z->name, z->name_len, labels, TYPE_DNSKEY, 3600, &rr, 1,
+                                now - 3600, now + 86400, sig);
+
+    msg_start(m, z->name, z->name_len, TYPE_DNSKEY, 0);
+    msg_add(m, NULL, 0, TYPE_DNSKEY, 3600, z->dnskey, z->dnskey_len);
+    msg_add(m, NULL, 0, TYPE_RRSIG, 3600, sig, sig_len);
+}
+
+// The child's DS set answer, signed by the parent
+static void ds_answer(struct test_msg *m, const struct test_zone *child, const struct test_zone *parent,
+                      uint8_t labels) {
+    uint8_t ds[64], sig[700];
+    size_t ds_len = make_ds(child, ds);
+    struct test_rr rr = {ds, ds_len};
+    size_t sig_len = make_rrsig(parent, child->name, child->name_len, labels, TYPE_DS, 3600, &rr, 1,
+                                now - 3600, now + 86400, sig);
+    msg_start(m, child->name, child->name_len, TYPE_DS, 0);
+    msg_add(m, NULL, 0, TYPE_DS, 3600, ds, ds_len);
+    msg_add(m, NULL, 0, TYPE_RRSIG, 3600, sig, sig_len);
+}
+
+// www.example.test A, two addresses listed out of canonical order
+static void a_answer(struct test_msg *m, uint32_t inception, uint32_t expiration) {
+    uint8_t owner[64], sig[700];
+    size_t owner_len = encode("www.example.test", owner);
+    const uint8_t low[4] = {192, 0, 2, 1}, high[4] = {192, 0, 2, 7};
+    struct test_rr rrs[2] = {{low, 4}, {high, 4}};
+    size_t sig_len = make_rrsig(&example_zone, owner, owner_len, 3, TYPE_A, 300, rrs, 2, inception, expiration, sig);
+
+    msg_start(m, owner, owner_len, TYPE_A, 0);
+    msg_add(m, NULL, 0, TYPE_A, 300, high, 4);
+    msg_add(m, NULL, 0, TYPE_A, 300, low, 4);
+    msg_add(m, NULL, 0, TYPE_RRSIG, 300, sig, sig_len);
+}
+
+// Queue an answer, wait for it and return its verdict; VALIDATOR_STATUSES
+// when it never came back
+static enum validator_status validate(const struct test_msg *m) {
+    struct validator_stats before, after;
+    validator_get_stats(&before);
+    cache_insert((const char *)m->buf + 12, m->buf, m->len, 300);
+    if (validator_submit((const char *)m->buf + 12, NULL, m->buf, m->len) != 0) {
+        return VALIDATOR_STATUSES;
+    }
+    validator_flush();
+    if (validator_poll() != 1) {
+        return VALIDATOR_STATUSES;
+    }
+    validator_get_stats(&after);
+    for (int s = 0; s < VALIDATOR_STATUSES; s++) {
+        if (after.results[s] != before.results[s]) {
+            return s;
+        }
+    }
+    return VALIDATOR_STATUSES;
+}
+
+static bool cached_secure(const struct test_msg *m) {
+    uint8_t response[CACHE_MAX_RESPONSE];
+    size_t response_len = sizeof(response);
+    bool secure = false;
+    return cache_lookup_scoped((const char *)m->buf + 12, NULL, response, &response_len, &secure, NULL) && secure;
+}
+
+static void start(unsigned int workers) {
+    struct validator_config cfg = {.workers = workers, .anchors_file = anchors_path};
+    TEST_ASSERT_EQUAL_INT(0, validator_init(&cfg));
+}
+
+void setUp(void) {
+    struct cache_config cfg = {.max_entries = 1024, .default_ttl = 300};
+    cache_init(&cfg);
+    now = (uint32_t)time(NULL);
+
+    // The test zone is anchored by DS, the root by its DNSKEY
+    uint8_t ds[64];
+    size_t ds_len = make_ds(&test_zone, ds);
+    strcpy(anchors_path, "/tmp/test_validator_XXXXXX");
+    int fd = mkstemp(anchors_path);
+    FILE *fp = fdopen(fd, "w");
+    fprintf(fp, "; trust anchors\ntest. 3600 IN DS %u %u 2 ", test_zone.tag, test_zone.alg);
+    for (size_t i = 4; i < ds_len; i++) {
+        fprintf(fp, "%02X", ds[i]);
+    }
+    fprintf(fp, "\n. IN DNSKEY 257 3 15 ");
+    uint8_t text[128];
+    int text_len = EVP_EncodeBlock(text, root_zone.dnskey + 4, root_zone.dnskey_len - 4);
+    fprintf(fp, "%.*s\n", text_len, text);
+    fclose(fp);
+}
+
+void tearDown(void) {
+    validator_destroy();
+    cache_destroy();
+    unlink(anchors_path);
+}
+
+void test_validator_chain_of_trust(void) {
+    start(2);
+    struct test_msg m;
+
+    // Nothing is known about example.test yet
+    a_answer(&m, now - 3600, now + 86400);
+    TEST_ASSERT_EQUAL_INT(VALIDATOR_INDETERMINATE, validate(&m));
+    TEST_ASSERT_FALSE(cached_secure(&m));
+
+    // The anchored zone's keys (RSA), then the delegation to example.test
+    // and its keys (ECDSA P-256); each verifies against what came before
+    dnskey_answer(&m, &test_zone);
+    TEST_ASSERT_EQUAL_INT(VALIDATOR_SECURE, validate(&m));
+    TEST_ASSERT_TRUE(cached_secure(&m));
+    ds_answer(&m, &example_zone, &test_zone, 2);
+    TEST_ASSERT_EQUAL_INT(VALIDATOR_SECURE, validate(&m));
+    dnskey_answer(&m, &example_zone);
+    TEST_ASSERT_EQUAL_INT(VALIDATOR_SECURE, validate(&m));
+
+    a_answer(&m, now - 3600, now + 86400);
+    TEST_ASSERT_EQUAL_INT(VALIDATOR_SECURE, validate(&m));
+    TEST_ASSERT_TRUE(cached_secure(&m));
+
+    // A newer answer in the slot is not the one that was verified
+    validator_submit((const char *)m.buf + 12, NULL, m.buf, m.len);
+    m.buf[m.len - 1] ^= 1;
+    cache_insert((const char *)m.buf + 12, m.buf, m.len, 300);
+    validator_flush();
+    validator_poll();
+    TEST_ASSERT_FALSE(cached_secure(&m));
+
+    // The root is anchored by its DNSKEY (Ed25519)
+    dnskey_answer(&m, &root_zone);
+    TEST_ASSERT_EQUAL_INT(VALIDATOR_SECURE, validate(&m));
+
+    struct validator_stats stats;
+    validator_get_stats(&stats);
+    TEST_ASSERT_EQUAL_UINT(7, stats.queued);
+    TEST_ASSERT_EQUAL_UINT(7, stats.total.validated);
+    TEST_ASSERT_EQUAL_UINT(5, stats.marked);
+    TEST_ASSERT_EQUAL_UINT(3, stats.key_sets);
+    TEST_ASSERT_GREATER_THAN(0, stats.total.memo_hits);
+}
+
+void test_validator_bogus(void) {
+    start(1);
+    struct test_msg m;
+    dnskey_answer(&m, &test_zone);
+    validate(&m);
+    ds_answer(&m, &example_zone, &test_zone, 2);
+    validate(&m);
+    dnskey_answer(&m, &example_zone);
+    validate(&m);
+
+    // A changed address
+    a_answer(&m, now - 3600, now + 86400);
+    size_t rdata = m.len;
+    while (memcmp(m.buf + rdata - 4, "\xC0\x00\x02\x07", 4) != 0) {
+        rdata--;
+    }
+    m.buf[rdata - 1] = 8;
+    TEST_ASSERT_EQUAL_INT(VALIDATOR_BOGUS, validate(&m));
+    TEST_ASSERT_FALSE(cached_secure(&m));
+
+    // Expired, and not yet valid
+    a_answer(&m, now - 7200, now - 3600);
+    TEST_ASSERT_EQUAL_INT(VALIDATOR_BOGUS, validate(&m));
+    a_answer(&m, now + 3600, now + 7200);
+    TEST_ASSERT_EQUAL_INT(VALIDATOR_BOGUS, validate(&m));
+
+    // A DS set for example.test signed by itself rather than its parent
+    ds_answer(&m, &example_zone, &example_zone, 2);
+    TEST_ASSERT_EQUAL_INT(VALIDATOR_BOGUS, validate(&m));
+}
+
+void test_validator_insecure(void) {
+    start(1);
+    struct test_msg m;
+    uint8_t owner[64];
+    size_t owner_len = encode("plain.test", owner);
+    const uint8_t addr[4] = {192, 0, 2, 9};
+
+    // No signatures, and negative answers whose denial is not checked
+    msg_start(&m, owner, owner_len, TYPE_A, 0);
+    msg_add(&m, NULL, 0, TYPE_A, 300, addr, 4);
+    TEST_ASSERT_EQUAL_INT(VALIDATOR_INSECURE, validate(&m));
+    msg_start(&m, owner, owner_len, TYPE_A, 3);
+    TEST_ASSERT_EQUAL_INT(VALIDATOR_INSECURE, validate(&m));
+    TEST_ASSERT_FALSE(cached_secure(&m));
+}
+
+void test_validator_wildcard(void) {
+    start(1);
+    struct test_msg m;
+    dnskey_answer(&m, &test_zone);
+    validate(&m);
+
+    // host.test synthesized from *.test: signed with one label under the
+    // wildcard owner. Authentic, but with no proof that host.test has no
+    // records of its own it is not secure.
+    uint8_t owner[64], wildcard[64], sig[700];
+    size_t owner_len = encode("host.test", owner), wildcard_len = encode("*.test", wildcard);
+    uint8_t addr[4] = {192, 0, 2, 53};
+    struct test_rr rr = {addr, 4};
+    size_t sig_len = make_rrsig(&test_zone, wildcard, wildcard_len, 1, TYPE_A, 300, &rr, 1, now - 60, now + 60, sig);
+    msg_start(&m, owner, owner_len, TYPE_A, 0);
+    msg_add(&m, NULL, 0, TYPE_A, 300, addr, 4);
+    msg_add(&m, NULL, 0, TYPE_RRSIG, 300, sig, sig_len);
+    TEST_ASSERT_EQUAL_INT(VALIDATOR_INSECURE, validate(&m));
+    TEST_ASSERT_FALSE(cached_secure(&m));
+
+    // The expansion is still verified
+    addr[3] = 54;
+    msg_start(&m, owner, owner_len, TYPE_A, 0);
+    msg_add(&m, NULL, 0, TYPE_A, 300, addr, 4);
+    msg_add(&m, NULL, 0, TYPE_RRSIG, 300, sig, sig_len);
+    TEST_ASSERT_EQUAL_INT(VALIDATOR_BOGUS, validate(&m));
+
+    // Claiming more labels than the owner has
+    sig[3] = 3;
+    msg_start(&m, owner, owner_len, TYPE_A, 0);
+    msg_add(&m, NULL, 0, TYPE_A, 300, addr, 4);
+    msg_add(&m, NULL, 0, TYPE_RRSIG, 300, sig, sig_len);
+    TEST_ASSERT_EQUAL_INT(VALIDATOR_BOGUS, validate(&m));
+}
+
+void test_validator_answers_question(void) {
+    start(1);
+    struct test_msg m, a;
+    dnskey_answer(&m, &test_zone);
+    validate(&m);
+    ds_answer(&m, &example_zone, &test_zone, 2);
+    validate(&m);
+    dnskey_answer(&m, &example_zone);
+    validate(&m);
+
+    // The records of the signed www.example.test answer, question name
+    // pointers expanded so they can follow another question
+    uint8_t www[64], alias[64], other[64], sig[700];
+    size_t www_len = encode("www.example.test", www), alias_len = encode("alias.test", alias);
+    size_t other_len = encode("other.example.test", other);
+    a_answer(&a, now - 3600, now + 86400);
+    size_t records = 12 + www_len + 4;
+
+    // Authentic, but for another name than the one asked
+    msg_start(&m, other, other_len, TYPE_A, 0);
+    for (size_t at = records; at < a.len;) {
+        size_t rdlen = a.buf[at + 10] << 8 | a.buf[at + 11];
+        msg_add(&m, www, www_len, a.buf[at + 2] << 8 | a.buf[at + 3], 300, a.buf + at + 12, rdlen);
+        at += 12 + rdlen;
+    }
+    TEST_ASSERT_EQUAL_INT(VALIDATOR_INSECURE, validate(&m));
+    TEST_ASSERT_FALSE(cached_secure(&m));
+
+    // Reached through a signed CNAME from the name asked
+    struct test_rr target = {www, www_len};
+    size_t sig_len = make_rrsig(&test_zone, alias, alias_len, 2, TYPE_CNAME, 300, &target, 1, now - 60, now + 60, sig);
+    msg_start(&m, alias, alias_len, TYPE_A, 0);
+    msg_add(&m, NULL, 0, TYPE_CNAME, 300, www, www_len);
+    msg_add(&m, NULL, 0, TYPE_RRSIG, 300, sig, sig_len);
+    for (size_t at = records; at < a.len;) {
+        size_t rdlen = a.buf[at + 10] << 8 | a.buf[at + 11];
+        msg_add(&m, www, www_len, a.buf[at + 2] << 8 | a.buf[at + 3], 300, a.buf + at + 12, rdlen);
+        at += 12 + rdlen;
+    }
+    TEST_ASSERT_EQUAL_INT(VALIDATOR_SECURE, validate(&m));
+    TEST_ASSERT_TRUE(cached_secure(&m));
+
+    // The same CNAME asked for directly, with the A records tacked on
+    msg_start(&m, alias, alias_len, TYPE_CNAME, 0);
+    msg_add(&m, NULL, 0, TYPE_CNAME, 300, www, www_len);
+    msg_add(&m, NULL, 0, TYPE_RRSIG, 300, sig, sig_len);
+    TEST_ASSERT_EQUAL_INT(VALIDATOR_SECURE, validate(&m));
+    msg_add(&m, www, www_len, TYPE_A, 300, a.buf + records + 12, 4);
+    TEST_ASSERT_EQUAL_INT(VALIDATOR_INSECURE, validate(&m));
+}
+
+void test_validator_full_rings_drop(void) {
+    // Never blocks: with no poll in between, the rest is turned away
+    start(1);
+    struct test_msg m;
+    uint8_t owner[64];
+    msg_start(&m, owner, encode("plain.test", owner), TYPE_A, 0);
+    int dropped = 0;
+    for (int i = 0; i < VALIDATOR_RING_JOBS + 10; i++) {
+        dropped += validator_submit((const char *)m.buf + 12, NULL, m.buf, m.len) == -EAGAIN;
+    }
+    TEST_ASSERT_EQUAL_INT(10, dropped);
+    TEST_ASSERT_EQUAL_UINT(VALIDATOR_RING_JOBS, validator_pending());
+
+    validator_flush();
+    TEST_ASSERT_EQUAL_UINT(VALIDATOR_RING_JOBS, validator_poll());
+    TEST_ASSERT_EQUAL_UINT(0, validator_pending());
+    struct validator_stats stats;
+    validator_get_stats(&stats);
+    TEST_ASSERT_EQUAL_UINT(10, stats.dropped);
+    TEST_ASSERT_EQUAL_UINT(VALIDATOR_RING_JOBS, stats.results[VALIDATOR_INSECURE]);
+}
+
+int main(void) {
+    make_zone(&root_zone, ".", 15);
+    make_zone(&test_zone, "test", 8);
+    make_zone(&example_zone, "example.test", 13);
+
+    UNITY_BEGIN();
+    RUN_TEST(test_validator_chain_of_trust);
+    RUN_TEST(test_validator_bogus);
+    RUN_TEST(test_validator_insecure);
+    RUN_TEST(test_validator_wildcard);
+    RUN_TEST(test_validator_answers_question);
+    RUN_TEST(test_validator_full_rings_drop);
+    return UNITY_END();
+}
@@ -0,0 +1,252 @@
+#include "../include/zone.h"
+#include "../include/dns_query.h"
+#include <unity.h>
+#include <stdio.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+
+static const char *example_zone =
+    "$ORIGIN example.com.\n"
+    "$TTL 300\n"
+    "@       IN SOA ns1 hostmaster (\n"
+    "                2024010101 ; serial\n"
+    "                3600 600 86400 60 )\n"
+    "        IN NS   ns1\n"
+    "ns1     IN A    192.0.2.53\n"
+    "www  60 IN A    192.0.2.1\n"
+    "        IN A    192.0.2.2\n"
+    "        IN AAAA 2001:db8::1\n"
+    "mail    IN MX   10 mx.example.net.\n"
+    "alias   IN CNAME www\n"
+    "far     IN CNAME elsewhere.example.net.\n"
+    "txt     IN TXT  \"hello world\" \"a\\\"b\"\n"
+    "a.b.c   IN A    192.0.2.9\n";
+
+static char path[64];
+
+static void write_zone(const char *text) {
+    strcpy(path, "/tmp/test_zone_XXXXXX");
+    int fd = mkstemp(path);
+    TEST_ASSERT_TRUE(fd >= 0);
+    TEST_ASSERT_EQUAL_INT((int)strlen(text), (int)write(fd, text, strlen(text)));
+    close(fd);
+}
+
+static int load(const char *text) {
+    write_zone(text);
+    const char *paths[] = {path};
+    int ret = zone_load(paths, 1);
+    unlink(path);
+    return ret;
+}
+
+void setUp(void) {
+    TEST_ASSERT_EQUAL_INT(0, load(example_zone));
+}
+
+void tearDown(void) {
+    zone_destroy();
+}
+
+// Reply to a query for name, -1 when no zone is authoritative, -2 when the
+// reply does not carry the client's ID and question
+static int ask(const char *name, enum DnsQType type, bool edns, uint8_t *reply, size_t reply_len) {
+    struct dns_query query;
+    uint8_t msg[512];
+    size_t msg_len = sizeof(msg);
+    init_query(&query, name, type);
+    query.edns.present = edns;
+    int question_end;
+    struct dns_edns opt;
+    if (construct_query(&query, msg, &msg_len) != 0 || (question_end = dns_question_end(msg, msg_len)) < 0 ||
+        dns_parse_edns(msg, msg_len, &opt) != 0) {
+        return -2;
+    }
+
+    size_t template_len;
+    const uint8_t *tmpl = zone_lookup(msg, question_end, &template_len);
+    if (!tmpl) {
+        return -1;
+    }
+
+    int len = zone_write(tmpl, template_len, msg, question_end, &opt, reply, reply_len);
+    if (len < question_end || memcmp(msg, reply, 2) != 0 ||
+        memcmp(msg + 12, reply + 12, question_end - 12) != 0) {
+        return -2;
+    }
+    return len;
+}
+
+static uint16_t count(const uint8_t *reply, int section) {
+    return reply[4 + section * 2] << 8 | reply[5 + section * 2];
+}
+
+static bool contains(const uint8_t *reply, int len, const void *bytes, size_t n) {
+    return memmem(reply, len, bytes, n) != NULL;
+}
+
+void test_zone_answers_rrsets(void) {
+    uint8_t reply[1024];
+    int len = ask("WWW.Example.com", A, false, reply, sizeof(reply));
+    TEST_ASSERT_GREATER_THAN(0, len);
+    TEST_ASSERT_EQUAL_INT(0x85, reply[2]);     // QR, AA, RD echoed
+    TEST_ASSERT_EQUAL_INT(0x00, reply[3] & 0x0F);
+    TEST_ASSERT_EQUAL_UINT(2, count(reply, 1));
+    const uint8_t first[] = {192, 0, 2, 1}, second[] = {192, 0, 2, 2};
+    TEST_ASSERT_TRUE(contains(reply, len, first, 4));
+    TEST_ASSERT_TRUE(contains(reply, len, second, 4));
+
+    // Explicit TTL carries to the next record of the owner, the answer's TTL is it
+    uint32_t ttl;
+    TEST_ASSERT_EQUAL_INT(0, dns_answer_ttl(reply, len, &ttl));
+    TEST_ASSERT_EQUAL_UINT(60, ttl);
+
+    // One OPT record when the client sent EDNS
+    len = ask("www.example.com", AAAA, true, reply, sizeof(reply));
+    TEST_ASSERT_GREATER_THAN(0, len);
+    TEST_ASSERT_EQUAL_UINT(1, count(reply, 1));
+    TEST_ASSERT_EQUAL_UINT(1, count(reply, 3));
+    struct dns_edns opt;
+    TEST_ASSERT_EQUAL_INT(0, dns_parse_edns(reply, len, &opt));
+    TEST_ASSERT_TRUE(opt.present);
+
+    len = ask("txt.example.com", TXT, false, reply, sizeof(reply));
+    TEST_ASSERT_TRUE(len > 0 && contains(reply, len, "\x0bhello world\x03" "a\"b", 16));
+
+    TEST_ASSERT_GREATER_THAN(0, ask("example.com", SOA, false, reply, sizeof(reply)));
+    TEST_ASSERT_EQUAL_UINT(1, count(reply, 1));
+
+    // No room for the records: the question alone, flagged truncated
+    len = ask("www.example.com", A, false, reply, 40);
+    TEST_ASSERT_EQUAL_INT(33, len);
+    TEST_ASSERT_EQUAL_INT(0x02, reply[2] & 0x02);
+    TEST_ASSERT_EQUAL_UINT(0, count(reply, 1));
+}
+
+void test_zone_negative_answers(void) {
+    uint8_t reply[1024];
+
+    // Missing name: NXDOMAIN with the SOA, its TTL capped at the minimum
+    int len = ask("nope.example.com", A, false, reply, sizeof(reply));
+    TEST_ASSERT_GREATER_THAN(0, len);
+    TEST_ASSERT_EQUAL_INT(0x03, reply[3] & 0x0F);
+    TEST_ASSERT_EQUAL_UINT(0, count(reply, 1));
+    TEST_ASSERT_EQUAL_UINT(1, count(reply, 2));
+    uint32_t ttl;
+    TEST_ASSERT_EQUAL_INT(0, dns_answer_ttl(reply, len, &ttl));
+    TEST_ASSERT_EQUAL_UINT(60, ttl);
+
+    // Existing name, missing type: NODATA
+    TEST_ASSERT_GREATER_THAN(0, ask("www.example.com", MX, false, reply, sizeof(reply)));
+    TEST_ASSERT_EQUAL_INT(0x00, reply[3] & 0x0F);
+    TEST_ASSERT_EQUAL_UINT(0, count(reply, 1));
+    TEST_ASSERT_EQUAL_UINT(1, count(reply, 2));
+
+    // Empty non-terminals exist, names below data do not
+    TEST_ASSERT_GREATER_THAN(0, ask("b.c.example.com", A, false, reply, sizeof(reply)));
+    TEST_ASSERT_EQUAL_INT(0x00, reply[3] & 0x0F);
+    TEST_ASSERT_GREATER_THAN(0, ask("x.a.b.c.example.com", A, false, reply, sizeof(reply)));
+    TEST_ASSERT_EQUAL_INT(0x03, reply[3] & 0x0F);
+
+    // Outside every zone: left to the cache and upstream
+    TEST_ASSERT_EQUAL_INT(-1, ask("example.org", A, false, reply, sizeof(reply)));
+    TEST_ASSERT_EQUAL_INT(-1, ask("com", A, false, reply, sizeof(reply)));
+}
+
+void test_zone_cname_chains(void) {
+    uint8_t reply[1024];
+    const uint8_t first[] = {192, 0, 2, 1};
+
+    // In-zone target: chain plus the target's RRset
+    int len = ask("alias.example.com", A, false, reply, sizeof(reply));
+    TEST_ASSERT_GREATER_THAN(0, len);
+    TEST_ASSERT_EQUAL_UINT(3, count(reply, 1));
+    TEST_ASSERT_TRUE(contains(reply, len, first, 4));
+
+    // Type the target lacks, or the CNAME itself: the chain alone
+    TEST_ASSERT_GREATER_THAN(0, ask("alias.example.com", MX, false, reply, sizeof(reply)));
+    TEST_ASSERT_EQUAL_UINT(1, count(reply, 1));
+    TEST_ASSERT_GREATER_THAN(0, ask("alias.example.com", CNAME, false, reply, sizeof(reply)));
+    TEST_ASSERT_EQUAL_UINT(1, count(reply, 1));
+
+    // Out-of-zone target: the resolver follows it
+    len = ask("far.example.com", A, false, reply, sizeof(reply));
+    TEST_ASSERT_GREATER_THAN(0, len);
+    TEST_ASSERT_EQUAL_UINT(1, count(reply, 1));
+    TEST_ASSERT_TRUE(contains(reply, len, "\x09" "elsewhere\x07" "example\x03" "net", 22));
+}
+
+void test_zone_rejects_bad_input(void) {
+    // A failed load keeps the loaded index
+    TEST_ASSERT_NOT_EQUAL(0, load("$ORIGIN example.net.\nwww IN A 192.0.2.1\n"));              // No SOA
+    TEST_ASSERT_NOT_EQUAL(0, load("www.example.net. IN A 192.0.2.1\n"));                     // Outside every zone
+    TEST_ASSERT_NOT_EQUAL(0, load("$ORIGIN x.\n@ SOA a b 1 2 3 4 5\nc CNAME a\nc A 192.0.2.1\n"));
+    TEST_ASSERT_NOT_EQUAL(0, load("$ORIGIN x.\n@ SOA a b 1 2 3 4 5\nc IN HINFO a b\n"));
+    TEST_ASSERT_NOT_EQUAL(0, load("$ORIGIN x.\n@ SOA a b 1 2 3 4 ( 5\n"));
+    TEST_ASSERT_NOT_EQUAL(0, load("$ORIGIN x.\n@ SOA a b 1 2 3 4 5\nc A 192.0.2.300\n"));
+
+    uint8_t reply[1024];
+    TEST_ASSERT_GREATER_THAN(0, ask("www.example.com", A, false, reply, sizeof(reply)));
+}
+
+void test_zone_rejects_wildcards(void) {
+    // Served as plain data, *.x. would only answer queries for "*.x."
+    TEST_ASSERT_EQUAL_INT(-EINVAL, load("$ORIGIN x.\n@ SOA a b 1 2 3 4 5\n* A 192.0.2.1\n"));
+    TEST_ASSERT_EQUAL_INT(-EINVAL, load("$ORIGIN x.\n@ SOA a b 1 2 3 4 5\n*.c TXT \"t\"\n"));
+    TEST_ASSERT_EQUAL_INT(0, load("$ORIGIN x.\n@ SOA a b 1 2 3 4 5\nc.* A 192.0.2.1\n"));
+}
+
+void test_zone_rejects_delegations(void) {
+    // NS below an apex would answer for the child instead of referring
+    TEST_ASSERT_EQUAL_INT(-EINVAL, load("$ORIGIN x.\n@ SOA a b 1 2 3 4 5\nc NS ns.c\nns.c A 192.0.2.1\n"));
+
+    // The apex NS set, of a parent or of a child zone, is fine
+    TEST_ASSERT_EQUAL_INT(0, load("$ORIGIN x.\n@ SOA a b 1 2 3 4 5\n@ NS ns\nc SOA a b 1 2 3 4 5\nc NS ns.c\n"));
+    uint8_t reply[1024];
+    TEST_ASSERT_GREATER_THAN(0, ask("c.x", NS, false, reply, sizeof(reply)));
+}
+
+void test_zone_large(void) {
+    // Every name of a larger zone is found through the perfect hash
+    const size_t names = 50000;
+    size_t cap = names * 40 + 256;
+    char *text = malloc(cap);
+    TEST_ASSERT_NOT_NULL(text);
+    size_t pos = snprintf(text, cap, "$ORIGIN big.test.\n@ SOA ns hm 1 2 3 4 5\n");
+    for (size_t i = 0; i < names; i++) {
+        pos += snprintf(text + pos, cap - pos, "h%zu A 10.%zu.%zu.%zu\n", i, i >> 16, (i >> 8) & 255, i & 255);
+    }
+    TEST_ASSERT_EQUAL_INT(0, load(text));
+    free(text);
+
+    struct zone_stats stats;
+    zone_get_stats(&stats);
+    TEST_ASSERT_EQUAL_UINT(1, stats.zones);
+    TEST_ASSERT_EQUAL_UINT(names + 1, stats.names);
+    TEST_ASSERT_EQUAL_UINT(names + 1, stats.records);
+
+    uint8_t reply[512];
+    for (size_t i = 0; i < names; i += 7) {
+        char name[64];
+        snprintf(name, sizeof(name), "h%zu.big.test", i);
+        int len = ask(name, A, false, reply, sizeof(reply));
+        const uint8_t addr[] = {10, i >> 16, (i >> 8) & 255, i & 255};
+        TEST_ASSERT_TRUE(len > 0 && contains(reply, len, addr, 4));
+    }
+    TEST_ASSERT_EQUAL_INT(-1, ask("www.example.com", A, false, reply, sizeof(reply)));
+}
+
+int main(void) {
+    UNITY_BEGIN();
+    RUN_TEST(test_zone_answers_rrsets);
+    RUN_TEST(test_zone_negative_answers);
+    RUN_TEST(test_zone_cname_chains);
+    RUN_TEST(test_zone_rejects_bad_input);
+    RUN_TEST(test_zone_rejects_wildcards);
+    RUN_TEST(test_zone_rejects_delegations);
+    RUN_TEST(test_zone_large);
+    return UNITY_END();
+}